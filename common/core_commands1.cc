@@ -106,6 +106,15 @@ int docmd_chs(arg_struct *arg) {
                 cm->array->data[i] = -(cm->array->data[i]);
             break;
         }
+        case TYPE_SPARSEMATRIX: {
+            vartype_sparsematrix *sm = (vartype_sparsematrix *) stack[sp];
+            if (!disentangle((vartype *) sm))
+                return ERR_INSUFFICIENT_MEMORY;
+            int4 nnz = sm->array->nnz;
+            for (int4 i = 0; i < nnz; i++)
+                sm->array->data[i] = -(sm->array->data[i]);
+            break;
+        }
         default:
             return ERR_INTERNAL_ERROR;
     }
@@ -119,8 +128,15 @@ static int docmd_div_completion(int error, vartype *res) {
     return binary_result(res);
 }
 
+/* The arithmetic operators let Y be overwritten by the result, since
+ * binary_result() discards it anyway. In four-level mode, though,
+ * binary_result() may still fail while copying T, and that must leave Y as
+ * it was, so this is only done in big-stack mode.
+ */
+
 int docmd_div(arg_struct *arg) {
-    return generic_div(stack[sp], stack[sp - 1], docmd_div_completion);
+    return generic_div(stack[sp], stack[sp - 1], docmd_div_completion,
+                                                        flags.f.big_stack);
 }
 
 static int docmd_mul_completion(int error, vartype *res) {
@@ -130,12 +146,13 @@ static int docmd_mul_completion(int error, vartype *res) {
 }
 
 int docmd_mul(arg_struct *arg) {
-    return generic_mul(stack[sp], stack[sp - 1], docmd_mul_completion);
+    return generic_mul(stack[sp], stack[sp - 1], docmd_mul_completion,
+                                                        flags.f.big_stack);
 }
 
 int docmd_sub(arg_struct *arg) {
     vartype *res;
-    int error = generic_sub(stack[sp], stack[sp - 1], &res);
+    int error = generic_sub(stack[sp], stack[sp - 1], &res, flags.f.big_stack);
     if (error != ERR_NONE)
         return error;
     return binary_result(res);
@@ -143,7 +160,7 @@ int docmd_sub(arg_struct *arg) {
 
 int docmd_add(arg_struct *arg) {
     vartype *res;
-    int error = generic_add(stack[sp], stack[sp - 1], &res);
+    int error = generic_add(stack[sp], stack[sp - 1], &res, flags.f.big_stack);
     if (error != ERR_NONE)
         return error;
     return binary_result(res);
@@ -646,7 +663,7 @@ int docmd_rdxcomma(arg_struct *arg) {
 }
 
 int docmd_clsigma(arg_struct *arg) {
-    vartype *regs = recall_var("REGS", 4);
+    vartype *regs = recall_regs();
     vartype_realmatrix *r;
     int4 first = mode_sigma_reg;
     int4 last = first + (flags.f.all_sigma ? 13 : 6);
@@ -659,10 +676,11 @@ int docmd_clsigma(arg_struct *arg) {
     size = r->rows * r->columns;
     if (last > size)
         return ERR_SIZE_ERROR;
+    touch_matrix(regs);
     for (i = first; i < last; i++) {
-        if (r->array->is_string[i] == 2)
+        if (get_is_string(r->array, i) == 2)
             free(*(void **) &r->array->data[i]);
-        r->array->is_string[i] = 0;
+        set_is_string(r->array, i, 0);
         r->array->data[i] = 0;
     }
     flags.f.log_fit_invalid = 0;
@@ -723,7 +741,7 @@ int docmd_clst(arg_struct *arg) {
 }
 
 int docmd_clrg(arg_struct *arg) {
-    vartype *regs = recall_var("REGS", 4);
+    vartype *regs = recall_regs();
     if (regs == NULL)
         return ERR_NONEXISTENT;
     if (regs->type == TYPE_REALMATRIX) {
@@ -733,11 +751,9 @@ int docmd_clrg(arg_struct *arg) {
             return ERR_INSUFFICIENT_MEMORY;
         rm = (vartype_realmatrix *) regs;
         sz = rm->rows * rm->columns;
-        free_long_strings(rm->array->is_string, rm->array->data, sz);
+        clear_is_string(rm->array, sz);
         for (i = 0; i < sz; i++)
             rm->array->data[i] = 0;
-        for (i = 0; i < sz; i++)
-            rm->array->is_string[i] = 0;
         return ERR_NONE;
     } else if (regs->type == TYPE_COMPLEXMATRIX) {
         vartype_complexmatrix *cm;
@@ -1267,7 +1283,7 @@ int docmd_sign(arg_struct *arg) {
                 return ERR_INSUFFICIENT_MEMORY;
             size = src->rows * src->columns;
             for (i = 0; i < size; i++) {
-                if (src->array->is_string[i] != 0)
+                if (get_is_string(src->array, i) != 0)
                     dst->array->data[i] = 0;
                 else
                     dst->array->data[i] = src->array->data[i] < 0 ? -1 : 1;
@@ -284,6 +284,37 @@ int docmd_ran(arg_struct *arg) {
     return recall_result(v);
 }
 
+int docmd_ranfill(arg_struct *arg) {
+    if (stack[sp]->type == TYPE_REALMATRIX) {
+        vartype_realmatrix *rm = (vartype_realmatrix *) stack[sp];
+        vartype_realmatrix *res = (vartype_realmatrix *) new_realmatrix(rm->rows, rm->columns);
+        if (res == NULL)
+            return ERR_INSUFFICIENT_MEMORY;
+        math_random_fill(res->array->data, rm->rows * rm->columns);
+        unary_result((vartype *) res);
+    } else {
+        vartype_list *list = (vartype_list *) stack[sp];
+        int4 n = list->size;
+        vartype_list *res = (vartype_list *) new_list(n);
+        if (res == NULL)
+            return ERR_INSUFFICIENT_MEMORY;
+        for (int4 i = 0; i < n; i++) {
+            vartype *v = new_real(0);
+            if (v == NULL) {
+                free_vartype((vartype *) res);
+                return ERR_INSUFFICIENT_MEMORY;
+            }
+            res->array->data[i] = v;
+        }
+        // Don't touch the generator state until all the allocations have
+        // succeeded, so a failed RANFILL doesn't change the sequence.
+        for (int4 i = 0; i < n; i++)
+            ((vartype_real *) res->array->data[i])->x = math_random();
+        unary_result((vartype *) res);
+    }
+    return ERR_NONE;
+}
+
 int docmd_seed(arg_struct *arg) {
     phloat x = ((vartype_real *) stack[sp])->x;
     if (x == 0) {
@@ -683,7 +714,7 @@ static int generic_loop(arg_struct *arg, bool isg) {
     }
     switch (arg->type) {
         case ARGTYPE_NUM: {
-            vartype *regs = recall_var("REGS", 4);
+            vartype *regs = recall_regs();
             if (regs == NULL)
                 return ERR_SIZE_ERROR;
             else if (regs->type == TYPE_REALMATRIX) {
@@ -692,7 +723,7 @@ static int generic_loop(arg_struct *arg, bool isg) {
                 int4 index = arg->val.num;
                 if (index >= size)
                     return ERR_SIZE_ERROR;
-                if (rm->array->is_string[index] != 0)
+                if (get_is_string(rm->array, index) != 0)
                     return ERR_ALPHA_DATA_IS_INVALID;
                 else {
                     if (!disentangle(regs))
@@ -784,7 +815,7 @@ int docmd_xtoa(arg_struct *arg) {
         char buf[44];
         int buflen = 0;
         for (i = size - 1; i >= 0; i--) {
-            if (m->array->is_string[i] != 0) {
+            if (get_is_string(m->array, i) != 0) {
                 int4 len;
                 char *text;
                 get_matrix_string(m, i, &text, &len);
@@ -1067,7 +1098,7 @@ static const sigma_label_spec sigma_labels[] = {
 };
 
 int docmd_prsigma(arg_struct *arg) {
-    vartype *regs = recall_var("REGS", 4);
+    vartype *regs = recall_regs();
     vartype_realmatrix *rm;
     int nr;
     int4 size, max, i;
@@ -1093,7 +1124,7 @@ int docmd_prsigma(arg_struct *arg) {
     print_text(NULL, 0, true);
     for (i = 0; i < nr; i++) {
         int4 j = i + mode_sigma_reg;
-        if (rm->array->is_string[j] != 0) {
+        if (get_is_string(rm->array, j) != 0) {
             char *text;
             int4 len;
             get_matrix_string(rm, j, &text, &len);
@@ -1155,6 +1186,8 @@ int docmd_prv(arg_struct *arg) {
         int llen = 0, rlen = 0;
         if (v == NULL)
             return ERR_NONEXISTENT;
+        if (!materialize(v))
+            return ERR_INSUFFICIENT_MEMORY;
         if (!flags.f.printer_enable && program_running())
             return ERR_NONE;
         if (!flags.f.printer_exists)
@@ -1182,6 +1215,8 @@ int docmd_prv(arg_struct *arg) {
 
         if (v->type == TYPE_REALMATRIX
                 || v->type == TYPE_COMPLEXMATRIX
+                || v->type == TYPE_SPARSEMATRIX
+                && ((vartype_sparsematrix *) v)->array->nnz > 0
                 || v->type == TYPE_LIST
                 && ((vartype_list *) v)->size > 0) {
             prv_var = v;
@@ -1224,7 +1259,7 @@ static int prv_worker(bool interrupted) {
             llen += int2string(j + 1, lbuf + llen, 32 - llen);
             char2buf(lbuf, 32, &llen, '=');
         }
-        if (rm->array->is_string[prv_index] != 0) {
+        if (get_is_string(rm->array, prv_index) != 0) {
             char *text;
             int4 len;
             get_matrix_string(rm, prv_index, &text, &len);
@@ -1266,6 +1301,25 @@ static int prv_worker(bool interrupted) {
         cpx.im = cm->array->data[2 * prv_index + 1];
         rlen = vartype2string((vartype *) &cpx, rbuf, 100);
         print_wide(lbuf, llen, rbuf, rlen);
+    } else if (prv_var->type == TYPE_SPARSEMATRIX) {
+        /* Only the nonzero elements are printed */
+        vartype_sparsematrix *sm = (vartype_sparsematrix *) prv_var;
+        const sparsematrix_data *sd = sm->array;
+        sz = sd->nnz;
+        int4 lo = 0, hi = sm->rows - 1;
+        while (lo < hi) {
+            int4 mid = (lo + hi + 1) / 2;
+            if (sd->rowptr[mid] <= prv_index)
+                lo = mid;
+            else
+                hi = mid - 1;
+        }
+        llen = int2string(lo + 1, lbuf, 32);
+        char2buf(lbuf, 32, &llen, ':');
+        llen += int2string(sd->colidx[prv_index] + 1, lbuf + llen, 32 - llen);
+        char2buf(lbuf, 32, &llen, '=');
+        rlen = easy_phloat2string(sd->data[prv_index], rbuf, 100, 0);
+        print_wide(lbuf, llen, rbuf, rlen);
     } else /* prv_var->type == TYPE_LIST */ {
         vartype_list *list = (vartype_list *) prv_var;
         i = prv_index;
@@ -1300,7 +1354,7 @@ static int prv_worker(bool interrupted) {
 }
 
 int docmd_prreg(arg_struct *arg) {
-    vartype *regs = recall_var("REGS", 4);
+    vartype *regs = recall_regs();
     if (regs == NULL)
         return ERR_NONEXISTENT;
     if (!flags.f.printer_enable && program_running())
@@ -1817,7 +1871,8 @@ int docmd_str_t(arg_struct *arg) {
 
 int docmd_mat_t(arg_struct *arg) {
     return stack[sp]->type == TYPE_REALMATRIX
-            || stack[sp]->type == TYPE_COMPLEXMATRIX ? ERR_YES : ERR_NO;
+            || stack[sp]->type == TYPE_COMPLEXMATRIX
+            || stack[sp]->type == TYPE_SPARSEMATRIX ? ERR_YES : ERR_NO;
 }
 
 int docmd_dim_t(arg_struct *arg) {
@@ -1825,6 +1880,9 @@ int docmd_dim_t(arg_struct *arg) {
     if (stack[sp]->type == TYPE_REALMATRIX) {
         rows = ((vartype_realmatrix *) stack[sp])->rows;
         columns = ((vartype_realmatrix *) stack[sp])->columns;
+    } else if (stack[sp]->type == TYPE_SPARSEMATRIX) {
+        rows = ((vartype_sparsematrix *) stack[sp])->rows;
+        columns = ((vartype_sparsematrix *) stack[sp])->columns;
     } else {
         rows = ((vartype_complexmatrix *) stack[sp])->rows;
         columns = ((vartype_complexmatrix *) stack[sp])->columns;
@@ -1839,6 +1897,45 @@ int docmd_dim_t(arg_struct *arg) {
     return unary_two_results(new_x, new_y);
 }
 
+int docmd_sparse(arg_struct *arg) {
+    if (stack[sp]->type == TYPE_SPARSEMATRIX)
+        return ERR_NONE;
+    if (stack[sp]->type == TYPE_REALMATRIX) {
+        vartype *v;
+        int err = dense_to_sparse((vartype_realmatrix *) stack[sp], &v);
+        if (err != ERR_NONE)
+            return err;
+        unary_result(v);
+        return ERR_NONE;
+    }
+    /* With two reals, create an empty matrix, like NEWMAT, but without
+     * going through a dense one, which may not even fit in memory.
+     */
+    if (sp == 0)
+        return ERR_TOO_FEW_ARGUMENTS;
+    if (stack[sp - 1]->type == TYPE_STRING)
+        return ERR_ALPHA_DATA_IS_INVALID;
+    if (stack[sp - 1]->type != TYPE_REAL)
+        return ERR_INVALID_TYPE;
+    int4 row, col;
+    if (!dim_to_int4(stack[sp - 1], &row))
+        return ERR_DIMENSION_ERROR;
+    if (!dim_to_int4(stack[sp], &col))
+        return ERR_DIMENSION_ERROR;
+    vartype *m = new_sparsematrix(row + 1, col + 1, 0);
+    if (m == NULL)
+        return ERR_INSUFFICIENT_MEMORY;
+    return binary_result(m);
+}
+
+int docmd_dense(arg_struct *arg) {
+    vartype *v = sparse_to_dense((vartype_sparsematrix *) stack[sp]);
+    if (v == NULL)
+        return ERR_INSUFFICIENT_MEMORY;
+    unary_result(v);
+    return ERR_NONE;
+}
+
 static int assign_helper(int num, arg_struct *arg) {
     if (arg->type == ARGTYPE_COMMAND) {
         /* For backward compatibility only; we don't allow this type
@@ -32,6 +32,7 @@ int docmd_perm(arg_struct *arg);
 int docmd_fact(arg_struct *arg);
 int docmd_gamma(arg_struct *arg);
 int docmd_ran(arg_struct *arg);
+int docmd_ranfill(arg_struct *arg);
 int docmd_seed(arg_struct *arg);
 int docmd_lbl(arg_struct *arg);
 int docmd_rtn(arg_struct *arg);
@@ -97,6 +98,8 @@ int docmd_cpx_t(arg_struct *arg);
 int docmd_str_t(arg_struct *arg);
 int docmd_mat_t(arg_struct *arg);
 int docmd_dim_t(arg_struct *arg);
+int docmd_sparse(arg_struct *arg);
+int docmd_dense(arg_struct *arg);
 int docmd_asgn01(arg_struct *arg);
 int docmd_asgn02(arg_struct *arg);
 int docmd_asgn03(arg_struct *arg);
@@ -292,10 +292,10 @@ int docmd_cross(arg_struct *arg) {
         if (ls > 3 || rs > 3)
             return ERR_DIMENSION_ERROR;
         for (i = 0; i < ls; i++)
-            if (left->array->is_string[i] != 0)
+            if (get_is_string(left->array, i) != 0)
                 return ERR_ALPHA_DATA_IS_INVALID;
         for (i = 0; i < rs; i++)
-            if (right->array->is_string[i] != 0)
+            if (get_is_string(right->array, i) != 0)
                 return ERR_ALPHA_DATA_IS_INVALID;
         switch (ls) {
             case 3: zl = left->array->data[2];
@@ -401,7 +401,7 @@ int docmd_delr(arg_struct *arg) {
     interactive = matedit_mode == 2 || matedit_mode == 3;
     if (interactive) {
         if (m->type == TYPE_REALMATRIX) {
-            if (rm->array->is_string[n] != 0) {
+            if (get_is_string(rm->array, n) != 0) {
                 char *text;
                 int4 len;
                 get_matrix_string(rm, n, &text, &len);
@@ -430,17 +430,20 @@ int docmd_delr(arg_struct *arg) {
          * of all, no temporary memory allocations needed!
          */
         if (m->type == TYPE_REALMATRIX) {
+            char *is_string = rm->array->is_string;
             for (j = 0; j < columns; j++) {
                 phloat tempd = rm->array->data[matedit_i * columns + j];
-                char tempc = rm->array->is_string[matedit_i * columns + j];
-                for (i = matedit_i; i < rows - 1; i++) {
+                for (i = matedit_i; i < rows - 1; i++)
                     rm->array->data[i * columns + j] =
                                 rm->array->data[(i + 1) * columns + j];
-                    rm->array->is_string[i * columns + j] =
-                                rm->array->is_string[(i + 1) * columns + j];
-                }
                 rm->array->data[(rows - 1) * columns + j] = tempd;
-                rm->array->is_string[(rows - 1) * columns + j] = tempc;
+                if (is_string == NULL)
+                    continue;
+                char tempc = is_string[matedit_i * columns + j];
+                for (i = matedit_i; i < rows - 1; i++)
+                    is_string[i * columns + j] =
+                                is_string[(i + 1) * columns + j];
+                is_string[(rows - 1) * columns + j] = tempc;
             }
             err = dimension_array_ref(m, rows - 1, columns);
             if (err != ERR_NONE) {
@@ -448,15 +451,17 @@ int docmd_delr(arg_struct *arg) {
                  * it was before. */
                 for (j = 0; j < columns; j++) {
                     phloat tempd = rm->array->data[(rows - 1) * columns + j];
-                    char tempc = rm->array->is_string[(rows - 1) * columns + j];
-                    for (i = rows - 1; i > matedit_i; i--) {
+                    for (i = rows - 1; i > matedit_i; i--)
                         rm->array->data[i * columns + j] =
                                     rm->array->data[(i - 1) * columns + j];
-                        rm->array->is_string[i * columns + j] =
-                                    rm->array->is_string[(i - 1) * columns + j];
-                    }
                     rm->array->data[matedit_i * columns + j] = tempd;
-                    rm->array->is_string[matedit_i * columns + j] = tempc;
+                    if (is_string == NULL)
+                        continue;
+                    char tempc = is_string[(rows - 1) * columns + j];
+                    for (i = rows - 1; i > matedit_i; i--)
+                        is_string[i * columns + j] =
+                                    is_string[(i - 1) * columns + j];
+                    is_string[matedit_i * columns + j] = tempc;
                 }
                 if (interactive)
                     free_vartype(newx);
@@ -505,35 +510,42 @@ int docmd_delr(arg_struct *arg) {
                     free_vartype(newx);
                 return ERR_INSUFFICIENT_MEMORY;
             }
-            array->data = (phloat *) malloc(newsize * sizeof(phloat));
+            array->data = matrix_data_alloc(newsize, &array->map);
             if (array->data == NULL) {
                 if (interactive)
                     free_vartype(newx);
                 free(array);
                 return ERR_INSUFFICIENT_MEMORY;
             }
-            array->is_string = (char *) malloc(newsize);
-            if (array->is_string == NULL) {
-                if (interactive)
-                    free_vartype(newx);
-                free(array->data);
-                free(array);
-                return ERR_INSUFFICIENT_MEMORY;
+            array->is_string = NULL;
+            array->nstrings = 0;
+            if (rm->array->is_string != NULL) {
+                array->is_string = (char *) malloc(newsize);
+                if (array->is_string == NULL) {
+                    if (interactive)
+                        free_vartype(newx);
+                    matrix_data_free(array->data, array->map);
+                    free(array);
+                    return ERR_INSUFFICIENT_MEMORY;
+                }
+                for (i = 0; i < matedit_i * columns; i++)
+                    array->is_string[i] = rm->array->is_string[i];
+                for (i = matedit_i * columns; i < newsize; i++)
+                    array->is_string[i] = rm->array->is_string[i + columns];
+                for (i = 0; i < newsize; i++)
+                    if (array->is_string[i] != 0)
+                        array->nstrings++;
             }
-            for (i = 0; i < matedit_i * columns; i++) {
-                array->is_string[i] = rm->array->is_string[i];
+            for (i = 0; i < matedit_i * columns; i++)
                 array->data[i] = rm->array->data[i];
-            }
-            for (i = matedit_i * columns; i < (matedit_i + 1) * columns; i++)
-                if (array->is_string[i] == 2)
-                    free(*(void **) &array->data[i]);
-            for (i = matedit_i * columns; i < newsize; i++) {
-                array->is_string[i] = rm->array->is_string[i + columns];
+            for (i = matedit_i * columns; i < newsize; i++)
                 array->data[i] = rm->array->data[i + columns];
-            }
             array->refcount = 1;
+            array->cow_base = NULL;
+            array->cow_chunks = NULL;
             rm->array->refcount--;
             rm->array = array;
+            touch_matrix(m);
             rm->rows--;
         } else if (m->type == TYPE_COMPLEXMATRIX) {
             complexmatrix_data *array = (complexmatrix_data *)
@@ -555,8 +567,11 @@ int docmd_delr(arg_struct *arg) {
             for (i = 2 * matedit_i * columns; i < 2 * newsize; i++)
                 array->data[i] = cm->array->data[i + 2 * columns];
             array->refcount = 1;
+            array->cow_base = NULL;
+            array->cow_chunks = NULL;
             cm->array->refcount--;
             cm->array = array;
+            touch_matrix(m);
             cm->rows--;
         } else /* m->type == TYPE_LIST */ {
             list_data *array = (list_data *) malloc(sizeof(list_data));
@@ -612,6 +627,64 @@ int docmd_det(arg_struct *arg) {
     return linalg_det(stack[sp], det_completion);
 }
 
+static int cond_completion(int error, vartype *cond, vartype *growth) {
+    if (error == ERR_NONE)
+        error = unary_two_results(cond, growth);
+    return error;
+}
+
+int docmd_cond(arg_struct *arg) {
+    return linalg_cond(stack[sp], cond_completion);
+}
+
+static int sort_completion(int error, vartype *res) {
+    if (error == ERR_NONE)
+        unary_result(res);
+    return error;
+}
+
+int docmd_sort(arg_struct *arg) {
+    return linalg_sort(stack[sp], SORT_VALUES, 0, false, sort_completion);
+}
+
+int docmd_isort(arg_struct *arg) {
+    return linalg_sort(stack[sp], SORT_INDICES, 0, false, sort_completion);
+}
+
+static int sort_key_completion(int error, vartype *res) {
+    if (error == ERR_NONE)
+        error = binary_result(res);
+    return error;
+}
+
+/* SORTR and SORTC: Y is the matrix, X the number of the key column or row;
+ * a negative number sorts in descending order.
+ */
+static int sort_by_key(int mode) {
+    if (stack[sp]->type != TYPE_REAL || stack[sp - 1]->type != TYPE_REALMATRIX)
+        return ERR_INVALID_TYPE;
+    vartype_realmatrix *rm = (vartype_realmatrix *) stack[sp - 1];
+    phloat x = ((vartype_real *) stack[sp])->x;
+    bool descending = x < 0;
+    if (descending)
+        x = -x;
+    if (x != floor(x))
+        return ERR_INVALID_DATA;
+    int4 size = mode == SORT_ROWS ? rm->columns : rm->rows;
+    if (x < 1 || x > size)
+        return ERR_DIMENSION_ERROR;
+    return linalg_sort(stack[sp - 1], mode, to_int4(x) - 1, descending,
+                       sort_key_completion);
+}
+
+int docmd_sortr(arg_struct *arg) {
+    return sort_by_key(SORT_ROWS);
+}
+
+int docmd_sortc(arg_struct *arg) {
+    return sort_by_key(SORT_COLUMNS);
+}
+
 int docmd_dim(arg_struct *arg) {
     phloat x, y;
     int err;
@@ -656,15 +729,13 @@ int docmd_dot(arg_struct *arg) {
         vartype_realmatrix *rm1 = (vartype_realmatrix *) stack[sp];
         vartype_realmatrix *rm2 = (vartype_realmatrix *) stack[sp - 1];
         int4 size = rm1->rows * rm1->columns;
-        int4 i;
-        phloat dot = 0;
+        phloat dot;
         int inf;
         if (size != rm2->rows * rm2->columns)
             return ERR_DIMENSION_ERROR;
         if (contains_strings(rm1) || contains_strings(rm2))
             return ERR_ALPHA_DATA_IS_INVALID;
-        for (i = 0; i < size; i++)
-            dot += rm1->array->data[i] * rm2->array->data[i];
+        dot = math_dot(rm1->array->data, 1, rm2->array->data, 1, size);
         if ((inf = p_isinf(dot)) != 0) {
             if (flags.f.range_error_ignore)
                 dot = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
@@ -679,8 +750,8 @@ int docmd_dot(arg_struct *arg) {
                     && stack[sp - 1]->type == TYPE_REALMATRIX)) {
         vartype_realmatrix *rm;
         vartype_complexmatrix *cm;
-        int4 size, i;
-        phloat dot_re = 0, dot_im = 0;
+        int4 size;
+        phloat dot_re, dot_im;
         int inf;
         if (stack[sp]->type == TYPE_REALMATRIX) {
             rm = (vartype_realmatrix *) stack[sp];
@@ -694,10 +765,8 @@ int docmd_dot(arg_struct *arg) {
             return ERR_DIMENSION_ERROR;
         if (contains_strings(rm))
             return ERR_ALPHA_DATA_IS_INVALID;
-        for (i = 0; i < size; i++) {
-            dot_re += rm->array->data[i] * cm->array->data[2 * i];
-            dot_im += rm->array->data[i] * cm->array->data[2 * i + 1];
-        }
+        dot_re = math_dot(rm->array->data, 1, cm->array->data, 2, size);
+        dot_im = math_dot(rm->array->data, 1, cm->array->data + 1, 2, size);
         if ((inf = p_isinf(dot_re)) != 0) {
             if (flags.f.range_error_ignore)
                 dot_re = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
@@ -722,14 +791,21 @@ int docmd_dot(arg_struct *arg) {
         if (size != cm2->rows * cm2->columns)
             return ERR_DIMENSION_ERROR;
         size *= 2;
+        phloat_sum acc_re, acc_im;
+        sum_init(&acc_re);
+        sum_init(&acc_im);
         for (i = 0; i < size; i += 2) {
             phloat re1 = cm1->array->data[i];
             phloat im1 = cm1->array->data[i + 1];
             phloat re2 = cm2->array->data[i];
             phloat im2 = cm2->array->data[i + 1];
-            dot_re += re1 * re2 - im1 * im2;
-            dot_im += re1 * im2 + re2 * im1;
+            sum_add_product(&acc_re, re1, re2);
+            sum_add_product(&acc_re, -im1, im2);
+            sum_add_product(&acc_im, re1, im2);
+            sum_add_product(&acc_im, re2, im1);
         }
+        dot_re = sum_result(&acc_re);
+        dot_im = sum_result(&acc_im);
         if ((inf = p_isinf(dot_re)) != 0) {
             if (flags.f.range_error_ignore)
                 dot_re = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
@@ -765,7 +841,7 @@ int docmd_dot(arg_struct *arg) {
 int matedit_get_dim(int4 *rows, int4 *columns, vartype **res) {
     vartype *m;
 
-    int err = matedit_get(&m);
+    int err = matedit_get(&m, true);
     if (err != ERR_NONE)
         return err;
 
@@ -777,6 +853,10 @@ int matedit_get_dim(int4 *rows, int4 *columns, vartype **res) {
         vartype_complexmatrix *cm = (vartype_complexmatrix *) m;
         *rows = cm->rows;
         *columns = cm->columns;
+    } else if (m->type == TYPE_SPARSEMATRIX) {
+        vartype_sparsematrix *sm = (vartype_sparsematrix *) m;
+        *rows = sm->rows;
+        *columns = sm->columns;
     } else { // TYPE_LIST
         vartype_list *list = (vartype_list *) m;
         *rows = list->size;
@@ -882,7 +962,7 @@ int docmd_edit(arg_struct *arg) {
     vartype *v;
     if (stack[sp]->type == TYPE_REALMATRIX) {
         vartype_realmatrix *rm = (vartype_realmatrix *) stack[sp];
-        if (rm->array->is_string[0] != 0) {
+        if (get_is_string(rm->array, 0) != 0) {
             char *text;
             int4 len;
             get_matrix_string(rm, 0, &text, &len);
@@ -951,11 +1031,13 @@ int docmd_editn(arg_struct *arg) {
             && m->type != TYPE_COMPLEXMATRIX
             && m->type != TYPE_LIST)
         return ERR_INVALID_TYPE;
+    if (!materialize(m))
+        return ERR_INSUFFICIENT_MEMORY;
 
     vartype *v;
     if (m->type == TYPE_REALMATRIX) {
         vartype_realmatrix *rm = (vartype_realmatrix *) m;
-        if (rm->array->is_string[0] != 0) {
+        if (get_is_string(rm->array, 0) != 0) {
             char *text;
             int4 len;
             get_matrix_string(rm , 0, &text, &len);
@@ -1089,12 +1171,13 @@ static int fnrm(vartype *m, phloat *norm) {
         if (s > max_exp)
             max_exp = s;
     }
-    phloat nrm = 0;
+    phloat_sum acc;
+    sum_init(&acc);
     for (int4 i = 0; i < size; i++) {
         phloat x = scalbn(data[i], -max_exp);
-        nrm += x * x;
+        sum_add_product(&acc, x, x);
     }
-    nrm = scalbn(sqrt(nrm), max_exp);
+    phloat nrm = scalbn(sqrt(sum_result(&acc)), max_exp);
     if (p_isinf(nrm)) {
         if (flags.f.range_error_ignore)
             nrm = POS_HUGE_PHLOAT;
@@ -1153,11 +1236,15 @@ int docmd_getm(arg_struct *arg) {
         dst = (vartype_realmatrix *) new_realmatrix(y, x);
         if (dst == NULL)
             return ERR_INSUFFICIENT_MEMORY;
+        if (contains_strings(src) && !alloc_is_string(dst->array, y * x)) {
+            free_vartype((vartype *) dst);
+            return ERR_INSUFFICIENT_MEMORY;
+        }
         for (i = 0; i < y; i++)
             for (j = 0; j < x; j++) {
                 int4 n1 = (i + matedit_i) * src->columns + j + matedit_j;
                 int4 n2 = i * dst->columns + j;
-                if (src->array->is_string[n1] == 2) {
+                if (get_is_string(src->array, n1) == 2) {
                     int4 *sp = *(int4 **) &src->array->data[n1];
                     int4 *dp = (int4 *) malloc(*sp + 4);
                     if (dp == NULL) {
@@ -1169,7 +1256,7 @@ int docmd_getm(arg_struct *arg) {
                 } else {
                     dst->array->data[n2] = src->array->data[n1];
                 }
-                dst->array->is_string[n2] = src->array->is_string[n1];
+                set_is_string(dst->array, n2, get_is_string(src->array, n1));
             }
         return binary_result((vartype *) dst);
     } else /* m->type == TYPE_COMPLEXMATRIX */ {
@@ -1447,6 +1534,7 @@ int docmd_index(arg_struct *arg) {
     m = vars[mi].value;
     if (m->type != TYPE_REALMATRIX
             && m->type != TYPE_COMPLEXMATRIX
+            && m->type != TYPE_SPARSEMATRIX
             && m->type != TYPE_LIST)
         return ERR_INVALID_TYPE;
 
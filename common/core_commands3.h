@@ -37,6 +37,11 @@ int docmd_cross(arg_struct *arg);
 int docmd_custom(arg_struct *arg);
 int docmd_delr(arg_struct *arg);
 int docmd_det(arg_struct *arg);
+int docmd_cond(arg_struct *arg);
+int docmd_sort(arg_struct *arg);
+int docmd_isort(arg_struct *arg);
+int docmd_sortr(arg_struct *arg);
+int docmd_sortc(arg_struct *arg);
 int docmd_dim(arg_struct *arg);
 int docmd_dot(arg_struct *arg);
 int docmd_edit(arg_struct *arg);
@@ -101,12 +101,16 @@ int docmd_insr(arg_struct *arg) {
         }
         rows++;
         if (m->type == TYPE_REALMATRIX) {
+            /* Moving the flags around doesn't change the string count */
+            char *is_string = rm->array->is_string;
             for (i = rows * columns - 1; i >= (matedit_i + 1) * columns; i--) {
-                rm->array->is_string[i] = rm->array->is_string[i - columns];
+                if (is_string != NULL)
+                    is_string[i] = is_string[i - columns];
                 rm->array->data[i] = rm->array->data[i - columns];
             }
             for (i = matedit_i * columns; i < (matedit_i + 1) * columns; i++) {
-                rm->array->is_string[i] = 0;
+                if (is_string != NULL)
+                    is_string[i] = 0;
                 rm->array->data[i] = 0;
             }
         } else if (m->type == TYPE_COMPLEXMATRIX) {
@@ -149,36 +153,43 @@ int docmd_insr(arg_struct *arg) {
                     free_vartype(newx);
                 return ERR_INSUFFICIENT_MEMORY;
             }
-            array->data = (phloat *) malloc(newsize * sizeof(phloat));
+            array->data = matrix_data_alloc(newsize, &array->map);
             if (array->data == NULL) {
                 if (interactive)
                     free_vartype(newx);
                 free(array);
                 return ERR_INSUFFICIENT_MEMORY;
             }
-            array->is_string = (char *) malloc(newsize);
-            if (array->is_string == NULL) {
-                if (interactive)
-                    free_vartype(newx);
-                free(array->data);
-                free(array);
-                return ERR_INSUFFICIENT_MEMORY;
+            array->is_string = NULL;
+            array->nstrings = rm->array->nstrings;
+            if (rm->array->is_string != NULL) {
+                array->is_string = (char *) malloc(newsize);
+                if (array->is_string == NULL) {
+                    if (interactive)
+                        free_vartype(newx);
+                    matrix_data_free(array->data, array->map);
+                    free(array);
+                    return ERR_INSUFFICIENT_MEMORY;
+                }
+                for (i = 0; i < matedit_i * columns; i++)
+                    array->is_string[i] = rm->array->is_string[i];
+                for (i = matedit_i * columns; i < (matedit_i + 1) * columns; i++)
+                    array->is_string[i] = 0;
+                for (i = (matedit_i + 1) * columns; i < newsize; i++)
+                    array->is_string[i] = rm->array->is_string[i - columns];
             }
-            for (i = 0; i < matedit_i * columns; i++) {
-                array->is_string[i] = rm->array->is_string[i];
+            for (i = 0; i < matedit_i * columns; i++)
                 array->data[i] = rm->array->data[i];
-            }
-            for (i = matedit_i * columns; i < (matedit_i + 1) * columns; i++) {
-                array->is_string[i] = 0;
+            for (i = matedit_i * columns; i < (matedit_i + 1) * columns; i++)
                 array->data[i] = 0;
-            }
-            for (i = (matedit_i + 1) * columns; i < newsize; i++) {
-                array->is_string[i] = rm->array->is_string[i - columns];
+            for (i = (matedit_i + 1) * columns; i < newsize; i++)
                 array->data[i] = rm->array->data[i - columns];
-            }
             array->refcount = 1;
+            array->cow_base = NULL;
+            array->cow_chunks = NULL;
             rm->array->refcount--;
             rm->array = array;
+            touch_matrix(m);
             rm->rows++;
         } else if (m->type == TYPE_COMPLEXMATRIX) {
             complexmatrix_data *array = (complexmatrix_data *)
@@ -203,8 +214,11 @@ int docmd_insr(arg_struct *arg) {
             for (i = 2 * (matedit_i + 1) * columns; i < 2 * newsize; i++)
                 array->data[i] = cm->array->data[i - 2 * columns];
             array->refcount = 1;
+            array->cow_base = NULL;
+            array->cow_chunks = NULL;
             cm->array->refcount--;
             cm->array = array;
+            touch_matrix(m);
             cm->rows++;
         } else {
             list_data *array = (list_data *) malloc(sizeof(list_data));
@@ -310,7 +324,7 @@ int docmd_j_add(arg_struct *arg) {
             flags.f.matrix_end_wrap = 1;
             if (flags.f.grow) {
                 vartype *m;
-                err = matedit_get(&m);
+                err = matedit_get(&m, true);
                 if (err == ERR_NONE)
                     err = dimension_array_ref(m, rows + 1, columns);
                 if (err != ERR_NONE) {
@@ -449,7 +463,7 @@ int docmd_putm(arg_struct *arg) {
     vartype *m;
     int4 i, j;
 
-    int err = matedit_get(&m);
+    int err = matedit_get(&m, true);
     if (err != ERR_NONE)
         return err;
     if (m->type == TYPE_LIST)
@@ -483,13 +497,18 @@ int docmd_putm(arg_struct *arg) {
             return ERR_INSUFFICIENT_MEMORY;
         }
         src = (vartype_realmatrix *) v;
+        if (contains_strings(src) && !alloc_is_string(dst->array, dst->rows * dst->columns)
+                || contains_strings(dst) && !alloc_is_string(src->array, src->rows * src->columns)) {
+            free_vartype(v);
+            return ERR_INSUFFICIENT_MEMORY;
+        }
         for (i = 0; i < src->rows; i++)
             for (j = 0; j < src->columns; j++) {
                 int4 n1 = i * src->columns + j;
                 int4 n2 = (i + matedit_i) * dst->columns + j + matedit_j;
-                char tc = dst->array->is_string[n2];
-                dst->array->is_string[n2] = src->array->is_string[n1];
-                src->array->is_string[n1] = tc;
+                char tc = get_is_string(dst->array, n2);
+                set_is_string(dst->array, n2, get_is_string(src->array, n1));
+                set_is_string(src->array, n1, tc);
                 phloat tp = dst->array->data[n2];
                 dst->array->data[n2] = src->array->data[n1];
                 src->array->data[n1] = tp;
@@ -535,25 +554,28 @@ int docmd_putm(arg_struct *arg) {
 
 int docmd_rclel(arg_struct *arg) {
     vartype *m, *v;
-    int err = matedit_get(&m);
+    int err = matedit_get(&m, true, true);
     if (err != ERR_NONE)
         return err;
 
     if (m->type == TYPE_REALMATRIX) {
         vartype_realmatrix *rm = (vartype_realmatrix *) m;
         int4 n = matedit_i * rm->columns + matedit_j;
-        if (rm->array->is_string[n] != 0) {
+        if (get_is_string(rm->array, n) != 0) {
             char *text;
             int4 length;
             get_matrix_string(rm, n, &text, &length);
             v = new_string(text, length);
         } else
-            v = new_real(rm->array->data[n]);
+            v = new_real(*matrix_element(m, n));
     } else if (m->type == TYPE_COMPLEXMATRIX) {
         vartype_complexmatrix *cm = (vartype_complexmatrix *) m;
         int4 n = matedit_i * cm->columns + matedit_j;
-        v = new_complex(cm->array->data[2 * n],
-                        cm->array->data[2 * n + 1]);
+        phloat *p = matrix_element(m, n);
+        v = new_complex(p[0], p[1]);
+    } else if (m->type == TYPE_SPARSEMATRIX) {
+        vartype_sparsematrix *sm = (vartype_sparsematrix *) m;
+        v = new_real(sparse_get(sm, matedit_i, matedit_j));
     } else {
         vartype_list *list = (vartype_list *) m;
         if (list->size == 0)
@@ -649,10 +671,9 @@ int docmd_rsum(arg_struct *arg) {
         if (res == NULL)
             return ERR_INSUFFICIENT_MEMORY;
         for (int4 i = 0; i < rm->rows; i++) {
-            phloat sum = 0;
+            phloat sum = math_sum(rm->array->data + i * rm->columns, 1,
+                                  rm->columns);
             int inf;
-            for (int4 j = 0; j < rm->columns; j++)
-                sum += rm->array->data[i * rm->columns + j];
             if ((inf = p_isinf(sum)) != 0) {
                 if (flags.f.range_error_ignore)
                     sum = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
@@ -668,17 +689,15 @@ int docmd_rsum(arg_struct *arg) {
     } else if (stack[sp]->type == TYPE_COMPLEXMATRIX) {
         vartype_complexmatrix *cm = (vartype_complexmatrix *) stack[sp];
         vartype_complexmatrix *res;
-        int4 i, j;
+        int4 i;
         res = (vartype_complexmatrix *) new_complexmatrix(cm->rows, 1);
         if (res == NULL)
             return ERR_INSUFFICIENT_MEMORY;
         for (i = 0; i < cm->rows; i++) {
-            phloat sum_re = 0, sum_im = 0;
+            phloat *row = cm->array->data + 2 * i * cm->columns;
+            phloat sum_re = math_sum(row, 2, cm->columns);
+            phloat sum_im = math_sum(row + 1, 2, cm->columns);
             int inf;
-            for (j = 0; j < cm->columns; j++) {
-                sum_re += cm->array->data[2 * (i * cm->columns + j)];
-                sum_im += cm->array->data[2 * (i * cm->columns + j) + 1];
-            }
             if ((inf = p_isinf(sum_re)) != 0) {
                 if (flags.f.range_error_ignore)
                     sum_re = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
@@ -738,14 +757,17 @@ int docmd_swap_r(arg_struct *arg) {
             return ERR_NONE;
         if (!disentangle(m))
             return ERR_INSUFFICIENT_MEMORY;
+        char *is_string = rm->array->is_string;
         for (i = 0; i < rm->columns; i++) {
             int4 n1 = x * rm->columns + i;
             int4 n2 = y * rm->columns + i;
-            char tempc = rm->array->is_string[n1];
+            if (is_string != NULL) {
+                char tempc = is_string[n1];
+                is_string[n1] = is_string[n2];
+                is_string[n2] = tempc;
+            }
             phloat tempds = rm->array->data[n1];
-            rm->array->is_string[n1] = rm->array->is_string[n2];
             rm->array->data[n1] = rm->array->data[n2];
-            rm->array->is_string[n2] = tempc;
             rm->array->data[n2] = tempds;
         }
         return ERR_NONE;
@@ -823,21 +845,35 @@ int docmd_sinh(arg_struct *arg) {
 
 int docmd_stoel(arg_struct *arg) {
     vartype *m;
-    int err = matedit_get(&m);
+    /* A number stored into a matrix variable only needs the element's own
+     * chunk to be unshared; see disentangle_element().
+     */
+    bool chunked_ok = matedit_mode != 2 && matedit_stack_depth == 0
+            && (stack[sp]->type == TYPE_REAL || stack[sp]->type == TYPE_COMPLEX);
+    int err = matedit_get(&m, true, chunked_ok);
     if (err != ERR_NONE)
         return err;
 
-    if (!disentangle(m))
+    if (chunked_ok && m->type == TYPE_REALMATRIX) {
+        vartype_realmatrix *rm = (vartype_realmatrix *) m;
+        if (!disentangle_element(m, matedit_i * rm->columns + matedit_j))
+            return ERR_INSUFFICIENT_MEMORY;
+    } else if (chunked_ok && m->type == TYPE_COMPLEXMATRIX) {
+        vartype_complexmatrix *cm = (vartype_complexmatrix *) m;
+        if (!disentangle_element(m, matedit_i * cm->columns + matedit_j))
+            return ERR_INSUFFICIENT_MEMORY;
+    } else if (!disentangle(m))
         return ERR_INSUFFICIENT_MEMORY;
 
     if (m->type == TYPE_REALMATRIX) {
         vartype_realmatrix *rm = (vartype_realmatrix *) m;
         int4 n = matedit_i * rm->columns + matedit_j;
         if (stack[sp]->type == TYPE_REAL) {
-            if (rm->array->is_string[n] == 2)
-                free(*(void **) &rm->array->data[n]);
-            rm->array->is_string[n] = 0;
-            rm->array->data[n] = ((vartype_real *) stack[sp])->x;
+            phloat *p = matrix_element(m, n);
+            if (get_is_string(rm->array, n) == 2)
+                free(*(void **) p);
+            set_is_string(rm->array, n, 0);
+            *p = ((vartype_real *) stack[sp])->x;
             return ERR_NONE;
         } else if (stack[sp]->type == TYPE_STRING) {
             vartype_string *s = (vartype_string *) stack[sp];
@@ -849,14 +885,25 @@ int docmd_stoel(arg_struct *arg) {
     } else if (m->type == TYPE_COMPLEXMATRIX) {
         vartype_complexmatrix *cm = (vartype_complexmatrix *) m;
         int4 n = matedit_i * cm->columns + matedit_j;
+        phloat *p = matrix_element(m, n);
         if (stack[sp]->type == TYPE_REAL) {
-            cm->array->data[2 * n] = ((vartype_real *) stack[sp])->x;
-            cm->array->data[2 * n + 1] = 0;
+            p[0] = ((vartype_real *) stack[sp])->x;
+            p[1] = 0;
             return ERR_NONE;
         } else if (stack[sp]->type == TYPE_COMPLEX) {
             vartype_complex *c = (vartype_complex *) stack[sp];
-            cm->array->data[2 * n] = c->re;
-            cm->array->data[2 * n + 1] = c->im;
+            p[0] = c->re;
+            p[1] = c->im;
+            return ERR_NONE;
+        } else if (stack[sp]->type == TYPE_STRING)
+            return ERR_ALPHA_DATA_IS_INVALID;
+        else
+            return ERR_INVALID_TYPE;
+    } else if (m->type == TYPE_SPARSEMATRIX) {
+        vartype_sparsematrix *sm = (vartype_sparsematrix *) m;
+        if (stack[sp]->type == TYPE_REAL) {
+            if (!sparse_put(sm, matedit_i, matedit_j, ((vartype_real *) stack[sp])->x))
+                return ERR_INSUFFICIENT_MEMORY;
             return ERR_NONE;
         } else if (stack[sp]->type == TYPE_STRING)
             return ERR_ALPHA_DATA_IS_INVALID;
@@ -879,7 +926,7 @@ int docmd_stoij(arg_struct *arg) {
     vartype *m;
     int4 i, j;
 
-    int err = matedit_get(&m);
+    int err = matedit_get(&m, true);
     if (err != ERR_NONE)
         return err;
 
@@ -905,6 +952,10 @@ int docmd_stoij(arg_struct *arg) {
         vartype_complexmatrix *cm = (vartype_complexmatrix *) m;
         if (i >= cm->rows || j >= cm->columns)
             return ERR_DIMENSION_ERROR;
+    } else if (m->type == TYPE_SPARSEMATRIX) {
+        vartype_sparsematrix *sm = (vartype_sparsematrix *) m;
+        if (i >= sm->rows || j >= sm->columns)
+            return ERR_DIMENSION_ERROR;
     } else if (m->type == TYPE_LIST) {
         vartype_list *list = (vartype_list *) m;
         if (i >= list->size || j != 0)
@@ -969,51 +1020,110 @@ int docmd_tanh(arg_struct *arg) {
     return err;
 }
 
+/* Transposition is done by recursively halving the larger dimension of the
+ * block being copied, until it is small enough for the source rows and the
+ * destination columns it touches to stay in the cache together. That keeps
+ * the strided side of the copy from thrashing the cache on large matrices,
+ * without having to know the cache size.
+ * The result always goes into a new array, so TRANS needs room for a second
+ * copy of the matrix: the original stays in LASTX, and, if it was recalled
+ * from a variable, is still shared with that variable, so there is no case
+ * where it could be transposed in place.
+ */
+#define TRANS_LEAF 16
+
+static bool trans_block_r(vartype_realmatrix *src, vartype_realmatrix *dst,
+                          int4 i0, int4 i1, int4 j0, int4 j1) {
+    if (i1 - i0 > TRANS_LEAF || j1 - j0 > TRANS_LEAF) {
+        if (i1 - i0 >= j1 - j0) {
+            int4 im = (i0 + i1) / 2;
+            return trans_block_r(src, dst, i0, im, j0, j1)
+                && trans_block_r(src, dst, im, i1, j0, j1);
+        } else {
+            int4 jm = (j0 + j1) / 2;
+            return trans_block_r(src, dst, i0, i1, j0, jm)
+                && trans_block_r(src, dst, i0, i1, jm, j1);
+        }
+    }
+    int4 rows = src->rows;
+    int4 columns = src->columns;
+    for (int4 i = i0; i < i1; i++)
+        for (int4 j = j0; j < j1; j++) {
+            int4 n1 = i * columns + j;
+            int4 n2 = j * rows + i;
+            char s = get_is_string(src->array, n1);
+            if (s == 2) {
+                int4 *sp = *(int4 **) &src->array->data[n1];
+                int4 *dp = (int4 *) malloc(*sp + 4);
+                if (dp == NULL)
+                    return false;
+                memcpy(dp, sp, *sp + 4);
+                *(int4 **) &dst->array->data[n2] = dp;
+            } else
+                dst->array->data[n2] = src->array->data[n1];
+            set_is_string(dst->array, n2, s);
+        }
+    return true;
+}
+
+static void trans_block_c(vartype_complexmatrix *src, vartype_complexmatrix *dst,
+                          int4 i0, int4 i1, int4 j0, int4 j1) {
+    if (i1 - i0 > TRANS_LEAF || j1 - j0 > TRANS_LEAF) {
+        if (i1 - i0 >= j1 - j0) {
+            int4 im = (i0 + i1) / 2;
+            trans_block_c(src, dst, i0, im, j0, j1);
+            trans_block_c(src, dst, im, i1, j0, j1);
+        } else {
+            int4 jm = (j0 + j1) / 2;
+            trans_block_c(src, dst, i0, i1, j0, jm);
+            trans_block_c(src, dst, i0, i1, jm, j1);
+        }
+        return;
+    }
+    int4 rows = src->rows;
+    int4 columns = src->columns;
+    phloat *s = src->array->data;
+    phloat *d = dst->array->data;
+    for (int4 i = i0; i < i1; i++)
+        for (int4 j = j0; j < j1; j++) {
+            int4 n1 = 2 * (i * columns + j);
+            int4 n2 = 2 * (j * rows + i);
+            d[n2] = s[n1];
+            d[n2 + 1] = s[n1 + 1];
+        }
+}
+
 int docmd_trans(arg_struct *arg) {
     if (stack[sp]->type == TYPE_REALMATRIX) {
         vartype_realmatrix *src = (vartype_realmatrix *) stack[sp];
         vartype_realmatrix *dst;
         int4 rows = src->rows;
         int4 columns = src->columns;
-        int4 i, j;
         dst = (vartype_realmatrix *) new_realmatrix(columns, rows);
         if (dst == NULL)
             return ERR_INSUFFICIENT_MEMORY;
-        for (i = 0; i < rows; i++)
-            for (j = 0; j < columns; j++) {
-                int4 n1 = i * columns + j;
-                int4 n2 = j * rows + i;
-                dst->array->is_string[n2] = src->array->is_string[n1];
-                if (dst->array->is_string[n2] == 2) {
-                    int4 *sp = *(int4 **) &src->array->data[n1];
-                    int4 *dp = (int4 *) malloc(*sp + 4);
-                    if (dp == NULL) {
-                        free_vartype((vartype *) dst);
-                        return ERR_INSUFFICIENT_MEMORY;
-                    }
-                    memcpy(dp, sp, *sp + 4);
-                    *(int4 **) &dst->array->data[n2] = dp;
-                } else
-                    dst->array->data[n2] = src->array->data[n1];
-            }
+        if (contains_strings(src) && !alloc_is_string(dst->array, rows * columns)
+                || !trans_block_r(src, dst, 0, rows, 0, columns)) {
+            free_vartype((vartype *) dst);
+            return ERR_INSUFFICIENT_MEMORY;
+        }
         unary_result((vartype *) dst);
         return ERR_NONE;
+    } else if (stack[sp]->type == TYPE_SPARSEMATRIX) {
+        vartype *dst = sparse_transpose((vartype_sparsematrix *) stack[sp]);
+        if (dst == NULL)
+            return ERR_INSUFFICIENT_MEMORY;
+        unary_result(dst);
+        return ERR_NONE;
     } else {
         vartype_complexmatrix *src = (vartype_complexmatrix *) stack[sp];
         vartype_complexmatrix *dst;
         int4 rows = src->rows;
         int4 columns = src->columns;
-        int4 i, j;
         dst = (vartype_complexmatrix *) new_complexmatrix(columns, rows);
         if (dst == NULL)
             return ERR_INSUFFICIENT_MEMORY;
-        for (i = 0; i < rows; i++)
-            for (j = 0; j < columns; j++) {
-                int4 n1 = 2 * (i * columns + j);
-                int4 n2 = 2 * (j * rows + i);
-                dst->array->data[n2] = src->array->data[n1];
-                dst->array->data[n2 + 1] = src->array->data[n1 + 1];
-            }
+        trans_block_c(src, dst, 0, rows, 0, columns);
         unary_result((vartype *) dst);
         return ERR_NONE;
     }
@@ -1123,7 +1233,7 @@ static int matedit_move_list(vartype_list *list, int direction) {
             new_i = 0;
             if (m->type == TYPE_REALMATRIX) {
                 vartype_realmatrix *rm = (vartype_realmatrix *) m;
-                if (rm->array->is_string[0] != 0) {
+                if (get_is_string(rm->array, 0) != 0) {
                     char *text;
                     int4 len;
                     get_matrix_string(rm, 0, &text, &len);
@@ -1228,12 +1338,12 @@ static int matedit_move(int direction) {
         if (reg_x == NULL) {
             changed = false;
         } else if (reg_x->type == TYPE_REAL) {
-            if (rm->array->is_string[old_n] != 0)
+            if (get_is_string(rm->array, old_n) != 0)
                 changed = true;
             else
                 changed = rm->array->data[old_n] != ((vartype_real *) reg_x)->x;
         } else if (reg_x->type == TYPE_STRING) {
-            if (rm->array->is_string[old_n] == 0)
+            if (get_is_string(rm->array, old_n) == 0)
                 changed = true;
             else {
                 char *text;
@@ -1322,7 +1432,7 @@ static int matedit_move(int direction) {
 
     if (m->type == TYPE_REALMATRIX) {
         if (old_n != new_n) {
-            if (rm->array->is_string[new_n] != 0) {
+            if (get_is_string(rm->array, new_n) != 0) {
                 char *text;
                 int4 len;
                 get_matrix_string(rm, new_n, &text, &len);
@@ -1335,9 +1445,9 @@ static int matedit_move(int direction) {
         if (!changed) {
             /* There's nothing to store, so leave cell unchanged */
         } else if (stack[sp]->type == TYPE_REAL) {
-            if (rm->array->is_string[old_n] == 2)
+            if (get_is_string(rm->array, old_n) == 2)
                 free(*(void **) &rm->array->data[old_n]);
-            rm->array->is_string[old_n] = 0;
+            set_is_string(rm->array, old_n, 0);
             rm->array->data[old_n] = ((vartype_real *) stack[sp])->x;
         } else {
             vartype_string *s = (vartype_string *) stack[sp];
@@ -1481,6 +1591,8 @@ static int matabx(int which) {
                 return ERR_ALPHA_DATA_IS_INVALID;
             if (mat->type != TYPE_REALMATRIX && mat->type != TYPE_COMPLEXMATRIX)
                 return ERR_INVALID_TYPE;
+            if (!materialize(mat))
+                return ERR_INSUFFICIENT_MEMORY;
             break;
 
         case 2: {
@@ -1499,12 +1611,15 @@ static int matabx(int which) {
                 return ERR_NONEXISTENT;
             if (mata->type == TYPE_STRING)
                 return ERR_ALPHA_DATA_IS_INVALID;
-            if (mata->type != TYPE_REALMATRIX && mata->type != TYPE_COMPLEXMATRIX)
+            if (mata->type != TYPE_REALMATRIX && mata->type != TYPE_COMPLEXMATRIX
+                    && mata->type != TYPE_SPARSEMATRIX)
                 return ERR_INVALID_TYPE;
+            if (!materialize(mata) || !materialize(matb))
+                return ERR_INSUFFICIENT_MEMORY;
 
             if (!ensure_var_space(1))
                 return ERR_INSUFFICIENT_MEMORY;
-            if (mata->type == TYPE_REALMATRIX && matb->type == TYPE_REALMATRIX)
+            if (mata->type != TYPE_COMPLEXMATRIX && matb->type == TYPE_REALMATRIX)
                 matx_v = new_real(0);
             else
                 matx_v = new_complex(0, 0);
@@ -1516,7 +1631,7 @@ static int matabx(int which) {
 
     if (mat->type == TYPE_REALMATRIX) {
         vartype_realmatrix *rm = (vartype_realmatrix *) mat;
-        if (rm->array->is_string[0] != 0) {
+        if (get_is_string(rm->array, 0) != 0) {
             char *text;
             int4 length;
             get_matrix_string(rm, 0, &text, &length);
@@ -1583,7 +1698,8 @@ int docmd_simq(arg_struct *arg) {
         return ERR_INSUFFICIENT_MEMORY;
 
     m = recall_var("MATA", 4);
-    if (m != NULL && (m->type == TYPE_REALMATRIX || m->type == TYPE_COMPLEXMATRIX)) {
+    if (m != NULL && (m->type == TYPE_REALMATRIX || m->type == TYPE_COMPLEXMATRIX
+                        || m->type == TYPE_SPARSEMATRIX)) {
         mata = dup_vartype(m);
         if (mata == NULL)
             return ERR_INSUFFICIENT_MEMORY;
@@ -1685,7 +1801,7 @@ static int max_min_helper(int do_max) {
     for (i = matedit_i; i < rm->rows; i++) {
         int4 index = i * rm->columns + matedit_j;
         phloat e;
-        if (rm->array->is_string[index] != 0)
+        if (get_is_string(rm->array, index) != 0)
             return ERR_ALPHA_DATA_IS_INVALID;
         e = rm->array->data[index];
         if (do_max ? e >= max_or_min_value : e <= max_or_min_value) {
@@ -1731,7 +1847,7 @@ int docmd_find(arg_struct *arg) {
             phloat d = ((vartype_real *) stack[sp])->x;
             for (i = 0; i < rm->rows; i++)
                 for (j = 0; j < rm->columns; j++)
-                    if (rm->array->is_string[p] == 0 && rm->array->data[p] == d) {
+                    if (get_is_string(rm->array, p) == 0 && rm->array->data[p] == d) {
                         matedit_i = i;
                         matedit_j = j;
                         return ERR_YES;
@@ -1743,7 +1859,7 @@ int docmd_find(arg_struct *arg) {
             int4 len = s->length;
             for (i = 0; i < rm->rows; i++)
                 for (j = 0; j < rm->columns; j++) {
-                    if (rm->array->is_string[p] != 0) {
+                    if (get_is_string(rm->array, p) != 0) {
                         char *mtext;
                         int4 mlen;
                         get_matrix_string(rm, p, &mtext, &mlen);
@@ -26,6 +26,7 @@
 #include "core_helpers.h"
 #include "core_main.h"
 #include "core_math1.h"
+#include "core_math2.h"
 #include "core_sto_rcl.h"
 #include "core_variables.h"
 
@@ -91,7 +92,7 @@ static int get_summation() {
     int4 first = mode_sigma_reg;
     int4 last = first + (flags.f.all_sigma ? 13 : 6);
     int4 size, i;
-    vartype *regs = recall_var("REGS", 4);
+    vartype *regs = recall_regs();
     vartype_realmatrix *r;
     phloat *sigmaregs;
     if (regs == NULL)
@@ -103,7 +104,7 @@ static int get_summation() {
     if (last > size)
         return ERR_SIZE_ERROR;
     for (i = first; i < last; i++)
-        if (r->array->is_string[i] != 0)
+        if (get_is_string(r->array, i) != 0)
             return ERR_ALPHA_DATA_IS_INVALID;
     sigmaregs = r->array->data + first;
     sum.x = sigmaregs[0];
@@ -1986,19 +1987,16 @@ int docmd_to_oct(arg_struct *arg) {
     return ERR_NONE;
 }
 
-static void accum(phloat *sum, phloat term, int weight) {
+static void accum(phloat_sum *sum, phloat term, int weight) {
     int inf;
-    phloat s;
-    if (weight == 1)
-        s = *sum + term;
-    else
-        s = *sum - term;
-    if ((inf = p_isinf(s)) != 0)
-        s = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
-    *sum = s;
+    sum_add(sum, weight == 1 ? term : -term);
+    if ((inf = p_isinf(sum->s)) != 0) {
+        sum_init(sum);
+        sum->s = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
+    }
 }
 
-static phloat sigma_helper_2(phloat *sigmaregs,
+static phloat sigma_helper_2(phloat_sum *sigmaregs,
                              phloat x, phloat y, int weight) {
 
     accum(&sigmaregs[0], x, weight);
@@ -2041,17 +2039,112 @@ static phloat sigma_helper_2(phloat *sigmaregs,
         flags.f.pwr_fit_invalid = 1;
     }
 
-    return sigmaregs[5];
+    return sum_result(&sigmaregs[5]);
+}
+
+/* Adds or subtracts n data points, stored as (x, y) pairs, in one pass.
+ * The sums are the same as with sigma_helper_2() for each point in turn,
+ * but the loop has no calls, and no overflow checks; if any sum did
+ * overflow, it is infinite or NaN at the end, and in that case, the points
+ * are done over, one at a time, so that the sums saturate the way they
+ * always have.
+ */
+static phloat sigma_points(phloat_sum *sigmaregs, int4 nregs,
+                           const phloat *data, int4 n, int weight) {
+    phloat_sum sums[13];
+    for (int4 i = 0; i < nregs; i++)
+        sums[i] = sigmaregs[i];
+    bool neg = weight != 1;
+    bool lnx_bad = false, lny_bad = false;
+
+    if (nregs == 6) {
+        for (int4 i = 0; i < n; i++) {
+            phloat x = data[2 * i];
+            phloat y = data[2 * i + 1];
+            sum_add(&sums[0], neg ? -x : x);
+            sum_add(&sums[1], neg ? -(x * x) : x * x);
+            sum_add(&sums[2], neg ? -y : y);
+            sum_add(&sums[3], neg ? -(y * y) : y * y);
+            sum_add(&sums[4], neg ? -(x * y) : x * y);
+            sum_add(&sums[5], neg ? -1 : 1);
+        }
+    } else {
+        for (int4 i = 0; i < n; i++) {
+            phloat x = data[2 * i];
+            phloat y = data[2 * i + 1];
+            sum_add(&sums[0], neg ? -x : x);
+            sum_add(&sums[1], neg ? -(x * x) : x * x);
+            sum_add(&sums[2], neg ? -y : y);
+            sum_add(&sums[3], neg ? -(y * y) : y * y);
+            sum_add(&sums[4], neg ? -(x * y) : x * y);
+            sum_add(&sums[5], neg ? -1 : 1);
+            phloat lnx;
+            if (x > 0) {
+                lnx = log(x);
+                sum_add(&sums[6], neg ? -lnx : lnx);
+                sum_add(&sums[7], neg ? -(lnx * lnx) : lnx * lnx);
+                sum_add(&sums[12], neg ? -(lnx * y) : lnx * y);
+            } else
+                lnx_bad = true;
+            if (y > 0) {
+                phloat lny = log(y);
+                sum_add(&sums[8], neg ? -lny : lny);
+                sum_add(&sums[9], neg ? -(lny * lny) : lny * lny);
+                sum_add(&sums[11], neg ? -(x * lny) : x * lny);
+                if (x > 0)
+                    sum_add(&sums[10], neg ? -(lnx * lny) : lnx * lny);
+            } else
+                lny_bad = true;
+        }
+    }
+
+    for (int4 i = 0; i < nregs; i++)
+        if (p_isinf(sums[i].s) != 0 || p_isnan(sums[i].s)) {
+            for (int4 j = 0; j < n; j++)
+                sigma_helper_2(sigmaregs, data[2 * j], data[2 * j + 1], weight);
+            return sum_result(&sigmaregs[5]);
+        }
+
+    for (int4 i = 0; i < nregs; i++)
+        sigmaregs[i] = sums[i];
+    if (n > 0) {
+        if (nregs == 6) {
+            flags.f.log_fit_invalid = 1;
+            flags.f.exp_fit_invalid = 1;
+            flags.f.pwr_fit_invalid = 1;
+        } else {
+            if (lnx_bad) {
+                flags.f.log_fit_invalid = 1;
+                flags.f.pwr_fit_invalid = 1;
+            }
+            if (lny_bad) {
+                flags.f.exp_fit_invalid = 1;
+                flags.f.pwr_fit_invalid = 1;
+            }
+        }
+    }
+    return sum_result(&sigmaregs[5]);
 }
 
-static int sigma_helper_1(int weight) {
-    /* Check if summation registers are OK */
+static void sigma_store(phloat *sigmaregs, const phloat_sum *sums, int4 n) {
+    for (int4 i = 0; i < n; i++) {
+        phloat s = sum_result(&sums[i]);
+        int inf;
+        if ((inf = p_isinf(s)) != 0)
+            s = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
+        sigmaregs[i] = s;
+    }
+}
+
+/* Checks that the summation registers exist and are all real numbers, and
+ * returns a pointer to the first one, and how many there are.
+ */
+static int sigma_regs(phloat **sigmaregs, int4 *nregs) {
     int4 first = mode_sigma_reg;
     int4 last = first + (flags.f.all_sigma ? 13 : 6);
     int4 size, i;
-    vartype *regs = recall_var("REGS", 4);
+    vartype *regs = recall_regs();
     vartype_realmatrix *r;
-    phloat *sigmaregs;
     if (regs == NULL)
         return ERR_SIZE_ERROR;
     if (regs->type != TYPE_REALMATRIX)
@@ -2061,11 +2154,55 @@ static int sigma_helper_1(int weight) {
     if (last > size)
         return ERR_SIZE_ERROR;
     for (i = first; i < last; i++)
-        if (r->array->is_string[i] != 0)
+        if (get_is_string(r->array, i) != 0)
             return ERR_ALPHA_DATA_IS_INVALID;
-    sigmaregs = r->array->data + first;
+    *sigmaregs = r->array->data + first;
+    *nregs = last - first;
+    touch_matrix(regs);
+    return ERR_NONE;
+}
 
-    /* All summation registers present, real-valued, non-string. */
+int sigma_begin(sigma_state *st) {
+    phloat *sigmaregs;
+    int err = sigma_regs(&sigmaregs, &st->nregs);
+    if (err != ERR_NONE)
+        return err;
+    for (int4 i = 0; i < st->nregs; i++) {
+        sum_init(&st->sums[i]);
+        st->sums[i].s = sigmaregs[i];
+    }
+    return ERR_NONE;
+}
+
+phloat sigma_add_points(sigma_state *st, const phloat *data, int4 n, int weight) {
+    return sigma_points(st->sums, st->nregs, data, n, weight);
+}
+
+void sigma_end(sigma_state *st) {
+    phloat *sigmaregs;
+    int4 nregs;
+    if (sigma_regs(&sigmaregs, &nregs) == ERR_NONE)
+        sigma_store(sigmaregs, st->sums, st->nregs);
+}
+
+static int sigma_helper_1(int weight) {
+    /* Check if summation registers are OK */
+    phloat *sigmaregs;
+    int4 nregs, i;
+    int err = sigma_regs(&sigmaregs, &nregs);
+    if (err != ERR_NONE)
+        return err;
+
+    /* All summation registers present, real-valued, non-string.
+     * The sums are accumulated with compensation while the data points
+     * are processed, and only rounded back into the registers at the end;
+     * this matters when a whole matrix of data points is added at once.
+     */
+    phloat_sum sums[13];
+    for (i = 0; i < nregs; i++) {
+        sum_init(&sums[i]);
+        sums[i].s = sigmaregs[i];
+    }
     if (stack[sp]->type == TYPE_REALMATRIX) {
         vartype_realmatrix *rm = (vartype_realmatrix *) stack[sp];
         vartype_real *x;
@@ -2073,16 +2210,53 @@ static int sigma_helper_1(int weight) {
         if (rm->columns != 2)
             return ERR_DIMENSION_ERROR;
         for (i = 0; i < rm->rows * 2; i++)
-            if (rm->array->is_string[i] != 0)
+            if (get_is_string(rm->array, i) != 0)
                 return ERR_ALPHA_DATA_IS_INVALID;
         x = (vartype_real *) new_real(0);
         if (x == NULL)
             return ERR_INSUFFICIENT_MEMORY;
-        for (i = 0; i < rm->rows; i++)
-            x->x = sigma_helper_2(sigmaregs,
-                                    rm->array->data[i * 2],
-                                    rm->array->data[i * 2 + 1],
-                                    weight);
+        x->x = sigma_points(sums, nregs, rm->array->data, rm->rows, weight);
+        sigma_store(sigmaregs, sums, nregs);
+        free_vartype(lastx);
+        lastx = stack[sp];
+        stack[sp] = (vartype *) x;
+        mode_disable_stack_lift = true;
+        return ERR_NONE;
+    } else if (stack[sp]->type == TYPE_LIST) {
+        // A list of {x y} pairs
+        vartype_list *list = (vartype_list *) stack[sp];
+        int4 n = list->size;
+        for (i = 0; i < n; i++) {
+            vartype *p = list->array->data[i];
+            if (p->type != TYPE_LIST)
+                return p->type == TYPE_STRING ? ERR_ALPHA_DATA_IS_INVALID
+                                              : ERR_INVALID_TYPE;
+            vartype_list *pair = (vartype_list *) p;
+            if (pair->size != 2)
+                return ERR_DIMENSION_ERROR;
+            for (int j = 0; j < 2; j++) {
+                int t = pair->array->data[j]->type;
+                if (t != TYPE_REAL)
+                    return t == TYPE_STRING ? ERR_ALPHA_DATA_IS_INVALID
+                                            : ERR_INVALID_TYPE;
+            }
+        }
+        phloat *data = (phloat *) malloc((n == 0 ? 1 : 2 * n) * sizeof(phloat));
+        if (data == NULL)
+            return ERR_INSUFFICIENT_MEMORY;
+        vartype_real *x = (vartype_real *) new_real(0);
+        if (x == NULL) {
+            free(data);
+            return ERR_INSUFFICIENT_MEMORY;
+        }
+        for (i = 0; i < n; i++) {
+            vartype **pair = ((vartype_list *) list->array->data[i])->array->data;
+            data[2 * i] = ((vartype_real *) pair[0])->x;
+            data[2 * i + 1] = ((vartype_real *) pair[1])->x;
+        }
+        x->x = sigma_points(sums, nregs, data, n, weight);
+        free(data);
+        sigma_store(sigmaregs, sums, nregs);
         free_vartype(lastx);
         lastx = stack[sp];
         stack[sp] = (vartype *) x;
@@ -2095,10 +2269,11 @@ static int sigma_helper_1(int weight) {
             if (x == NULL)
                 return ERR_INSUFFICIENT_MEMORY;
             phloat y = sp == 0 ? 0 : ((vartype_real *) stack[sp - 1])->x;
-            x->x = sigma_helper_2(sigmaregs,
+            x->x = sigma_helper_2(sums,
                                     ((vartype_real *) stack[sp])->x,
                                     y,
                                     weight);
+            sigma_store(sigmaregs, sums, nregs);
             free_vartype(lastx);
             lastx = stack[sp];
             stack[sp] = (vartype *) x;
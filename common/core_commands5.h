@@ -20,6 +20,22 @@
 
 #include "free42.h"
 #include "core_globals.h"
+#include "core_math2.h"
+
+/* Σ+ and Σ- on batches of (x, y) pairs, for core_sigma_csv(). sigma_begin()
+ * checks the summation registers and loads them into the accumulators;
+ * sigma_add_points() adds (weight 1) or subtracts (weight -1) n pairs, and
+ * returns the new count; sigma_end() rounds the sums back into the
+ * registers. Nothing is stored if sigma_end() isn't called.
+ */
+struct sigma_state {
+    phloat_sum sums[13];
+    int4 nregs;
+};
+
+int sigma_begin(sigma_state *st);
+phloat sigma_add_points(sigma_state *st, const phloat *data, int4 n, int weight);
+void sigma_end(sigma_state *st);
 
 int docmd_linf(arg_struct *arg);
 int docmd_logf(arg_struct *arg);
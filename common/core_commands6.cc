@@ -353,7 +353,7 @@ static int mappable_log_c(phloat xre, phloat xim, phloat *yre, phloat *yim) {
             *yim = 0;
         } else {
             *yre = log10(-xre);
-            *yim = PI / log(phloat(10.0));
+            *yim = PI / LN10_PHLOAT;
         }
         return ERR_NONE;
     } else if (xre == 0) {
@@ -367,7 +367,7 @@ static int mappable_log_c(phloat xre, phloat xim, phloat *yre, phloat *yim) {
         return ERR_NONE;
     } else {
         math_ln(xre, xim, yre, yim);
-        phloat s = log(phloat(10.0));
+        phloat s = LN10_PHLOAT;
         *yre /= s;
         *yim /= s;
         return ERR_NONE;
@@ -383,7 +383,7 @@ int docmd_log(arg_struct *arg) {
             if (flags.f.real_result_only)
                 return ERR_INVALID_DATA;
             else {
-                vartype *r = new_complex(log10(-x->x), PI / log(phloat(10.0)));
+                vartype *r = new_complex(log10(-x->x), PI / LN10_PHLOAT);
                 if (r == NULL)
                     return ERR_INSUFFICIENT_MEMORY;
                 else {
@@ -422,7 +422,7 @@ static int mappable_10_pow_x_r(phloat x, phloat *y) {
 static int mappable_10_pow_x_c(phloat xre, phloat xim, phloat *yre, phloat *yim){
     int inf;
     phloat h;
-    xim *= log(phloat(10.0));
+    xim *= LN10_PHLOAT;
     if ((inf = p_isinf(xim)) != 0)
         xim = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
     h = pow(10, xre);
@@ -468,6 +468,15 @@ static int mappable_ln_r(phloat x, phloat *y) {
     }
 }
 
+static bool batch_ln_r(const phloat *x, phloat *y, int4 n) {
+    bool ok = true;
+    for (int4 i = 0; i < n; i++) {
+        ok &= !(x[i] <= 0);
+        y[i] = log(x[i]);
+    }
+    return ok;
+}
+
 int docmd_ln(arg_struct *arg) {
     if (stack[sp]->type == TYPE_REAL) {
         vartype_real *x = (vartype_real *) stack[sp];
@@ -496,7 +505,7 @@ int docmd_ln(arg_struct *arg) {
         }
     } else {
         vartype *v;
-        int err = map_unary(stack[sp], &v, mappable_ln_r, math_ln);
+        int err = map_unary(stack[sp], &v, mappable_ln_r, math_ln, batch_ln_r);
         if (err == ERR_NONE)
             unary_result(v);
         return err;
@@ -513,6 +522,16 @@ static int mappable_e_pow_x_r(phloat x, phloat *y) {
     return ERR_NONE;
 }
 
+static bool batch_e_pow_x_r(const phloat *x, phloat *y, int4 n) {
+    bool ok = true;
+    for (int4 i = 0; i < n; i++) {
+        phloat r = exp(x[i]);
+        ok &= p_isinf(r) == 0;
+        y[i] = r;
+    }
+    return ok;
+}
+
 static int mappable_e_pow_x_c(phloat xre, phloat xim, phloat *yre, phloat *yim){
     phloat h = exp(xre);
     int inf = p_isinf(h);
@@ -542,7 +561,8 @@ static int mappable_e_pow_x_c(phloat xre, phloat xim, phloat *yre, phloat *yim){
 
 int docmd_e_pow_x(arg_struct *arg) {
     vartype *v;
-    int err = map_unary(stack[sp], &v, mappable_e_pow_x_r, mappable_e_pow_x_c);
+    int err = map_unary(stack[sp], &v, mappable_e_pow_x_r, mappable_e_pow_x_c,
+                                                            batch_e_pow_x_r);
     if (err == ERR_NONE)
         unary_result(v);
     return err;
@@ -557,6 +577,15 @@ static int mappable_sqrt_r(phloat x, phloat *y) {
     }
 }
 
+static bool batch_sqrt_r(const phloat *x, phloat *y, int4 n) {
+    bool ok = true;
+    for (int4 i = 0; i < n; i++) {
+        ok &= !(x[i] < 0);
+        y[i] = sqrt(x[i]);
+    }
+    return ok;
+}
+
 int docmd_sqrt(arg_struct *arg) {
     if (stack[sp]->type == TYPE_REAL) {
         phloat x = ((vartype_real *) stack[sp])->x;
@@ -573,7 +602,8 @@ int docmd_sqrt(arg_struct *arg) {
         return ERR_NONE;
     } else {
         vartype *v;
-        int err = map_unary(stack[sp], &v, mappable_sqrt_r, math_sqrt);
+        int err = map_unary(stack[sp], &v, mappable_sqrt_r, math_sqrt,
+                                                            batch_sqrt_r);
         if (err != ERR_NONE)
             return err;
         unary_result(v);
@@ -594,6 +624,16 @@ static int mappable_square_r(phloat x, phloat *y) {
     return ERR_NONE;
 }
 
+static bool batch_square_r(const phloat *x, phloat *y, int4 n) {
+    bool ok = true;
+    for (int4 i = 0; i < n; i++) {
+        phloat r = x[i] * x[i];
+        ok &= p_isinf(r) == 0;
+        y[i] = r;
+    }
+    return ok;
+}
+
 static int mappable_square_c(phloat xre, phloat xim, phloat *yre, phloat *yim) {
     phloat rre = xre * xre - xim * xim;
     phloat rim = 2 * xre * xim;
@@ -617,7 +657,8 @@ static int mappable_square_c(phloat xre, phloat xim, phloat *yre, phloat *yim) {
 
 int docmd_square(arg_struct *arg) {
     vartype *v;
-    int err = map_unary(stack[sp], &v, mappable_square_r, mappable_square_c);
+    int err = map_unary(stack[sp], &v, mappable_square_r, mappable_square_c,
+                                                            batch_square_r);
     if (err == ERR_NONE)
         unary_result(v);
     return err;
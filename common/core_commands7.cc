@@ -1072,6 +1072,8 @@ static int get_mat_or_list(arg_struct *arg, bool matrix, vartype **res, int4 *ro
         *res = recall_var(arg->val.text, arg->length);
         if (*res == NULL)
             return ERR_NONEXISTENT;
+        if (!materialize(*res))
+            return ERR_INSUFFICIENT_MEMORY;
     } else {
         return ERR_INTERNAL_ERROR;
     }
@@ -1114,7 +1116,7 @@ int docmd_getmi(arg_struct *arg) {
     int4 n = row * cols + col;
     if (v->type == TYPE_REALMATRIX) {
         vartype_realmatrix *rm = (vartype_realmatrix *) v;
-        if (rm->array->is_string[n] != 0) {
+        if (get_is_string(rm->array, n) != 0) {
             char *text;
             int4 length;
             get_matrix_string(rm, n, &text, &length);
@@ -1160,9 +1162,9 @@ int docmd_putmi(arg_struct *arg) {
     if (v->type == TYPE_REALMATRIX) {
         vartype_realmatrix *rm = (vartype_realmatrix *) v;
         if (stack[sp]->type == TYPE_REAL) {
-            if (rm->array->is_string[n] == 2)
+            if (get_is_string(rm->array, n) == 2)
                 free(*(void **) &rm->array->data[n]);
-            rm->array->is_string[n] = 0;
+            set_is_string(rm->array, n, 0);
             rm->array->data[n] = ((vartype_real *) stack[sp])->x;
         } else if (stack[sp]->type == TYPE_STRING) {
             vartype_string *s = (vartype_string *) stack[sp];
@@ -1944,7 +1946,7 @@ int docmd_head(arg_struct *arg) {
     vartype *s, *v;
     switch (arg->type) {
         case ARGTYPE_NUM: {
-            vartype *regs = recall_var("REGS", 4);
+            vartype *regs = recall_regs();
             if (regs == NULL)
                 return ERR_SIZE_ERROR;
             if (regs->type != TYPE_REALMATRIX)
@@ -1954,7 +1956,7 @@ int docmd_head(arg_struct *arg) {
             int4 n = arg->val.num;
             if (n >= sz)
                 return ERR_SIZE_ERROR;
-            if (rm->array->is_string[n] == 0)
+            if (get_is_string(rm->array, n) == 0)
                 return ERR_INVALID_TYPE;
             char *text;
             int len;
@@ -1631,40 +1631,46 @@ static int ext_stk_cat[] = {
 #if defined(ANDROID) || defined(IPHONE)
 #ifdef FREE42_FPTEST
 static int ext_misc_cat[] = {
-    CMD_A2LINE, CMD_A2PLINE, CMD_CAPS,   CMD_C_LN_1_X, CMD_C_E_POW_X_1, CMD_DYNAMIC,
-    CMD_FMA,    CMD_GETLI,   CMD_GETMI,  CMD_HEIGHT,   CMD_IDENT,       CMD_LOCK,
-    CMD_MIXED,  CMD_PCOMPLX, CMD_PRREG,  CMD_PUTLI,    CMD_PUTMI,       CMD_RCOMPLX,
-    CMD_STATIC, CMD_STRACE,  CMD_UNLOCK, CMD_WIDTH,    CMD_X2LINE,      CMD_ACCEL,
-    CMD_LOCAT,  CMD_HEADING, CMD_FPTEST, CMD_NULL,     CMD_NULL,        CMD_NULL
+    CMD_A2LINE, CMD_A2PLINE, CMD_CAPS,    CMD_C_LN_1_X, CMD_C_E_POW_X_1, CMD_COND,
+    CMD_DENSE,  CMD_DYNAMIC, CMD_FMA,     CMD_GETLI,    CMD_GETMI,       CMD_HEIGHT,
+    CMD_IDENT,  CMD_ISORT,   CMD_LOCK,    CMD_MIXED,    CMD_PCOMPLX,     CMD_PRREG,
+    CMD_PUTLI,  CMD_PUTMI,   CMD_RANFILL, CMD_RCOMPLX,  CMD_SORT,        CMD_SORTC,
+    CMD_SORTR,  CMD_SPARSE,  CMD_STATIC,  CMD_STRACE,   CMD_UNLOCK,      CMD_WIDTH,
+    CMD_X2LINE, CMD_ACCEL,   CMD_LOCAT,   CMD_HEADING,  CMD_FPTEST,      CMD_NULL
 };
-#define MISC_CAT_ROWS 5
+#define MISC_CAT_ROWS 6
 #else
 static int ext_misc_cat[] = {
-    CMD_A2LINE, CMD_A2PLINE, CMD_CAPS,   CMD_C_LN_1_X, CMD_C_E_POW_X_1, CMD_DYNAMIC,
-    CMD_FMA,    CMD_GETLI,   CMD_GETMI,  CMD_HEIGHT,   CMD_IDENT,       CMD_LOCK,
-    CMD_MIXED,  CMD_PCOMPLX, CMD_PRREG,  CMD_PUTLI,    CMD_PUTMI,       CMD_RCOMPLX,
-    CMD_STATIC, CMD_STRACE,  CMD_UNLOCK, CMD_WIDTH,    CMD_X2LINE,      CMD_ACCEL,
-    CMD_LOCAT,  CMD_HEADING, CMD_NULL,   CMD_NULL,     CMD_NULL,        CMD_NULL
+    CMD_A2LINE, CMD_A2PLINE, CMD_CAPS,    CMD_C_LN_1_X, CMD_C_E_POW_X_1, CMD_COND,
+    CMD_DENSE,  CMD_DYNAMIC, CMD_FMA,     CMD_GETLI,    CMD_GETMI,       CMD_HEIGHT,
+    CMD_IDENT,  CMD_ISORT,   CMD_LOCK,    CMD_MIXED,    CMD_PCOMPLX,     CMD_PRREG,
+    CMD_PUTLI,  CMD_PUTMI,   CMD_RANFILL, CMD_RCOMPLX,  CMD_SORT,        CMD_SORTC,
+    CMD_SORTR,  CMD_SPARSE,  CMD_STATIC,  CMD_STRACE,   CMD_UNLOCK,      CMD_WIDTH,
+    CMD_X2LINE, CMD_ACCEL,   CMD_LOCAT,   CMD_HEADING,  CMD_NULL,        CMD_NULL
 };
-#define MISC_CAT_ROWS 5
+#define MISC_CAT_ROWS 6
 #endif
 #else
 #ifdef FREE42_FPTEST
 static int ext_misc_cat[] = {
-    CMD_A2LINE, CMD_A2PLINE, CMD_CAPS,   CMD_C_LN_1_X, CMD_C_E_POW_X_1, CMD_DYNAMIC,
-    CMD_FMA,    CMD_GETLI,   CMD_GETMI,  CMD_HEIGHT,   CMD_IDENT,       CMD_LOCK,
-    CMD_MIXED,  CMD_PCOMPLX, CMD_PRREG,  CMD_PUTLI,    CMD_PUTMI,       CMD_RCOMPLX,
-    CMD_STATIC, CMD_STRACE,  CMD_UNLOCK, CMD_WIDTH,    CMD_X2LINE,      CMD_FPTEST
+    CMD_A2LINE, CMD_A2PLINE, CMD_CAPS,    CMD_C_LN_1_X, CMD_C_E_POW_X_1, CMD_COND,
+    CMD_DENSE,  CMD_DYNAMIC, CMD_FMA,     CMD_GETLI,    CMD_GETMI,       CMD_HEIGHT,
+    CMD_IDENT,  CMD_ISORT,   CMD_LOCK,    CMD_MIXED,    CMD_PCOMPLX,     CMD_PRREG,
+    CMD_PUTLI,  CMD_PUTMI,   CMD_RANFILL, CMD_RCOMPLX,  CMD_SORT,        CMD_SORTC,
+    CMD_SORTR,  CMD_SPARSE,  CMD_STATIC,  CMD_STRACE,   CMD_UNLOCK,      CMD_WIDTH,
+    CMD_X2LINE, CMD_FPTEST,  CMD_NULL,    CMD_NULL,     CMD_NULL,        CMD_NULL
 };
-#define MISC_CAT_ROWS 4
+#define MISC_CAT_ROWS 6
 #else
 static int ext_misc_cat[] = {
-    CMD_A2LINE, CMD_A2PLINE, CMD_CAPS,   CMD_C_LN_1_X, CMD_C_E_POW_X_1, CMD_DYNAMIC,
-    CMD_FMA,    CMD_GETLI,   CMD_GETMI,  CMD_HEIGHT,   CMD_IDENT,       CMD_LOCK,
-    CMD_MIXED,  CMD_PCOMPLX, CMD_PRREG,  CMD_PUTLI,    CMD_PUTMI,       CMD_RCOMPLX,
-    CMD_STATIC, CMD_STRACE,  CMD_UNLOCK, CMD_WIDTH,    CMD_X2LINE,      CMD_NULL
+    CMD_A2LINE, CMD_A2PLINE, CMD_CAPS,    CMD_C_LN_1_X, CMD_C_E_POW_X_1, CMD_COND,
+    CMD_DENSE,  CMD_DYNAMIC, CMD_FMA,     CMD_GETLI,    CMD_GETMI,       CMD_HEIGHT,
+    CMD_IDENT,  CMD_ISORT,   CMD_LOCK,    CMD_MIXED,    CMD_PCOMPLX,     CMD_PRREG,
+    CMD_PUTLI,  CMD_PUTMI,   CMD_RANFILL, CMD_RCOMPLX,  CMD_SORT,        CMD_SORTC,
+    CMD_SORTR,  CMD_SPARSE,  CMD_STATIC,  CMD_STRACE,   CMD_UNLOCK,      CMD_WIDTH,
+    CMD_X2LINE, CMD_NULL,    CMD_NULL,    CMD_NULL,     CMD_NULL,        CMD_NULL
 };
-#define MISC_CAT_ROWS 4
+#define MISC_CAT_ROWS 6
 #endif
 #endif
 
@@ -1841,6 +1847,7 @@ static void draw_catalog() {
                     break;
                 case TYPE_REALMATRIX:
                 case TYPE_COMPLEXMATRIX:
+                case TYPE_SPARSEMATRIX:
                     if (show_mat) vcount++;
                     break;
                 case TYPE_LIST:
@@ -1882,6 +1889,7 @@ static void draw_catalog() {
                     if (show_cpx) break; else continue;
                 case TYPE_REALMATRIX:
                 case TYPE_COMPLEXMATRIX:
+                case TYPE_SPARSEMATRIX:
                     if (show_mat) break; else continue;
                 case TYPE_LIST:
                     if (show_list) break; else continue;
@@ -2059,7 +2067,7 @@ void show() {
                 draw_string(0, 0, buf, bufptr);
                 draw_string(0, 1, "1:1=", 4);
                 bufptr = 0;
-                if (rm->array->is_string[0] != 0) {
+                if (get_is_string(rm->array, 0) != 0) {
                     char *text;
                     int4 len;
                     get_matrix_string(rm, 0, &text, &len);
@@ -2088,6 +2096,17 @@ void show() {
                 draw_string(4, 1, buf, bufptr);
                 break;
             }
+            case TYPE_SPARSEMATRIX: {
+                vartype_sparsematrix *sm = (vartype_sparsematrix *) rx;
+                bufptr = vartype2string(rx, buf, 22);
+                draw_string(0, 0, buf, bufptr);
+                draw_string(0, 1, "1:1=", 4);
+                bufptr = phloat2string(sparse_get(sm, 0, 0), buf, 18,
+                                       0, 0, 3,
+                                       flags.f.thousands_separators);
+                draw_string(4, 1, buf, bufptr);
+                break;
+            }
         }
     }
     flush_display();
@@ -814,8 +814,11 @@ bool no_keystrokes_yet;
  * Version 51: 3.3    BASE enhancements (menu additions)
  * Version 52: 3.3    BASE enhancements (carry; display modes)
  * Version 53: 3.3.3  STATIC/DYNAMIC for menus
+ * Version 54: 3.3.3  Sparse matrices
+ * Version 55: 3.3.3  Memory-mapped real matrices
+ * Version 56: 3.3.3  Calibrated matrix multiplication block size
  */
-#define FREE42_VERSION 53
+#define FREE42_VERSION 56
 
 
 /*******************/
@@ -983,11 +986,35 @@ static bool persist_vartype(vartype *v) {
             write_int4(columns);
             if (must_write) {
                 int size = rm->rows * rm->columns;
-                if (fwrite(rm->array->is_string, 1, size, gfile) != size)
+                // A matrix in a mapped file is saved as the file's name
+                const char *path = rm->array->nstrings == 0
+                                    ? matrix_map_save(rm->array->map, size,
+                                                      rm->array->generation)
+                                    : NULL;
+                if (!write_bool(path != NULL))
                     return false;
+                if (path != NULL) {
+                    int4 len = (int4) strlen(path);
+                    return write_int4(len)
+                        && fwrite(path, 1, len, gfile) == (size_t) len;
+                }
+                if (rm->array->is_string != NULL) {
+                    if (fwrite(rm->array->is_string, 1, size, gfile) != size)
+                        return false;
+                } else {
+                    // No strings; the file still gets one flag per element
+                    char zeros[1024];
+                    memset(zeros, 0, sizeof(zeros));
+                    for (int n = 0; n < size; n += (int) sizeof(zeros)) {
+                        int k = size - n < (int) sizeof(zeros) ? size - n : (int) sizeof(zeros);
+                        if (fwrite(zeros, 1, k, gfile) != k)
+                            return false;
+                    }
+                }
                 for (int i = 0; i < size; i++) {
-                    if (rm->array->is_string[i] == 0) {
-                        if (!write_phloat(rm->array->data[i]))
+                    if (get_is_string(rm->array, i) == 0) {
+                        // matrix_element(), since this may be chunked
+                        if (!write_phloat(*matrix_element(v, i)))
                             return false;
                     } else {
                         char *text;
@@ -1026,10 +1053,12 @@ static bool persist_vartype(vartype *v) {
             write_int4(rows);
             write_int4(columns);
             if (must_write) {
-                int size = 2 * cm->rows * cm->columns;
-                for (int i = 0; i < size; i++)
-                    if (!write_phloat(cm->array->data[i]))
+                int size = cm->rows * cm->columns;
+                for (int i = 0; i < size; i++) {
+                    phloat *p = matrix_element(v, i);
+                    if (!write_phloat(p[0]) || !write_phloat(p[1]))
                         return false;
+                }
             }
             return true;
         }
@@ -1061,6 +1090,45 @@ static bool persist_vartype(vartype *v) {
             }
             return true;
         }
+        case TYPE_SPARSEMATRIX: {
+            vartype_sparsematrix *sm = (vartype_sparsematrix *) v;
+            int4 rows = sm->rows;
+            int4 columns = sm->columns;
+            bool must_write = true;
+            if (sm->array->refcount > 1) {
+                int n = array_list_search(sm->array);
+                if (n == -1) {
+                    // A negative row count signals a new shared matrix
+                    rows = -rows;
+                    if (!array_list_grow())
+                        return false;
+                    array_list[array_count++] = sm->array;
+                } else {
+                    // A zero row count means this matrix shares its data
+                    // with a previously written matrix
+                    rows = 0;
+                    columns = n;
+                    must_write = false;
+                }
+            }
+            write_int4(rows);
+            write_int4(columns);
+            if (must_write) {
+                // Per row, the number of entries, followed by their
+                // column numbers and values
+                sparsematrix_data *sd = sm->array;
+                if (!write_int4(sd->nnz))
+                    return false;
+                for (int4 i = 0; i < sm->rows; i++) {
+                    if (!write_int4(sd->rowptr[i + 1] - sd->rowptr[i]))
+                        return false;
+                    for (int4 p = sd->rowptr[i]; p < sd->rowptr[i + 1]; p++)
+                        if (!write_int4(sd->colidx[p]) || !write_phloat(sd->data[p]))
+                            return false;
+                }
+            }
+            return true;
+        }
         default:
             /* Should not happen */
             return false;
@@ -1095,6 +1163,78 @@ int bug_mode;
 
 int4 ver;
 
+/* Loads a matrix that was saved as the name of its backing file. If the file
+ * belongs to this state file, it is simply mapped again; otherwise, or if
+ * it was written by the other of the binary and decimal versions, its
+ * contents are read into a new matrix.
+ */
+static vartype *unpersist_mapped_matrix(int4 rows, int4 columns) {
+    int4 len;
+    if (!read_int4(&len) || len <= 0 || len > 65536)
+        return NULL;
+    char *path = (char *) malloc(len + 1);
+    if (path == NULL)
+        return NULL;
+    if (fread(path, 1, len, gfile) != (size_t) len) {
+        free(path);
+        return NULL;
+    }
+    path[len] = 0;
+    int4 size = rows * columns;
+    vartype_realmatrix *rm = NULL;
+    matrix_map *map;
+    phloat *data = bin_dec_mode_switch() ? NULL : matrix_map_load(path, size, &map);
+    if (data != NULL) {
+        rm = (vartype_realmatrix *) malloc(sizeof(vartype_realmatrix));
+        realmatrix_data *array = (realmatrix_data *) malloc(sizeof(realmatrix_data));
+        if (rm == NULL || array == NULL) {
+            free(rm);
+            free(array);
+            matrix_data_free(data, map);
+            free(path);
+            return NULL;
+        }
+        rm->type = TYPE_REALMATRIX;
+        rm->rows = rows;
+        rm->columns = columns;
+        rm->array = array;
+        array->refcount = 1;
+        array->data = data;
+        array->is_string = NULL;
+        array->nstrings = 0;
+        array->cow_base = NULL;
+        array->cow_chunks = NULL;
+        array->map = map;
+        touch_matrix((vartype *) rm);
+        matrix_map_loaded(map, array->generation);
+    } else {
+        FILE *f = fopen(path, "rb");
+        if (f != NULL) {
+            rm = (vartype_realmatrix *) new_realmatrix(rows, columns);
+            if (rm != NULL) {
+                // Borrow gfile, so read_phloat() can do any conversion
+                FILE *saved_gfile = gfile;
+                gfile = f;
+                for (int4 i = 0; i < size; i++)
+                    if (!read_phloat(&rm->array->data[i])) {
+                        free_vartype((vartype *) rm);
+                        rm = NULL;
+                        break;
+                    }
+                // A file of the wrong size means the state is inconsistent
+                if (rm != NULL && getc(f) != EOF) {
+                    free_vartype((vartype *) rm);
+                    rm = NULL;
+                }
+                gfile = saved_gfile;
+            }
+            fclose(f);
+        }
+    }
+    free(path);
+    return (vartype *) rm;
+}
+
 static bool unpersist_vartype(vartype **v) {
     char type;
     if (!read_char(&type))
@@ -1164,11 +1304,29 @@ static bool unpersist_vartype(vartype **v) {
             bool shared = rows < 0;
             if (shared)
                 rows = -rows;
+            bool mapped = false;
+            if (ver >= 55 && !read_bool(&mapped))
+                return false;
+            if (mapped) {
+                vartype *m = unpersist_mapped_matrix(rows, columns);
+                if (m == NULL)
+                    return false;
+                if (shared) {
+                    if (!array_list_grow()) {
+                        free_vartype(m);
+                        return false;
+                    }
+                    array_list[array_count++] = m;
+                }
+                *v = m;
+                return true;
+            }
             vartype_realmatrix *rm = (vartype_realmatrix *) new_realmatrix(rows, columns);
             if (rm == NULL)
                 return false;
             int4 size = rows * columns;
-            if (fread(rm->array->is_string, 1, size, gfile) != size) {
+            if (!alloc_is_string(rm->array, size)
+                    || fread(rm->array->is_string, 1, size, gfile) != size) {
                 free_vartype((vartype *) rm);
                 return false;
             }
@@ -1250,6 +1408,13 @@ static bool unpersist_vartype(vartype **v) {
                 free_vartype((vartype *) rm);
                 return false;
             }
+            for (i = 0; i < size; i++)
+                if (rm->array->is_string[i] != 0)
+                    rm->array->nstrings++;
+            if (rm->array->nstrings == 0) {
+                free(rm->array->is_string);
+                rm->array->is_string = NULL;
+            }
             if (shared) {
                 if (!array_list_grow()) {
                     free_vartype((vartype *) rm);
@@ -1332,6 +1497,62 @@ static bool unpersist_vartype(vartype **v) {
             *v = (vartype *) list;
             return true;
         }
+        case TYPE_SPARSEMATRIX: {
+            int4 rows, columns, nnz;
+            if (!read_int4(&rows) || !read_int4(&columns))
+                return false;
+            if (rows == 0) {
+                // Shared matrix
+                if (columns < 0 || columns >= array_count)
+                    return false;
+                vartype *m = dup_vartype((vartype *) array_list[columns]);
+                if (m == NULL)
+                    return false;
+                else {
+                    *v = m;
+                    return true;
+                }
+            }
+            bool shared = rows < 0;
+            if (shared)
+                rows = -rows;
+            if (columns <= 0 || !read_int4(&nnz) || nnz < 0)
+                return false;
+            vartype_sparsematrix *sm = (vartype_sparsematrix *) new_sparsematrix(rows, columns, nnz);
+            if (sm == NULL)
+                return false;
+            sparsematrix_data *sd = sm->array;
+            for (int4 i = 0; i < rows; i++) {
+                int4 count;
+                if (!read_int4(&count) || count < 0 || count > nnz - sd->nnz) {
+                    free_vartype((vartype *) sm);
+                    return false;
+                }
+                // The kernels rely on the column indices being in range and
+                // strictly increasing within each row
+                int4 prev = -1;
+                for (int4 k = 0; k < count; k++) {
+                    int4 j;
+                    if (!read_int4(&j) || j <= prev || j >= columns
+                            || !read_phloat(&sd->data[sd->nnz])) {
+                        free_vartype((vartype *) sm);
+                        return false;
+                    }
+                    sd->colidx[sd->nnz++] = j;
+                    prev = j;
+                }
+                sd->rowptr[i + 1] = sd->nnz;
+            }
+            if (shared) {
+                if (!array_list_grow()) {
+                    free_vartype((vartype *) sm);
+                    return false;
+                }
+                array_list[array_count++] = sm;
+            }
+            *v = (vartype *) sm;
+            return true;
+        }
         default:
             return false;
     }
@@ -3872,6 +4093,7 @@ static bool load_state2(bool *clear, bool *too_new) {
     if (!read_bool(&bdummy)) return false;
     if (!read_bool(&bdummy)) return false;
     if (!read_bool(&bdummy)) return false;
+    if (ver >= 56 && !read_int(&core_settings.matrix_block_size)) return false;
 
     if (!read_bool(&mode_clall)) return false;
     if (!read_bool(&mode_command_entry)) return false;
@@ -4074,6 +4296,7 @@ void save_state(bool *success) {
     if (!write_bool(core_settings.matrix_singularmatrix)) return;
     if (!write_bool(core_settings.matrix_outofrange)) return;
     if (!write_bool(core_settings.auto_repeat)) return;
+    if (!write_int(core_settings.matrix_block_size)) return;
     if (!write_bool(mode_clall)) return;
     if (!write_bool(mode_command_entry)) return;
     if (!write_char(mode_number_entry)) return;
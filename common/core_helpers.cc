@@ -32,7 +32,7 @@ int resolve_ind_arg(arg_struct *arg, char *buf, int *buflen) {
     vartype *v;
     switch (arg->type) {
         case ARGTYPE_IND_NUM: {
-            vartype *regs = recall_var("REGS", 4);
+            vartype *regs = recall_regs();
             if (regs == NULL)
                 return ERR_SIZE_ERROR;
             if (regs->type != TYPE_REALMATRIX)
@@ -43,7 +43,7 @@ int resolve_ind_arg(arg_struct *arg, char *buf, int *buflen) {
                 int4 num = arg->val.num;
                 if (num >= size)
                     return ERR_SIZE_ERROR;
-                if (rm->array->is_string[num] == 0) {
+                if (get_is_string(rm->array, num) == 0) {
                     phloat x = rm->array->data[num];
                     if (x < 0)
                         x = -x;
@@ -369,17 +369,17 @@ phloat rad_to_angle(phloat x) {
     if (flags.f.rad)
         return x;
     else if (flags.f.grad)
-        return x * (200 / PI);
+        return x * RAD_TO_GRAD_PHLOAT;
     else
-        return x * (180 / PI);
+        return x * RAD_TO_DEG_PHLOAT;
 }
 
 phloat rad_to_deg(phloat x) {
-    return x * (180 / PI);
+    return x * RAD_TO_DEG_PHLOAT;
 }
 
 phloat deg_to_rad(phloat x) {
-    return x / (180 / PI);
+    return x / RAD_TO_DEG_PHLOAT;
 }
 
 void append_alpha_char(char c) {
@@ -488,8 +488,8 @@ bool vartype_equals(const vartype *v1, const vartype *v2) {
                 return false;
             sz = x->rows * x->columns;
             for (i = 0; i < sz; i++) {
-                int xstr = x->array->is_string[i];
-                int ystr = y->array->is_string[i];
+                int xstr = get_is_string(x->array, i);
+                int ystr = get_is_string(y->array, i);
                 if (xstr != ystr)
                     return false;
                 if (xstr == 0) {
@@ -540,6 +540,25 @@ bool vartype_equals(const vartype *v1, const vartype *v2) {
                     return false;
             return true;
         }
+        case TYPE_SPARSEMATRIX: {
+            const vartype_sparsematrix *x = (const vartype_sparsematrix *) v1;
+            const vartype_sparsematrix *y = (const vartype_sparsematrix *) v2;
+            if (x->array == y->array)
+                return true;
+            if (x->rows != y->rows || x->columns != y->columns
+                    || x->array->nnz != y->array->nnz)
+                return false;
+            // Only nonzero elements are stored, in a fixed order, so equal
+            // matrices have identical arrays.
+            for (int4 i = 0; i <= x->rows; i++)
+                if (x->array->rowptr[i] != y->array->rowptr[i])
+                    return false;
+            for (int4 p = 0; p < x->array->nnz; p++)
+                if (x->array->colidx[p] != y->array->colidx[p]
+                        || x->array->data[p] != y->array->data[p])
+                    return false;
+            return true;
+        }
         default:
             /* Looks like someone added a type that we're not handling yet! */
             return false;
@@ -955,14 +974,69 @@ int effective_wsize() {
 #endif
 }
 
+/* Conversions between phloat and the BASE integer representation are cached,
+ * so that loops that keep feeding the results of BASE operations back into
+ * further BASE operations don't pay for a phloat->integer conversion every
+ * time; in the decimal build, phloat2base() costs several BID128 operations,
+ * including pow() and fmod(). Entries are keyed on the exact bit pattern of
+ * the phloat, and tagged with the word size and signed/wrap flags that were
+ * in effect when they were created, so changing any of those simply causes
+ * cache misses. Only values that are within range for the current word size
+ * are ever cached, so for those, phloat2base(base2phloat(n)) == n.
+ */
+
+#define BASE_CACHE_SIZE 16
+
+struct base_cache_entry {
+    phloat p;
+    int8 n;
+    int mode;
+};
+
+static base_cache_entry base_cache[BASE_CACHE_SIZE];
+
+static int base_cache_mode() {
+    // Never 0, so zero-initialized entries never match
+    return effective_wsize()
+            | (flags.f.base_signed ? 0x100 : 0)
+            | (flags.f.base_wrap ? 0x200 : 0);
+}
+
+static int base_cache_index(phloat p) {
+    uint8 h;
+    memcpy(&h, &p, sizeof(h));
+    h ^= h >> 29;
+    h ^= h >> 13;
+    return (int) (h & (BASE_CACHE_SIZE - 1));
+}
+
+static void base_cache_put(phloat p, int8 n) {
+    int8 m = n;
+    base_range_check(&m, true);
+    if (m != n)
+        return;
+    base_cache_entry *e = base_cache + base_cache_index(p);
+    e->p = p;
+    e->n = n;
+    e->mode = base_cache_mode();
+}
+
 phloat base2phloat(int8 n) {
+    phloat p;
     if (flags.f.base_signed)
-        return phloat(n);
+        p = phloat(n);
     else
-        return phloat((uint8) n);
+        p = phloat((uint8) n);
+    base_cache_put(p, n);
+    return p;
 }
 
 bool phloat2base(phloat p, int8 *res) {
+    base_cache_entry *e = base_cache + base_cache_index(p);
+    if (e->mode == base_cache_mode() && memcmp(&e->p, &p, sizeof(phloat)) == 0) {
+        *res = e->n;
+        return true;
+    }
     int wsize = effective_wsize();
     if (flags.f.base_wrap) {
         phloat ip = p < 0 ? -floor(-p) : floor(p);
@@ -1002,6 +1076,7 @@ bool phloat2base(phloat p, int8 *res) {
             return false;
         *res = (int8) to_uint8(p);
     }
+    base_cache_put(p, *res);
     return true;
 }
 
@@ -1307,84 +1382,66 @@ void generic_p2r(phloat r, phloat phi, phloat *re, phloat *im) {
     *im = r * tim;
 }
 
-static phloat sin_or_cos_deg(phloat x, bool do_sin) {
+/* Shared argument reduction for SIN and COS in DEG and GRAD modes. 'full' is
+ * the number of angle units in a full circle (360 or 400), and 'scale' is the
+ * number of angle units per radian. Arguments that are already in the first
+ * octant, which is the common case in practice, skip the reduction entirely.
+ */
+static phloat sin_or_cos_reduced(phloat x, bool do_sin, int full, phloat scale) {
     bool neg = false;
     if (x < 0) {
         x = -x;
         if (do_sin)
             neg = true;
     }
-    x = fmod(x, 360);
-    if (x >= 180) {
-        x -= 180;
+    int half = full / 2;
+    int quarter = full / 4;
+    int eighth = full / 8;
+    if (x < eighth) {
+        phloat r = x / scale;
+        r = do_sin ? sin(r) : cos(r);
+        return neg ? -r : r;
+    }
+    if (x >= full)
+        x = fmod(x, full);
+    if (x >= half) {
+        x -= half;
         neg = !neg;
     }
-    if (x >= 90) {
-        x -= 90;
+    if (x >= quarter) {
+        x -= quarter;
         do_sin = !do_sin;
         if (do_sin)
             neg = !neg;
     }
     phloat r;
-    if (x == 45)
-        r = sqrt(phloat(0.5));
+    if (x == eighth)
+        r = SQRT_HALF_PHLOAT;
     else {
-        if (x > 45) {
-            x = 90 - x;
+        if (x > eighth) {
+            x = quarter - x;
             do_sin = !do_sin;
         }
-        x /= 180 / PI;
+        x /= scale;
         r = do_sin ? sin(x) : cos(x);
     }
     return neg ? -r : r;
 }
 
 phloat sin_deg(phloat x) {
-    return sin_or_cos_deg(x, true);
+    return sin_or_cos_reduced(x, true, 360, RAD_TO_DEG_PHLOAT);
 }
 
 phloat cos_deg(phloat x) {
-    return sin_or_cos_deg(x, false);
-}
-
-static phloat sin_or_cos_grad(phloat x, bool do_sin) {
-    bool neg = false;
-    if (x < 0) {
-        x = -x;
-        if (do_sin)
-            neg = true;
-    }
-    x = fmod(x, 400);
-    if (x >= 200) {
-        x -= 200;
-        neg = !neg;
-    }
-    if (x >= 100) {
-        x -= 100;
-        do_sin = !do_sin;
-        if (do_sin)
-            neg = !neg;
-    }
-    phloat r;
-    if (x == 50)
-        r = sqrt(phloat(0.5));
-    else {
-        if (x > 50) {
-            x = 100 - x;
-            do_sin = !do_sin;
-        }
-        x /= 200 / PI;
-        r = do_sin ? sin(x) : cos(x);
-    }
-    return neg ? -r : r;
+    return sin_or_cos_reduced(x, false, 360, RAD_TO_DEG_PHLOAT);
 }
 
 phloat sin_grad(phloat x) {
-    return sin_or_cos_grad(x, true);
+    return sin_or_cos_reduced(x, true, 400, RAD_TO_GRAD_PHLOAT);
 }
 
 phloat cos_grad(phloat x) {
-    return sin_or_cos_grad(x, false);
+    return sin_or_cos_reduced(x, false, 400, RAD_TO_GRAD_PHLOAT);
 }
 
 int dimension_array(const char *name, int namelen, int4 rows, int4 columns, bool check_matedit) {
@@ -1406,6 +1463,7 @@ int dimension_array(const char *name, int namelen, int4 rows, int4 columns, bool
     int4 size = rows * columns;
     if (matrix == NULL || (matrix->type != TYPE_REALMATRIX
                         && matrix->type != TYPE_COMPLEXMATRIX
+                        && matrix->type != TYPE_SPARSEMATRIX
                         && matrix->type != TYPE_LIST)) {
         vartype *newmatrix;
         if (size == 0)
@@ -1424,13 +1482,23 @@ int dimension_array(const char *name, int namelen, int4 rows, int4 columns, bool
         return dimension_array_ref(matrix, rows, columns);
 }
 
+/* Grows a matrix data array from oldsize to newsize elements, zeroing the
+ * new ones. Returns NULL, leaving the old array alone, if there isn't
+ * enough memory. All-zero bits are a valid zero both as a double and as a
+ * BID128 (see new_realmatrix()), so when the array more than doubles, it is
+ * cheaper to get a fresh zeroed block from calloc() and copy the old
+ * contents, than to realloc() and then clear the whole new tail.
+ */
 int dimension_array_ref(vartype *matrix, int4 rows, int4 columns) {
     int4 size = rows * columns;
+    if (!materialize(matrix))
+        return ERR_INSUFFICIENT_MEMORY;
     if (matrix->type == TYPE_REALMATRIX) {
         vartype_realmatrix *oldmatrix = (vartype_realmatrix *) matrix;
         if (oldmatrix->rows == rows && oldmatrix->columns == columns)
             return ERR_NONE;
         if (oldmatrix->array->refcount == 1) {
+            touch_matrix(matrix);
             int4 oldsize = oldmatrix->rows * oldmatrix->columns;
             if (size == oldsize) {
                 /* Easy case! */
@@ -1444,13 +1512,23 @@ int dimension_array_ref(vartype *matrix, int4 rows, int4 columns) {
                  * shrinking, but that is easy to handle by simply hanging onto
                  * the existing block.
                  */
-                free_long_strings(oldmatrix->array->is_string + size, oldmatrix->array->data + size, oldsize - size);
-                char *new_is_string = (char *) realloc(oldmatrix->array->is_string, size);
-                if (new_is_string != NULL)
-                    oldmatrix->array->is_string = new_is_string;
-                phloat *new_data = (phloat *) realloc((void *) oldmatrix->array->data, size * sizeof(phloat));
-                if (new_data != NULL)
-                    oldmatrix->array->data = new_data;
+                realmatrix_data *a = oldmatrix->array;
+                if (a->is_string != NULL) {
+                    free_long_strings(a->is_string + size, a->data + size, oldsize - size);
+                    for (int4 i = size; i < oldsize; i++)
+                        if (a->is_string[i] != 0)
+                            a->nstrings--;
+                    if (a->nstrings == 0) {
+                        free(a->is_string);
+                        a->is_string = NULL;
+                    } else {
+                        char *new_is_string = (char *) realloc(a->is_string, size);
+                        if (new_is_string != NULL)
+                            a->is_string = new_is_string;
+                    }
+                }
+                oldmatrix->array->data = matrix_data_resize(oldmatrix->array->data,
+                                    &oldmatrix->array->map, oldsize, size);
                 oldmatrix->rows = rows;
                 oldmatrix->columns = columns;
                 return ERR_NONE;
@@ -1462,23 +1540,28 @@ int dimension_array_ref(vartype *matrix, int4 rows, int4 columns) {
              * call fails, I might be unable to roll back the first.
              * So, playing safe -- shouldn't be too big a handicap since
              * 'is_string' is a lot smaller than 'data', so the transient
-             * memory overhead is only about 12.5%.
+             * memory overhead is only about 12.5%. Matrices without
+             * strings have no 'is_string' array at all, so for those, this
+             * is just the matrix_data_resize().
              */
-            char *new_is_string = (char *) malloc(size);
-            if (new_is_string == NULL)
-                return ERR_INSUFFICIENT_MEMORY;
-            phloat *new_data = (phloat *) realloc((void *) oldmatrix->array->data, size * sizeof(phloat));
+            char *new_is_string = NULL;
+            if (oldmatrix->array->is_string != NULL) {
+                new_is_string = (char *) malloc(size);
+                if (new_is_string == NULL)
+                    return ERR_INSUFFICIENT_MEMORY;
+            }
+            phloat *new_data = matrix_data_resize(oldmatrix->array->data,
+                                    &oldmatrix->array->map, oldsize, size);
             if (new_data == NULL) {
                 free(new_is_string);
                 return ERR_INSUFFICIENT_MEMORY;
             }
-            memcpy(new_is_string, oldmatrix->array->is_string, oldsize);
-            for (int4 i = oldsize; i < size; i++) {
-                new_is_string[i] = 0;
-                new_data[i] = 0;
+            if (new_is_string != NULL) {
+                memcpy(new_is_string, oldmatrix->array->is_string, oldsize);
+                memset(new_is_string + oldsize, 0, size - oldsize);
+                free(oldmatrix->array->is_string);
+                oldmatrix->array->is_string = new_is_string;
             }
-            free(oldmatrix->array->is_string);
-            oldmatrix->array->is_string = new_is_string;
             oldmatrix->array->data = new_data;
             oldmatrix->rows = rows;
             oldmatrix->columns = columns;
@@ -1495,43 +1578,57 @@ int dimension_array_ref(vartype *matrix, int4 rows, int4 columns) {
             new_array = (realmatrix_data *) malloc(sizeof(realmatrix_data));
             if (new_array == NULL)
                 return ERR_INSUFFICIENT_MEMORY;
-            new_array->data = (phloat *) malloc(size * sizeof(phloat));
-            if (new_array->data == NULL) {
-                free(new_array);
-                return ERR_INSUFFICIENT_MEMORY;
+            if (oldmatrix->array->is_string == NULL)
+                new_array->data = matrix_data_alloc(size, &new_array->map);
+            else {
+                new_array->data = (phloat *) calloc(size, sizeof(phloat));
+                new_array->map = NULL;
             }
-            new_array->is_string = (char *) malloc(size);
-            if (new_array->is_string == NULL) {
-                nomem:
-                free(new_array->data);
+            if (new_array->data == NULL) {
                 free(new_array);
                 return ERR_INSUFFICIENT_MEMORY;
             }
             oldsize = oldmatrix->rows * oldmatrix->columns;
             s = oldsize < size ? oldsize : size;
-            for (i = 0; i < s; i++) {
-                new_array->is_string[i] = oldmatrix->array->is_string[i];
-                if (oldmatrix->array->is_string[i] == 2) {
-                    int4 *sp = *(int4 **) &oldmatrix->array->data[i];
-                    int4 *dp = (int4 *) malloc(*sp + 4);
-                    if (dp == NULL) {
-                        free_long_strings(new_array->is_string, new_array->data, i);
-                        free(new_array->is_string);
-                        goto nomem;
+            new_array->is_string = NULL;
+            new_array->nstrings = 0;
+            if (oldmatrix->array->is_string == NULL) {
+                memcpy((void *) new_array->data, (const void *) oldmatrix->array->data, s * sizeof(phloat));
+            } else {
+                new_array->is_string = (char *) malloc(size);
+                if (new_array->is_string == NULL) {
+                    nomem:
+                    free(new_array->data);
+                    free(new_array);
+                    return ERR_INSUFFICIENT_MEMORY;
+                }
+                for (i = 0; i < s; i++) {
+                    new_array->is_string[i] = oldmatrix->array->is_string[i];
+                    if (new_array->is_string[i] != 0)
+                        new_array->nstrings++;
+                    if (new_array->is_string[i] == 2) {
+                        int4 *sp = *(int4 **) &oldmatrix->array->data[i];
+                        int4 *dp = (int4 *) malloc(*sp + 4);
+                        if (dp == NULL) {
+                            free_long_strings(new_array->is_string, new_array->data, i);
+                            free(new_array->is_string);
+                            goto nomem;
+                        }
+                        memcpy(dp, sp, *sp + 4);
+                        *(int4 **) &new_array->data[i] = dp;
+                    } else {
+                        new_array->data[i] = oldmatrix->array->data[i];
                     }
-                    memcpy(dp, sp, *sp + 4);
-                    *(int4 **) &new_array->data[i] = dp;
-                } else {
-                    new_array->data[i] = oldmatrix->array->data[i];
                 }
-            }
-            for (i = s; i < size; i++) {
-                new_array->is_string[i] = 0;
-                new_array->data[i] = 0;
+                for (i = s; i < size; i++)
+                    new_array->is_string[i] = 0;
             }
             new_array->refcount = 1;
+            new_array->cow_base = NULL;
+            new_array->cow_chunks = NULL;
             oldmatrix->array->refcount--;
             oldmatrix->array = new_array;
+            touch_matrix(matrix);
             oldmatrix->rows = rows;
             oldmatrix->columns = columns;
             return ERR_NONE;
@@ -1541,17 +1638,18 @@ int dimension_array_ref(vartype *matrix, int4 rows, int4 columns) {
         if (oldmatrix->rows == rows && oldmatrix->columns == columns)
             return ERR_NONE;
         if (oldmatrix->array->refcount == 1) {
+            touch_matrix(matrix);
             /* Since there are no shared references to this array,
              * I can modify it in place using a realloc().
              */
-            int4 i, oldsize;
-            phloat *new_data = (phloat *)
-                    realloc((void *) oldmatrix->array->data, 2 * size * sizeof(phloat));
+            int4 oldsize = oldmatrix->rows * oldmatrix->columns;
+            phloat *new_data;
+            if (size > oldsize)
+                new_data = grow_data(oldmatrix->array->data, 2 * oldsize, 2 * size);
+            else
+                new_data = (phloat *) realloc((void *) oldmatrix->array->data, 2 * size * sizeof(phloat));
             if (new_data == NULL)
                 return ERR_INSUFFICIENT_MEMORY;
-            oldsize = oldmatrix->rows * oldmatrix->columns;
-            for (i = 2 * oldsize; i < 2 * size; i++)
-                new_data[i] = 0;
             oldmatrix->array->data = new_data;
             oldmatrix->rows = rows;
             oldmatrix->columns = columns;
@@ -1569,7 +1667,7 @@ int dimension_array_ref(vartype *matrix, int4 rows, int4 columns) {
                                         malloc(sizeof(complexmatrix_data));
             if (new_array == NULL)
                 return ERR_INSUFFICIENT_MEMORY;
-            new_array->data = (phloat *) malloc(2 * size * sizeof(phloat));
+            new_array->data = (phloat *) calloc(2 * size, sizeof(phloat));
             if (new_array->data == NULL) {
                 free(new_array);
                 return ERR_INSUFFICIENT_MEMORY;
@@ -1578,15 +1676,56 @@ int dimension_array_ref(vartype *matrix, int4 rows, int4 columns) {
             s = oldsize < size ? oldsize : size;
             for (i = 0; i < 2 * s; i++)
                 new_array->data[i] = oldmatrix->array->data[i];
-            for (i = 2 * s; i < 2 * size; i++)
-                new_array->data[i] = 0;
             new_array->refcount = 1;
+            new_array->cow_base = NULL;
+            new_array->cow_chunks = NULL;
             oldmatrix->array->refcount--;
             oldmatrix->array = new_array;
+            touch_matrix(matrix);
             oldmatrix->rows = rows;
             oldmatrix->columns = columns;
             return ERR_NONE;
         }
+    } else if (matrix->type == TYPE_SPARSEMATRIX) {
+        vartype_sparsematrix *sm = (vartype_sparsematrix *) matrix;
+        if (sm->rows == rows && sm->columns == columns)
+            return ERR_NONE;
+        if (!disentangle(matrix))
+            return ERR_INSUFFICIENT_MEMORY;
+        /* Like dense matrices, elements keep their positions in row-major
+         * order. Entries are stored in that order, so each one only needs
+         * its row and column recomputed, and the ones past the new size
+         * are dropped.
+         */
+        sparsematrix_data *sd = sm->array;
+        int4 *newptr = (int4 *) malloc((rows + 1) * sizeof(int4));
+        if (newptr == NULL)
+            return ERR_INSUFFICIENT_MEMORY;
+        int8 newsize = ((int8) rows) * columns;
+        int4 r = 0, nnz = 0;
+        newptr[0] = 0;
+        for (int4 i = 0; i < sm->rows; i++) {
+            for (int4 p = sd->rowptr[i]; p < sd->rowptr[i + 1]; p++) {
+                int8 n = ((int8) i) * sm->columns + sd->colidx[p];
+                if (n >= newsize)
+                    goto done;
+                int4 ni = (int4) (n / columns);
+                while (r < ni)
+                    newptr[++r] = nnz;
+                sd->colidx[nnz] = (int4) (n % columns);
+                sd->data[nnz] = sd->data[p];
+                nnz++;
+            }
+        }
+        done:
+        while (r < rows)
+            newptr[++r] = nnz;
+        free(sd->rowptr);
+        sd->rowptr = newptr;
+        sd->nnz = nnz;
+        sm->rows = rows;
+        sm->columns = columns;
+        return ERR_NONE;
     } else /* matrix->type == TYPE_LIST */ {
         if (columns != 1)
             return ERR_DIMENSION_ERROR;
@@ -1866,6 +2005,20 @@ int vartype2string(const vartype *v, char *buf, int buflen, int max_mant_digits)
             return chars_so_far;
         }
 
+        case TYPE_SPARSEMATRIX: {
+            vartype_sparsematrix *m = (vartype_sparsematrix *) v;
+            int i;
+            int chars_so_far = 0;
+            string2buf(buf, buflen, &chars_so_far, "[ ", 2);
+            i = int2string(m->rows, buf + chars_so_far, buflen - chars_so_far);
+            chars_so_far += i;
+            char2buf(buf, buflen, &chars_so_far, 'x');
+            i = int2string(m->columns, buf + chars_so_far, buflen - chars_so_far);
+            chars_so_far += i;
+            string2buf(buf, buflen, &chars_so_far, " Sparse ]", 9);
+            return chars_so_far;
+        }
+
         case TYPE_STRING: {
             vartype_string *s = (vartype_string *) v;
             int i;
@@ -2034,7 +2187,7 @@ int ip2revstring(phloat d, char *buf, int buflen) {
     return bufpos;
 }
 
-int matedit_get(vartype **res) {
+int matedit_get(vartype **res, bool sparse_ok, bool chunked_ok) {
     if (matedit_mode == 0)
         return ERR_NONEXISTENT;
 
@@ -2074,7 +2227,8 @@ int matedit_get(vartype **res) {
         m = list->array->data[matedit_stack[i]];
     }
 
-    if (m->type != TYPE_REALMATRIX && m->type != TYPE_COMPLEXMATRIX && m->type != TYPE_LIST) {
+    if (m->type != TYPE_REALMATRIX && m->type != TYPE_COMPLEXMATRIX && m->type != TYPE_LIST
+            && (m->type != TYPE_SPARSEMATRIX || !sparse_ok)) {
         err = matedit_stack_depth == 0 ? ERR_INVALID_TYPE : ERR_INVALID_DATA;
         goto bad_matrix;
     }
@@ -2089,6 +2243,10 @@ int matedit_get(vartype **res) {
         vartype_complexmatrix *cm = (vartype_complexmatrix *) m;
         if (matedit_i >= cm->rows || matedit_j >= cm->columns)
             matedit_i = matedit_j = 0;
+    } else if (m->type == TYPE_SPARSEMATRIX) {
+        vartype_sparsematrix *sm = (vartype_sparsematrix *) m;
+        if (matedit_i >= sm->rows || matedit_j >= sm->columns)
+            matedit_i = matedit_j = 0;
     } else { // m->type == TYPE_LIST
         vartype_list *list = (vartype_list *) m;
         if (matedit_i >= list->size)
@@ -2096,6 +2254,10 @@ int matedit_get(vartype **res) {
         matedit_j = 0;
     }
 
+    // Only the element commands know how to deal with chunked matrices
+    if (!chunked_ok && !materialize(m))
+        return ERR_INSUFFICIENT_MEMORY;
+
     *res = m;
     return ERR_NONE;
 }
@@ -16,6 +16,7 @@
  *****************************************************************************/
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "core_globals.h"
 #include "core_linalg1.h"
@@ -24,6 +25,190 @@
 #include "core_math2.h"
 #include "core_sto_rcl.h"
 #include "core_variables.h"
+#include "shell.h"
+
+
+/************************************/
+/***** Cached LU decompositions *****/
+/************************************/
+
+/* Matrix division, INVRT, and DET all start by LU-decomposing a square
+ * matrix, and programs tend to apply several of them to the same one: DET
+ * followed by INVRT, or a series of right-hand sides solved against an
+ * unchanged MATA. So, the last few decompositions are kept around, keyed by
+ * the identity and generation of the data array they were made from (see
+ * touch_matrix() in core_variables.cc), and a repeated operation only has
+ * to do the back substitution.
+ * What the decomposition does with zero pivots depends on the 'singular
+ * matrix' error mode. A decomposition that was made with that mode on, and
+ * ran to completion without hitting a zero pivot, is what it would have
+ * been with the mode off, so it can be used either way; otherwise, the mode
+ * has to match.
+ */
+
+#define LU_CACHE_SIZE 2
+
+struct lu_cache_entry {
+    const void *array;
+    uint8 generation;
+    bool singularmatrix;
+    int error;
+    vartype *lu;
+    int4 *perm;
+    phloat det_re, det_im;
+    phloat growth;
+};
+
+static lu_cache_entry lu_cache[LU_CACHE_SIZE];
+
+static const void *lu_pending_array;
+static uint8 lu_pending_generation;
+static int (*lu_pending_completion_r)(int, vartype_realmatrix *, int4 *,
+                                    phloat);
+static int (*lu_pending_completion_c)(int, vartype_complexmatrix *, int4 *,
+                                    phloat, phloat);
+
+static lu_cache_entry *lu_cache_lookup(const void *array, uint8 generation) {
+    bool sm = core_settings.matrix_singularmatrix;
+    for (int i = 0; i < LU_CACHE_SIZE; i++) {
+        lu_cache_entry *e = lu_cache + i;
+        if (e->lu == NULL || e->array != array || e->generation != generation)
+            continue;
+        if (e->singularmatrix != sm && !(e->singularmatrix
+                && e->error == ERR_NONE && (e->det_re != 0 || e->det_im != 0)))
+            continue;
+        if (i > 0) {
+            lu_cache_entry t = *e;
+            for (; i > 0; i--)
+                lu_cache[i] = lu_cache[i - 1];
+            lu_cache[0] = t;
+        }
+        return lu_cache;
+    }
+    return NULL;
+}
+
+static void lu_cache_store(vartype *lu, int4 *perm, int error,
+                                    phloat det_re, phloat det_im, phloat growth) {
+    /* Replace an older decomposition of the same array, if there is one,
+     * or else the least recently used one.
+     */
+    int i;
+    for (i = 0; i < LU_CACHE_SIZE - 1; i++)
+        if (lu_cache[i].array == lu_pending_array
+                && lu_cache[i].generation == lu_pending_generation)
+            break;
+    free_vartype(lu_cache[i].lu);
+    free(lu_cache[i].perm);
+    for (; i > 0; i--)
+        lu_cache[i] = lu_cache[i - 1];
+    lu_cache_entry *e = lu_cache;
+    e->array = lu_pending_array;
+    e->generation = lu_pending_generation;
+    e->singularmatrix = core_settings.matrix_singularmatrix;
+    e->error = error;
+    e->lu = lu;
+    e->perm = perm;
+    e->det_re = det_re;
+    e->det_im = det_im;
+    e->growth = growth;
+}
+
+/* Called by the completion routines instead of freeing the decomposition,
+ * since it may belong to the cache.
+ */
+static void lu_release(vartype *lu, int4 *perm) {
+    for (int i = 0; i < LU_CACHE_SIZE; i++)
+        if (lu_cache[i].lu == lu)
+            return;
+    free_vartype(lu);
+    free(perm);
+}
+
+/* The pivot growth of a decomposition in the cache, or 0 if it isn't there,
+ * or wasn't finished.
+ */
+static phloat lu_cache_growth(const vartype *lu) {
+    for (int i = 0; i < LU_CACHE_SIZE; i++)
+        if (lu_cache[i].lu == lu)
+            return lu_cache[i].growth;
+    return 0;
+}
+
+void linalg_clear_lu_cache() {
+    for (int i = 0; i < LU_CACHE_SIZE; i++) {
+        free_vartype(lu_cache[i].lu);
+        free(lu_cache[i].perm);
+        lu_cache[i].lu = NULL;
+        lu_cache[i].perm = NULL;
+    }
+}
+
+static int lu_cache_completion_r(int error, vartype_realmatrix *a, int4 *perm,
+                                    phloat det, phloat growth) {
+    if (error == ERR_NONE || error == ERR_SINGULAR_MATRIX)
+        lu_cache_store((vartype *) a, perm, error, det, 0, growth);
+    return lu_pending_completion_r(error, a, perm, det);
+}
+
+static int lu_cache_completion_c(int error, vartype_complexmatrix *a,
+                                    int4 *perm, phloat det_re, phloat det_im,
+                                    phloat growth) {
+    if (error == ERR_NONE || error == ERR_SINGULAR_MATRIX)
+        lu_cache_store((vartype *) a, perm, error, det_re, det_im, growth);
+    return lu_pending_completion_c(error, a, perm, det_re, det_im);
+}
+
+/* Like lu_decomp_r() and lu_decomp_c(), but these take care of allocating
+ * the decomposition and its permutation vector, leaving 'src' untouched, and
+ * they go to the cache first. The completion routines must pass what they
+ * are given to lu_release() when they're done with it.
+ */
+static int cached_lu_decomp_r(const vartype_realmatrix *src,
+            int (*completion)(int, vartype_realmatrix *, int4 *, phloat)) {
+    lu_cache_entry *e = lu_cache_lookup(src->array, src->array->generation);
+    if (e != NULL)
+        return completion(e->error, (vartype_realmatrix *) e->lu, e->perm,
+                                    e->det_re);
+    int4 n = src->rows;
+    int4 *perm = (int4 *) malloc(n * sizeof(int4));
+    if (perm == NULL)
+        return completion(ERR_INSUFFICIENT_MEMORY, NULL, NULL, 0);
+    vartype *lu = new_realmatrix(n, n);
+    if (lu == NULL) {
+        free(perm);
+        return completion(ERR_INSUFFICIENT_MEMORY, NULL, NULL, 0);
+    }
+    matrix_copy(lu, (const vartype *) src);
+    lu_pending_array = src->array;
+    lu_pending_generation = src->array->generation;
+    lu_pending_completion_r = completion;
+    return lu_decomp_r((vartype_realmatrix *) lu, perm, lu_cache_completion_r);
+}
+
+static int cached_lu_decomp_c(const vartype_complexmatrix *src,
+            int (*completion)(int, vartype_complexmatrix *, int4 *,
+                                    phloat, phloat)) {
+    lu_cache_entry *e = lu_cache_lookup(src->array, src->array->generation);
+    if (e != NULL)
+        return completion(e->error, (vartype_complexmatrix *) e->lu, e->perm,
+                                    e->det_re, e->det_im);
+    int4 n = src->rows;
+    int4 *perm = (int4 *) malloc(n * sizeof(int4));
+    if (perm == NULL)
+        return completion(ERR_INSUFFICIENT_MEMORY, NULL, NULL, 0, 0);
+    vartype *lu = new_complexmatrix(n, n);
+    if (lu == NULL) {
+        free(perm);
+        return completion(ERR_INSUFFICIENT_MEMORY, NULL, NULL, 0, 0);
+    }
+    matrix_copy(lu, (const vartype *) src);
+    lu_pending_array = src->array;
+    lu_pending_generation = src->array->generation;
+    lu_pending_completion_c = completion;
+    return lu_decomp_c((vartype_complexmatrix *) lu, perm,
+                                    lu_cache_completion_c);
+}
 
 
 /**********************************/
@@ -52,136 +237,122 @@ static int div_cc_completion2(int error, vartype_complexmatrix *a, int4 *perm,
                                     vartype_complexmatrix *b);
 static int small_div(const vartype *left, const vartype *right,
                                     int (*completion)(int, vartype *));
+static int sparse_div(const vartype *left, const vartype *right,
+                                    int (*completion)(int, vartype *));
+
+#ifdef BCD_MATH
+
+/* In the decimal version, a large system with few right-hand sides is solved
+ * with a binary decomposition and decimal iterative refinement, falling back
+ * on the decimal decomposition if that doesn't work out; see lu_refine_rr().
+ * A decimal decomposition that's already in the cache is used instead, though.
+ */
+#define REFINE_MIN_SIZE 20
+
+static vartype_realmatrix *linalg_div_right;
+
+static bool use_refinement(vartype_realmatrix *a, vartype_realmatrix *b) {
+    return a->rows >= REFINE_MIN_SIZE && b->columns * 8 <= a->rows
+            && !contains_strings(a) && !contains_strings(b)
+            && lu_cache_lookup(a->array, a->array->generation) == NULL;
+}
+
+static int div_rr_refine_completion(int error, bool solved,
+                                    vartype_realmatrix *b) {
+    if (error != ERR_NONE) {
+        free_vartype(linalg_div_result); /* Note: linalg_div_result == b */
+        return linalg_div_completion(error, NULL);
+    }
+    if (solved)
+        return linalg_div_completion(ERR_NONE, linalg_div_result);
+    return cached_lu_decomp_r(linalg_div_right, div_rr_completion1);
+}
+
+#endif
 
 int linalg_div(const vartype *left, const vartype *right,
                                     int (*completion)(int, vartype *)) {
+    if (left->type == TYPE_SPARSEMATRIX || right->type == TYPE_SPARSEMATRIX)
+        return sparse_div(left, right, completion);
     if (left->type == TYPE_REALMATRIX) {
         if (right->type == TYPE_REALMATRIX) {
             vartype_realmatrix *num = (vartype_realmatrix *) left;
             vartype_realmatrix *denom = (vartype_realmatrix *) right;
-            vartype *lu, *res;
+            vartype *res;
             int4 rows = num->rows;
             int4 columns = num->columns;
-            int4 *perm;
             if (denom->rows != rows || denom->columns != rows)
                 return completion(ERR_DIMENSION_ERROR, NULL);
             if (denom->rows <= 2)
                 return small_div(left, right, completion);
-            perm = (int4 *) malloc(rows * sizeof(int4));
-            if (perm == NULL)
-                return completion(ERR_INSUFFICIENT_MEMORY, NULL);
-            lu = new_realmatrix(rows, rows);
-            if (lu == NULL) {
-                free(perm);
-                return completion(ERR_INSUFFICIENT_MEMORY, NULL);
-            }
             res = new_realmatrix(rows, columns);
-            if (res == NULL) {
-                free(perm);
-                free_vartype(lu);
+            if (res == NULL)
                 return completion(ERR_INSUFFICIENT_MEMORY, NULL);
-            }
-            matrix_copy(lu, right);
             linalg_div_completion = completion;
             linalg_div_left = left;
             linalg_div_result = res;
-            return lu_decomp_r((vartype_realmatrix *) lu, perm,
-                                                div_rr_completion1);
+#ifdef BCD_MATH
+            if (use_refinement(denom, num)) {
+                linalg_div_right = denom;
+                matrix_copy(res, left);
+                return lu_refine_rr(denom, (vartype_realmatrix *) res,
+                                                div_rr_refine_completion);
+            }
+#endif
+            return cached_lu_decomp_r(denom, div_rr_completion1);
         } else {
             vartype_realmatrix *num = (vartype_realmatrix *) left;
             vartype_complexmatrix *denom = (vartype_complexmatrix *) right;
-            vartype *lu, *res;
+            vartype *res;
             int4 rows = num->rows;
             int4 columns = num->columns;
-            int4 *perm;
             if (denom->rows != rows || denom->columns != rows)
                 return completion(ERR_DIMENSION_ERROR, NULL);
             if (denom->rows <= 2)
                 return small_div(left, right, completion);
-            perm = (int4 *) malloc(rows * sizeof(int4));
-            if (perm == NULL)
-                return completion(ERR_INSUFFICIENT_MEMORY, NULL);
-            lu = new_complexmatrix(rows, rows);
-            if (lu == NULL) {
-                free(perm);
-                return completion(ERR_INSUFFICIENT_MEMORY, NULL);
-            }
             res = new_complexmatrix(rows, columns);
-            if (res == NULL) {
-                free(perm);
-                free_vartype(lu);
+            if (res == NULL)
                 return completion(ERR_INSUFFICIENT_MEMORY, NULL);
-            }
-            matrix_copy(lu, right);
             linalg_div_completion = completion;
             linalg_div_left = left;
             linalg_div_result = res;
-            return lu_decomp_c((vartype_complexmatrix *) lu, perm,
-                                                div_rc_completion1);
+            return cached_lu_decomp_c(denom, div_rc_completion1);
         }
     } else {
         if (right->type == TYPE_REALMATRIX) {
             vartype_complexmatrix *num = (vartype_complexmatrix *) left;
             vartype_realmatrix *denom = (vartype_realmatrix *) right;
-            vartype *lu, *res;
+            vartype *res;
             int4 rows = num->rows;
             int4 columns = num->columns;
-            int4 *perm;
             if (denom->rows != rows || denom->columns != rows)
                 return completion(ERR_DIMENSION_ERROR, 0);
             if (denom->rows <= 2)
                 return small_div(left, right, completion);
-            perm = (int4 *) malloc(rows * sizeof(int4));
-            if (perm == NULL)
-                return completion(ERR_INSUFFICIENT_MEMORY, NULL);
-            lu = new_realmatrix(rows, rows);
-            if (lu == NULL) {
-                free(perm);
-                return completion(ERR_INSUFFICIENT_MEMORY, NULL);
-            }
             res = new_complexmatrix(rows, columns);
-            if (res == NULL) {
-                free(perm);
-                free_vartype(lu);
+            if (res == NULL)
                 return completion(ERR_INSUFFICIENT_MEMORY, NULL);
-            }
-            matrix_copy(lu, right);
             linalg_div_completion = completion;
             linalg_div_left = left;
             linalg_div_result = res;
-            return lu_decomp_r((vartype_realmatrix *) lu, perm,
-                                                    div_cr_completion1);
+            return cached_lu_decomp_r(denom, div_cr_completion1);
         } else {
             vartype_complexmatrix *num = (vartype_complexmatrix *) left;
             vartype_complexmatrix *denom = (vartype_complexmatrix *) right;
-            vartype *lu, *res;
+            vartype *res;
             int4 rows = num->rows;
             int4 columns = num->columns;
-            int4 *perm;
             if (denom->rows != rows || denom->columns != rows)
                 return completion(ERR_DIMENSION_ERROR, NULL);
             if (denom->rows <= 2)
                 return small_div(left, right, completion);
-            perm = (int4 *) malloc(rows * sizeof(int4));
-            if (perm == NULL)
-                return completion(ERR_INSUFFICIENT_MEMORY, NULL);
-            lu = new_complexmatrix(rows, rows);
-            if (lu == NULL) {
-                free(perm);
-                return completion(ERR_INSUFFICIENT_MEMORY, NULL);
-            }
             res = new_complexmatrix(rows, columns);
-            if (res == NULL) {
-                free(perm);
-                free_vartype(lu);
+            if (res == NULL)
                 return completion(ERR_INSUFFICIENT_MEMORY, NULL);
-            }
-            matrix_copy(lu, right);
             linalg_div_completion = completion;
             linalg_div_left = left;
             linalg_div_result = res;
-            return lu_decomp_c((vartype_complexmatrix *) lu, perm,
-                                                    div_cc_completion1);
+            return cached_lu_decomp_c(denom, div_cc_completion1);
         }
     }
 }
@@ -189,10 +360,9 @@ int linalg_div(const vartype *left, const vartype *right,
 static int div_rr_completion1(int error, vartype_realmatrix *a, int4 *perm,
                                          phloat det) {
     if (error != ERR_NONE) {
-        free_vartype((vartype *) a);
-        free(perm);
+        lu_release((vartype *) a, perm);
         free_vartype(linalg_div_result);
-        return error;
+        return linalg_div_completion(error, NULL);
     } else {
         matrix_copy(linalg_div_result, linalg_div_left);
         return lu_backsubst_rr(a, perm,
@@ -205,18 +375,16 @@ static int div_rr_completion2(int error, vartype_realmatrix *a, int4 *perm,
                                           vartype_realmatrix *b) {
     if (error != ERR_NONE)
         free_vartype(linalg_div_result); /* Note: linalg_div_result == b */
-    free_vartype((vartype *) a);
-    free(perm);
+    lu_release((vartype *) a, perm);
     return linalg_div_completion(error, linalg_div_result);
 }
 
 static int div_rc_completion1(int error, vartype_complexmatrix *a, int4 *perm,
                                          phloat det_re, phloat det_im) {
     if (error != ERR_NONE) {
-        free_vartype((vartype *) a);
-        free(perm);
+        lu_release((vartype *) a, perm);
         free_vartype(linalg_div_result);
-        return error;
+        return linalg_div_completion(error, NULL);
     } else {
         matrix_copy(linalg_div_result, linalg_div_left);
         return lu_backsubst_cc(a, perm,
@@ -229,18 +397,16 @@ static int div_rc_completion2(int error, vartype_complexmatrix *a, int4 *perm,
                                           vartype_complexmatrix *b) {
     if (error != ERR_NONE)
         free_vartype(linalg_div_result); /* Note: linalg_div_result == b */
-    free_vartype((vartype *) a);
-    free(perm);
+    lu_release((vartype *) a, perm);
     return linalg_div_completion(error, linalg_div_result);
 }
 
 static int div_cr_completion1(int error, vartype_realmatrix *a, int4 *perm,
                                     phloat det) {
     if (error != ERR_NONE) {
-        free_vartype((vartype *) a);
-        free(perm);
+        lu_release((vartype *) a, perm);
         free_vartype(linalg_div_result);
-        return error;
+        return linalg_div_completion(error, NULL);
     } else {
         matrix_copy(linalg_div_result, linalg_div_left);
         return lu_backsubst_rc(a, perm,
@@ -253,18 +419,16 @@ static int div_cr_completion2(int error, vartype_realmatrix *a, int4 *perm,
                                     vartype_complexmatrix *b) {
     if (error != ERR_NONE)
         free_vartype(linalg_div_result); /* Note: linalg_div_result == b */
-    free_vartype((vartype *) a);
-    free(perm);
+    lu_release((vartype *) a, perm);
     return linalg_div_completion(error, linalg_div_result);
 }
 
 static int div_cc_completion1(int error, vartype_complexmatrix *a, int4 *perm,
                                     phloat det_re, phloat det_im) {
     if (error != ERR_NONE) {
-        free_vartype((vartype *) a);
-        free(perm);
+        lu_release((vartype *) a, perm);
         free_vartype(linalg_div_result);
-        return error;
+        return linalg_div_completion(error, NULL);
     } else {
         matrix_copy(linalg_div_result, linalg_div_left);
         return lu_backsubst_cc(a, perm,
@@ -277,17 +441,15 @@ static int div_cc_completion2(int error, vartype_complexmatrix *a, int4 *perm,
                                     vartype_complexmatrix *b) {
     if (error != ERR_NONE)
         free_vartype(linalg_div_result); /* Note: linalg_div_result == b */
-    free_vartype((vartype *) a);
-    free(perm);
+    lu_release((vartype *) a, perm);
     return linalg_div_completion(error, linalg_div_result);
 }
 
 static int small_inv_r(vartype_realmatrix *ma, int (*completion)(int, vartype *));
 static int small_inv_c(vartype_complexmatrix *ma, int (*completion)(int, vartype *));
-static int matrix_mul_rr(vartype_realmatrix *left, vartype_realmatrix *right, int (*completion)(int, vartype *));
-static int matrix_mul_cr(vartype_complexmatrix *left, vartype_realmatrix *right, int (*completion)(int, vartype *));
-static int matrix_mul_rc(vartype_realmatrix *left, vartype_complexmatrix *right, int (*completion)(int, vartype *));
-static int matrix_mul_cc(vartype_complexmatrix *left, vartype_complexmatrix *right, int (*completion)(int, vartype *));
+static int matrix_mul(vartype *left, vartype *right, int (*completion)(int, vartype *));
+static int sparse_mul(const vartype *left, const vartype *right,
+                                    int (*completion)(int, vartype *));
 
 static vartype *small_div_res;
 static int (*small_div_completion)(int, vartype *);
@@ -309,19 +471,13 @@ static int small_div(const vartype *left, const vartype *right, int (*completion
         if (err != ERR_NONE)
             return completion(err, NULL);
         small_div_completion = completion;
-        if (left->type == TYPE_REALMATRIX)
-            return matrix_mul_rr((vartype_realmatrix *) small_div_res, (vartype_realmatrix *) left, small_div_completion_2);
-        else
-            return matrix_mul_rc((vartype_realmatrix *) small_div_res, (vartype_complexmatrix *) left, small_div_completion_2);
+        return matrix_mul(small_div_res, (vartype *) left, small_div_completion_2);
     } else {
         err = small_inv_c((vartype_complexmatrix *) right, small_div_completion_1);
         if (err != ERR_NONE)
             return completion(err, NULL);
         small_div_completion = completion;
-        if (left->type == TYPE_REALMATRIX)
-            return matrix_mul_cr((vartype_complexmatrix *) small_div_res, (vartype_realmatrix *) left, small_div_completion_2);
-        else
-            return matrix_mul_cc((vartype_complexmatrix *) small_div_res, (vartype_complexmatrix *) left, small_div_completion_2);
+        return matrix_mul(small_div_res, (vartype *) left, small_div_completion_2);
     }
 }
 
@@ -330,295 +486,322 @@ static int small_div(const vartype *left, const vartype *right, int (*completion
 /***** Matrix-matrix multiplication *****/
 /****************************************/
 
-struct mul_rr_data_struct {
-    vartype_realmatrix *left;
-    vartype_realmatrix *right;
-    vartype *result;
-    int4 i, j, k;
-    phloat sum;
-    int (*completion)(int error, vartype *result);
-};
-
-static mul_rr_data_struct *mul_rr_data;
-
-static int matrix_mul_rr_worker(bool interrupted);
-
-static int matrix_mul_rr(vartype_realmatrix *left, vartype_realmatrix *right,
-                         int (*completion)(int, vartype *)) {
+/* The multiplications are blocked: the result is computed in tiles of
+ * block_size rows by block_size columns, and each tile is accumulated in
+ * slices of block_size terms, so that the parts of the operands being worked
+ * on stay in the CPU cache. Within a tile, rows are updated in i,k,j order,
+ * which keeps the inner loops at unit stride. Each result element still
+ * receives its terms in order of increasing k, so the results are identical
+ * to those of the straightforward i,j,k algorithm.
+ * The best block size depends on the host's cache; it is determined by
+ * mul_calibrate() the first time a multiplication is large enough for it to
+ * matter, and kept in core_settings, which is saved with the core state.
+ * Smaller multiplications use the default, which is never far off for them.
+ */
 
-    mul_rr_data_struct *dat;
-    int error;
+#define MUL_DEFAULT_BLOCK_SIZE 64
+#define MUL_MAX_BLOCK_SIZE 128
 
-    if (left->columns != right->rows) {
-        error = ERR_DIMENSION_ERROR;
-        goto finished;
+static void mul_row_rr(const phloat *lrow, const phloat *r, phloat *prow,
+                       int4 n, int4 k0, int4 k1, int4 j0, int4 j1) {
+    for (int4 k = k0; k < k1; k++) {
+        phloat a = lrow[k];
+        const phloat *rrow = r + k * n;
+        for (int4 j = j0; j < j1; j++)
+            prow[j] += a * rrow[j];
     }
+}
 
-    if (contains_strings(left) || contains_strings(right)) {
-        error = ERR_ALPHA_DATA_IS_INVALID;
-        goto finished;
+static void mul_row_rc(const phloat *lrow, const phloat *r, phloat *prow,
+                       int4 n, int4 k0, int4 k1, int4 j0, int4 j1) {
+    for (int4 k = k0; k < k1; k++) {
+        phloat a = lrow[k];
+        const phloat *rrow = r + 2 * k * n;
+        for (int4 j = j0; j < j1; j++) {
+            prow[2 * j] += a * rrow[2 * j];
+            prow[2 * j + 1] += a * rrow[2 * j + 1];
+        }
     }
+}
 
-    dat = (mul_rr_data_struct *) malloc(sizeof(mul_rr_data_struct));
-    if (dat == NULL) {
-        error = ERR_INSUFFICIENT_MEMORY;
-        goto finished;
+static void mul_row_cr(const phloat *lrow, const phloat *r, phloat *prow,
+                       int4 n, int4 k0, int4 k1, int4 j0, int4 j1) {
+    for (int4 k = k0; k < k1; k++) {
+        phloat a_re = lrow[2 * k];
+        phloat a_im = lrow[2 * k + 1];
+        const phloat *rrow = r + k * n;
+        for (int4 j = j0; j < j1; j++) {
+            phloat tmp = rrow[j];
+            prow[2 * j] += tmp * a_re;
+            prow[2 * j + 1] += tmp * a_im;
+        }
     }
+}
 
-    dat->result = new_realmatrix(left->rows, right->columns);
-    if (dat->result == NULL) {
-        free(dat);
-        error = ERR_INSUFFICIENT_MEMORY;
-        goto finished;
+static void mul_row_cc(const phloat *lrow, const phloat *r, phloat *prow,
+                       int4 n, int4 k0, int4 k1, int4 j0, int4 j1) {
+    for (int4 k = k0; k < k1; k++) {
+        phloat l_re = lrow[2 * k];
+        phloat l_im = lrow[2 * k + 1];
+        const phloat *rrow = r + 2 * k * n;
+        for (int4 j = j0; j < j1; j++) {
+            phloat r_re = rrow[2 * j];
+            phloat r_im = rrow[2 * j + 1];
+            prow[2 * j] += l_re * r_re - l_im * r_im;
+            prow[2 * j + 1] += l_im * r_re + l_re * r_im;
+        }
     }
+}
 
-    dat->left = left;
-    dat->right = right;
-    dat->i = 0;
-    dat->j = 0;
-    dat->k = 0;
-    dat->sum = 0;
-    dat->completion = completion;
-
-    mul_rr_data = dat;
-    mode_interruptible = matrix_mul_rr_worker;
-    mode_stoppable = false;
-    return ERR_INTERRUPTIBLE;
+#ifndef BCD_MATH
 
-    finished:
-    return completion(error, NULL);
+/* In the binary version, complex x complex products with at least this many
+ * columns are computed with the right operand and the result in split rows,
+ * see linalg_split_rows(); the result is joined again at the end.
+ */
+#define MUL_SPLIT_MIN_COLUMNS 8
+
+static void mul_row_cc_split(const phloat *lrow, const phloat *r, phloat *prow,
+                       int4 n, int4 k0, int4 k1, int4 j0, int4 j1) {
+    phloat *p_re = prow;
+    phloat *p_im = prow + n;
+    for (int4 k = k0; k < k1; k++) {
+        phloat l_re = lrow[2 * k];
+        phloat l_im = lrow[2 * k + 1];
+        const phloat *r_re = r + 2 * k * n;
+        const phloat *r_im = r_re + n;
+        for (int4 j = j0; j < j1; j++) {
+            p_re[j] += l_re * r_re[j] - l_im * r_im[j];
+            p_im[j] += l_im * r_re[j] + l_re * r_im[j];
+        }
+    }
 }
 
-static int matrix_mul_rr_worker(bool interrupted) {
-    mul_rr_data_struct *dat = mul_rr_data;
-    int count = 0;
+#endif
+
+static int mul_check_range(phloat *p, int4 n) {
     int inf;
-    phloat *l = dat->left->array->data;
-    phloat *r = dat->right->array->data;
-    phloat *p = ((vartype_realmatrix *) dat->result)->array->data;
-    int4 i = dat->i;
-    int4 j = dat->j;
-    int4 k = dat->k;
-    int4 m = dat->left->rows;
-    int4 n = dat->right->columns;
-    int4 q = dat->left->columns;
-    phloat sum = dat->sum;
+    for (int4 i = 0; i < n; i++)
+        if ((inf = p_isinf(p[i])) != 0) {
+            if (core_settings.matrix_outofrange && !flags.f.range_error_ignore)
+                return ERR_OUT_OF_RANGE;
+            else
+                p[i] = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
+        }
+    return ERR_NONE;
+}
 
-    if (interrupted) {
-        int err = dat->completion(ERR_INTERRUPTED, NULL);
-        free_vartype(dat->result);
-        free(dat);
-        return err;
+static int mul_calibrate() {
+#ifdef BCD_MATH
+    // In the decimal version, the arithmetic is so much slower than memory
+    // access that the block size hardly matters, and timing enough work
+    // to tell the candidates apart would take several seconds.
+    return MUL_DEFAULT_BLOCK_SIZE;
+#else
+    // Time a 256 x 256 multiplication with each candidate block size,
+    // twice, and pick the fastest. The operands take 512 kilobytes each,
+    // which is more than most L1 and L2 caches can hold, so the
+    // differences between the block sizes are clearly visible.
+    const int4 n = 256;
+    static const int candidates[] = { 16, 24, 32, 48, 64, 96, MUL_MAX_BLOCK_SIZE, 0 };
+    phloat *buf = (phloat *) malloc(3 * n * n * sizeof(phloat));
+    if (buf == NULL)
+        return MUL_DEFAULT_BLOCK_SIZE;
+    phloat *l = buf;
+    phloat *r = buf + n * n;
+    phloat *p = buf + 2 * n * n;
+    for (int4 i = 0; i < n * n; i++) {
+        l[i] = (i * 7 + 3) % 11 - 5;
+        r[i] = (i * 5 + 1) % 13 - 6;
     }
-
-    while (count++ < 1000) {
-        sum += l[i * q + k] * r[k * n + j];
-        if (++k < q)
-            continue;
-        k = 0;
-        if ((inf = p_isinf(sum)) != 0) {
-            if (core_settings.matrix_outofrange && !flags.f.range_error_ignore){
-                int err = dat->completion(ERR_OUT_OF_RANGE, NULL);
-                free_vartype(dat->result);
-                free(dat);
-                return err;
-            } else
-                sum = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
-        }
-        p[i * n + j] = sum;
-        sum = 0;
-        if (++j < n)
-            continue;
-        j = 0;
-        if (++i < m)
-            continue;
-        else {
-            int err = dat->completion(ERR_NONE, dat->result);
-            free(dat);
-            return err;
+    int best = MUL_DEFAULT_BLOCK_SIZE;
+    uint4 best_time = 0xffffffff;
+    for (int c = 0; candidates[c] != 0; c++) {
+        int bs = candidates[c];
+        for (int rep = 0; rep < 2; rep++) {
+            for (int4 i = 0; i < n * n; i++)
+                p[i] = 0;
+            uint4 start = shell_milliseconds();
+            for (int4 i = 0; i < n; i += bs) {
+                int4 iend = i + bs < n ? i + bs : n;
+                for (int4 j = 0; j < n; j += bs) {
+                    int4 jend = j + bs < n ? j + bs : n;
+                    for (int4 k = 0; k < n; k += bs) {
+                        int4 kend = k + bs < n ? k + bs : n;
+                        for (int4 ii = i; ii < iend; ii++)
+                            mul_row_rr(l + ii * n, r, p + ii * n, n,
+                                       k, kend, j, jend);
+                    }
+                }
+            }
+            uint4 elapsed = shell_milliseconds() - start;
+            if (elapsed < best_time) {
+                best_time = elapsed;
+                best = bs;
+            }
         }
     }
+    free(buf);
+    return best;
+#endif
+}
 
-    dat->i = i;
-    dat->j = j;
-    dat->k = k;
-    dat->sum = sum;
-    return ERR_INTERRUPTIBLE;
+static int mul_block_size(bool complex, int4 m, int4 n, int4 q) {
+    int bs;
+    if (core_settings.matrix_block_size > 0)
+        bs = core_settings.matrix_block_size;
+    else if (m > MUL_MAX_BLOCK_SIZE && n > MUL_MAX_BLOCK_SIZE
+            && q > MUL_MAX_BLOCK_SIZE)
+        bs = core_settings.matrix_block_size = mul_calibrate();
+    else
+        bs = MUL_DEFAULT_BLOCK_SIZE;
+    // Complex elements are twice as large, so the tiles are made about
+    // 1/sqrt(2) times as wide, to keep their footprint the same.
+    if (complex)
+        bs = bs * 7 / 10;
+    return bs < 8 ? 8 : bs;
 }
 
-#if 0
-/* TODO: Blocked matrix multiplication
- * This commented-out function implements a working blocked matrix
- * multiplication algorithm. It works by breaking up the multiplication into
- * multiplications of submatrices of the multiplicands. If the submatrices are
- * sufficiently small, they can be made to fit entirely in the CPU's L1 cache.
- * With block sizes of around 45, I have observed a speed-up factor of circa
- * 1.7 on a Pentium MMX, and with block sizes of about 90, I have observed a
- * speed-up factor of circa 3 on a Duron. (Those were the optimum block sizes
- * observed for each processor.) These numbers suggest the Pentium MMX has a 32
- * kilobyte L1 cache, and the Duron has a 128 kilobyte L1 cache.
- * For production use, the block size should be a user-configurable parameter,
- * with a built-in tool to automatically determine the optimum value. Since the
- * UI for this kind of advanced configuration does not exist yet, and sice the
- * determination of optimum block size is a very slow process, and since I
- * expect most HP-42S users will not be very interested in using a calculator
- * to work with order-100+ matrices, and since even in the optimum case the
- * speed-up is not staggering, I'm putting full implementation of this feature
- * off until some later date.
+/* The multiplication workers all follow the same pattern: (i, j, k) is the
+ * top-left corner of the current tile and term slice, and ii is the row
+ * within the tile that will be processed next.
+ * Large multiplications are split into panels of rows_per_part rows, which
+ * are handed to the worker threads; the interruptible worker then only
+ * polls for completion.
  */
-static int matrix_mul_rr(vartype_realmatrix *left, vartype_realmatrix *right,
-                         vartype **result) {
-    phloat *cache = NULL;
-    phloat *leftcache, *rightcache;
-
-    phloat *l = left->array->data;
-    phloat *r = right->array->data;
-    phloat *p;
-    int inf;
+struct mul_data_struct {
+    vartype *left;
+    vartype *right;
+    vartype *result;
+    phloat *l, *r, *p;
+    int lw, pw;
     int4 m, n, q;
-    int4 i, j, k;
-
-    q = left->columns;
-    if (q != right->rows)
-        return ERR_DIMENSION_ERROR;
-    m = left->rows;
-    n = right->columns;
+    int4 i, j, k, ii;
+    int4 bs;
+    bool parallel;
+    int4 rows_per_part;
+    volatile int error;
+    void (*row)(const phloat *lrow, const phloat *r, phloat *prow,
+                int4 n, int4 k0, int4 k1, int4 j0, int4 j1);
+    phloat *rsplit;
+    int (*completion)(int error, vartype *result);
+};
 
-    if (contains_strings(left) || contains_strings(right))
-        return ERR_ALPHA_DATA_IS_INVALID;
+static mul_data_struct *mul_data;
 
-    *result = new_realmatrix(m, n);
-    if (*result == NULL)
-        return ERR_INSUFFICIENT_MEMORY;
-    p = ((vartype_realmatrix *) *result)->array->data;
-
-    if (BLOCK_SIZE > 0) {
-        int4 cachesize = 2 * BLOCK_SIZE * BLOCK_SIZE;
-        int4 alignment = CACHE_ALIGNMENT;
-        int4 misalgn;
-        if (alignment == 0)
-            alignment = 1;
-        misalgn = alignment % sizeof(phloat);
-        if (misalgn != 0)
-            alignment += sizeof(phloat) - misalgn;
-
-        cache = (phloat *) malloc(cachesize * sizeof(phloat) + alignment);
-        if (cache != NULL) {
-            misalgn = ((unsigned long) cache) % alignment;
-            if (misalgn == 0)
-                leftcache = cache;
-            else
-                leftcache = cache + (alignment - misalgn) / sizeof(phloat);
-            rightcache = leftcache + BLOCK_SIZE * BLOCK_SIZE;
-        }
+/* Checks the range of the finished elements j0 through j1 - 1 of a row of
+ * the product.
+ */
+static int mul_check_row(mul_data_struct *dat, phloat *prow, int4 j0, int4 j1) {
+    if (dat->rsplit != NULL) {
+        int err = mul_check_range(prow + j0, j1 - j0);
+        if (err == ERR_NONE)
+            err = mul_check_range(prow + dat->n + j0, j1 - j0);
+        return err;
     }
+    return mul_check_range(prow + dat->pw * j0, dat->pw * (j1 - j0));
+}
 
-    if (cache == NULL) {
-
-        /* Falling back on basic i,j,k algorithm */
-        for (i = 0; i < m; i++)
-            for (j = 0; j < n; j++) {
-                phloat sum = 0;
-                for (k = 0; k < q; k++)
-                    sum += l[i * q + k] * r[k * n + j];
-                if ((inf = p_isinf(sum)) != 0) {
-                    if (core_settings.matrix_outofrange
-                                            && !flags.f.range_error_ignore)
-                        return ERR_OUT_OF_RANGE;
-                    else
-                        sum = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
-                }
-                p[i * n + j] = sum;
-            }
-        return ERR_NONE;
-
-    } else {
+/* Releases the split copy of the right operand, if any, after joining the
+ * rows of the product if it is going to be returned.
+ */
+static void mul_cleanup(mul_data_struct *dat, bool success) {
+#ifndef BCD_MATH
+    if (dat->rsplit != NULL) {
+        if (success)
+            linalg_join_rows(dat->p, dat->m, dat->n,
+                             dat->rsplit + 2 * dat->q * dat->n);
+        free(dat->rsplit);
+    }
+#endif
+}
 
-        /* Blocked i,j,k algorithm for optimal cache utilization */
-        int4 i, j, k, ii, jj, kk;
-        for (i = 0; i < m; i += BLOCK_SIZE) {
-            int4 iimax = m - i;
-            if (iimax > BLOCK_SIZE)
-                iimax = BLOCK_SIZE;
-            for (j = 0; j < n; j += BLOCK_SIZE) {
-                int4 jjmax = n - j;
-                if (jjmax > BLOCK_SIZE)
-                    jjmax = BLOCK_SIZE;
-                for (k = 0; k < q; k += BLOCK_SIZE) {
-                    int4 kkmax = q - k;
-                    if (kkmax > BLOCK_SIZE)
-                        kkmax = BLOCK_SIZE;
-                    for (ii = 0; ii < iimax; ii++)
-                        for (kk = 0; kk < kkmax; kk++)
-                            leftcache[ii * BLOCK_SIZE + kk]
-                                = l[(ii + i) * q + (kk + k)];
-                    for (kk = 0; kk < kkmax; kk++)
-                        for (jj = 0; jj < jjmax; jj++)
-                            rightcache[kk * BLOCK_SIZE + jj]
-                                = r[(kk + k) * n + (jj + j)];
-                    for (ii = 0; ii < iimax; ii++)
-                        for (jj = 0; jj < jjmax; jj++) {
-                            phloat sum = p[(ii + i) * n + (jj + j)];
-                            for (kk = 0; kk < kkmax; kk++)
-                                sum += leftcache[ii * BLOCK_SIZE + kk]
-                                        * rightcache[kk * BLOCK_SIZE + jj];
-                            if ((inf = p_isinf(sum)) != 0) {
-                                if (core_settings.matrix_outofrange
-                                            && !flags.f.range_error_ignore) {
-                                    free(cache);
-                                    return ERR_OUT_OF_RANGE;
-                                } else
-                                    sum = inf < 0 ? NEG_HUGE_PHLOAT
-                                                  : POS_HUGE_PHLOAT;
-                            }
-                            p[(ii + i) * n + (jj + j)] = sum;
+static int matrix_mul_worker(bool interrupted);
+
+static void mul_panel(void *ctx, int4 part) {
+    mul_data_struct *dat = (mul_data_struct *) ctx;
+    int4 n = dat->n;
+    int4 q = dat->q;
+    int4 bs = dat->bs;
+    int lw = dat->lw;
+    int pw = dat->pw;
+    int4 rstart = part * dat->rows_per_part;
+    int4 rend = rstart + dat->rows_per_part;
+    if (rend > dat->m)
+        rend = dat->m;
+
+    for (int4 i = rstart; i < rend; i += bs) {
+        int4 iend = i + bs < rend ? i + bs : rend;
+        for (int4 j = 0; j < n; j += bs) {
+            int4 jend = j + bs < n ? j + bs : n;
+            for (int4 k = 0; k < q; k += bs) {
+                int4 kend = k + bs < q ? k + bs : q;
+                if (dat->error != ERR_NONE)
+                    return;
+                for (int4 row = i; row < iend; row++) {
+                    phloat *prow = dat->p + pw * row * n;
+                    dat->row(dat->l + lw * row * q, dat->r, prow, n, k, kend, j, jend);
+                    if (kend == q) {
+                        int err = mul_check_row(dat, prow, j, jend);
+                        if (err != ERR_NONE) {
+                            dat->error = err;
+                            return;
                         }
+                    }
                 }
             }
         }
-        free(cache);
-        return ERR_NONE;
-
     }
 }
-#endif
-
-struct mul_rc_data_struct {
-    vartype_realmatrix *left;
-    vartype_complexmatrix *right;
-    vartype *result;
-    int4 i, j, k;
-    phloat sum_re, sum_im;
-    int (*completion)(int error, vartype *result);
-};
-
-static mul_rc_data_struct *mul_rc_data;
 
-static int matrix_mul_rc_worker(bool interrupted);
 
-static int matrix_mul_rc(vartype_realmatrix *left, vartype_complexmatrix *right,
-                         int (*completion)(int, vartype *)) {
+static int matrix_mul(vartype *left, vartype *right,
+                      int (*completion)(int, vartype *)) {
 
-    mul_rc_data_struct *dat;
+    mul_data_struct *dat;
     int error;
+    int4 m, n, q;
+    int nthreads;
+    bool lc = left->type == TYPE_COMPLEXMATRIX;
+    bool rc = right->type == TYPE_COMPLEXMATRIX;
 
-    if (left->columns != right->rows) {
-        error = ERR_DIMENSION_ERROR;
-        goto finished;
+    if (lc) {
+        m = ((vartype_complexmatrix *) left)->rows;
+        q = ((vartype_complexmatrix *) left)->columns;
+    } else {
+        m = ((vartype_realmatrix *) left)->rows;
+        q = ((vartype_realmatrix *) left)->columns;
+    }
+    if (rc) {
+        if (q != ((vartype_complexmatrix *) right)->rows) {
+            error = ERR_DIMENSION_ERROR;
+            goto finished;
+        }
+        n = ((vartype_complexmatrix *) right)->columns;
+    } else {
+        if (q != ((vartype_realmatrix *) right)->rows) {
+            error = ERR_DIMENSION_ERROR;
+            goto finished;
+        }
+        n = ((vartype_realmatrix *) right)->columns;
     }
 
-    if (contains_strings(left)) {
+    if (!lc && contains_strings((vartype_realmatrix *) left)
+            || !rc && contains_strings((vartype_realmatrix *) right)) {
         error = ERR_ALPHA_DATA_IS_INVALID;
         goto finished;
     }
 
-    dat = (mul_rc_data_struct *) malloc(sizeof(mul_rc_data_struct));
+    dat = (mul_data_struct *) malloc(sizeof(mul_data_struct));
     if (dat == NULL) {
         error = ERR_INSUFFICIENT_MEMORY;
         goto finished;
     }
 
-    dat->result = new_complexmatrix(left->rows, right->columns);
+    if (lc || rc)
+        dat->result = new_complexmatrix(m, n);
+    else
+        dat->result = new_realmatrix(m, n);
     if (dat->result == NULL) {
         free(dat);
         error = ERR_INSUFFICIENT_MEMORY;
@@ -627,15 +810,57 @@ static int matrix_mul_rc(vartype_realmatrix *left, vartype_complexmatrix *right,
 
     dat->left = left;
     dat->right = right;
+    dat->l = lc ? ((vartype_complexmatrix *) left)->array->data
+                : ((vartype_realmatrix *) left)->array->data;
+    dat->r = rc ? ((vartype_complexmatrix *) right)->array->data
+                : ((vartype_realmatrix *) right)->array->data;
+    dat->p = lc || rc ? ((vartype_complexmatrix *) dat->result)->array->data
+                      : ((vartype_realmatrix *) dat->result)->array->data;
+    dat->lw = lc ? 2 : 1;
+    dat->pw = lc || rc ? 2 : 1;
+    dat->m = m;
+    dat->n = n;
+    dat->q = q;
     dat->i = 0;
     dat->j = 0;
     dat->k = 0;
-    dat->sum_re = 0;
-    dat->sum_im = 0;
+    dat->ii = 0;
+    dat->bs = mul_block_size(lc || rc, m, n, q);
+    dat->row = lc ? rc ? mul_row_cc : mul_row_cr
+                  : rc ? mul_row_rc : mul_row_rr;
+    dat->rsplit = NULL;
     dat->completion = completion;
 
-    mul_rc_data = dat;
-    mode_interruptible = matrix_mul_rc_worker;
+#ifndef BCD_MATH
+    if (lc && rc && n >= MUL_SPLIT_MIN_COLUMNS) {
+        // The extra row at the end is the scratch space for the layout
+        // changes. If there isn't enough memory for all this, the
+        // interleaved kernel will do.
+        dat->rsplit = (phloat *) malloc(2 * (q + 1) * n * sizeof(phloat));
+        if (dat->rsplit != NULL) {
+            memcpy(dat->rsplit, dat->r, 2 * q * n * sizeof(phloat));
+            linalg_split_rows(dat->rsplit, q, n, dat->rsplit + 2 * q * n);
+            dat->r = dat->rsplit;
+            dat->row = mul_row_cc_split;
+        }
+    }
+#endif
+
+    nthreads = linalg_par_threads();
+    dat->parallel = nthreads > 1 && m > 1
+                    && ((double) m) * n * q * dat->pw >= PAR_MIN_WORK;
+    if (dat->parallel) {
+        // A few parts per thread, so that they all finish at about
+        // the same time even if they don't all get a CPU to themselves
+        int4 parts = 4 * nthreads;
+        dat->rows_per_part = (m + parts - 1) / parts;
+        parts = (m + dat->rows_per_part - 1) / dat->rows_per_part;
+        dat->error = ERR_NONE;
+        linalg_par_start(mul_panel, dat, parts);
+    }
+
+    mul_data = dat;
+    mode_interruptible = matrix_mul_worker;
     mode_stoppable = false;
     return ERR_INTERRUPTIBLE;
 
@@ -643,64 +868,82 @@ static int matrix_mul_rc(vartype_realmatrix *left, vartype_complexmatrix *right,
     return completion(error, NULL);
 }
 
-static int matrix_mul_rc_worker(bool interrupted) {
-    mul_rc_data_struct *dat = mul_rc_data;
-    int count = 0;
-    int inf;
-    phloat *l = dat->left->array->data;
-    phloat *r = dat->right->array->data;
-    phloat *p = ((vartype_complexmatrix *) dat->result)->array->data;
+static int matrix_mul_worker(bool interrupted) {
+    mul_data_struct *dat = mul_data;
+    int4 count = 0;
+    phloat *l = dat->l;
+    phloat *r = dat->r;
+    phloat *p = dat->p;
+    int lw = dat->lw;
+    int pw = dat->pw;
     int4 i = dat->i;
     int4 j = dat->j;
     int4 k = dat->k;
-    int4 m = dat->left->rows;
-    int4 n = dat->right->columns;
-    int4 q = dat->left->columns;
-    phloat sum_re = dat->sum_re;
-    phloat sum_im = dat->sum_im;
+    int4 ii = dat->ii;
+    int4 m = dat->m;
+    int4 n = dat->n;
+    int4 q = dat->q;
+    int4 bs = dat->bs;
 
     if (interrupted) {
+        if (dat->parallel)
+            linalg_par_cancel();
+        mul_cleanup(dat, false);
         int err = dat->completion(ERR_INTERRUPTED, NULL);
         free_vartype(dat->result);
         free(dat);
         return err;
     }
 
-    while (count++ < 1000) {
-        phloat tmp = l[i * q + k];
-        sum_re += tmp * r[2 * (k * n + j)];
-        sum_im += tmp * r[2 * (k * n + j) + 1];
-        if (++k < q)
-            continue;
-        k = 0;
-        if ((inf = p_isinf(sum_re)) != 0) {
-            if (core_settings.matrix_outofrange && !flags.f.range_error_ignore){
-                int err = dat->completion(ERR_OUT_OF_RANGE, NULL);
+    if (dat->parallel) {
+        if (!linalg_par_wait(10))
+            return ERR_INTERRUPTIBLE;
+        int err = dat->error;
+        mul_cleanup(dat, err == ERR_NONE);
+        if (err != ERR_NONE) {
+            err = dat->completion(err, NULL);
+            free_vartype(dat->result);
+        } else
+            err = dat->completion(ERR_NONE, dat->result);
+        free(dat);
+        return err;
+    }
+
+    while (count < LINALG_WORK_PER_CALL) {
+        int4 iend = i + bs < m ? i + bs : m;
+        int4 jend = j + bs < n ? j + bs : n;
+        int4 kend = k + bs < q ? k + bs : q;
+        int4 row = i + ii;
+        phloat *prow = p + pw * row * n;
+        dat->row(l + lw * row * q, r, prow, n, k, kend, j, jend);
+        count += (kend - k) * (jend - j);
+        if (kend == q) {
+            // Last slice of terms for this row of the tile; the sums
+            // are complete now, so this is where we check their range.
+            int err = mul_check_row(dat, prow, j, jend);
+            if (err != ERR_NONE) {
+                mul_cleanup(dat, false);
+                err = dat->completion(err, NULL);
                 free_vartype(dat->result);
                 free(dat);
                 return err;
-            } else
-                sum_re = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
+            }
         }
-        if ((inf = p_isinf(sum_im)) != 0) {
-            if (core_settings.matrix_outofrange && !flags.f.range_error_ignore){
-                int err = dat->completion(ERR_OUT_OF_RANGE, NULL);
-                free_vartype(dat->result);
-                free(dat);
-                return err;
-            } else
-                sum_im = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
+        if (row + 1 < iend) {
+            ii++;
+            continue;
         }
-        p[2 * (i * n + j)] = sum_re;
-        p[2 * (i * n + j) + 1] = sum_im;
-        sum_re = 0;
-        sum_im = 0;
-        if (++j < n)
+        ii = 0;
+        if ((k += bs) < q)
+            continue;
+        k = 0;
+        if ((j += bs) < n)
             continue;
         j = 0;
-        if (++i < m)
+        if ((i += bs) < m)
             continue;
         else {
+            mul_cleanup(dat, true);
             int err = dat->completion(ERR_NONE, dat->result);
             free(dat);
             return err;
@@ -710,294 +953,557 @@ static int matrix_mul_rc_worker(bool interrupted) {
     dat->i = i;
     dat->j = j;
     dat->k = k;
-    dat->sum_re = sum_re;
-    dat->sum_im = sum_im;
+    dat->ii = ii;
     return ERR_INTERRUPTIBLE;
 }
 
-struct mul_cr_data_struct {
-    vartype_complexmatrix *left;
-    vartype_realmatrix *right;
-    vartype *result;
-    int4 i, j, k;
-    phloat sum_re, sum_im;
-    int (*completion)(int error, vartype *result);
-};
+int linalg_mul(const vartype *left, const vartype *right,
+                                    int (*completion)(int, vartype *)) {
+    if (left->type == TYPE_SPARSEMATRIX || right->type == TYPE_SPARSEMATRIX)
+        return sparse_mul(left, right, completion);
+    return matrix_mul((vartype *) left, (vartype *) right, completion);
+}
 
-static mul_cr_data_struct *mul_cr_data;
 
-static int matrix_mul_cr_worker(bool interrupted);
+/***************************/
+/***** Sparse matrices *****/
+/***************************/
 
-static int matrix_mul_cr(vartype_complexmatrix *left, vartype_realmatrix *right,
-                         int (*completion)(int, vartype *)) {
+/* Products of sparse and real matrices only visit the stored elements: a
+ * sparse times a sparse matrix is computed a row at a time, accumulating the
+ * contributions of the rows of the right-hand operand selected by the
+ * nonzeros in the row of the left-hand one; products with a dense matrix
+ * give a dense result. Every element still receives its terms in order of
+ * increasing k, like in matrix_mul(). Combinations with complex matrices,
+ * and quotients with a dense denominator, convert the sparse operand to a
+ * dense matrix and use the regular code.
+ */
 
-    mul_cr_data_struct *dat;
-    int error;
+static vartype *sparse_temp;
+static int (*sparse_temp_completion)(int, vartype *);
 
-    if (left->columns != right->rows) {
-        error = ERR_DIMENSION_ERROR;
-        goto finished;
-    }
+static int sparse_temp_done(int error, vartype *res) {
+    free_vartype(sparse_temp);
+    sparse_temp = NULL;
+    return sparse_temp_completion(error, res);
+}
 
-    if (contains_strings(right)) {
-        error = ERR_ALPHA_DATA_IS_INVALID;
-        goto finished;
-    }
+/* Converts v to a dense matrix that is freed by sparse_temp_done(), which
+ * then calls 'completion'. Returns NULL if there's not enough memory.
+ */
+static vartype *sparse_densify(const vartype *v,
+                                    int (*completion)(int, vartype *)) {
+    sparse_temp = sparse_to_dense((const vartype_sparsematrix *) v);
+    sparse_temp_completion = completion;
+    return sparse_temp;
+}
 
-    dat = (mul_cr_data_struct *) malloc(sizeof(mul_cr_data_struct));
-    if (dat == NULL) {
-        error = ERR_INSUFFICIENT_MEMORY;
-        goto finished;
-    }
+static int int4_compare(const void *a, const void *b) {
+    int4 x = *(const int4 *) a;
+    int4 y = *(const int4 *) b;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
 
-    dat->result = new_complexmatrix(left->rows, right->columns);
-    if (dat->result == NULL) {
-        free(dat);
-        error = ERR_INSUFFICIENT_MEMORY;
-        goto finished;
+static int sparse_mul_ss(const vartype_sparsematrix *a,
+                            const vartype_sparsematrix *b, vartype **res) {
+    if (a->columns != b->rows)
+        return ERR_DIMENSION_ERROR;
+    int4 m = a->rows;
+    int4 n = b->columns;
+    const sparsematrix_data *ad = a->array;
+    const sparsematrix_data *bd = b->array;
+    vartype_sparsematrix *c = (vartype_sparsematrix *)
+                            new_sparsematrix(m, n, ad->nnz + bd->nnz);
+    int4 *mark = (int4 *) malloc(n * sizeof(int4));
+    int4 *pattern = (int4 *) malloc(n * sizeof(int4));
+    phloat *w = (phloat *) malloc(n * sizeof(phloat));
+    int err = ERR_NONE;
+    if (c == NULL || mark == NULL || pattern == NULL || w == NULL) {
+        err = ERR_INSUFFICIENT_MEMORY;
+        goto done;
+    }
+    for (int4 j = 0; j < n; j++)
+        mark[j] = -1;
+    for (int4 i = 0; i < m; i++) {
+        int4 cnt = 0;
+        for (int4 p = ad->rowptr[i]; p < ad->rowptr[i + 1]; p++) {
+            phloat av = ad->data[p];
+            int4 k = ad->colidx[p];
+            for (int4 q = bd->rowptr[k]; q < bd->rowptr[k + 1]; q++) {
+                int4 j = bd->colidx[q];
+                if (mark[j] != i) {
+                    mark[j] = i;
+                    pattern[cnt++] = j;
+                    w[j] = av * bd->data[q];
+                } else
+                    w[j] += av * bd->data[q];
+            }
+        }
+        qsort(pattern, cnt, sizeof(int4), int4_compare);
+        sparsematrix_data *cd = c->array;
+        if (!sparse_reserve(c, cd->nnz + cnt)) {
+            err = ERR_INSUFFICIENT_MEMORY;
+            goto done;
+        }
+        for (int4 t = 0; t < cnt; t++) {
+            int4 j = pattern[t];
+            err = mul_check_range(w + j, 1);
+            if (err != ERR_NONE)
+                goto done;
+            if (w[j] != 0) {
+                cd->colidx[cd->nnz] = j;
+                cd->data[cd->nnz++] = w[j];
+            }
+        }
+        cd->rowptr[i + 1] = cd->nnz;
     }
 
-    dat->left = left;
-    dat->right = right;
-    dat->i = 0;
-    dat->j = 0;
-    dat->k = 0;
-    dat->sum_re = 0;
-    dat->sum_im = 0;
-    dat->completion = completion;
-
-    mul_cr_data = dat;
-    mode_interruptible = matrix_mul_cr_worker;
-    mode_stoppable = false;
-    return ERR_INTERRUPTIBLE;
-
-    finished:
-    return completion(error, NULL);
+    done:
+    free(mark);
+    free(pattern);
+    free(w);
+    if (err != ERR_NONE)
+        free_vartype((vartype *) c);
+    else
+        *res = (vartype *) c;
+    return err;
 }
 
-static int matrix_mul_cr_worker(bool interrupted) {
-    mul_cr_data_struct *dat = mul_cr_data;
-    int count = 0;
-    int inf;
-    phloat *l = dat->left->array->data;
-    phloat *r = dat->right->array->data;
-    phloat *p = ((vartype_complexmatrix *) dat->result)->array->data;
-    int4 i = dat->i;
-    int4 j = dat->j;
-    int4 k = dat->k;
-    int4 m = dat->left->rows;
-    int4 n = dat->right->columns;
-    int4 q = dat->left->columns;
-    phloat sum_re = dat->sum_re;
-    phloat sum_im = dat->sum_im;
-
-    if (interrupted) {
-        int err = dat->completion(ERR_INTERRUPTED, NULL);
-        free_vartype(dat->result);
-        free(dat);
-        return err;
+static int sparse_mul_sd(const vartype_sparsematrix *a,
+                            const vartype_realmatrix *b, vartype **res) {
+    if (a->columns != b->rows)
+        return ERR_DIMENSION_ERROR;
+    if (contains_strings(b))
+        return ERR_ALPHA_DATA_IS_INVALID;
+    int4 n = b->columns;
+    vartype_realmatrix *c = (vartype_realmatrix *) new_realmatrix(a->rows, n);
+    if (c == NULL)
+        return ERR_INSUFFICIENT_MEMORY;
+    const sparsematrix_data *ad = a->array;
+    for (int4 i = 0; i < a->rows; i++) {
+        phloat *crow = c->array->data + i * n;
+        for (int4 p = ad->rowptr[i]; p < ad->rowptr[i + 1]; p++) {
+            phloat av = ad->data[p];
+            const phloat *brow = b->array->data + ad->colidx[p] * n;
+            for (int4 j = 0; j < n; j++)
+                crow[j] += av * brow[j];
+        }
+        int err = mul_check_range(crow, n);
+        if (err != ERR_NONE) {
+            free_vartype((vartype *) c);
+            return err;
+        }
     }
+    *res = (vartype *) c;
+    return ERR_NONE;
+}
 
-    while (count++ < 1000) {
-        phloat tmp = r[k * n + j];
-        sum_re += tmp * l[2 * (i * q + k)];
-        sum_im += tmp * l[2 * (i * q + k) + 1];
-        if (++k < q)
-            continue;
-        k = 0;
-        if ((inf = p_isinf(sum_re)) != 0) {
-            if (core_settings.matrix_outofrange && !flags.f.range_error_ignore){
-                int err = dat->completion(ERR_OUT_OF_RANGE, NULL);
-                free_vartype(dat->result);
-                free(dat);
-                return err;
-            } else
-                sum_re = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
-        }
-        if ((inf = p_isinf(sum_im)) != 0) {
-            if (core_settings.matrix_outofrange && !flags.f.range_error_ignore){
-                int err = dat->completion(ERR_OUT_OF_RANGE, NULL);
-                free_vartype(dat->result);
-                free(dat);
-                return err;
-            } else
-                sum_im = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
+static int sparse_mul_ds(const vartype_realmatrix *a,
+                            const vartype_sparsematrix *b, vartype **res) {
+    if (a->columns != b->rows)
+        return ERR_DIMENSION_ERROR;
+    if (contains_strings(a))
+        return ERR_ALPHA_DATA_IS_INVALID;
+    int4 q = a->columns;
+    int4 n = b->columns;
+    vartype_realmatrix *c = (vartype_realmatrix *) new_realmatrix(a->rows, n);
+    if (c == NULL)
+        return ERR_INSUFFICIENT_MEMORY;
+    const sparsematrix_data *bd = b->array;
+    for (int4 i = 0; i < a->rows; i++) {
+        phloat *crow = c->array->data + i * n;
+        const phloat *arow = a->array->data + i * q;
+        for (int4 k = 0; k < q; k++) {
+            phloat av = arow[k];
+            if (av == 0)
+                continue;
+            for (int4 p = bd->rowptr[k]; p < bd->rowptr[k + 1]; p++)
+                crow[bd->colidx[p]] += av * bd->data[p];
         }
-        p[2 * (i * n + j)] = sum_re;
-        p[2 * (i * n + j) + 1] = sum_im;
-        sum_re = 0;
-        sum_im = 0;
-        if (++j < n)
-            continue;
-        j = 0;
-        if (++i < m)
-            continue;
-        else {
-            int err = dat->completion(ERR_NONE, dat->result);
-            free(dat);
+        int err = mul_check_range(crow, n);
+        if (err != ERR_NONE) {
+            free_vartype((vartype *) c);
             return err;
         }
     }
+    *res = (vartype *) c;
+    return ERR_NONE;
+}
 
-    dat->i = i;
-    dat->j = j;
-    dat->k = k;
-    dat->sum_re = sum_re;
-    dat->sum_im = sum_im;
-    return ERR_INTERRUPTIBLE;
+static int sparse_mul(const vartype *left, const vartype *right,
+                                    int (*completion)(int, vartype *)) {
+    vartype *res = NULL;
+    int err;
+    if (left->type == TYPE_SPARSEMATRIX && right->type == TYPE_SPARSEMATRIX)
+        err = sparse_mul_ss((const vartype_sparsematrix *) left,
+                            (const vartype_sparsematrix *) right, &res);
+    else if (right->type == TYPE_REALMATRIX)
+        err = sparse_mul_sd((const vartype_sparsematrix *) left,
+                            (const vartype_realmatrix *) right, &res);
+    else if (left->type == TYPE_REALMATRIX)
+        err = sparse_mul_ds((const vartype_realmatrix *) left,
+                            (const vartype_sparsematrix *) right, &res);
+    else {
+        const vartype *s = left->type == TYPE_SPARSEMATRIX ? left : right;
+        vartype *d = sparse_densify(s, completion);
+        if (d == NULL)
+            return completion(ERR_INSUFFICIENT_MEMORY, NULL);
+        if (s == left)
+            return matrix_mul(d, (vartype *) right, sparse_temp_done);
+        else
+            return matrix_mul((vartype *) left, d, sparse_temp_done);
+    }
+    return completion(err, res);
 }
 
-struct mul_cc_data_struct {
-    vartype_complexmatrix *left;
-    vartype_complexmatrix *right;
+/* A sparse denominator is LU-decomposed in sparse form, so that only the
+ * elements of L and U that can be nonzero are stored and computed. The
+ * columns are eliminated left to right; for each one, a depth-first search
+ * through the columns of L computed so far finds which entries the
+ * elimination will fill in, and in what order they have to be computed
+ * (Gilbert and Peierls). Pivots are chosen by scaled partial pivoting, as in
+ * lu_decomp_r(), and zero pivots are handled the same way, too.
+ * The denominator is stored by rows, so the decomposition works on its
+ * transpose, whose rows are the denominator's columns. L and U are kept by
+ * columns, with the unit diagonal of L at the start of each of its columns,
+ * and the diagonal of U at the end of each of its columns.
+ */
+
+struct sparse_lu_struct {
+    vartype *at;
     vartype *result;
-    int4 i, j, k;
-    phloat sum_re, sum_im;
-    int (*completion)(int error, vartype *result);
+    phloat *b;
+    int4 width;
+    int4 n;
+    int4 k;
+    int4 c;
+    int4 *lp, *li, *up, *ui;
+    phloat *lx, *ux;
+    int4 lnz, lcap, unz, ucap;
+    int4 *pinv;
+    int4 *xi;
+    int4 *mark;
+    int4 nextfree;
+    phloat *x;
+    phloat *scale;
+    int (*completion)(int, vartype *);
 };
 
-static mul_cc_data_struct *mul_cc_data;
-
-static int matrix_mul_cc_worker(bool interrupted);
-
-static int matrix_mul_cc(vartype_complexmatrix *left, vartype_complexmatrix *right,
-                         int (*completion)(int, vartype *)) {
-
-    mul_cc_data_struct *dat;
-    int error;
-
-    if (left->columns != right->rows) {
-        error = ERR_DIMENSION_ERROR;
-        goto finished;
-    }
+static sparse_lu_struct *sparse_lu_data;
+
+static int sparse_lu_finish(sparse_lu_struct *dat, int err) {
+    int (*completion)(int, vartype *) = dat->completion;
+    vartype *res = dat->result;
+    free_vartype(dat->at);
+    free(dat->lp);
+    free(dat->li);
+    free((void *) dat->lx);
+    free(dat->up);
+    free(dat->ui);
+    free((void *) dat->ux);
+    free(dat->pinv);
+    free(dat->xi);
+    free(dat->mark);
+    free((void *) dat->x);
+    free((void *) dat->scale);
+    free(dat);
+    if (err != ERR_NONE) {
+        free_vartype(res);
+        return completion(err, NULL);
+    } else
+        return completion(ERR_NONE, res);
+}
 
-    dat = (mul_cc_data_struct *) malloc(sizeof(mul_cc_data_struct));
-    if (dat == NULL) {
-        error = ERR_INSUFFICIENT_MEMORY;
-        goto finished;
-    }
+static bool sparse_lu_grow(int4 **idx, phloat **val, int4 *cap, int4 need) {
+    if (need <= *cap)
+        return true;
+    int4 newcap = *cap * 2 > need ? *cap * 2 : need;
+    double d_bytes = ((double) newcap) * sizeof(phloat);
+    if (((double) (int4) d_bytes) != d_bytes)
+        return false;
+    int4 *newidx = (int4 *) realloc(*idx, newcap * sizeof(int4));
+    if (newidx == NULL)
+        return false;
+    *idx = newidx;
+    phloat *newval = (phloat *) realloc((void *) *val, newcap * sizeof(phloat));
+    if (newval == NULL)
+        return false;
+    *val = newval;
+    *cap = newcap;
+    return true;
+}
 
-    dat->result = new_complexmatrix(left->rows, right->columns);
-    if (dat->result == NULL) {
-        free(dat);
-        error = ERR_INSUFFICIENT_MEMORY;
-        goto finished;
+/* Finds the rows reachable from row j through the columns of L, pushing
+ * them onto xi[top - 1] and down in reverse topological order.
+ */
+static int4 sparse_lu_dfs(sparse_lu_struct *dat, int4 j, int4 top) {
+    int4 *xi = dat->xi;
+    int4 *pstack = dat->xi + dat->n;
+    int4 head = 0;
+    xi[0] = j;
+    while (head >= 0) {
+        j = xi[head];
+        int4 jnew = dat->pinv[j];
+        if (dat->mark[j] != dat->k) {
+            dat->mark[j] = dat->k;
+            pstack[head] = jnew < 0 ? 0 : dat->lp[jnew] + 1;
+        }
+        bool done = true;
+        int4 p2 = jnew < 0 ? 0 : dat->lp[jnew + 1];
+        for (int4 p = pstack[head]; p < p2; p++) {
+            int4 i = dat->li[p];
+            if (dat->mark[i] == dat->k)
+                continue;
+            pstack[head] = p + 1;
+            xi[++head] = i;
+            done = false;
+            break;
+        }
+        if (done) {
+            head--;
+            xi[--top] = j;
+        }
     }
-
-    dat->left = left;
-    dat->right = right;
-    dat->i = 0;
-    dat->j = 0;
-    dat->k = 0;
-    dat->sum_re = 0;
-    dat->sum_im = 0;
-    dat->completion = completion;
-
-    mul_cc_data = dat;
-    mode_interruptible = matrix_mul_cc_worker;
-    mode_stoppable = false;
-    return ERR_INTERRUPTIBLE;
-
-    finished:
-    return completion(error, NULL);
+    return top;
 }
 
-static int matrix_mul_cc_worker(bool interrupted) {
-    mul_cc_data_struct *dat = mul_cc_data;
-    int count = 0;
-    int inf;
-    phloat *l = dat->left->array->data;
-    phloat *r = dat->right->array->data;
-    phloat *p = ((vartype_complexmatrix *) dat->result)->array->data;
-    int4 i = dat->i;
-    int4 j = dat->j;
+static int sparse_lu_column(sparse_lu_struct *dat, int4 *count) {
+    int4 n = dat->n;
     int4 k = dat->k;
-    int4 m = dat->left->rows;
-    int4 n = dat->right->columns;
-    int4 q = dat->left->columns;
-    phloat sum_re = dat->sum_re;
-    phloat sum_im = dat->sum_im;
+    const sparsematrix_data *ad = ((vartype_sparsematrix *) dat->at)->array;
+    phloat *x = dat->x;
+    int4 *xi = dat->xi;
+    int4 *pinv = dat->pinv;
 
-    if (interrupted) {
-        int err = dat->completion(ERR_INTERRUPTED, NULL);
-        free_vartype(dat->result);
-        free(dat);
-        return err;
+    if (!sparse_lu_grow(&dat->li, &dat->lx, &dat->lcap, dat->lnz + n)
+            || !sparse_lu_grow(&dat->ui, &dat->ux, &dat->ucap, dat->unz + n))
+        return ERR_INSUFFICIENT_MEMORY;
+    dat->lp[k] = dat->lnz;
+    dat->up[k] = dat->unz;
+
+    int4 top = n;
+    for (int4 p = ad->rowptr[k]; p < ad->rowptr[k + 1]; p++)
+        if (dat->mark[ad->colidx[p]] != k)
+            top = sparse_lu_dfs(dat, ad->colidx[p], top);
+    for (int4 p = top; p < n; p++)
+        x[xi[p]] = 0;
+    for (int4 p = ad->rowptr[k]; p < ad->rowptr[k + 1]; p++)
+        x[ad->colidx[p]] = ad->data[p];
+
+    for (int4 px = top; px < n; px++) {
+        int4 j = pinv[xi[px]];
+        if (j < 0)
+            continue;
+        phloat xj = x[xi[px]];
+        int4 pend = dat->lp[j + 1];
+        for (int4 p = dat->lp[j] + 1; p < pend; p++)
+            x[dat->li[p]] -= dat->lx[p] * xj;
+        *count += pend - dat->lp[j];
+    }
+    *count += n - top + 1;
+
+    int4 ipiv = -1;
+    phloat max = 0;
+    for (int4 px = top; px < n; px++) {
+        int4 i = xi[px];
+        if (pinv[i] < 0) {
+            phloat t = x[i] < 0 ? -x[i] : x[i];
+            t /= dat->scale[i];
+            if (t > max) {
+                max = t;
+                ipiv = i;
+            }
+        } else if (x[i] != 0) {
+            dat->ui[dat->unz] = pinv[i];
+            dat->ux[dat->unz++] = x[i];
+        }
     }
 
-    while (count++ < 1000) {
-        phloat l_re = l[2 * (i * q + k)];
-        phloat l_im = l[2 * (i * q + k) + 1];
-        phloat r_re = r[2 * (k * n + j)];
-        phloat r_im = r[2 * (k * n + j) + 1];
-        sum_re += l_re * r_re - l_im * r_im;
-        sum_im += l_im * r_re + l_re * r_im;
-        if (++k < q)
-            continue;
-        k = 0;
-        if ((inf = p_isinf(sum_re)) != 0) {
-            if (core_settings.matrix_outofrange && !flags.f.range_error_ignore){
-                int err = dat->completion(ERR_OUT_OF_RANGE, NULL);
-                free_vartype(dat->result);
-                free(dat);
-                return err;
-            } else
-                sum_re = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
+    phloat pivot;
+    if (ipiv == -1) {
+        if (core_settings.matrix_singularmatrix)
+            return ERR_SINGULAR_MATRIX;
+        /* See lu_decomp_r() */
+        while (pinv[dat->nextfree] >= 0)
+            dat->nextfree++;
+        ipiv = dat->nextfree;
+        phloat tiniest = 1e20 / POS_HUGE_PHLOAT;
+        if (dat->scale[ipiv] == 0)
+            pivot = tiniest;
+        else {
+            pivot = pow(10, floor(log10(dat->scale[ipiv])) - 20);
+            if (pivot < tiniest)
+                pivot = tiniest;
         }
-        if ((inf = p_isinf(sum_im)) != 0) {
-            if (core_settings.matrix_outofrange && !flags.f.range_error_ignore){
-                int err = dat->completion(ERR_OUT_OF_RANGE, NULL);
-                free_vartype(dat->result);
-                free(dat);
-                return err;
-            } else
-                sum_im = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
+    } else
+        pivot = x[ipiv];
+    dat->ui[dat->unz] = k;
+    dat->ux[dat->unz++] = pivot;
+    pinv[ipiv] = k;
+    dat->li[dat->lnz] = ipiv;
+    dat->lx[dat->lnz++] = 1;
+    for (int4 px = top; px < n; px++) {
+        int4 i = xi[px];
+        if (pinv[i] < 0 && x[i] != 0) {
+            dat->li[dat->lnz] = i;
+            dat->lx[dat->lnz++] = x[i] / pivot;
         }
-        p[2 * (i * n + j)] = sum_re;
-        p[2 * (i * n + j) + 1] = sum_im;
-        sum_re = 0;
-        sum_im = 0;
-        if (++j < n)
+        x[i] = 0;
+    }
+    dat->lp[k + 1] = dat->lnz;
+    dat->up[k + 1] = dat->unz;
+    dat->k++;
+    return ERR_NONE;
+}
+
+static int sparse_lu_solve(sparse_lu_struct *dat, int4 c) {
+    int4 n = dat->n;
+    int4 w = dat->width;
+    phloat *b = dat->b + c;
+    phloat *y = dat->x;
+    for (int4 i = 0; i < n; i++)
+        y[dat->pinv[i]] = b[i * w];
+    for (int4 j = 0; j < n; j++) {
+        phloat yj = y[j];
+        if (yj == 0)
             continue;
-        j = 0;
-        if (++i < m)
+        for (int4 p = dat->lp[j] + 1; p < dat->lp[j + 1]; p++)
+            y[dat->li[p]] -= dat->lx[p] * yj;
+    }
+    for (int4 j = n - 1; j >= 0; j--) {
+        int4 pend = dat->up[j + 1] - 1;
+        phloat yj = y[j] /= dat->ux[pend];
+        if (yj == 0)
             continue;
-        else {
-            int err = dat->completion(ERR_NONE, dat->result);
-            free(dat);
-            return err;
-        }
+        for (int4 p = dat->up[j]; p < pend; p++)
+            y[dat->ui[p]] -= dat->ux[p] * yj;
     }
+    int err = mul_check_range(y, n);
+    if (err != ERR_NONE)
+        return err;
+    for (int4 i = 0; i < n; i++)
+        b[i * w] = y[i];
+    return ERR_NONE;
+}
 
-    dat->i = i;
-    dat->j = j;
-    dat->k = k;
-    dat->sum_re = sum_re;
-    dat->sum_im = sum_im;
-    return ERR_INTERRUPTIBLE;
+static int sparse_lu_worker(bool interrupted) {
+    sparse_lu_struct *dat = sparse_lu_data;
+    int4 count = 0;
+    int err;
+
+    if (interrupted)
+        return sparse_lu_finish(dat, ERR_INTERRUPTED);
+
+    while (dat->k < dat->n) {
+        if (count >= LINALG_WORK_PER_CALL)
+            return ERR_INTERRUPTIBLE;
+        err = sparse_lu_column(dat, &count);
+        if (err != ERR_NONE)
+            return sparse_lu_finish(dat, err);
+        if (dat->k == dat->n)
+            // Decomposition complete; switch L to pivot order
+            for (int4 p = 0; p < dat->lnz; p++)
+                dat->li[p] = dat->pinv[dat->li[p]];
+    }
+    while (dat->c < dat->width) {
+        if (count >= LINALG_WORK_PER_CALL)
+            return ERR_INTERRUPTIBLE;
+        err = sparse_lu_solve(dat, dat->c++);
+        if (err != ERR_NONE)
+            return sparse_lu_finish(dat, err);
+        count += dat->lnz + dat->unz;
+    }
+    return sparse_lu_finish(dat, ERR_NONE);
 }
 
-int linalg_mul(const vartype *left, const vartype *right,
+static int sparse_div(const vartype *left, const vartype *right,
                                     int (*completion)(int, vartype *)) {
-    if (left->type == TYPE_REALMATRIX) {
-        if (right->type == TYPE_REALMATRIX)
-            return matrix_mul_rr((vartype_realmatrix *) left,
-                                 (vartype_realmatrix *) right,
-                                 completion);
+    if (left->type == TYPE_SPARSEMATRIX) {
+        vartype *d = sparse_densify(left, completion);
+        if (d == NULL)
+            return completion(ERR_INSUFFICIENT_MEMORY, NULL);
+        if (right->type == TYPE_SPARSEMATRIX)
+            return sparse_div(d, right, sparse_temp_done);
         else
-            return matrix_mul_rc((vartype_realmatrix *) left,
-                                 (vartype_complexmatrix *) right,
-                                 completion);
+            return linalg_div(d, right, sparse_temp_done);
+    }
+
+    const vartype_sparsematrix *a = (const vartype_sparsematrix *) right;
+    int4 n = a->rows;
+    int4 rows, columns;
+    bool complex = left->type == TYPE_COMPLEXMATRIX;
+    if (complex) {
+        rows = ((vartype_complexmatrix *) left)->rows;
+        columns = ((vartype_complexmatrix *) left)->columns;
     } else {
-        if (right->type == TYPE_REALMATRIX)
-            return matrix_mul_cr((vartype_complexmatrix *) left,
-                                 (vartype_realmatrix *) right,
-                                 completion);
-        else
-            return matrix_mul_cc((vartype_complexmatrix *) left,
-                                 (vartype_complexmatrix *) right,
-                                 completion);
+        rows = ((vartype_realmatrix *) left)->rows;
+        columns = ((vartype_realmatrix *) left)->columns;
+        if (contains_strings((vartype_realmatrix *) left))
+            return completion(ERR_ALPHA_DATA_IS_INVALID, NULL);
+    }
+    if (a->columns != n || rows != n)
+        return completion(ERR_DIMENSION_ERROR, NULL);
+
+    sparse_lu_struct *dat = (sparse_lu_struct *) malloc(sizeof(sparse_lu_struct));
+    if (dat == NULL)
+        return completion(ERR_INSUFFICIENT_MEMORY, NULL);
+    const sparsematrix_data *ad = a->array;
+    int4 cap = ad->nnz <= (0x7fffffff - n) / 4 ? ad->nnz * 4 + n
+                                               : ad->nnz + n;
+    dat->at = sparse_transpose(a);
+    dat->result = complex ? new_complexmatrix(rows, columns)
+                          : new_realmatrix(rows, columns);
+    dat->n = n;
+    dat->k = 0;
+    dat->c = 0;
+    dat->lp = (int4 *) malloc((n + 1) * sizeof(int4));
+    dat->up = (int4 *) malloc((n + 1) * sizeof(int4));
+    dat->li = (int4 *) malloc(cap * sizeof(int4));
+    dat->ui = (int4 *) malloc(cap * sizeof(int4));
+    dat->lx = (phloat *) malloc(cap * sizeof(phloat));
+    dat->ux = (phloat *) malloc(cap * sizeof(phloat));
+    dat->lnz = dat->unz = 0;
+    dat->lcap = dat->ucap = cap;
+    dat->pinv = (int4 *) malloc(n * sizeof(int4));
+    dat->xi = (int4 *) malloc(2 * n * sizeof(int4));
+    dat->mark = (int4 *) malloc(n * sizeof(int4));
+    dat->nextfree = 0;
+    dat->x = (phloat *) malloc(n * sizeof(phloat));
+    dat->scale = (phloat *) malloc(n * sizeof(phloat));
+    dat->completion = completion;
+    if (dat->at == NULL || dat->result == NULL || dat->lp == NULL
+            || dat->up == NULL || dat->li == NULL || dat->ui == NULL
+            || dat->lx == NULL || dat->ux == NULL || dat->pinv == NULL
+            || dat->xi == NULL || dat->mark == NULL || dat->x == NULL
+            || dat->scale == NULL)
+        return sparse_lu_finish(dat, ERR_INSUFFICIENT_MEMORY);
+
+    matrix_copy(dat->result, left);
+    if (complex) {
+        dat->b = ((vartype_complexmatrix *) dat->result)->array->data;
+        dat->width = 2 * columns;
+    } else {
+        dat->b = ((vartype_realmatrix *) dat->result)->array->data;
+        dat->width = columns;
     }
+    for (int4 i = 0; i < n; i++) {
+        phloat max = 0;
+        for (int4 p = ad->rowptr[i]; p < ad->rowptr[i + 1]; p++) {
+            phloat t = ad->data[p] < 0 ? -ad->data[p] : ad->data[p];
+            if (t > max)
+                max = t;
+        }
+        dat->scale[i] = max;
+        dat->pinv[i] = -1;
+        dat->mark[i] = -1;
+        dat->x[i] = 0;
+    }
+    dat->lp[0] = dat->up[0] = 0;
+
+    sparse_lu_data = dat;
+    mode_interruptible = sparse_lu_worker;
+    mode_stoppable = false;
+    return ERR_INTERRUPTIBLE;
 }
 
 
@@ -1019,10 +1525,9 @@ static int inv_c_completion2(int error, vartype_complexmatrix *a, int4 *perm,
 
 int linalg_inv(const vartype *src, int (*completion)(int, vartype *)) {
     int4 n;
-    int4 *perm;
     if (src->type == TYPE_REALMATRIX) {
         vartype_realmatrix *ma = (vartype_realmatrix *) src;
-        vartype *lu, *inv;
+        vartype *inv;
         n = ma->rows;
         if (n != ma->columns)
             return completion(ERR_DIMENSION_ERROR, NULL);
@@ -1030,51 +1535,26 @@ int linalg_inv(const vartype *src, int (*completion)(int, vartype *)) {
             return completion(ERR_ALPHA_DATA_IS_INVALID, NULL);
         if (n <= 2)
             return small_inv_r(ma, completion);
-        lu = new_realmatrix(n, n);
-        if (lu == NULL)
-            return completion(ERR_INSUFFICIENT_MEMORY, NULL);
         inv = new_realmatrix(n, n);
-        if (inv == NULL) {
-            free_vartype(lu);
-            return completion(ERR_INSUFFICIENT_MEMORY, NULL);
-        }
-        perm = (int4 *) malloc(n * sizeof(int4));
-        if (perm == NULL) {
-            free_vartype(lu);
-            free_vartype(inv);
+        if (inv == NULL)
             return completion(ERR_INSUFFICIENT_MEMORY, NULL);
-        }
-        matrix_copy(lu, src);
         linalg_inv_completion = completion;
         linalg_inv_result = inv;
-        return lu_decomp_r((vartype_realmatrix *) lu, perm, inv_r_completion1);
+        return cached_lu_decomp_r(ma, inv_r_completion1);
     } else {
         vartype_complexmatrix *ma = (vartype_complexmatrix *) src;
-        vartype *lu, *inv;
+        vartype *inv;
         n = ma->rows;
         if (n != ma->columns)
             return completion(ERR_DIMENSION_ERROR, NULL);
         if (n <= 2)
             return small_inv_c(ma, completion);
-        lu = new_complexmatrix(n, n);
-        if (lu == NULL)
-            return completion(ERR_INSUFFICIENT_MEMORY, NULL);
         inv = new_complexmatrix(n, n);
-        if (inv == NULL) {
-            free_vartype(lu);
-            return completion(ERR_INSUFFICIENT_MEMORY, NULL);
-        }
-        perm = (int4 *) malloc(n * sizeof(int4));
-        if (perm == NULL) {
-            free_vartype(lu);
-            free_vartype(inv);
+        if (inv == NULL)
             return completion(ERR_INSUFFICIENT_MEMORY, NULL);
-        }
-        matrix_copy(lu, src);
         linalg_inv_completion = completion;
         linalg_inv_result = inv;
-        return lu_decomp_c((vartype_complexmatrix *) lu, perm,
-                                                    inv_c_completion1);
+        return cached_lu_decomp_c(ma, inv_c_completion1);
     }
 }
 
@@ -1082,8 +1562,7 @@ static int inv_r_completion1(int error, vartype_realmatrix *a, int4 *perm,
                                 phloat det) {
     if (error != ERR_NONE) {
         free_vartype(linalg_inv_result);
-        free_vartype((vartype *) a);
-        free(perm);
+        lu_release((vartype *) a, perm);
         return linalg_inv_completion(error, NULL);
     } else {
         int4 i, n = a->rows;
@@ -1098,8 +1577,7 @@ static int inv_r_completion2(int error, vartype_realmatrix *a, int4 *perm,
                                 vartype_realmatrix *b) {
     if (error != ERR_NONE)
         free_vartype(linalg_inv_result); /* Note: linalg_inv_result == b */
-    free_vartype((vartype *) a);
-    free(perm);
+    lu_release((vartype *) a, perm);
     return linalg_inv_completion(error, linalg_inv_result);
 }
 
@@ -1107,8 +1585,7 @@ static int inv_c_completion1(int error, vartype_complexmatrix *a, int4 *perm,
                                 phloat det_re, phloat det_im) {
     if (error != ERR_NONE) {
         free_vartype(linalg_inv_result);
-        free_vartype((vartype *) a);
-        free(perm);
+        lu_release((vartype *) a, perm);
         return linalg_inv_completion(error, NULL);
     } else {
         int4 i, n = a->rows;
@@ -1124,8 +1601,7 @@ static int inv_c_completion2(int error, vartype_complexmatrix *a, int4 *perm,
                                 vartype_complexmatrix *b) {
     if (error != ERR_NONE)
         free_vartype(linalg_inv_result); /* Note: linalg_inv_result == b */
-    free_vartype((vartype *) a);
-    free(perm);
+    lu_release((vartype *) a, perm);
     return linalg_inv_completion(error, linalg_inv_result);
 }
 
@@ -1266,7 +1742,6 @@ static int det_c_completion(int error, vartype_complexmatrix *a, int4 *perm,
 
 int linalg_det(const vartype *src, int (*completion)(int, vartype *)) {
     int4 n;
-    int4 *perm;
     if (src->type == TYPE_REALMATRIX) {
         vartype_realmatrix *ma = (vartype_realmatrix *) src;
         n = ma->rows;
@@ -1284,19 +1759,6 @@ int linalg_det(const vartype *src, int (*completion)(int, vartype *)) {
                 return completion(ERR_INSUFFICIENT_MEMORY, NULL);
             return completion(ERR_NONE, v);
         }
-        ma = (vartype_realmatrix *) dup_vartype(src);
-        if (ma == NULL)
-            return completion(ERR_INSUFFICIENT_MEMORY, NULL);
-        if (!disentangle((vartype *) ma)) {
-            free_vartype((vartype *) ma);
-            return completion(ERR_INSUFFICIENT_MEMORY, NULL);
-        }
-        perm = (int4 *) malloc(n * sizeof(int4));
-        if (perm == NULL) {
-            free_vartype((vartype *) ma);
-            return completion(ERR_INSUFFICIENT_MEMORY, NULL);
-        }
-
         /* Before calling lu_decomp_r, make sure the 'singular matrix'
          * error reporting mode is on; we don't want the HP-42S compatible
          * zero-pivot-fudging to take place when all we're doing is computing
@@ -1308,7 +1770,7 @@ int linalg_det(const vartype *src, int (*completion)(int, vartype *)) {
         core_settings.matrix_singularmatrix = true;
 
         linalg_det_completion = completion;
-        return lu_decomp_r(ma, perm, det_r_completion);
+        return cached_lu_decomp_r(ma, det_r_completion);
     } else /* src->type == TYPE_COMPLEXMATRIX */ {
         vartype_complexmatrix *ma = (vartype_complexmatrix *) src;
         n = ma->rows;
@@ -1324,20 +1786,6 @@ int linalg_det(const vartype *src, int (*completion)(int, vartype *)) {
                 return completion(ERR_INSUFFICIENT_MEMORY, NULL);
             return completion(ERR_NONE, v);
         }
-        ma = (vartype_complexmatrix *) dup_vartype(src);
-        if (ma == NULL)
-            return completion(ERR_INSUFFICIENT_MEMORY, NULL);
-        if (!disentangle((vartype *) ma)) {
-            free_vartype((vartype *) ma);
-            return completion(ERR_INSUFFICIENT_MEMORY, NULL);
-        }
-        n = ma->rows;
-        perm = (int4 *) malloc(n * sizeof(int4));
-        if (perm == NULL) {
-            free_vartype((vartype *) ma);
-            return completion(ERR_INSUFFICIENT_MEMORY, NULL);
-        }
-
         /* Before calling lu_decomp_c, make sure the 'singular matrix'
          * error reporting mode is on; we don't want the HP-42S compatible
          * zero-pivot-fudging to take place when all we're doing is computing
@@ -1349,7 +1797,7 @@ int linalg_det(const vartype *src, int (*completion)(int, vartype *)) {
         core_settings.matrix_singularmatrix = true;
 
         linalg_det_completion = completion;
-        return lu_decomp_c(ma, perm, det_c_completion);
+        return cached_lu_decomp_c(ma, det_c_completion);
     }
 }
 
@@ -1359,8 +1807,7 @@ static int det_r_completion(int error, vartype_realmatrix *a, int4 *perm,
 
     core_settings.matrix_singularmatrix = linalg_det_prev_sm_err;
 
-    free_vartype((vartype *) a);
-    free(perm);
+    lu_release((vartype *) a, perm);
     if (error == ERR_SINGULAR_MATRIX) {
         det = 0;
         error = ERR_NONE;
@@ -1389,8 +1836,7 @@ static int det_c_completion(int error, vartype_complexmatrix *a, int4 *perm,
 
     core_settings.matrix_singularmatrix = linalg_det_prev_sm_err;
 
-    free_vartype((vartype *) a);
-    free(perm);
+    lu_release((vartype *) a, perm);
     if (error == ERR_SINGULAR_MATRIX) {
         det_re = 0;
         det_im = 0;
@@ -1497,3 +1943,828 @@ static int small_det_c(vartype_complexmatrix *m, phloat *dre, phloat *dim) {
             return ERR_OUT_OF_RANGE;
     return ERR_NONE;
 }
+
+
+/*************************************/
+/***** Condition number estimate *****/
+/*************************************/
+
+/* COND estimates the condition number of a square matrix in the 1-norm,
+ * ||A|| ||A^-1||, without computing the inverse. Hager's method, with
+ * Higham's refinements, as in LAPACK's xLACON, finds a lower bound for
+ * ||A^-1|| that is rarely off by more than a factor of 3, using a handful of
+ * solves with the LU decomposition and with its (conjugate) transpose, each
+ * of which takes O(n^2) steps. The decomposition comes from the cache, so it
+ * is shared with a subsequent matrix division, INVRT, or DET.
+ * The result comes with the pivot growth of that decomposition; see
+ * lu_decomp_r().
+ */
+
+#define COND_MAX_ITER 5
+
+struct cond_data_struct {
+    vartype *lu;
+    int4 *perm;
+    int4 n;
+    bool cpx;
+    phloat anorm, est, growth;
+    phloat *x;
+    phloat *sgn;
+    int4 j;
+    int iter;
+    int state;
+    int (*completion)(int, vartype *, vartype *);
+};
+
+static cond_data_struct *cond_data;
+
+static int (*linalg_cond_completion)(int, vartype *, vartype *);
+static phloat linalg_cond_anorm;
+
+static int cond_r_completion(int error, vartype_realmatrix *a, int4 *perm,
+                                    phloat det);
+static int cond_c_completion(int error, vartype_complexmatrix *a, int4 *perm,
+                                    phloat det_re, phloat det_im);
+static int cond_start(vartype *lu, int4 *perm, bool cpx);
+static int cond_worker(bool interrupted);
+
+int linalg_cond(const vartype *src,
+                int (*completion)(int, vartype *cond, vartype *growth)) {
+    phloat anorm = 0;
+    if (src->type == TYPE_REALMATRIX) {
+        vartype_realmatrix *ma = (vartype_realmatrix *) src;
+        int4 n = ma->rows;
+        if (n != ma->columns)
+            return completion(ERR_DIMENSION_ERROR, NULL, NULL);
+        if (contains_strings(ma))
+            return completion(ERR_ALPHA_DATA_IS_INVALID, NULL, NULL);
+        phloat *a = ma->array->data;
+        for (int4 c = 0; c < n; c++) {
+            phloat sum = 0;
+            for (int4 i = 0; i < n; i++) {
+                phloat t = a[i * n + c];
+                sum += t < 0 ? -t : t;
+            }
+            if (sum > anorm)
+                anorm = sum;
+        }
+        linalg_cond_completion = completion;
+        linalg_cond_anorm = anorm;
+        return cached_lu_decomp_r(ma, cond_r_completion);
+    } else /* src->type == TYPE_COMPLEXMATRIX */ {
+        vartype_complexmatrix *ma = (vartype_complexmatrix *) src;
+        int4 n = ma->rows;
+        if (n != ma->columns)
+            return completion(ERR_DIMENSION_ERROR, NULL, NULL);
+        phloat *a = ma->array->data;
+        for (int4 c = 0; c < n; c++) {
+            phloat sum = 0;
+            for (int4 i = 0; i < n; i++)
+                sum += hypot(a[2 * (i * n + c)], a[2 * (i * n + c) + 1]);
+            if (sum > anorm)
+                anorm = sum;
+        }
+        linalg_cond_completion = completion;
+        linalg_cond_anorm = anorm;
+        return cached_lu_decomp_c(ma, cond_c_completion);
+    }
+}
+
+static int cond_r_completion(int error, vartype_realmatrix *a, int4 *perm,
+                                    phloat det) {
+    if (error != ERR_NONE) {
+        lu_release((vartype *) a, perm);
+        return linalg_cond_completion(error, NULL, NULL);
+    }
+    return cond_start((vartype *) a, perm, false);
+}
+
+static int cond_c_completion(int error, vartype_complexmatrix *a, int4 *perm,
+                                    phloat det_re, phloat det_im) {
+    if (error != ERR_NONE) {
+        lu_release((vartype *) a, perm);
+        return linalg_cond_completion(error, NULL, NULL);
+    }
+    /* With the 'singular matrix' error mode on, lu_decomp_c() reports
+     * a zero pivot by stopping early, without an error.
+     */
+    if (lu_cache_growth((vartype *) a) == 0) {
+        lu_release((vartype *) a, perm);
+        return linalg_cond_completion(ERR_SINGULAR_MATRIX, NULL, NULL);
+    }
+    return cond_start((vartype *) a, perm, true);
+}
+
+static int cond_start(vartype *lu, int4 *perm, bool cpx) {
+    cond_data_struct *dat =
+            (cond_data_struct *) malloc(sizeof(cond_data_struct));
+    if (dat == NULL) {
+        lu_release(lu, perm);
+        return linalg_cond_completion(ERR_INSUFFICIENT_MEMORY, NULL, NULL);
+    }
+    int4 n = ((vartype_realmatrix *) lu)->rows;
+    dat->x = (phloat *) malloc(3 * n * sizeof(phloat));
+    if (dat->x == NULL) {
+        free(dat);
+        lu_release(lu, perm);
+        return linalg_cond_completion(ERR_INSUFFICIENT_MEMORY, NULL, NULL);
+    }
+    dat->sgn = dat->x + 2 * n;
+    dat->lu = lu;
+    dat->perm = perm;
+    dat->n = n;
+    dat->cpx = cpx;
+    dat->anorm = linalg_cond_anorm;
+    dat->est = 0;
+    dat->growth = lu_cache_growth(lu);
+    dat->completion = linalg_cond_completion;
+    dat->state = 0;
+
+    cond_data = dat;
+    mode_interruptible = cond_worker;
+    mode_stoppable = false;
+    return ERR_INTERRUPTIBLE;
+}
+
+/* x = A^-1 x, or x = A^-T x; A^T = U^T L^T P */
+static void cond_solve_r(const phloat *a, const int4 *perm, int4 n,
+                                    phloat *x, bool trans) {
+    int4 i, j;
+    if (!trans) {
+        for (i = 0; i < n; i++) {
+            phloat t = x[perm[i]];
+            x[perm[i]] = x[i];
+            for (j = 0; j < i; j++)
+                t -= a[i * n + j] * x[j];
+            x[i] = t;
+        }
+        for (i = n - 1; i >= 0; i--) {
+            phloat t = x[i];
+            for (j = i + 1; j < n; j++)
+                t -= a[i * n + j] * x[j];
+            x[i] = t / a[i * n + i];
+        }
+    } else {
+        for (j = 0; j < n; j++) {
+            phloat t = x[j] / a[j * n + j];
+            x[j] = t;
+            for (i = j + 1; i < n; i++)
+                x[i] -= a[j * n + i] * t;
+        }
+        for (j = n - 1; j > 0; j--) {
+            phloat t = x[j];
+            for (i = 0; i < j; i++)
+                x[i] -= a[j * n + i] * t;
+        }
+        for (i = n - 1; i >= 0; i--) {
+            phloat t = x[perm[i]];
+            x[perm[i]] = x[i];
+            x[i] = t;
+        }
+    }
+}
+
+/* x = A^-1 x, or x = A^-H x; A^H = U^H L^H P */
+static void cond_solve_c(const phloat *a, const int4 *perm, int4 n,
+                                    phloat *x, bool trans) {
+    int4 i, j;
+    phloat are, aim, tre, tim, d;
+    if (!trans) {
+        for (i = 0; i < n; i++) {
+            int4 l = perm[i];
+            tre = x[2 * l];
+            tim = x[2 * l + 1];
+            x[2 * l] = x[2 * i];
+            x[2 * l + 1] = x[2 * i + 1];
+            for (j = 0; j < i; j++) {
+                are = a[2 * (i * n + j)];
+                aim = a[2 * (i * n + j) + 1];
+                tre -= are * x[2 * j] - aim * x[2 * j + 1];
+                tim -= are * x[2 * j + 1] + aim * x[2 * j];
+            }
+            x[2 * i] = tre;
+            x[2 * i + 1] = tim;
+        }
+        for (i = n - 1; i >= 0; i--) {
+            tre = x[2 * i];
+            tim = x[2 * i + 1];
+            for (j = i + 1; j < n; j++) {
+                are = a[2 * (i * n + j)];
+                aim = a[2 * (i * n + j) + 1];
+                tre -= are * x[2 * j] - aim * x[2 * j + 1];
+                tim -= are * x[2 * j + 1] + aim * x[2 * j];
+            }
+            are = a[2 * (i * n + i)];
+            aim = a[2 * (i * n + i) + 1];
+            d = are * are + aim * aim;
+            x[2 * i] = (tre * are + tim * aim) / d;
+            x[2 * i + 1] = (tim * are - tre * aim) / d;
+        }
+    } else {
+        for (j = 0; j < n; j++) {
+            /* Divide by the conjugate of the pivot */
+            are = a[2 * (j * n + j)];
+            aim = a[2 * (j * n + j) + 1];
+            d = are * are + aim * aim;
+            tre = (x[2 * j] * are - x[2 * j + 1] * aim) / d;
+            tim = (x[2 * j + 1] * are + x[2 * j] * aim) / d;
+            x[2 * j] = tre;
+            x[2 * j + 1] = tim;
+            for (i = j + 1; i < n; i++) {
+                are = a[2 * (j * n + i)];
+                aim = a[2 * (j * n + i) + 1];
+                x[2 * i] -= are * tre + aim * tim;
+                x[2 * i + 1] -= are * tim - aim * tre;
+            }
+        }
+        for (j = n - 1; j > 0; j--) {
+            tre = x[2 * j];
+            tim = x[2 * j + 1];
+            for (i = 0; i < j; i++) {
+                are = a[2 * (j * n + i)];
+                aim = a[2 * (j * n + i) + 1];
+                x[2 * i] -= are * tre + aim * tim;
+                x[2 * i + 1] -= are * tim - aim * tre;
+            }
+        }
+        for (i = n - 1; i >= 0; i--) {
+            int4 l = perm[i];
+            tre = x[2 * l];
+            tim = x[2 * l + 1];
+            x[2 * l] = x[2 * i];
+            x[2 * l + 1] = x[2 * i + 1];
+            x[2 * i] = tre;
+            x[2 * i + 1] = tim;
+        }
+    }
+}
+
+static void cond_solve(cond_data_struct *dat, bool trans) {
+    if (dat->cpx)
+        cond_solve_c(((vartype_complexmatrix *) dat->lu)->array->data,
+                     dat->perm, dat->n, dat->x, trans);
+    else
+        cond_solve_r(((vartype_realmatrix *) dat->lu)->array->data,
+                     dat->perm, dat->n, dat->x, trans);
+}
+
+static phloat cond_abs(cond_data_struct *dat, int4 i) {
+    if (dat->cpx)
+        return hypot(dat->x[2 * i], dat->x[2 * i + 1]);
+    phloat t = dat->x[i];
+    return t < 0 ? -t : t;
+}
+
+static phloat cond_norm1(cond_data_struct *dat) {
+    phloat sum = 0;
+    for (int4 i = 0; i < dat->n; i++)
+        sum += cond_abs(dat, i);
+    return sum;
+}
+
+static int4 cond_argmax(cond_data_struct *dat) {
+    int4 j = 0;
+    phloat max = cond_abs(dat, 0);
+    for (int4 i = 1; i < dat->n; i++) {
+        phloat t = cond_abs(dat, i);
+        if (t > max) {
+            max = t;
+            j = i;
+        }
+    }
+    return j;
+}
+
+/* Replaces x by its signs, x / |x| in the complex case, and returns whether
+ * they're the same as last time; only used for real matrices, where a repeat
+ * means the iteration is stuck.
+ */
+static bool cond_sign(cond_data_struct *dat) {
+    bool same = true;
+    for (int4 i = 0; i < dat->n; i++) {
+        if (dat->cpx) {
+            phloat t = cond_abs(dat, i);
+            if (t == 0) {
+                dat->x[2 * i] = 1;
+                dat->x[2 * i + 1] = 0;
+            } else {
+                dat->x[2 * i] /= t;
+                dat->x[2 * i + 1] /= t;
+            }
+        } else {
+            phloat s = dat->x[i] < 0 ? -1 : 1;
+            if (s != dat->sgn[i])
+                same = false;
+            dat->sgn[i] = s;
+            dat->x[i] = s;
+        }
+    }
+    return same;
+}
+
+static void cond_unit(cond_data_struct *dat, int4 j) {
+    int4 w = dat->cpx ? 2 : 1;
+    for (int4 i = 0; i < w * dat->n; i++)
+        dat->x[i] = 0;
+    dat->x[w * j] = 1;
+}
+
+/* Each call does one solve, and works out what to solve next:
+ * state 0: x = A^-1 (1/n, ..., 1/n)
+ * state 1: x = A^-T sign(x)
+ * state 2: x = A^-1 e_j
+ * state 3: x = A^-T sign(x)
+ * state 4: x = A^-1 (1, -(1 + 1/(n-1)), 1 + 2/(n-1), ...), Higham's extra
+ *          test vector, for matrices that fool the iteration
+ */
+static int cond_worker(bool interrupted) {
+    cond_data_struct *dat = cond_data;
+    int4 n = dat->n;
+    int4 w = dat->cpx ? 2 : 1;
+    int4 i, jlast;
+    phloat t;
+    bool stuck;
+    int err = ERR_NONE;
+
+    if (interrupted) {
+        err = ERR_INTERRUPTED;
+        goto done;
+    }
+
+    switch (dat->state) {
+        case 0:
+            for (i = 0; i < w * n; i++)
+                dat->x[i] = i % w == 0 ? phloat(1) / n : phloat(0);
+            cond_solve(dat, false);
+            dat->est = cond_norm1(dat);
+            if (n == 1)
+                goto done;
+            for (i = 0; i < n; i++)
+                dat->sgn[i] = 0;
+            cond_sign(dat);
+            dat->state = 1;
+            break;
+        case 1:
+            cond_solve(dat, true);
+            dat->j = cond_argmax(dat);
+            dat->iter = 2;
+            cond_unit(dat, dat->j);
+            dat->state = 2;
+            break;
+        case 2:
+            cond_solve(dat, false);
+            t = dat->est;
+            dat->est = cond_norm1(dat);
+            stuck = cond_sign(dat) && !dat->cpx;
+            if (stuck || dat->est <= t) {
+                if (dat->est < t)
+                    dat->est = t;
+                goto alternate;
+            }
+            dat->state = 3;
+            break;
+        case 3:
+            cond_solve(dat, true);
+            jlast = dat->j;
+            dat->j = cond_argmax(dat);
+            if (cond_abs(dat, jlast) != cond_abs(dat, dat->j)
+                    && dat->iter < COND_MAX_ITER) {
+                dat->iter++;
+                cond_unit(dat, dat->j);
+                dat->state = 2;
+                break;
+            }
+            alternate:
+            for (i = 0; i < n; i++) {
+                t = 1 + phloat(i) / (n - 1);
+                dat->x[w * i] = i % 2 == 0 ? t : -t;
+                if (dat->cpx)
+                    dat->x[2 * i + 1] = 0;
+            }
+            dat->state = 4;
+            break;
+        case 4:
+            cond_solve(dat, false);
+            t = 2 * cond_norm1(dat) / (3 * n);
+            if (t > dat->est)
+                dat->est = t;
+            goto done;
+    }
+    return ERR_INTERRUPTIBLE;
+
+    done:
+    vartype *cond_v = NULL, *growth_v = NULL;
+    if (err == ERR_NONE) {
+        /* A zero matrix gets here only when zero pivots are allowed */
+        t = dat->anorm * dat->est;
+        if (dat->anorm == 0 || p_isinf(t) || p_isnan(t)) {
+            if (flags.f.range_error_ignore)
+                t = POS_HUGE_PHLOAT;
+            else
+                err = ERR_OUT_OF_RANGE;
+        }
+    }
+    if (err == ERR_NONE) {
+        cond_v = new_real(t);
+        growth_v = new_real(dat->growth);
+        if (cond_v == NULL || growth_v == NULL) {
+            free_vartype(cond_v);
+            free_vartype(growth_v);
+            cond_v = growth_v = NULL;
+            err = ERR_INSUFFICIENT_MEMORY;
+        }
+    }
+    lu_release(dat->lu, dat->perm);
+    free(dat->x);
+    int (*completion)(int, vartype *, vartype *) = dat->completion;
+    free(dat);
+    return completion(err, cond_v, growth_v);
+}
+
+
+/*******************/
+/***** Sorting *****/
+/*******************/
+
+/* SORT, ISORT, SORTR, and SORTC all sort an array of sort_items, one per
+ * element, row, or column, each holding its key and its original position.
+ * Numbers come before strings, with NaN after all other numbers, and
+ * strings are ordered by their bytes, a prefix before the longer string;
+ * elements that vartype_equals() considers equal compare equal, and keep
+ * their original order.
+ * The sort is a bottom-up merge sort. Runs of SORT_RUN items are sorted by
+ * insertion, and then merged pairwise, in passes, between the item array
+ * and a scratch array. Each phase is cut into chunks of SORT_CHUNK output
+ * items. A chunk that starts in the middle of a merge finds its starting
+ * points in the two runs by bisection, so the chunks are independent: with
+ * more than one thread and enough items, each phase is handed to the
+ * worker threads, and otherwise, the interruptible worker does a few chunks
+ * per call.
+ */
+
+#define SORT_RUN 32
+#define SORT_CHUNK 8192
+#define SORT_PAR_MIN (4 * SORT_CHUNK)
+#ifdef BCD_MATH
+#define SORT_WORK_PER_CALL 16384
+#else
+#define SORT_WORK_PER_CALL 65536
+#endif
+
+struct sort_item {
+    phloat x;
+    const char *s;
+    int4 len;
+    int4 i;
+};
+
+struct sort_data_struct {
+    vartype *src;
+    int mode;
+    int dir;
+    int4 n;
+    sort_item *a, *b;
+    int4 width;
+    int4 chunk, nchunks;
+    bool parallel;
+    int (*completion)(int, vartype *);
+};
+
+static sort_data_struct *sort_data;
+
+static int sort_cmp(const sort_item *p, const sort_item *q) {
+    if (p->s == NULL) {
+        if (q->s != NULL)
+            return -1;
+        bool pn = p_isnan(p->x) != 0;
+        bool qn = p_isnan(q->x) != 0;
+        if (pn || qn)
+            return pn - qn;
+        return p->x < q->x ? -1 : p->x > q->x ? 1 : 0;
+    }
+    if (q->s == NULL)
+        return 1;
+    int c = memcmp(p->s, q->s, p->len < q->len ? p->len : q->len);
+    if (c != 0)
+        return c;
+    return p->len < q->len ? -1 : p->len > q->len ? 1 : 0;
+}
+
+/* Returns how many of the first k items of the merge of run A, of length
+ * m, and run B, of length nb, come from A. Ties go to A.
+ */
+static int4 sort_corank(int dir, int4 k, const sort_item *a, int4 m,
+                        const sort_item *b, int4 nb) {
+    int4 lo = k > nb ? k - nb : 0;
+    int4 hi = k < m ? k : m;
+    while (lo < hi) {
+        int4 i = lo + (hi - lo) / 2;
+        if (dir * sort_cmp(a + i, b + k - i - 1) <= 0)
+            lo = i + 1;
+        else
+            hi = i;
+    }
+    return lo;
+}
+
+static void sort_chunk(sort_data_struct *dat, int4 c) {
+    int4 n = dat->n;
+    int dir = dat->dir;
+    int4 start = c * SORT_CHUNK;
+    int4 end = n - start > SORT_CHUNK ? start + SORT_CHUNK : n;
+
+    if (dat->width == 0) {
+        sort_item *a = dat->a;
+        for (int4 r = start; r < end; r += SORT_RUN) {
+            int4 rend = end - r > SORT_RUN ? r + SORT_RUN : end;
+            for (int4 i = r + 1; i < rend; i++) {
+                sort_item t = a[i];
+                int4 j = i;
+                while (j > r && dir * sort_cmp(a + j - 1, &t) > 0) {
+                    a[j] = a[j - 1];
+                    j--;
+                }
+                a[j] = t;
+            }
+        }
+        return;
+    }
+
+    int4 w = dat->width;
+    const sort_item *src = dat->a;
+    sort_item *dst = dat->b;
+    int4 pos = start;
+    while (pos < end) {
+        int4 lo = (pos / w & ~1) * w;
+        int4 mid = n - lo > w ? lo + w : n;
+        int4 hi = n - mid > w ? mid + w : n;
+        int4 stop = end < hi ? end : hi;
+        const sort_item *ra = src + lo;
+        const sort_item *rb = src + mid;
+        int4 m = mid - lo;
+        int4 nb = hi - mid;
+        int4 i = sort_corank(dir, pos - lo, ra, m, rb, nb);
+        int4 j = pos - lo - i;
+        sort_item *d = dst + pos;
+        sort_item *dend = dst + stop;
+        while (d < dend) {
+            if (j >= nb || i < m && dir * sort_cmp(ra + i, rb + j) <= 0)
+                *d++ = ra[i++];
+            else
+                *d++ = rb[j++];
+        }
+        pos = stop;
+    }
+}
+
+static void sort_part(void *ctx, int4 part) {
+    sort_chunk((sort_data_struct *) ctx, part);
+}
+
+static int sort_put(vartype_realmatrix *res, int4 k, const sort_item *item) {
+    if (item->s == NULL) {
+        res->array->data[k] = item->x;
+        return ERR_NONE;
+    }
+    return put_matrix_string(res, k, item->s, item->len)
+            ? ERR_NONE : ERR_INSUFFICIENT_MEMORY;
+}
+
+/* Builds the result from the sorted items */
+static int sort_result(sort_data_struct *dat, vartype **res) {
+    int4 n = dat->n;
+    const sort_item *items = dat->a;
+    vartype *src = dat->src;
+    vartype *v;
+    int err = ERR_NONE;
+
+    if (dat->mode == SORT_INDICES) {
+        if (src->type == TYPE_REALMATRIX) {
+            v = new_realmatrix(n, 1);
+            if (v == NULL)
+                return ERR_INSUFFICIENT_MEMORY;
+            phloat *d = ((vartype_realmatrix *) v)->array->data;
+            for (int4 k = 0; k < n; k++)
+                d[k] = items[k].i + 1;
+        } else {
+            v = new_list(n);
+            if (v == NULL)
+                return ERR_INSUFFICIENT_MEMORY;
+            vartype **d = ((vartype_list *) v)->array->data;
+            for (int4 k = 0; k < n; k++) {
+                d[k] = new_real(items[k].i + 1);
+                if (d[k] == NULL) {
+                    err = ERR_INSUFFICIENT_MEMORY;
+                    break;
+                }
+            }
+        }
+    } else if (src->type == TYPE_LIST) {
+        v = new_list(n);
+        if (v == NULL)
+            return ERR_INSUFFICIENT_MEMORY;
+        vartype **s = ((vartype_list *) src)->array->data;
+        vartype **d = ((vartype_list *) v)->array->data;
+        for (int4 k = 0; k < n; k++) {
+            d[k] = dup_vartype(s[items[k].i]);
+            if (d[k] == NULL) {
+                err = ERR_INSUFFICIENT_MEMORY;
+                break;
+            }
+        }
+    } else if (src->type == TYPE_STRING) {
+        v = new_string(NULL, n);
+        if (v == NULL)
+            return ERR_INSUFFICIENT_MEMORY;
+        char *d = ((vartype_string *) v)->txt();
+        for (int4 k = 0; k < n; k++)
+            d[k] = *items[k].s;
+    } else {
+        vartype_realmatrix *rm = (vartype_realmatrix *) src;
+        int4 rows = rm->rows;
+        int4 columns = rm->columns;
+        v = new_realmatrix(rows, columns);
+        if (v == NULL)
+            return ERR_INSUFFICIENT_MEMORY;
+        vartype_realmatrix *r = (vartype_realmatrix *) v;
+        if (dat->mode == SORT_VALUES) {
+            for (int4 k = 0; k < n && err == ERR_NONE; k++)
+                err = sort_put(r, k, items + k);
+        } else if (rm->array->nstrings == 0) {
+            phloat *s = rm->array->data;
+            phloat *d = r->array->data;
+            if (dat->mode == SORT_ROWS) {
+                for (int4 k = 0; k < n; k++)
+                    memcpy((void *) (d + k * columns),
+                           (const void *) (s + items[k].i * columns),
+                           columns * sizeof(phloat));
+            } else {
+                for (int4 i = 0; i < rows; i++)
+                    for (int4 k = 0; k < n; k++)
+                        d[i * columns + k] = s[i * columns + items[k].i];
+            }
+        } else {
+            sort_item t;
+            for (int4 i = 0; i < rows && err == ERR_NONE; i++)
+                for (int4 j = 0; j < columns && err == ERR_NONE; j++) {
+                    int4 from = dat->mode == SORT_ROWS
+                                ? items[i].i * columns + j
+                                : i * columns + items[j].i;
+                    if (get_is_string(rm->array, from)) {
+                        get_matrix_string((const vartype_realmatrix *) rm,
+                                          from, &t.s, &t.len);
+                    } else {
+                        t.s = NULL;
+                        t.x = rm->array->data[from];
+                    }
+                    err = sort_put(r, i * columns + j, &t);
+                }
+        }
+    }
+
+    if (err != ERR_NONE)
+        free_vartype(v);
+    else
+        *res = v;
+    return err;
+}
+
+static int sort_finish(sort_data_struct *dat, int err) {
+    vartype *res = NULL;
+    if (err == ERR_NONE)
+        err = sort_result(dat, &res);
+    int (*completion)(int, vartype *) = dat->completion;
+    free_vartype(dat->src);
+    free(dat->a);
+    free(dat->b);
+    free(dat);
+    return completion(err, res);
+}
+
+static int sort_worker(bool interrupted) {
+    sort_data_struct *dat = sort_data;
+
+    if (interrupted) {
+        if (dat->parallel)
+            linalg_par_cancel();
+        return sort_finish(dat, ERR_INTERRUPTED);
+    }
+
+    int4 count = 0;
+    while (true) {
+        if (dat->parallel) {
+            if (!linalg_par_wait(10))
+                return ERR_INTERRUPTIBLE;
+        } else {
+            while (dat->chunk < dat->nchunks) {
+                if (count >= SORT_WORK_PER_CALL)
+                    return ERR_INTERRUPTIBLE;
+                sort_chunk(dat, dat->chunk++);
+                count += SORT_CHUNK;
+            }
+        }
+
+        // This phase is done; the runs are now min(2 * width, n) long,
+        // or SORT_RUN after the insertion sort.
+        int4 w = dat->width;
+        if (w > 0) {
+            sort_item *t = dat->a;
+            dat->a = dat->b;
+            dat->b = t;
+        }
+        if (w == 0 ? SORT_RUN >= dat->n : w >= dat->n - w)
+            return sort_finish(dat, ERR_NONE);
+        dat->width = w == 0 ? SORT_RUN : 2 * w;
+        dat->chunk = 0;
+        if (dat->parallel) {
+            linalg_par_start(sort_part, dat, dat->nchunks);
+            return ERR_INTERRUPTIBLE;
+        }
+    }
+}
+
+int linalg_sort(const vartype *src, int mode, int4 key, bool descending,
+                int (*completion)(int, vartype *)) {
+    int4 n;
+    int err;
+    const vartype_realmatrix *rm = NULL;
+    const vartype_list *list = NULL;
+    const vartype_string *str = NULL;
+
+    if (src->type == TYPE_REALMATRIX) {
+        rm = (const vartype_realmatrix *) src;
+        n = mode == SORT_ROWS ? rm->rows
+          : mode == SORT_COLUMNS ? rm->columns
+          : rm->rows * rm->columns;
+    } else if (src->type == TYPE_LIST && mode <= SORT_INDICES) {
+        list = (const vartype_list *) src;
+        n = list->size;
+    } else if (src->type == TYPE_STRING && mode <= SORT_INDICES) {
+        str = (const vartype_string *) src;
+        n = str->length;
+    } else
+        return completion(ERR_INVALID_TYPE, NULL);
+
+    sort_data_struct *dat = (sort_data_struct *) malloc(sizeof(sort_data_struct));
+    if (dat == NULL)
+        return completion(ERR_INSUFFICIENT_MEMORY, NULL);
+    dat->a = (sort_item *) malloc((n == 0 ? 1 : n) * sizeof(sort_item));
+    dat->b = n <= SORT_RUN ? NULL : (sort_item *) malloc(n * sizeof(sort_item));
+    dat->src = dup_vartype(src);
+    if (dat->a == NULL || n > SORT_RUN && dat->b == NULL || dat->src == NULL) {
+        err = ERR_INSUFFICIENT_MEMORY;
+        goto failed;
+    }
+
+    for (int4 k = 0; k < n; k++) {
+        sort_item *item = dat->a + k;
+        item->i = k;
+        item->s = NULL;
+        if (rm != NULL) {
+            int4 e = mode == SORT_ROWS ? k * rm->columns + key
+                   : mode == SORT_COLUMNS ? key * rm->columns + k
+                   : k;
+            if (get_is_string(rm->array, e))
+                get_matrix_string(rm, e, &item->s, &item->len);
+            else
+                item->x = rm->array->data[e];
+        } else if (list != NULL) {
+            const vartype *v = list->array->data[k];
+            if (v->type == TYPE_REAL) {
+                item->x = ((const vartype_real *) v)->x;
+            } else if (v->type == TYPE_STRING) {
+                item->s = ((const vartype_string *) v)->txt();
+                item->len = ((const vartype_string *) v)->length;
+            } else {
+                err = ERR_INVALID_TYPE;
+                goto failed;
+            }
+        } else {
+            item->s = str->txt() + k;
+            item->len = 1;
+        }
+    }
+
+    dat->mode = mode;
+    dat->dir = descending ? -1 : 1;
+    dat->n = n;
+    dat->width = 0;
+    dat->chunk = 0;
+    dat->nchunks = n == 0 ? 0 : (n - 1) / SORT_CHUNK + 1;
+    dat->parallel = linalg_par_threads() > 1 && n >= SORT_PAR_MIN;
+    dat->completion = completion;
+    if (dat->parallel)
+        linalg_par_start(sort_part, dat, dat->nchunks);
+
+    sort_data = dat;
+    mode_interruptible = sort_worker;
+    mode_stoppable = false;
+    return ERR_INTERRUPTIBLE;
+
+    failed:
+    free_vartype(dat->src);
+    free(dat->a);
+    free(dat->b);
+    free(dat);
+    return completion(err, NULL);
+}
@@ -26,5 +26,20 @@ int linalg_mul(const vartype *left, const vartype *right,
                              int (*completion)(int, vartype *));
 int linalg_inv(const vartype *src, int (*completion)(int, vartype *));
 int linalg_det(const vartype *src, int (*completion)(int, vartype *));
+int linalg_cond(const vartype *src,
+                int (*completion)(int, vartype *cond, vartype *growth));
+void linalg_clear_lu_cache();
+
+/* Stable sort of a real matrix, list, or string. SORT_VALUES returns the
+ * elements in order; SORT_INDICES returns their original, 1-based positions;
+ * SORT_ROWS and SORT_COLUMNS reorder the rows or columns of a real matrix by
+ * the elements in column or row 'key', 0-based.
+ */
+#define SORT_VALUES 0
+#define SORT_INDICES 1
+#define SORT_ROWS 2
+#define SORT_COLUMNS 3
+int linalg_sort(const vartype *src, int mode, int4 key, bool descending,
+                int (*completion)(int, vartype *));
 
 #endif
@@ -15,34 +15,331 @@
  * along with this program; if not, see http://www.gnu.org/licenses/.
  *****************************************************************************/
 
+#include <math.h>
 #include <stdlib.h>
+#include <string.h>
+#ifdef FREE42_THREADS
+#include <pthread.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
 
 #include "core_linalg2.h"
 #include "core_globals.h"
 #include "core_main.h"
 
 
-#define STATE(s)             \
-        if (--count <= 0) {  \
-            dat->state = s;  \
-            goto suspend;    \
-        }                    \
-        state##s:            \
+/* Suspends the worker after a step that did w multiply-adds' worth of work,
+ * if that used up its share for this call
+ */
+#define STATE_WORK(s, w)             \
+        if ((count -= (w)) <= 0) {   \
+            dat->state = s;          \
+            goto suspend;            \
+        }                            \
+        state##s:                    \
         ;
 
 
+/**************************/
+/***** Worker threads *****/
+/**************************/
+
+#ifdef FREE42_THREADS
+
+#define PAR_MAX_THREADS 64
+
+static int par_nthreads = 0;
+static pthread_mutex_t par_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t par_work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t par_done_cond = PTHREAD_COND_INITIALIZER;
+static void (*par_task)(void *ctx, int4 part);
+static void *par_ctx;
+static int4 par_parts = 0;
+static int4 par_next = 0;
+static int4 par_finished = 0;
+static bool par_cancelled;
+
+/* Called with par_mutex held; returns with par_mutex held. */
+static void par_run_one() {
+    int4 part = par_next++;
+    bool skip = par_cancelled;
+    pthread_mutex_unlock(&par_mutex);
+    if (!skip)
+        par_task(par_ctx, part);
+    pthread_mutex_lock(&par_mutex);
+    if (++par_finished == par_parts)
+        pthread_cond_broadcast(&par_done_cond);
+}
+
+static void *par_thread(void *arg) {
+    pthread_mutex_lock(&par_mutex);
+    while (true) {
+        while (par_next >= par_parts)
+            pthread_cond_wait(&par_work_cond, &par_mutex);
+        par_run_one();
+    }
+    return NULL;
+}
+
+int linalg_par_threads() {
+    if (par_nthreads == 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        if (n > PAR_MAX_THREADS)
+            n = PAR_MAX_THREADS;
+        par_nthreads = 1;
+        if (n > 1) {
+            par_nthreads = 0;
+            for (int i = 0; i < n; i++) {
+                pthread_t t;
+                if (pthread_create(&t, NULL, par_thread, NULL) != 0)
+                    break;
+                pthread_detach(t);
+                par_nthreads++;
+            }
+            if (par_nthreads == 0)
+                par_nthreads = 1;
+        }
+    }
+    return par_nthreads;
+}
+
+void linalg_par_start(void (*task)(void *ctx, int4 part), void *ctx, int4 nparts) {
+    pthread_mutex_lock(&par_mutex);
+    par_task = task;
+    par_ctx = ctx;
+    par_finished = 0;
+    par_next = 0;
+    par_cancelled = false;
+    par_parts = nparts;
+    pthread_cond_broadcast(&par_work_cond);
+    pthread_mutex_unlock(&par_mutex);
+}
+
+bool linalg_par_wait(int ms) {
+    pthread_mutex_lock(&par_mutex);
+    if (ms < 0) {
+        while (par_next < par_parts)
+            par_run_one();
+        while (par_finished < par_parts)
+            pthread_cond_wait(&par_done_cond, &par_mutex);
+    } else if (par_finished < par_parts) {
+        struct timeval now;
+        struct timespec until;
+        gettimeofday(&now, NULL);
+        int8 nsec = (now.tv_usec + ms * 1000LL) * 1000;
+        until.tv_sec = now.tv_sec + (time_t) (nsec / 1000000000);
+        until.tv_nsec = (long) (nsec % 1000000000);
+        pthread_cond_timedwait(&par_done_cond, &par_mutex, &until);
+    }
+    bool done = par_finished == par_parts;
+    pthread_mutex_unlock(&par_mutex);
+    return done;
+}
+
+void linalg_par_cancel() {
+    pthread_mutex_lock(&par_mutex);
+    par_cancelled = true;
+    pthread_mutex_unlock(&par_mutex);
+    linalg_par_wait(-1);
+}
+
+#else
+
+int linalg_par_threads() {
+    return 1;
+}
+
+static void (*par_task)(void *ctx, int4 part);
+static void *par_ctx;
+static int4 par_parts = 0;
+
+void linalg_par_start(void (*task)(void *ctx, int4 part), void *ctx, int4 nparts) {
+    par_task = task;
+    par_ctx = ctx;
+    par_parts = nparts;
+}
+
+bool linalg_par_wait(int ms) {
+    for (int4 part = 0; part < par_parts; part++)
+        par_task(par_ctx, part);
+    par_parts = 0;
+    return true;
+}
+
+void linalg_par_cancel() {
+    par_parts = 0;
+}
+
+#endif
+
+
+#ifndef BCD_MATH
+
+void linalg_split_rows(phloat *a, int4 rows, int4 n, phloat *tmp) {
+    for (int4 i = 0; i < rows; i++) {
+        phloat *row = a + 2 * i * n;
+        memcpy(tmp, row, 2 * n * sizeof(phloat));
+        for (int4 c = 0; c < n; c++) {
+            row[c] = tmp[2 * c];
+            row[n + c] = tmp[2 * c + 1];
+        }
+    }
+}
+
+void linalg_join_rows(phloat *a, int4 rows, int4 n, phloat *tmp) {
+    for (int4 i = 0; i < rows; i++) {
+        phloat *row = a + 2 * i * n;
+        memcpy(tmp, row, 2 * n * sizeof(phloat));
+        for (int4 c = 0; c < n; c++) {
+            row[2 * c] = tmp[c];
+            row[2 * c + 1] = tmp[n + c];
+        }
+    }
+}
+
+#endif
+
+
 /****************************/
 /***** LU decomposition *****/
 /****************************/
 
+/* LU decomposition with partial pivoting, blocked right-looking version.
+ * The columns are processed in panels of LU_BLOCK_SIZE. Each panel is
+ * factored one column at a time; then the rows of U to the right of the panel
+ * are computed, and finally the panel's contribution is subtracted from the
+ * trailing submatrix, in chunks of LU_CHUNK columns so that the rows of U
+ * being used stay in the cache. The trailing update is where almost all the
+ * work is, and it is done by the worker threads for large matrices.
+ * Every element receives its updates in order of increasing k, just like
+ * in the Crout algorithm that this replaces, so the results are the same.
+ */
+
+#define LU_BLOCK_SIZE 32
+#define LU_CHUNK 256
+
+/* Element (i, c) of an n x n complex matrix that's being decomposed; in the
+ * binary version, its rows are split, see linalg_split_rows().
+ */
+#ifdef BCD_MATH
+#define LU_RE(a, n, i, c) (a)[2 * ((i) * (n) + (c))]
+#define LU_IM(a, n, i, c) (a)[2 * ((i) * (n) + (c)) + 1]
+#else
+#define LU_RE(a, n, i, c) (a)[2 * (i) * (n) + (c)]
+#define LU_IM(a, n, i, c) (a)[(2 * (i) + 1) * (n) + (c)]
+#endif
+
+static void lu_update_r(phloat *a, int4 n, int4 i0, int4 i1,
+                        int4 k0, int4 k1, int4 c0, int4 c1) {
+    for (int4 i = i0; i < i1; i++) {
+        phloat *arow = a + i * n;
+        for (int4 k = k0; k < k1; k++) {
+            phloat lik = arow[k];
+            const phloat *urow = a + k * n;
+            for (int4 c = c0; c < c1; c++)
+                arow[c] -= lik * urow[c];
+        }
+    }
+}
+
+static void lu_update_c(phloat *a, int4 n, int4 i0, int4 i1,
+                        int4 k0, int4 k1, int4 c0, int4 c1) {
+    for (int4 i = i0; i < i1; i++) {
+        for (int4 k = k0; k < k1; k++) {
+            phloat xre = LU_RE(a, n, i, k);
+            phloat xim = LU_IM(a, n, i, k);
+            for (int4 c = c0; c < c1; c++) {
+                phloat yre = LU_RE(a, n, k, c);
+                phloat yim = LU_IM(a, n, k, c);
+                LU_RE(a, n, i, c) -= xre * yre - xim * yim;
+                LU_IM(a, n, i, c) -= xim * yre + xre * yim;
+            }
+        }
+    }
+}
+
+struct lu_par_data_struct {
+    phloat *a;
+    int4 n, jb, jend;
+    int4 rows_per_part;
+    bool cpx;
+};
+
+static lu_par_data_struct lu_par_data;
+
+static void lu_trailing_part(void *ctx, int4 part) {
+    lu_par_data_struct *dat = (lu_par_data_struct *) ctx;
+    int4 n = dat->n;
+    int4 istart = dat->jend + part * dat->rows_per_part;
+    int4 iend = istart + dat->rows_per_part;
+    if (iend > n)
+        iend = n;
+    for (int4 c0 = dat->jend; c0 < n; c0 += LU_CHUNK) {
+        int4 c1 = c0 + LU_CHUNK < n ? c0 + LU_CHUNK : n;
+        if (dat->cpx)
+            lu_update_c(dat->a, n, istart, iend, dat->jb, dat->jend, c0, c1);
+        else
+            lu_update_r(dat->a, n, istart, iend, dat->jb, dat->jend, c0, c1);
+    }
+}
+
+static bool lu_par_start(phloat *a, int4 n, int4 jb, int4 jend, bool cpx) {
+    int nthreads = linalg_par_threads();
+    int4 rows = n - jend;
+    if (nthreads == 1
+            || ((double) rows) * rows * (jend - jb) * (cpx ? 4 : 1) < PAR_MIN_WORK)
+        return false;
+    lu_par_data_struct *dat = &lu_par_data;
+    dat->a = a;
+    dat->n = n;
+    dat->jb = jb;
+    dat->jend = jend;
+    dat->cpx = cpx;
+    int4 parts = rows < 4 * nthreads ? rows : 4 * nthreads;
+    dat->rows_per_part = (rows + parts - 1) / parts;
+    linalg_par_start(lu_trailing_part, dat, (rows + dat->rows_per_part - 1) / dat->rows_per_part);
+    return true;
+}
+
+/* The pivot growth of a finished decomposition: the largest element of U,
+ * relative to the largest one of the original matrix, which the workers
+ * find while computing the scale factors. Gaussian elimination with partial
+ * pivoting is only as accurate as this is small.
+ */
+static phloat lu_growth_r(const phloat *a, int4 n, phloat amax) {
+    phloat umax = 0;
+    for (int4 i = 0; i < n; i++)
+        for (int4 c = i; c < n; c++) {
+            phloat tmp = a[i * n + c];
+            if (tmp < 0)
+                tmp = -tmp;
+            if (tmp > umax)
+                umax = tmp;
+        }
+    return amax == 0 ? 1 : umax / amax;
+}
+
+static phloat lu_growth_c(const phloat *a, int4 n, phloat amax) {
+    phloat umax = 0;
+    for (int4 i = 0; i < n; i++)
+        for (int4 c = i; c < n; c++) {
+            phloat tmp = hypot(a[2 * (i * n + c)], a[2 * (i * n + c) + 1]);
+            if (tmp > umax)
+                umax = tmp;
+        }
+    return amax == 0 ? 1 : umax / amax;
+}
+
 struct lu_r_data_struct {
     vartype_realmatrix *a;
     int4 *perm;
     phloat det;
-    int4 i, imax, j, k;
-    phloat max, tmp, sum, *scale;
+    phloat amax;
+    int4 i, j, jb, c0;
+    phloat *scale;
     int state;
-    int (*completion)(int, vartype_realmatrix *, int4 *, phloat);
+    int (*completion)(int, vartype_realmatrix *, int4 *, phloat, phloat);
 };
 
 lu_r_data_struct *lu_r_data;
@@ -50,17 +347,18 @@ lu_r_data_struct *lu_r_data;
 static int lu_decomp_r_worker(bool interrupted);
 
 int lu_decomp_r(vartype_realmatrix *a, int4 *perm,
-                int (*completion)(int, vartype_realmatrix *, int4 *, phloat)) {
+                int (*completion)(int, vartype_realmatrix *, int4 *,
+                                                        phloat, phloat)) {
     lu_r_data_struct *dat =
                 (lu_r_data_struct *) malloc(sizeof(lu_r_data_struct));
 
     if (dat == NULL)
-        return completion(ERR_INSUFFICIENT_MEMORY, a, perm, 0);
+        return completion(ERR_INSUFFICIENT_MEMORY, a, perm, 0, 0);
 
     dat->scale = (phloat *) malloc(a->rows * sizeof(phloat));
     if (dat->scale == NULL) {
         free(dat);
-        return completion(ERR_INSUFFICIENT_MEMORY, a, perm, 0);
+        return completion(ERR_INSUFFICIENT_MEMORY, a, perm, 0, 0);
     }
 
     dat->a = a;
@@ -83,24 +381,27 @@ static int lu_decomp_r_worker(bool interrupted) {
     int4 n = dat->a->rows;
     phloat *scale = dat->scale;
     int4 *perm = dat->perm;
-    int count = 1000;
+    int4 count = LINALG_WORK_PER_CALL;
     int err;
 
     int4 i = dat->i;
-    int4 imax = dat->imax;
     int4 j = dat->j;
-    int4 k = dat->k;
-    phloat max = dat->max;
-    phloat tmp = dat->tmp;
-    phloat sum = dat->sum;
+    int4 jb = dat->jb;
+    int4 c0 = dat->c0;
+    int4 jend, imax, c;
+    phloat max, tmp;
 
     if (interrupted) {
+        if (dat->state == 4)
+            linalg_par_cancel();
         free(scale);
-        err = dat->completion(ERR_INTERRUPTED, dat->a, perm, 0);
+        err = dat->completion(ERR_INTERRUPTED, dat->a, perm, 0, 0);
         free(dat);
         return err;
     }
 
+    jend = jb + LU_BLOCK_SIZE < n ? jb + LU_BLOCK_SIZE : n;
+
     switch (dat->state) {
         case 0: break;
         case 1: goto state1;
@@ -111,109 +412,127 @@ static int lu_decomp_r_worker(bool interrupted) {
     }
 
     dat->det = 1;
+    dat->amax = 0;
 
     for (i = 0; i < n; i++) {
         max = 0;
-        for (j = 0; j < n; j++) {
-            tmp = a[i * n + j];
+        for (c = 0; c < n; c++) {
+            tmp = a[i * n + c];
             if (tmp < 0)
                 tmp = -tmp;
             if (tmp > max)
                 max = tmp;
-            STATE(1);
         }
         scale[i] = max;
+        if (max > dat->amax)
+            dat->amax = max;
+        STATE_WORK(1, n);
     }
 
-    for (j = 0; j < n; j++) {
-        for (i = 0; i < j; i++) {
-            sum = a[i * n + j];
-            for (k = 0; k < i; k++) {
-                sum -= a[i * n + k] * a[k * n + j];
-                STATE(2);
+    for (jb = 0; jb < n; jb += LU_BLOCK_SIZE) {
+        jend = jb + LU_BLOCK_SIZE < n ? jb + LU_BLOCK_SIZE : n;
+
+        /* Factor the panel */
+        for (j = jb; j < jend; j++) {
+            max = 0;
+            imax = j;
+            for (i = j; i < n; i++) {
+                if (scale[i] == 0) {
+                    imax = i;
+                    break;
+                }
+                tmp = a[i * n + j];
+                tmp = (tmp < 0 ? -tmp : tmp) / scale[i];
+                if (tmp > max) {
+                    imax = i;
+                    max = tmp;
+                }
             }
-            a[i * n + j] = sum;
-        }
 
-        max = 0;
-        imax = j;
-        for (i = j; i < n; i++) {
-            sum = a[i * n + j];
-            for (k = 0; k < j; k++) {
-                sum -= a[i * n + k] * a[k * n + j];
-                STATE(3);
+            if (j != imax) {
+                for (c = 0; c < n; c++) {
+                    tmp = a[imax * n + c];
+                    a[imax * n + c] = a[j * n + c];
+                    a[j * n + c] = tmp;
+                }
+                dat->det = -dat->det;
+                scale[imax] = scale[j];
             }
-            a[i * n  + j] = sum;
-            if (scale[i] == 0) {
-                imax = i;
-                break;
+
+            perm[j] = imax;
+            if (a[j * n + j] == 0) {
+                if (core_settings.matrix_singularmatrix) {
+                    free(scale);
+                    err = dat->completion(ERR_SINGULAR_MATRIX, dat->a, perm, 0, 0);
+                    free(dat);
+                    return err;
+                } else {
+                    /* For a zero pivot, substitute a small positive number.
+                     * I use a number that's about 10^-20 times the size of
+                     * the maximum of the original column, with a minimum of
+                     * 10^20 / POS_HUGE_PHLOAT.
+                     */
+                    phloat tiniest = 1e20 / POS_HUGE_PHLOAT;
+                    phloat tiny;
+                    if (scale[j] == 0)
+                        tiny = tiniest;
+                    else {
+                        tiny = pow(10, floor(log10(scale[j])) - 20);
+                        if (tiny < tiniest)
+                            tiny = tiniest;
+                    }
+                    a[j * n + j] = tiny;
+                }
             }
-            tmp = (sum < 0 ? -sum : sum) / scale[i];
-            if (tmp > max) {
-                imax = i;
-                max = tmp;
+            dat->det *= a[j * n + j];
+            if (j != n - 1) {
+                tmp = 1 / a[j * n + j];
+                for (i = j + 1; i < n; i++)
+                    a[i * n + j] *= tmp;
             }
-        }
 
-        if (j != imax) {
-            for (k = 0; k < n; k++) {
-                tmp = a[imax * n + k];
-                a[imax * n + k] = a[j * n + k];
-                a[j * n + k] = tmp;
-                STATE(4);
+            for (i = j + 1; i < n; i++) {
+                lu_update_r(a, n, i, i + 1, j, j + 1, j + 1, jend);
+                STATE_WORK(2, jend - j);
             }
-            dat->det = -dat->det;
-            scale[imax] = scale[j];
         }
 
-        perm[j] = imax;
-        if (a[j * n + j] == 0) {
-            if (core_settings.matrix_singularmatrix) {
-                free(scale);
-                err = dat->completion(ERR_SINGULAR_MATRIX, dat->a, perm, 0);
-                free(dat);
-                return err;
-            } else {
-                /* For a zero pivot, substitute a small positive number.
-                 * I use a number that's about 10^-20 times the size of
-                 * the maximum of the original column, with a minimum of
-                 * 10^20 / POS_HUGE_PHLOAT.
-                 */
-                phloat tiniest = 1e20 / POS_HUGE_PHLOAT;
-                phloat tiny;
-                if (scale[j] == 0)
-                    tiny = tiniest;
-                else {
-                    tiny = pow(10, floor(log10(scale[j])) - 20);
-                    if (tiny < tiniest)
-                        tiny = tiniest;
-                }
-                a[j * n + j] = tiny;
-            }
+        /* The rows of U to the right of the panel */
+        for (i = jb + 1; i < jend; i++) {
+            lu_update_r(a, n, i, i + 1, jb, i, jend, n);
+            STATE_WORK(3, (i - jb) * (n - jend) + 1);
         }
-        dat->det *= a[j * n + j];
-        if (j != n - 1) {
-            tmp = 1 / a[j * n + j];
-            for (i = j + 1; i < n; i++) {
-                a[i * n + j] *= tmp;
-                STATE(5);
+
+        /* The trailing submatrix */
+        if (lu_par_start(a, n, jb, jend, false)) {
+            while (!linalg_par_wait(10)) {
+                dat->state = 4;
+                goto suspend;
+                state4:
+                ;
+            }
+        } else {
+            for (c0 = jend; c0 < n; c0 += LU_CHUNK) {
+                for (i = jend; i < n; i++) {
+                    c = c0 + LU_CHUNK < n ? c0 + LU_CHUNK : n;
+                    lu_update_r(a, n, i, i + 1, jb, jend, c0, c);
+                    STATE_WORK(5, (jend - jb) * (c - c0));
+                }
             }
         }
     }
 
     free(scale);
-    err = dat->completion(ERR_NONE, dat->a, perm, dat->det);
+    err = dat->completion(ERR_NONE, dat->a, perm, dat->det,
+                          lu_growth_r(a, n, dat->amax));
     free(dat);
     return err;
 
     suspend:
     dat->i = i;
-    dat->imax = imax;
     dat->j = j;
-    dat->k = k;
-    dat->max = max;
-    dat->tmp = tmp;
-    dat->sum = sum;
+    dat->jb = jb;
+    dat->c0 = c0;
     return ERR_INTERRUPTIBLE;
 }
 
@@ -222,10 +541,12 @@ struct lu_c_data_struct {
     vartype_complexmatrix *a;
     int4 *perm;
     phloat det_re, det_im;
-    int4 i, imax, j, k;
-    phloat max, tmp, tmp_re, tmp_im, sum_re, sum_im, s_re, s_im, *scale;
+    phloat amax;
+    int4 i, j, jb, c0;
+    phloat *scale;
     int state;
-    int (*completion)(int, vartype_complexmatrix *, int4 *, phloat, phloat);
+    int (*completion)(int, vartype_complexmatrix *, int4 *,
+                                            phloat, phloat, phloat);
 };
 
 lu_c_data_struct *lu_c_data;
@@ -234,17 +555,23 @@ static int lu_decomp_c_worker(bool interrupted);
 
 int lu_decomp_c(vartype_complexmatrix *a, int4 *perm,
                 int (*completion)(int, vartype_complexmatrix *,
-                                          int4 *, phloat, phloat)) {
+                                          int4 *, phloat, phloat, phloat)) {
     lu_c_data_struct *dat =
                 (lu_c_data_struct *) malloc(sizeof(lu_c_data_struct));
 
     if (dat == NULL)
-        return completion(ERR_INSUFFICIENT_MEMORY, a, perm, 0, 0);
-
-    dat->scale = (phloat *) malloc(a->rows * sizeof(phloat));
+        return completion(ERR_INSUFFICIENT_MEMORY, a, perm, 0, 0, 0);
+
+    int4 n = a->rows;
+#ifdef BCD_MATH
+    dat->scale = (phloat *) malloc(n * sizeof(phloat));
+#else
+    /* The scale factors, followed by the scratch row for the layout changes */
+    dat->scale = (phloat *) malloc(3 * n * sizeof(phloat));
+#endif
     if (dat->scale == NULL) {
         free(dat);
-        return completion(ERR_INSUFFICIENT_MEMORY, a, perm, 0, 0);
+        return completion(ERR_INSUFFICIENT_MEMORY, a, perm, 0, 0, 0);
     }
 
     dat->a = a;
@@ -253,12 +580,27 @@ int lu_decomp_c(vartype_complexmatrix *a, int4 *perm,
 
     dat->state = 0;
 
+#ifndef BCD_MATH
+    linalg_split_rows(a->array->data, n, n, dat->scale + n);
+#endif
+
     lu_c_data = dat;
     mode_interruptible = lu_decomp_c_worker;
     mode_stoppable = false;
     return ERR_INTERRUPTIBLE;
 }
 
+/* Frees the scale factors, and in the binary version, puts the matrix back
+ * in the usual layout.
+ */
+static void lu_c_cleanup(lu_c_data_struct *dat) {
+#ifndef BCD_MATH
+    int4 n = dat->a->rows;
+    linalg_join_rows(dat->a->array->data, n, n, dat->scale + n);
+#endif
+    free(dat->scale);
+}
+
 static int lu_decomp_c_worker(bool interrupted) {
 
     lu_c_data_struct *dat = lu_c_data;
@@ -267,33 +609,30 @@ static int lu_decomp_c_worker(bool interrupted) {
     int4 n = dat->a->rows;
     phloat *scale = dat->scale;
     int4 *perm = dat->perm;
-    int count = 1000;
+    int4 count = LINALG_WORK_PER_CALL;
     int err;
 
     int4 i = dat->i;
-    int4 imax = dat->imax;
     int4 j = dat->j;
-    int4 k = dat->k;
-    phloat max = dat->max;
-    phloat tmp = dat->tmp;
-    phloat tmp_re = dat->tmp_re;
-    phloat tmp_im = dat->tmp_im;
-    phloat sum_re = dat->sum_re;
-    phloat sum_im = dat->sum_im;
-    phloat s_re = dat->s_re;
-    phloat s_im = dat->s_im;
-
-    phloat xre, xim, yre, yim;
+    int4 jb = dat->jb;
+    int4 c0 = dat->c0;
+    int4 jend, imax, c;
+    phloat max, tmp, tmp_re, tmp_im, s_re, s_im;
+
     phloat tiniest = 1e20 / POS_HUGE_PHLOAT;
     phloat tiny;
 
     if (interrupted) {
-        free(scale);
-        err = dat->completion(ERR_INTERRUPTED, dat->a, perm, 0, 0);
+        if (dat->state == 4)
+            linalg_par_cancel();
+        lu_c_cleanup(dat);
+        err = dat->completion(ERR_INTERRUPTED, dat->a, perm, 0, 0, 0);
         free(dat);
         return err;
     }
 
+    jend = jb + LU_BLOCK_SIZE < n ? jb + LU_BLOCK_SIZE : n;
+
     switch (dat->state) {
         case 0: break;
         case 1: goto state1;
@@ -305,138 +644,137 @@ static int lu_decomp_c_worker(bool interrupted) {
 
     dat->det_re = 1;
     dat->det_im = 0;
+    dat->amax = 0;
 
     for (i = 0; i < n; i++) {
         max = 0;
-        for (j = 0; j < n; j++) {
-            tmp = hypot(a[2 * (i * n + j)], a[2 * (i * n + j) + 1]);
+        for (c = 0; c < n; c++) {
+            tmp = hypot(LU_RE(a, n, i, c), LU_IM(a, n, i, c));
             if (tmp > max)
                 max = tmp;
-            STATE(1);
         }
         scale[i] = max;
+        if (max > dat->amax)
+            dat->amax = max;
+        STATE_WORK(1, n);
     }
 
-    for (j = 0; j < n; j++) {
-        for (i = 0; i < j; i++) {
-            sum_re = a[2 * (i * n + j)];
-            sum_im = a[2 * (i * n + j) + 1];
-            for (k = 0; k < i; k++) {
-                xre = a[2 * (i * n + k)];
-                xim = a[2 * (i * n + k) + 1];
-                yre = a[2 * (k * n + j)];
-                yim = a[2 * (k * n + j) + 1];
-                sum_re -= xre * yre - xim * yim;
-                sum_im -= xim * yre + xre * yim;
-                STATE(2);
+    for (jb = 0; jb < n; jb += LU_BLOCK_SIZE) {
+        jend = jb + LU_BLOCK_SIZE < n ? jb + LU_BLOCK_SIZE : n;
+
+        /* Factor the panel */
+        for (j = jb; j < jend; j++) {
+            max = 0;
+            imax = j;
+            for (i = j; i < n; i++) {
+                if (scale[i] == 0) {
+                    imax = i;
+                    break;
+                }
+                tmp = hypot(LU_RE(a, n, i, j), LU_IM(a, n, i, j)) / scale[i];
+                if (tmp > max) {
+                    imax = i;
+                    max = tmp;
+                }
             }
-            a[2 * (i * n + j)] = sum_re;
-            a[2 * (i * n + j) + 1] = sum_im;
-        }
 
-        max = 0;
-        imax = j;
-        for (i = j; i < n; i++) {
-            sum_re = a[2 * (i * n + j)];
-            sum_im = a[2 * (i * n + j) + 1];
-            for (k = 0; k < j; k++) {
-                xre = a[2 * (i * n + k)];
-                xim = a[2 * (i * n + k) + 1];
-                yre = a[2 * (k * n + j)];
-                yim = a[2 * (k * n + j) + 1];
-                sum_re -= xre * yre - xim * yim;
-                sum_im -= xim * yre + xre * yim;
-                STATE(3);
+            if (j != imax) {
+                for (c = 0; c < n; c++) {
+                    tmp = LU_RE(a, n, imax, c);
+                    LU_RE(a, n, imax, c) = LU_RE(a, n, j, c);
+                    LU_RE(a, n, j, c) = tmp;
+                    tmp = LU_IM(a, n, imax, c);
+                    LU_IM(a, n, imax, c) = LU_IM(a, n, j, c);
+                    LU_IM(a, n, j, c) = tmp;
+                }
+                dat->det_re = -dat->det_re;
+                dat->det_im = -dat->det_im;
+                scale[imax] = scale[j];
             }
-            a[2 * (i * n + j)] = sum_re;
-            a[2 * (i * n + j) + 1] = sum_im;
-            if (scale[i] == 0) {
-                imax = i;
-                break;
+
+            perm[j] = imax;
+            tmp_re = LU_RE(a, n, j, j);
+            tmp_im = LU_IM(a, n, j, j);
+            if (tmp_re == 0 && tmp_im == 0) {
+                if (core_settings.matrix_singularmatrix) {
+                    lu_c_cleanup(dat);
+                    err = dat->completion(ERR_NONE, dat->a, perm, 0, 0, 0);
+                    free(dat);
+                    return err;
+                } else {
+                    /* For a zero pivot, substitute a small positive number.
+                     * I use a number that's about 10^-20 times the size of
+                     * the maximum of the original column, with a minimum of
+                     * 10^20 / POS_HUGE_PHLOAT.
+                     */
+                    if (scale[j] == 0)
+                        tiny = tiniest;
+                    else {
+                        tiny = pow(10, floor(log10(scale[j])) - 20);
+                        if (tiny < tiniest)
+                            tiny = tiniest;
+                    }
+                    LU_RE(a, n, j, j) = tmp_re = tiny;
+                    LU_IM(a, n, j, j) = tmp_im = 0;
+                }
             }
-            tmp = hypot(sum_re, sum_im) / scale[i];
-            if (tmp > max) {
-                imax = i;
-                max = tmp;
+            tmp = dat->det_re * tmp_re - dat->det_im * tmp_im;
+            dat->det_im = dat->det_im * tmp_re + dat->det_re * tmp_im;
+            dat->det_re = tmp;
+            if (j != n - 1) {
+                tmp = hypot(tmp_re, tmp_im);
+                s_re = tmp_re / tmp / tmp;
+                s_im = -tmp_im / tmp / tmp;
+                for (i = j + 1; i < n; i++) {
+                    tmp_re = LU_RE(a, n, i, j);
+                    tmp_im = LU_IM(a, n, i, j);
+                    LU_RE(a, n, i, j) = tmp_re * s_re - tmp_im * s_im;
+                    LU_IM(a, n, i, j) = tmp_im * s_re + tmp_re * s_im;
+                }
             }
-        }
 
-        if (j != imax) {
-            for (k = 0; k < n; k++) {
-                tmp = a[2 * (imax * n + k)];
-                a[2 * (imax * n + k)] = a[2 * (j * n + k)];
-                a[2 * (j * n + k)] = tmp;
-                tmp = a[2 * (imax * n + k) + 1];
-                a[2 * (imax * n + k) + 1] = a[2 * (j * n + k) + 1];
-                a[2 * (j * n + k) + 1] = tmp;
-                STATE(4);
+            for (i = j + 1; i < n; i++) {
+                lu_update_c(a, n, i, i + 1, j, j + 1, j + 1, jend);
+                STATE_WORK(2, 4 * (jend - j));
             }
-            dat->det_re = -dat->det_re;
-            dat->det_im = -dat->det_im;
-            scale[imax] = scale[j];
         }
 
-        perm[j] = imax;
-        tmp_re = a[2 * (j * n + j)];
-        tmp_im = a[2 * (j * n + j) + 1];
-        if (tmp_re == 0 && tmp_im == 0) {
-            if (core_settings.matrix_singularmatrix) {
-                free(scale);
-                err = dat->completion(ERR_NONE, dat->a, perm, 0, 0);
-                free(dat);
-                return err;
-            } else {
-                /* For a zero pivot, substitute a small positive number.
-                 * I use a number that's about 10^-20 times the size of
-                 * the maximum of the original column, with a minimum of
-                 * 10^20 / POS_HUGE_PHLOAT.
-                 */
-                if (scale[j] == 0)
-                    tiny = tiniest;
-                else {
-                    tiny = pow(10, floor(log10(scale[j])) - 20);
-                    if (tiny < tiniest)
-                        tiny = tiniest;
-                }
-                a[2 * (j * n + j)] = tmp_re = tiny;
-                a[2 * (j * n + j) + 1] = tmp_im = 0;
-            }
+        /* The rows of U to the right of the panel */
+        for (i = jb + 1; i < jend; i++) {
+            lu_update_c(a, n, i, i + 1, jb, i, jend, n);
+            STATE_WORK(3, 4 * (i - jb) * (n - jend) + 1);
         }
-        tmp = dat->det_re * tmp_re - dat->det_im * tmp_im;
-        dat->det_im = dat->det_im * tmp_re + dat->det_re * tmp_im;
-        dat->det_re = tmp;
-        if (j != n - 1) {
-            tmp = hypot(tmp_re, tmp_im);
-            s_re = tmp_re / tmp / tmp;
-            s_im = -tmp_im / tmp / tmp;
-            for (i = j + 1; i < n; i++) {
-                tmp_re = a[2 * (i * n + j)];
-                tmp_im = a[2 * (i * n + j) + 1];
-                a[2 * (i * n + j)] = tmp_re * s_re - tmp_im * s_im;
-                a[2 * (i * n + j) + 1] = tmp_im * s_re + tmp_re * s_im;
-                STATE(5);
+
+        /* The trailing submatrix */
+        if (lu_par_start(a, n, jb, jend, true)) {
+            while (!linalg_par_wait(10)) {
+                dat->state = 4;
+                goto suspend;
+                state4:
+                ;
+            }
+        } else {
+            for (c0 = jend; c0 < n; c0 += LU_CHUNK) {
+                for (i = jend; i < n; i++) {
+                    c = c0 + LU_CHUNK < n ? c0 + LU_CHUNK : n;
+                    lu_update_c(a, n, i, i + 1, jb, jend, c0, c);
+                    STATE_WORK(5, 4 * (jend - jb) * (c - c0));
+                }
             }
         }
     }
 
-    free(scale);
-    err = dat->completion(ERR_NONE, dat->a, perm, dat->det_re, dat->det_im);
+    lu_c_cleanup(dat);
+    err = dat->completion(ERR_NONE, dat->a, perm, dat->det_re, dat->det_im,
+                          lu_growth_c(a, n, dat->amax));
     free(dat);
     return err;
 
     suspend:
     dat->i = i;
-    dat->imax = imax;
     dat->j = j;
-    dat->k = k;
-    dat->max = max;
-    dat->tmp = tmp;
-    dat->tmp_re = tmp_re;
-    dat->tmp_im = tmp_im;
-    dat->sum_re = sum_re;
-    dat->sum_im = sum_im;
-    dat->s_re = s_re;
-    dat->s_im = s_im;
+    dat->jb = jb;
+    dat->c0 = c0;
     return ERR_INTERRUPTIBLE;
 }
 
@@ -445,13 +783,345 @@ static int lu_decomp_c_worker(bool interrupted) {
 /***** Back-substitution *****/
 /*****************************/
 
+/* The right-hand sides are processed in blocks of BACKSUB_BLOCK columns. Each
+ * step does one row of the forward or back substitution for the whole block,
+ * as a sequence of row updates with unit stride, like in the multiplication,
+ * instead of a dot product with stride q for each column. Every element still
+ * receives its terms in order of increasing j, so the results are the same
+ * as when the columns were done one at a time.
+ * The forward substitution skips the leading zeros of each column: column c
+ * only gets terms from row ii[c] on, ii[c] being the first row where it is
+ * nonzero, or n if there's none yet. Within a block, the rows where only some
+ * of the columns get a term are done with a select, leaving the other ones
+ * exactly as they were.
+ * In the binary version, the rows of a complex B are split while it is being
+ * worked on, see linalg_split_rows(), so LU_RE() and LU_IM() apply to it.
+ * The blocks are independent of each other, so when there are several of
+ * them, and the matrix is large, the columns are divided among the worker
+ * threads.
+ */
+
+#define BACKSUB_BLOCK 32
+
+struct backsub_job_struct {
+    phloat *a;
+    int4 *perm;
+    phloat *b;
+    int4 n, q;
+    bool a_cpx, b_cpx;
+    int4 kend;
+    int4 k0, k1;
+    int4 i;
+    bool back;
+    bool done;
+    /* Per phloat with a real A, where both halves of a complex column share
+     * theirs; per column with a complex A
+     */
+    int4 ii[2 * BACKSUB_BLOCK];
+};
+
+static int backsub_check(phloat *t) {
+    if (p_isinf(*t) || p_isnan(*t)) {
+        if (core_settings.matrix_outofrange && !flags.f.range_error_ignore)
+            return ERR_OUT_OF_RANGE;
+        else
+            *t = p_isinf(*t) < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
+    }
+    return ERR_NONE;
+}
+
+static void backsub_block(backsub_job_struct *job, int4 k0) {
+    if (k0 >= job->kend) {
+        job->done = true;
+        return;
+    }
+    job->k0 = k0;
+    job->k1 = k0 + BACKSUB_BLOCK < job->kend ? k0 + BACKSUB_BLOCK : job->kend;
+    job->i = 0;
+    job->back = false;
+    for (int p = 0; p < 2 * BACKSUB_BLOCK; p++)
+        job->ii[p] = job->n;
+}
+
+static void backsub_init(backsub_job_struct *job, phloat *a, int4 *perm,
+                         phloat *b, int4 n, int4 q, bool a_cpx, bool b_cpx,
+                         int4 kbegin, int4 kend) {
+    job->a = a;
+    job->perm = perm;
+    job->b = b;
+    job->n = n;
+    job->q = q;
+    job->a_cpx = a_cpx;
+    job->b_cpx = b_cpx;
+    job->kend = kend;
+    job->done = false;
+    backsub_block(job, kbegin);
+}
+
+/* Forward substitution, row i, real A; a complex B is treated as a real one
+ * with twice as many columns, apart from ii.
+ */
+static void backsub_forward_r(backsub_job_struct *job) {
+    int4 n = job->n;
+    int4 i = job->i;
+    int4 w = job->b_cpx ? 2 : 1;
+    int4 rs = w * job->q;
+    int4 nb = w * (job->k1 - job->k0);
+    phloat *b = job->b + w * job->k0;
+    phloat *bi = b + i * rs;
+    phloat *bl = b + job->perm[i] * rs;
+    const phloat *arow = job->a + i * n;
+    int4 *ii = job->ii;
+    int4 p, j;
+
+    int4 jlo = n, jhi = 0;
+    for (p = 0; p < nb; p++) {
+        phloat t = bl[p];
+        bl[p] = bi[p];
+        bi[p] = t;
+        if (ii[p] < jlo)
+            jlo = ii[p];
+        if (ii[p] > jhi)
+            jhi = ii[p];
+    }
+    int4 jmid = jhi < i ? jhi : i;
+    for (j = jlo; j < jmid; j++) {
+        phloat aij = arow[j];
+        const phloat *bj = b + j * rs;
+        for (p = 0; p < nb; p++)
+            bi[p] = j >= ii[p] ? bi[p] - aij * bj[p] : bi[p];
+    }
+    for (j = jmid; j < i; j++) {
+        phloat aij = arow[j];
+        const phloat *bj = b + j * rs;
+        for (p = 0; p < nb; p++)
+            bi[p] -= aij * bj[p];
+    }
+    if (jhi == n)
+        for (p = 0; p < nb; p += w)
+            if (ii[p] == n && (bi[p] != 0 || (w == 2 && bi[p + 1] != 0)))
+                ii[p] = ii[p + w - 1] = i;
+}
+
+/* Back substitution, row i, real A */
+static int backsub_back_r(backsub_job_struct *job) {
+    int4 n = job->n;
+    int4 i = job->i;
+    int4 w = job->b_cpx ? 2 : 1;
+    int4 rs = w * job->q;
+    int4 nb = w * (job->k1 - job->k0);
+    phloat *b = job->b + w * job->k0;
+    phloat *bi = b + i * rs;
+    const phloat *arow = job->a + i * n;
+    int4 p;
+
+    for (int4 j = i + 1; j < n; j++) {
+        phloat aij = arow[j];
+        const phloat *bj = b + j * rs;
+        for (p = 0; p < nb; p++)
+            bi[p] -= aij * bj[p];
+    }
+    phloat aii = arow[i];
+    for (p = 0; p < nb; p++) {
+        phloat t = bi[p] / aii;
+        if (backsub_check(&t) != ERR_NONE)
+            return ERR_OUT_OF_RANGE;
+        bi[p] = t;
+    }
+    return ERR_NONE;
+}
+
+/* Forward substitution, row i, complex A */
+static void backsub_forward_c(backsub_job_struct *job) {
+    int4 n = job->n;
+    int4 q = job->q;
+    int4 i = job->i;
+    int4 l = job->perm[i];
+    int4 k0 = job->k0, k1 = job->k1;
+    phloat *a = job->a;
+    phloat *b = job->b;
+    int4 *ii = job->ii;
+    int4 c, j;
+
+    int4 jlo = n, jhi = 0;
+    for (c = k0; c < k1; c++) {
+        phloat t = LU_RE(b, q, l, c);
+        LU_RE(b, q, l, c) = LU_RE(b, q, i, c);
+        LU_RE(b, q, i, c) = t;
+        t = LU_IM(b, q, l, c);
+        LU_IM(b, q, l, c) = LU_IM(b, q, i, c);
+        LU_IM(b, q, i, c) = t;
+        if (ii[c - k0] < jlo)
+            jlo = ii[c - k0];
+        if (ii[c - k0] > jhi)
+            jhi = ii[c - k0];
+    }
+    int4 jmid = jhi < i ? jhi : i;
+    for (j = jlo; j < jmid; j++) {
+        phloat are = a[2 * (i * n + j)];
+        phloat aim = a[2 * (i * n + j) + 1];
+        for (c = k0; c < k1; c++) {
+            phloat bre = LU_RE(b, q, j, c);
+            phloat bim = LU_IM(b, q, j, c);
+            bool use = j >= ii[c - k0];
+            LU_RE(b, q, i, c) = use ? LU_RE(b, q, i, c) - (bre * are - bim * aim)
+                                    : LU_RE(b, q, i, c);
+            LU_IM(b, q, i, c) = use ? LU_IM(b, q, i, c) - (bim * are + bre * aim)
+                                    : LU_IM(b, q, i, c);
+        }
+    }
+    for (j = jmid; j < i; j++) {
+        phloat are = a[2 * (i * n + j)];
+        phloat aim = a[2 * (i * n + j) + 1];
+        for (c = k0; c < k1; c++) {
+            phloat bre = LU_RE(b, q, j, c);
+            phloat bim = LU_IM(b, q, j, c);
+            LU_RE(b, q, i, c) -= bre * are - bim * aim;
+            LU_IM(b, q, i, c) -= bim * are + bre * aim;
+        }
+    }
+    if (jhi == n)
+        for (c = k0; c < k1; c++)
+            if (ii[c - k0] == n
+                    && (LU_RE(b, q, i, c) != 0 || LU_IM(b, q, i, c) != 0))
+                ii[c - k0] = i;
+}
+
+/* Back substitution, row i, complex A */
+static int backsub_back_c(backsub_job_struct *job) {
+    int4 n = job->n;
+    int4 q = job->q;
+    int4 i = job->i;
+    int4 k0 = job->k0, k1 = job->k1;
+    phloat *a = job->a;
+    phloat *b = job->b;
+    int4 c;
+
+    for (int4 j = i + 1; j < n; j++) {
+        phloat are = a[2 * (i * n + j)];
+        phloat aim = a[2 * (i * n + j) + 1];
+        for (c = k0; c < k1; c++) {
+            phloat bre = LU_RE(b, q, j, c);
+            phloat bim = LU_IM(b, q, j, c);
+            LU_RE(b, q, i, c) -= bre * are - bim * aim;
+            LU_IM(b, q, i, c) -= bim * are + bre * aim;
+        }
+    }
+    phloat tmp_re = a[2 * (i * n + i)];
+    phloat tmp_im = a[2 * (i * n + i) + 1];
+    phloat tmp = hypot(tmp_re, tmp_im);
+    tmp_re = tmp_re / tmp / tmp;
+    tmp_im = -tmp_im / tmp / tmp;
+    for (c = k0; c < k1; c++) {
+        phloat sum_re = LU_RE(b, q, i, c);
+        phloat sum_im = LU_IM(b, q, i, c);
+        phloat t_re = sum_re * tmp_re - sum_im * tmp_im;
+        phloat t_im = sum_im * tmp_re + sum_re * tmp_im;
+        if (backsub_check(&t_re) != ERR_NONE || backsub_check(&t_im) != ERR_NONE)
+            return ERR_OUT_OF_RANGE;
+        LU_RE(b, q, i, c) = t_re;
+        LU_IM(b, q, i, c) = t_im;
+    }
+    return ERR_NONE;
+}
+
+/* Does the next row of the current block, and moves on to the next row or
+ * block. Returns how many multiply-adds' worth of work that was, or -1 if
+ * a result was out of range.
+ */
+static int4 backsub_step(backsub_job_struct *job) {
+    int4 work = (job->back ? job->n - job->i : job->i + 1)
+                * (job->k1 - job->k0) * (job->a_cpx ? 4 : job->b_cpx ? 2 : 1);
+    if (!job->back) {
+        if (job->a_cpx)
+            backsub_forward_c(job);
+        else
+            backsub_forward_r(job);
+        if (++job->i == job->n) {
+            job->back = true;
+            job->i = job->n - 1;
+        }
+    } else {
+        int err = job->a_cpx ? backsub_back_c(job) : backsub_back_r(job);
+        if (err != ERR_NONE)
+            return -1;
+        if (--job->i < 0)
+            backsub_block(job, job->k1);
+    }
+    return work;
+}
+
+/* Runs the job until it's done, or until it has done its share of work
+ * for this call
+ */
+static int backsub_run(backsub_job_struct *job) {
+    int4 count = LINALG_WORK_PER_CALL;
+    while (!job->done) {
+        int4 work = backsub_step(job);
+        if (work < 0)
+            return ERR_OUT_OF_RANGE;
+        if ((count -= work) <= 0)
+            return ERR_INTERRUPTIBLE;
+    }
+    return ERR_NONE;
+}
+
+struct backsub_par_data_struct {
+    phloat *a;
+    int4 *perm;
+    phloat *b;
+    int4 n, q;
+    int4 cols_per_part;
+    bool a_cpx, b_cpx;
+    volatile int error;
+};
+
+static backsub_par_data_struct backsub_par_data;
+
+static void backsub_part(void *ctx, int4 part) {
+    backsub_par_data_struct *dat = (backsub_par_data_struct *) ctx;
+    int4 kstart = part * dat->cols_per_part;
+    int4 kend = kstart + dat->cols_per_part;
+    if (kend > dat->q)
+        kend = dat->q;
+    backsub_job_struct job;
+    backsub_init(&job, dat->a, dat->perm, dat->b, dat->n, dat->q,
+                 dat->a_cpx, dat->b_cpx, kstart, kend);
+    while (!job.done) {
+        if (dat->error != ERR_NONE)
+            return;
+        if (backsub_step(&job) < 0)
+            dat->error = ERR_OUT_OF_RANGE;
+    }
+}
+
+static bool backsub_par_start(phloat *a, int4 *perm, phloat *b, int4 n, int4 q,
+                              bool a_cpx, bool b_cpx) {
+    int nthreads = linalg_par_threads();
+    if (nthreads == 1 || q < 2
+            || ((double) n) * n * q * (a_cpx ? 4 : b_cpx ? 2 : 1) < PAR_MIN_WORK)
+        return false;
+    backsub_par_data_struct *dat = &backsub_par_data;
+    dat->a = a;
+    dat->perm = perm;
+    dat->b = b;
+    dat->n = n;
+    dat->q = q;
+    int4 parts = q < 4 * nthreads ? q : 4 * nthreads;
+    dat->cols_per_part = (q + parts - 1) / parts;
+    dat->a_cpx = a_cpx;
+    dat->b_cpx = b_cpx;
+    dat->error = ERR_NONE;
+    linalg_par_start(backsub_part, dat, (q + dat->cols_per_part - 1) / dat->cols_per_part);
+    return true;
+}
+
 struct backsub_rr_data_struct {
     vartype_realmatrix *a;
     int4 *perm;
     vartype_realmatrix *b;
-    int4 i, ii, j, ll, k;
-    phloat sum;
-    int state;
+    backsub_job_struct job;
+    bool parallel;
     int (*completion)(int, vartype_realmatrix *, int4 *, vartype_realmatrix *);
 };
 
@@ -473,7 +1143,11 @@ int lu_backsubst_rr(vartype_realmatrix *a, int4 *perm, vartype_realmatrix *b,
     dat->b = b;
     dat->completion = completion;
 
-    dat->state = 0;
+    dat->parallel = backsub_par_start(a->array->data, perm, b->array->data,
+                                      a->rows, b->columns, false, false);
+    if (!dat->parallel)
+        backsub_init(&dat->job, a->array->data, perm, b->array->data,
+                     a->rows, b->columns, false, false, 0, b->columns);
 
     backsub_rr_data = dat;
     mode_interruptible = lu_backsubst_rr_worker;
@@ -483,89 +1157,33 @@ int lu_backsubst_rr(vartype_realmatrix *a, int4 *perm, vartype_realmatrix *b,
 
 static int lu_backsubst_rr_worker(bool interrupted) {
     backsub_rr_data_struct *dat = backsub_rr_data;
-    phloat *a = dat->a->array->data;
-    int4 n = dat->a->rows;
-    phloat *b = dat->b->array->data;
-    int4 q = dat->b->columns;
-    int4 *perm = dat->perm;
-    int count = 1000;
-
-    int4 i = dat->i;
-    int4 ii = dat->ii;
-    int4 j = dat->j;
-    int4 ll = dat->ll;
-    int4 k = dat->k;
-    phloat sum = dat->sum;
-
-    phloat t;
+    int err;
 
     if (interrupted) {
-        int err = dat->completion(ERR_INTERRUPTED, dat->a, perm, dat->b);
-        free(dat);
-        return err;
-    }
-
-    switch (dat->state) {
-        case 0: break;
-        case 1: goto state1;
-        case 2: goto state2;
+        if (dat->parallel)
+            linalg_par_cancel();
+        err = ERR_INTERRUPTED;
+    } else if (dat->parallel) {
+        if (!linalg_par_wait(10))
+            return ERR_INTERRUPTIBLE;
+        err = backsub_par_data.error;
+    } else {
+        err = backsub_run(&dat->job);
+        if (err == ERR_INTERRUPTIBLE)
+            return err;
     }
 
-    for (k = 0; k < q; k++) {
-        ii = -1;
-        for (i = 0; i < n; i++) {
-            ll = perm[i];
-            sum = b[ll * q + k];
-            b[ll * q + k] = b[i * q + k];
-            if (ii != -1) {
-                for (j = ii; j < i; j++) {
-                    sum -= a[i * n + j] * b[j * q + k];
-                    STATE(1);
-                }
-            } else if (sum != 0)
-                ii = i;
-            b[i * q + k] = sum;
-        }
-        for (i = n - 1; i >= 0; i--) {
-            sum = b[i * q + k];
-            for (j = i + 1; j < n; j++) {
-                sum -= a[i * n + j] * b[j * q + k];
-                STATE(2);
-            }
-            t = sum / a[i * n + i];
-            if (p_isinf(t) || p_isnan(t)) {
-                if (core_settings.matrix_outofrange
-                                        && !flags.f.range_error_ignore)
-                    return ERR_OUT_OF_RANGE;
-                else
-                    t = p_isinf(t) < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
-            }
-            b[i * q + k] = t;
-        }
-    }
-
-    int err;
-    err = dat->completion(ERR_NONE, dat->a, perm, dat->b);
+    err = dat->completion(err, dat->a, dat->perm, dat->b);
     free(dat);
     return err;
-
-    suspend:
-    dat->i = i;
-    dat->ii = ii;
-    dat->j = j;
-    dat->ll = ll;
-    dat->k = k;
-    dat->sum = sum;
-    return ERR_INTERRUPTIBLE;
 }
 
 struct backsub_rc_data_struct {
     vartype_realmatrix *a;
     int4 *perm;
     vartype_complexmatrix *b;
-    int4 i, ii, j, ll, k;
-    phloat sum_re, sum_im;
-    int state;
+    backsub_job_struct job;
+    bool parallel;
     int (*completion)(int, vartype_realmatrix *, int4 *,
                                             vartype_complexmatrix *);
 };
@@ -588,7 +1206,11 @@ int lu_backsubst_rc(vartype_realmatrix *a, int4 *perm, vartype_complexmatrix *b,
     dat->b = b;
     dat->completion = completion;
 
-    dat->state = 0;
+    dat->parallel = backsub_par_start(a->array->data, perm, b->array->data,
+                                      a->rows, b->columns, false, true);
+    if (!dat->parallel)
+        backsub_init(&dat->job, a->array->data, perm, b->array->data,
+                     a->rows, b->columns, false, true, 0, b->columns);
 
     backsub_rc_data = dat;
     mode_interruptible = lu_backsubst_rc_worker;
@@ -598,110 +1220,36 @@ int lu_backsubst_rc(vartype_realmatrix *a, int4 *perm, vartype_complexmatrix *b,
 
 static int lu_backsubst_rc_worker(bool interrupted) {
     backsub_rc_data_struct *dat = backsub_rc_data;
-    phloat *a = dat->a->array->data;
-    int4 n = dat->a->rows;
-    phloat *b = dat->b->array->data;
-    int4 q = dat->b->columns;
-    int4 *perm = dat->perm;
-    int count = 1000;
-
-    int4 i = dat->i;
-    int4 ii = dat->ii;
-    int4 j = dat->j;
-    int4 ll = dat->ll;
-    int4 k = dat->k;
-    phloat sum_re = dat->sum_re;
-    phloat sum_im = dat->sum_im;
-    phloat tmp;
-
-    phloat t_re, t_im;
+    int err;
 
     if (interrupted) {
-        int err = dat->completion(ERR_INTERRUPTED, dat->a, perm, dat->b);
-        free(dat);
-        return err;
-    }
-
-    switch (dat->state) {
-        case 0: break;
-        case 1: goto state1;
-        case 2: goto state2;
-    }
-
-    for (k = 0; k < q; k++) {
-        ii = -1;
-        for (i = 0; i < n; i++) {
-            ll = perm[i];
-            sum_re = b[2 * (ll * q + k)];
-            sum_im = b[2 * (ll * q + k) + 1];
-            b[2 * (ll * q + k)] = b[2 * (i * q + k)];
-            b[2 * (ll * q + k) + 1] = b[2 * (i * q + k) + 1];
-            if (ii != -1) {
-                for (j = ii; j < i; j++) {
-                    tmp = a[i * n + j];
-                    sum_re -= tmp * b[2 * (j * q + k)];
-                    sum_im -= tmp * b[2 * (j * q + k) + 1];
-                    STATE(1);
-                }
-            } else if (sum_re != 0 || sum_im != 0)
-                ii = i;
-            b[2 * (i * q + k)] = sum_re;
-            b[2 * (i * q + k) + 1] = sum_im;
-        }
-        for (i = n - 1; i >= 0; i--) {
-            sum_re = b[2 * (i * q + k)];
-            sum_im = b[2 * (i * q + k) + 1];
-            for (j = i + 1; j < n; j++) {
-                tmp = a[i * n + j];
-                sum_re -= tmp * b[2 * (j * q + k)];
-                sum_im -= tmp * b[2 * (j * q + k) + 1];
-                STATE(2);
-            }
-            tmp = a[i * n + i];
-            t_re = sum_re / tmp;
-            t_im = sum_im / tmp;
-            if (p_isinf(t_re) || p_isnan(t_re)) {
-                if (core_settings.matrix_outofrange
-                                        && !flags.f.range_error_ignore)
-                    return ERR_OUT_OF_RANGE;
-                else
-                    t_re = p_isinf(t_re) < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
-            }
-            if (p_isinf(t_im) || p_isnan(t_im)) {
-                if (core_settings.matrix_outofrange
-                                        && !flags.f.range_error_ignore)
-                    return ERR_OUT_OF_RANGE;
-                else
-                    t_im = p_isinf(t_im) < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
-            }
-            b[2 * (i * q + k)] = t_re;
-            b[2 * (i * q + k) + 1] = t_im;
-        }
+        if (dat->parallel)
+            linalg_par_cancel();
+        err = ERR_INTERRUPTED;
+    } else if (dat->parallel) {
+        if (!linalg_par_wait(10))
+            return ERR_INTERRUPTIBLE;
+        err = backsub_par_data.error;
+    } else {
+        err = backsub_run(&dat->job);
+        if (err == ERR_INTERRUPTIBLE)
+            return err;
     }
 
-    int err;
-    err = dat->completion(ERR_NONE, dat->a, perm, dat->b);
+    err = dat->completion(err, dat->a, dat->perm, dat->b);
     free(dat);
     return err;
-
-    suspend:
-    dat->i = i;
-    dat->ii = ii;
-    dat->j = j;
-    dat->ll = ll;
-    dat->k = k;
-    dat->sum_re = sum_re;
-    dat->sum_im = sum_im;
-    return ERR_INTERRUPTIBLE;
 }
 
 struct backsub_cc_data_struct {
     vartype_complexmatrix *a;
     int4 *perm;
     vartype_complexmatrix *b;
-    int4 i, ii, j, ll, k;
-    phloat sum_re, sum_im;
-    int state;
+#ifndef BCD_MATH
+    phloat *tmp;
+#endif
+    backsub_job_struct job;
+    bool parallel;
     int (*completion)(int, vartype_complexmatrix *, int4 *,
                                             vartype_complexmatrix *);
 };
@@ -719,12 +1267,25 @@ int lu_backsubst_cc(vartype_complexmatrix *a, int4 *perm, vartype_complexmatrix
     if (dat == NULL)
         return completion(ERR_INSUFFICIENT_MEMORY, a, perm, b);
 
+#ifndef BCD_MATH
+    dat->tmp = (phloat *) malloc(2 * b->columns * sizeof(phloat));
+    if (dat->tmp == NULL) {
+        free(dat);
+        return completion(ERR_INSUFFICIENT_MEMORY, a, perm, b);
+    }
+    linalg_split_rows(b->array->data, b->rows, b->columns, dat->tmp);
+#endif
+
     dat->a = a;
     dat->perm = perm;
     dat->b = b;
     dat->completion = completion;
 
-    dat->state = 0;
+    dat->parallel = backsub_par_start(a->array->data, perm, b->array->data,
+                                      a->rows, b->columns, true, true);
+    if (!dat->parallel)
+        backsub_init(&dat->job, a->array->data, perm, b->array->data,
+                     a->rows, b->columns, true, true, 0, b->columns);
 
     backsub_cc_data = dat;
     mode_interruptible = lu_backsubst_cc_worker;
@@ -734,110 +1295,289 @@ int lu_backsubst_cc(vartype_complexmatrix *a, int4 *perm, vartype_complexmatrix
 
 static int lu_backsubst_cc_worker(bool interrupted) {
     backsub_cc_data_struct *dat = backsub_cc_data;
+    int err;
+
+    if (interrupted) {
+        if (dat->parallel)
+            linalg_par_cancel();
+        err = ERR_INTERRUPTED;
+    } else if (dat->parallel) {
+        if (!linalg_par_wait(10))
+            return ERR_INTERRUPTIBLE;
+        err = backsub_par_data.error;
+    } else {
+        err = backsub_run(&dat->job);
+        if (err == ERR_INTERRUPTIBLE)
+            return err;
+    }
+
+#ifndef BCD_MATH
+    linalg_join_rows(dat->b->array->data, dat->b->rows, dat->b->columns, dat->tmp);
+    free(dat->tmp);
+#endif
+    err = dat->completion(err, dat->a, dat->perm, dat->b);
+    free(dat);
+    return err;
+}
+
+/************************************************/
+/***** Mixed-precision iterative refinement *****/
+/************************************************/
+
+#ifdef BCD_MATH
+
+/* In decimal, solving A X = B is slow, because all O(n^3) steps of the LU
+ * decomposition are done in BID128. When B has only a few columns, it is
+ * much faster to decompose A in binary instead, and then refine the solution:
+ * compute the residual R = B - A X in decimal, solve A D = R using the binary
+ * decomposition, set X = X + D, and repeat until the residual is down to the
+ * level of decimal rounding errors. Each round costs O(n^2) decimal steps per
+ * column of B, and gains about as many digits as the binary decomposition is
+ * accurate to, so a well-conditioned system is done in a few rounds.
+ * When A cannot be represented in binary, or is too ill-conditioned for the
+ * refinement to converge, the completion routine is told so, and the caller
+ * falls back on the decimal LU decomposition.
+ */
+
+#define REFINE_MAX_ITER 10
+#define REFINE_TOLERANCE 1e-33
+/* Pivots smaller than this, relative to the norm of A, mean A is too close
+ * to singular for the refinement to pay off, or to be trusted
+ */
+#define REFINE_MIN_PIVOT 1e-12
+/* What a binary multiply-add costs, roughly, in decimal ones */
+#define REFINE_BINARY_WORK(w) ((w) / 32 + 1)
+
+struct refine_data_struct {
+    vartype_realmatrix *a;
+    vartype_realmatrix *b;
+    phloat *rhs;
+    double *lu;
+    double *r;
+    int4 *perm;
+    double anorm, berr;
+    int4 i, j, k, iter;
+    int state;
+    int (*completion)(int, bool, vartype_realmatrix *);
+};
+
+static refine_data_struct *refine_data;
+
+static int lu_refine_rr_worker(bool interrupted);
+
+int lu_refine_rr(vartype_realmatrix *a, vartype_realmatrix *b,
+                    int (*completion)(int, bool, vartype_realmatrix *)) {
+    int4 n = a->rows;
+    int4 q = b->columns;
+    refine_data_struct *dat =
+            (refine_data_struct *) malloc(sizeof(refine_data_struct));
+    if (dat == NULL)
+        return completion(ERR_NONE, false, b);
+    dat->lu = (double *) malloc(n * n * sizeof(double));
+    dat->r = (double *) malloc(n * q * sizeof(double));
+    dat->perm = (int4 *) malloc(n * sizeof(int4));
+    dat->rhs = (phloat *) malloc(n * q * sizeof(phloat));
+    if (dat->lu == NULL || dat->r == NULL || dat->perm == NULL
+            || dat->rhs == NULL) {
+        free(dat->lu);
+        free(dat->r);
+        free(dat->perm);
+        free(dat->rhs);
+        free(dat);
+        return completion(ERR_NONE, false, b);
+    }
+    for (int4 i = 0; i < n * q; i++) {
+        dat->rhs[i] = b->array->data[i];
+        b->array->data[i] = 0;
+    }
+
+    dat->a = a;
+    dat->b = b;
+    dat->completion = completion;
+    dat->state = 0;
+
+    refine_data = dat;
+    mode_interruptible = lu_refine_rr_worker;
+    mode_stoppable = false;
+    return ERR_INTERRUPTIBLE;
+}
+
+static void refine_solve(const double *lu, const int4 *perm, double *r,
+                                    int4 n, int4 q, int4 k) {
+    for (int4 i = 0; i < n; i++) {
+        int4 p = perm[i];
+        double s = r[p * q + k];
+        r[p * q + k] = r[i * q + k];
+        for (int4 j = 0; j < i; j++)
+            s -= lu[i * n + j] * r[j * q + k];
+        r[i * q + k] = s;
+    }
+    for (int4 i = n - 1; i >= 0; i--) {
+        double s = r[i * q + k];
+        for (int4 j = i + 1; j < n; j++)
+            s -= lu[i * n + j] * r[j * q + k];
+        r[i * q + k] = s / lu[i * n + i];
+    }
+}
+
+static int lu_refine_rr_worker(bool interrupted) {
+    refine_data_struct *dat = refine_data;
     phloat *a = dat->a->array->data;
+    phloat *x = dat->b->array->data;
+    phloat *rhs = dat->rhs;
+    double *lu = dat->lu;
+    double *r = dat->r;
+    int4 *perm = dat->perm;
     int4 n = dat->a->rows;
-    phloat *b = dat->b->array->data;
     int4 q = dat->b->columns;
-    int4 *perm = dat->perm;
-    int count = 1000;
+    int4 count = LINALG_WORK_PER_CALL;
+    int err = ERR_NONE;
+    bool solved = false;
 
     int4 i = dat->i;
-    int4 ii = dat->ii;
     int4 j = dat->j;
-    int4 ll = dat->ll;
     int4 k = dat->k;
-    phloat sum_re = dat->sum_re;
-    phloat sum_im = dat->sum_im;
-    phloat tmp, tmp_re, tmp_im;
-
-    phloat bre, bim;
-    phloat t_re, t_im;
+    int4 iter = dat->iter;
+    int4 c, imax;
+    double d, max, rowsum, rnorm, xnorm, berr;
+    phloat sum;
 
     if (interrupted) {
-        int err = dat->completion(ERR_INTERRUPTED, dat->a, perm, dat->b);
-        free(dat);
-        return err;
+        err = ERR_INTERRUPTED;
+        goto done;
     }
 
     switch (dat->state) {
         case 0: break;
         case 1: goto state1;
         case 2: goto state2;
+        case 3: goto state3;
+        case 4: goto state4;
     }
 
-    for (k = 0; k < q; k++) {
-        ii = -1;
-        for (i = 0; i < n; i++) {
-            ll = perm[i];
-            sum_re = b[2 * (ll * q + k)];
-            sum_im = b[2 * (ll * q + k) + 1];
-            b[2 * (ll * q + k)] = b[2 * (i * q + k)];
-            b[2 * (ll * q + k) + 1] = b[2 * (i * q + k) + 1];
-            if (ii != -1) {
-                for (j = ii; j < i; j++) {
-                    bre = b[2 * (j * q + k)];
-                    bim = b[2 * (j * q + k) + 1];
-                    tmp_re = a[2 * (i * n + j)];
-                    tmp_im = a[2 * (i * n + j) + 1];
-                    sum_re -= bre * tmp_re - bim * tmp_im;
-                    sum_im -= bim * tmp_re + bre * tmp_im;
-                    STATE(1);
-                }
-            } else if (sum_re != 0 || sum_im != 0)
-                ii = i;
-            b[2 * (i * q + k)] = sum_re;
-            b[2 * (i * q + k) + 1] = sum_im;
+    /* Convert A to binary, giving up if any element overflows or underflows */
+    dat->anorm = 0;
+    for (i = 0; i < n; i++) {
+        rowsum = 0;
+        for (c = 0; c < n; c++) {
+            d = to_double(a[i * n + c]);
+            if (isinf(d) || isnan(d) || (d == 0 && a[i * n + c] != 0))
+                goto fail;
+            lu[i * n + c] = d;
+            rowsum += fabs(d);
         }
-        for (i = n - 1; i >= 0; i--) {
-            sum_re = b[2 * (i * q + k)];
-            sum_im = b[2 * (i * q + k) + 1];
-            for (j = i + 1; j < n; j++) {
-                bre = b[2 * (j * q + k)];
-                bim = b[2 * (j * q + k) + 1];
-                tmp_re = a[2 * (i * n + j)];
-                tmp_im = a[2 * (i * n + j) + 1];
-                sum_re -= bre * tmp_re - bim * tmp_im;
-                sum_im -= bim * tmp_re + bre * tmp_im;
-                STATE(2);
+        if (rowsum > dat->anorm)
+            dat->anorm = rowsum;
+        STATE_WORK(1, n);
+    }
+
+    /* Binary LU decomposition, with partial pivoting */
+    for (j = 0; j < n; j++) {
+        max = 0;
+        imax = -1;
+        for (i = j; i < n; i++) {
+            d = fabs(lu[i * n + j]);
+            if (d > max) {
+                max = d;
+                imax = i;
+            }
+        }
+        if (imax == -1 || max < dat->anorm * REFINE_MIN_PIVOT)
+            goto fail;
+        if (imax != j)
+            for (c = 0; c < n; c++) {
+                d = lu[imax * n + c];
+                lu[imax * n + c] = lu[j * n + c];
+                lu[j * n + c] = d;
+            }
+        perm[j] = imax;
+        for (i = j + 1; i < n; i++) {
+            d = lu[i * n + j] /= lu[j * n + j];
+            if (d != 0)
+                for (c = j + 1; c < n; c++)
+                    lu[i * n + c] -= d * lu[j * n + c];
+            STATE_WORK(2, REFINE_BINARY_WORK(n - j));
+        }
+    }
+
+    /* Starting from X = 0, the first residual is B itself */
+    for (i = 0; i < n * q; i++)
+        r[i] = to_double(rhs[i]);
+    dat->berr = 0;
+
+    for (iter = 0; ; iter++) {
+        if (iter > 0) {
+            for (i = 0; i < n; i++) {
+                for (k = 0; k < q; k++) {
+                    sum = rhs[i * q + k];
+                    for (c = 0; c < n; c++)
+                        sum -= a[i * n + c] * x[c * q + k];
+                    r[i * q + k] = to_double(sum);
+                }
+                STATE_WORK(3, n * q);
             }
-            tmp_re = a[2 * (i * n + i)];
-            tmp_im = a[2 * (i * n + i) + 1];
-            tmp = hypot(tmp_re, tmp_im);
-            tmp_re = tmp_re / tmp / tmp;
-            tmp_im = -tmp_im / tmp / tmp;
-            t_re = sum_re * tmp_re - sum_im * tmp_im;
-            t_im = sum_im * tmp_re + sum_re * tmp_im;
-            if (p_isinf(t_re) || p_isnan(t_re)) {
-                if (core_settings.matrix_outofrange
-                                        && !flags.f.range_error_ignore)
-                    return ERR_OUT_OF_RANGE;
-                else
-                    t_re = p_isinf(t_re) < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
+
+            /* Done when the backward error is down to decimal precision;
+             * give up when it stops shrinking.
+             */
+            berr = 0;
+            for (k = 0; k < q; k++) {
+                rnorm = 0;
+                xnorm = 0;
+                for (i = 0; i < n; i++) {
+                    d = fabs(r[i * q + k]);
+                    if (d > rnorm)
+                        rnorm = d;
+                    d = fabs(to_double(x[i * q + k]));
+                    if (d > xnorm)
+                        xnorm = d;
+                }
+                if (rnorm == 0)
+                    continue;
+                if (isinf(rnorm) || xnorm == 0)
+                    goto fail;
+                d = rnorm / (dat->anorm * xnorm);
+                if (d > berr)
+                    berr = d;
             }
-            if (p_isinf(t_im) || p_isnan(t_im)) {
-                if (core_settings.matrix_outofrange
-                                        && !flags.f.range_error_ignore)
-                    return ERR_OUT_OF_RANGE;
-                else
-                    t_im = p_isinf(t_im) < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
+            if (berr <= REFINE_TOLERANCE * sqrt((double) n)) {
+                solved = true;
+                goto done;
             }
-            b[2 * (i * q + k)] = t_re;
-            b[2 * (i * q + k) + 1] = t_im;
+            if (iter == REFINE_MAX_ITER || (iter > 1 && berr > dat->berr / 2))
+                goto fail;
+            dat->berr = berr;
+        }
+
+        for (k = 0; k < q; k++) {
+            refine_solve(lu, perm, r, n, q, k);
+            STATE_WORK(4, REFINE_BINARY_WORK(n * n));
+        }
+        for (i = 0; i < n * q; i++) {
+            if (isinf(r[i]) || isnan(r[i]))
+                goto fail;
+            x[i] += phloat(r[i]);
         }
     }
 
-    int err;
-    err = dat->completion(ERR_NONE, dat->a, perm, dat->b);
+    fail:
+    solved = false;
+
+    done:
+    free(dat->lu);
+    free(dat->r);
+    free(dat->perm);
+    free(dat->rhs);
+    err = dat->completion(err, solved, dat->b);
     free(dat);
     return err;
 
     suspend:
     dat->i = i;
-    dat->ii = ii;
     dat->j = j;
-    dat->ll = ll;
     dat->k = k;
-    dat->sum_re = sum_re;
-    dat->sum_im = sum_im;
+    dat->iter = iter;
     return ERR_INTERRUPTIBLE;
 }
+
+#endif
@@ -20,13 +20,58 @@
 
 #include "core_variables.h"
 
+/* Worker threads for large matrix operations. A job consists of nparts
+ * independent parts, task(ctx, 0) through task(ctx, nparts - 1), which are
+ * handed out to the worker threads. linalg_par_wait() waits up to ms
+ * milliseconds for the job to finish, and returns true if it has; with
+ * ms < 0, the calling thread works on the job as well, and waits until it is
+ * finished. linalg_par_cancel() skips the parts that haven't been started
+ * yet, and waits for the rest. Only one job can be active at a time.
+ * Without FREE42_THREADS, linalg_par_threads() returns 1, and the calling
+ * thread does all the work, in linalg_par_wait().
+ */
+int linalg_par_threads();
+void linalg_par_start(void (*task)(void *ctx, int4 part), void *ctx, int4 nparts);
+bool linalg_par_wait(int ms);
+void linalg_par_cancel();
+
+#ifndef BCD_MATH
+/* In the binary version, the complex multiplication and LU kernels work on
+ * rows that hold n real parts followed by n imaginary parts, instead of n
+ * interleaved (re, im) pairs, so that the compiler can vectorize them.
+ * linalg_split_rows() converts rows rows of n elements to that layout, in
+ * place, and linalg_join_rows() converts them back; tmp must have room for
+ * 2 * n phloats. The arithmetic is the same either way, so the results are
+ * too.
+ */
+void linalg_split_rows(phloat *a, int4 rows, int4 n, phloat *tmp);
+void linalg_join_rows(phloat *a, int4 rows, int4 n, phloat *tmp);
+#endif
+
+/* How many multiply-adds the interruptible matrix workers do per call */
+#ifdef BCD_MATH
+#define LINALG_WORK_PER_CALL 32768
+#else
+#define LINALG_WORK_PER_CALL 262144
+#endif
+
+/* Below this many multiply-adds, splitting up a job isn't worth the trouble */
+#ifdef BCD_MATH
+#define PAR_MIN_WORK 50000
+#else
+#define PAR_MIN_WORK 1000000
+#endif
+
+/* The completion routines get the determinant, and the pivot growth,
+ * max |U| / max |A|; the latter only when the decomposition was finished.
+ */
 int lu_decomp_r(vartype_realmatrix *a, int4 *perm,
                        int (*completion)(int, vartype_realmatrix *,
-                                          int4 *, phloat));
+                                          int4 *, phloat, phloat));
 
 int lu_decomp_c(vartype_complexmatrix *a, int4 *perm,
                        int (*completion)(int, vartype_complexmatrix *,
-                                          int4 *, phloat, phloat));
+                                          int4 *, phloat, phloat, phloat));
 
 int lu_backsubst_rr(vartype_realmatrix *a,
                             int4 *perm,
@@ -46,4 +91,14 @@ int lu_backsubst_cc(vartype_complexmatrix *a,
                             int (*completion)(int, vartype_complexmatrix *,
                                 int4 *, vartype_complexmatrix *));
 
+#ifdef BCD_MATH
+/* Solves A X = B, with X overwriting B, using a binary LU decomposition and
+ * decimal iterative refinement. If that doesn't work out, the completion
+ * routine is called with ERR_NONE and solved = false, and the contents of B
+ * are undefined.
+ */
+int lu_refine_rr(vartype_realmatrix *a, vartype_realmatrix *b,
+                    int (*completion)(int, bool, vartype_realmatrix *));
+#endif
+
 #endif
@@ -24,11 +24,13 @@
 #include "core_main.h"
 #include "core_commands2.h"
 #include "core_commands4.h"
+#include "core_commands5.h"
 #include "core_commands7.h"
 #include "core_display.h"
 #include "core_display.h"
 #include "core_helpers.h"
 #include "core_keydown.h"
+#include "core_linalg1.h"
 #include "core_math1.h"
 #include "core_sto_rcl.h"
 #include "core_tables.h"
@@ -84,6 +86,7 @@ void core_init(int read_saved_state, int4 version, const char *state_file_name,
      */
 
     phloat_init();
+    matrix_map_init(state_file_name);
 
     char *state_file_name_crash = NULL;
     if (read_saved_state == 1) {
@@ -161,15 +164,22 @@ void core_save_state(const char *state_file_name) {
     gfile = my_fopen(state_file_name_crash, "wb");
     if (gfile != NULL) {
         bool success;
+        matrix_map_begin_save(state_file_name);
         save_state(&success);
         fclose(gfile);
         if (success) {
             my_remove(state_file_name);
             my_rename(state_file_name_crash, state_file_name);
         }
+        matrix_map_end_save(success);
     }
 }
 
+bool core_move_state_files(const char *state_file_name,
+                           const char *new_state_file_name, bool copy) {
+    return matrix_map_move_files(state_file_name, new_state_file_name, copy);
+}
+
 void core_cleanup() {
     if (!initialized)
         return;
@@ -190,7 +200,9 @@ void core_cleanup() {
         vars = NULL;
         vars_capacity = 0;
     }
+    linalg_clear_lu_cache();
     clean_vartype_pools();
+    matrix_map_cleanup();
 }
 
 void core_repaint_display() {
@@ -2634,7 +2646,7 @@ static void serialize_list(textbuf *tb, vartype_list *list, int indent) {
                 tb_write(tb, " Matrix\n", 8);
                 for (int j = 0; j < rm->rows * rm->columns; j++) {
                     tb_indent(tb, indent);
-                    if (rm->array->is_string[j]) {
+                    if (get_is_string(rm->array, j)) {
                         tb_write(tb, "\"", 1);
                         char *text;
                         int4 len;
@@ -2690,6 +2702,39 @@ static void serialize_list(textbuf *tb, vartype_list *list, int indent) {
                 tb_write(tb, "]\n", 2);
                 break;
             }
+            case TYPE_SPARSEMATRIX: {
+                /* Written out in full, so it can be pasted back in, as
+                 * a dense matrix.
+                 */
+                vartype_sparsematrix *sm = (vartype_sparsematrix *) elem;
+                const sparsematrix_data *sd = sm->array;
+                tb_indent(tb, indent);
+                tb_write(tb, "[\n", 2);
+                indent += 2;
+                tb_indent(tb, indent);
+                n = int2string(sm->rows, buf, 49);
+                tb_write(tb, buf, n);
+                tb_write(tb, "x", 1);
+                n = int2string(sm->columns, buf, 49);
+                tb_write(tb, buf, n);
+                tb_write(tb, " Matrix\n", 8);
+                for (int4 r = 0; r < sm->rows; r++) {
+                    int4 p = sd->rowptr[r];
+                    for (int4 c = 0; c < sm->columns; c++) {
+                        phloat x = 0;
+                        if (p < sd->rowptr[r + 1] && sd->colidx[p] == c)
+                            x = sd->data[p++];
+                        tb_indent(tb, indent);
+                        n = real2buf(buf, x);
+                        tb_write(tb, buf, n);
+                        tb_write(tb, "\n", 1);
+                    }
+                }
+                indent -= 2;
+                tb_indent(tb, indent);
+                tb_write(tb, "]\n", 2);
+                break;
+            }
             case TYPE_LIST: {
                 serialize_list(tb, (vartype_list *) elem, indent);
                 break;
@@ -2761,7 +2806,7 @@ char *core_copy() {
         for (int r = 0; r < rm->rows; r++) {
             for (int c = 0; c < rm->columns; c++) {
                 int bufptr;
-                if (is_string[n] == 0) {
+                if (is_string == NULL || is_string[n] == 0) {
                     bufptr = real2buf(buf, data[n], format);
                     tb_write(&tb, buf, bufptr);
                 } else {
@@ -2802,6 +2847,26 @@ char *core_copy() {
                 tb_write(&tb, "\n", 1);
         }
         goto textbuf_finish;
+    } else if (stack[sp]->type == TYPE_SPARSEMATRIX) {
+        const char *format = core_settings.localized_copy_paste ? number_format() : NULL;
+        vartype_sparsematrix *sm = (vartype_sparsematrix *) stack[sp];
+        const sparsematrix_data *sd = sm->array;
+        char buf[50];
+        for (int4 r = 0; r < sm->rows; r++) {
+            int4 p = sd->rowptr[r];
+            for (int4 c = 0; c < sm->columns; c++) {
+                phloat x = 0;
+                if (p < sd->rowptr[r + 1] && sd->colidx[p] == c)
+                    x = sd->data[p++];
+                int bufptr = real2buf(buf, x, format);
+                if (c < sm->columns - 1)
+                    buf[bufptr++] = '\t';
+                tb_write(&tb, buf, bufptr);
+            }
+            if (r < sm->rows - 1)
+                tb_write(&tb, "\n", 1);
+        }
+        goto textbuf_finish;
     } else if (stack[sp]->type == TYPE_LIST) {
         serialize_list(&tb, (vartype_list *) stack[sp], 0);
         goto textbuf_finish;
@@ -4757,9 +4822,21 @@ void core_paste(const char *buf) {
                 rm->rows = rows;
                 rm->columns = cols;
                 rm->array->data = data;
+                rm->array->map = NULL;
+                rm->array->nstrings = 0;
+                for (int i = 0; i < n; i++)
+                    if (is_string[i] != 0)
+                        rm->array->nstrings++;
+                if (rm->array->nstrings == 0) {
+                    free(is_string);
+                    is_string = NULL;
+                }
                 rm->array->is_string = is_string;
                 rm->array->refcount = 1;
+                rm->array->cow_base = NULL;
+                rm->array->cow_chunks = NULL;
                 v = (vartype *) rm;
+                touch_matrix(v);
             } else {
                 vartype_complexmatrix *cm = (vartype_complexmatrix *)
                                 malloc(sizeof(vartype_complexmatrix));
@@ -4783,7 +4860,10 @@ void core_paste(const char *buf) {
                 cm->columns = cols;
                 cm->array->data = data;
                 cm->array->refcount = 1;
+                cm->array->cow_base = NULL;
+                cm->array->cow_chunks = NULL;
                 v = (vartype *) cm;
+                touch_matrix(v);
             }
         }
         parse_success:
@@ -4803,6 +4883,753 @@ void core_paste(const char *buf) {
     redisplay();
 }
 
+/* CSV import and export. Cells are streamed through fixed-size buffers, so
+ * apart from the matrix or list itself, moving large data sets this way
+ * takes constant memory. Numbers are always written and read with '.' as the
+ * decimal point and without grouping, so the delimiter is never ambiguous.
+ */
+
+#define CSV_BUFSIZE 16384
+
+static const char *csv_format = ".";
+
+static bool csv_lookup(const char *name, char *hpname, int *hplen) {
+    if (name == NULL) {
+        *hplen = 0;
+        return true;
+    }
+    *hplen = ascii2hp(hpname, 7, name);
+    return *hplen > 0;
+}
+
+static void csv_write_string(FILE *f, const char *text, int4 len) {
+    char buf[51];
+    putc('"', f);
+    for (int4 i = 0; i < len; i += 10) {
+        int4 seg_len = len - i;
+        if (seg_len > 10)
+            seg_len = 10;
+        int bufptr = hp2ascii(buf, text + i, seg_len);
+        for (int j = 0; j < bufptr; j++) {
+            if (buf[j] == '"')
+                putc('"', f);
+            putc(buf[j], f);
+        }
+    }
+    putc('"', f);
+}
+
+bool core_export_csv(const char *name, const char *file_name, char delim) {
+    if (mode_interruptible != NULL)
+        stop_interruptible();
+    set_running(false);
+
+    char hpname[11];
+    int hplen;
+    vartype *v;
+    if (!csv_lookup(name, hpname, &hplen))
+        v = NULL;
+    else if (hplen == 0)
+        v = sp == -1 ? NULL : stack[sp];
+    else
+        v = recall_var(hpname, hplen);
+    int err = ERR_NONE;
+    if (v == NULL)
+        err = name == NULL ? ERR_TOO_FEW_ARGUMENTS : ERR_NONEXISTENT;
+    else if (v->type != TYPE_REALMATRIX && v->type != TYPE_COMPLEXMATRIX
+            && v->type != TYPE_SPARSEMATRIX && v->type != TYPE_LIST)
+        err = ERR_INVALID_TYPE;
+    else if (!materialize(v))
+        err = ERR_INSUFFICIENT_MEMORY;
+    else if (v->type == TYPE_LIST) {
+        vartype_list *list = (vartype_list *) v;
+        for (int4 i = 0; i < list->size; i++) {
+            int t = list->array->data[i]->type;
+            if (t != TYPE_REAL && t != TYPE_COMPLEX && t != TYPE_STRING) {
+                err = ERR_INVALID_TYPE;
+                break;
+            }
+        }
+    }
+    if (err != ERR_NONE) {
+        display_error(err);
+        redisplay();
+        return false;
+    }
+
+    FILE *f = my_fopen(file_name, "wb");
+    if (f == NULL) {
+        char msg[1024];
+        int err = errno;
+        snprintf(msg, 1024, "Could not open \"%s\" for writing: %s (%d)", file_name, strerror(err), err);
+        shell_message(msg);
+        return false;
+    }
+    setvbuf(f, NULL, _IOFBF, CSV_BUFSIZE);
+
+    char buf[100];
+    int bufptr;
+    if (v->type == TYPE_REALMATRIX) {
+        vartype_realmatrix *rm = (vartype_realmatrix *) v;
+        phloat *data = rm->array->data;
+        char *is_string = rm->array->is_string;
+        int4 n = 0;
+        for (int4 r = 0; r < rm->rows; r++) {
+            for (int4 c = 0; c < rm->columns; c++) {
+                if (c > 0)
+                    putc(delim, f);
+                if (is_string == NULL || is_string[n] == 0) {
+                    bufptr = real2buf(buf, data[n], csv_format);
+                    fwrite(buf, 1, bufptr, f);
+                } else {
+                    char *text;
+                    int4 len;
+                    get_matrix_string(rm, n, &text, &len);
+                    csv_write_string(f, text, len);
+                }
+                n++;
+            }
+            putc('\n', f);
+        }
+    } else if (v->type == TYPE_COMPLEXMATRIX) {
+        vartype_complexmatrix *cm = (vartype_complexmatrix *) v;
+        phloat *data = cm->array->data;
+        int4 n = 0;
+        for (int4 r = 0; r < cm->rows; r++) {
+            for (int4 c = 0; c < cm->columns; c++) {
+                if (c > 0)
+                    putc(delim, f);
+                bufptr = complex2buf(buf, data[n], data[n + 1], true, csv_format);
+                fwrite(buf, 1, bufptr, f);
+                n += 2;
+            }
+            putc('\n', f);
+        }
+    } else if (v->type == TYPE_SPARSEMATRIX) {
+        vartype_sparsematrix *sm = (vartype_sparsematrix *) v;
+        const sparsematrix_data *sd = sm->array;
+        for (int4 r = 0; r < sm->rows; r++) {
+            int4 p = sd->rowptr[r];
+            for (int4 c = 0; c < sm->columns; c++) {
+                if (c > 0)
+                    putc(delim, f);
+                if (p < sd->rowptr[r + 1] && sd->colidx[p] == c) {
+                    bufptr = real2buf(buf, sd->data[p++], csv_format);
+                    fwrite(buf, 1, bufptr, f);
+                } else
+                    putc('0', f);
+            }
+            putc('\n', f);
+        }
+    } else {
+        vartype_list *list = (vartype_list *) v;
+        for (int4 i = 0; i < list->size; i++) {
+            vartype *elem = list->array->data[i];
+            if (elem->type == TYPE_REAL) {
+                bufptr = real2buf(buf, ((vartype_real *) elem)->x, csv_format);
+                fwrite(buf, 1, bufptr, f);
+            } else if (elem->type == TYPE_COMPLEX) {
+                vartype_complex *c = (vartype_complex *) elem;
+                bufptr = complex2buf(buf, c->re, c->im, true, csv_format);
+                fwrite(buf, 1, bufptr, f);
+            } else {
+                vartype_string *s = (vartype_string *) elem;
+                csv_write_string(f, s->txt(), s->length);
+            }
+            putc('\n', f);
+        }
+    }
+
+    bool ok = !ferror(f);
+    if (fclose(f) != 0)
+        ok = false;
+    if (!ok)
+        shell_message("An error occurred during matrix export.");
+    return ok;
+}
+
+// Result codes for csv_next_cell()
+#define CSV_NONE 0
+#define CSV_DELIM 1
+#define CSV_EOL 2
+#define CSV_EOF 3
+
+struct csv_reader {
+    FILE *f;
+    char buf[CSV_BUFSIZE];
+    int len, pos;
+    int8 bytes;
+    char delim;
+    char *cell;
+    char *hpcell;
+    int4 cell_len, cell_cap;
+    bool quoted;
+    bool fail;
+};
+
+static int csv_getc(csv_reader *r) {
+    if (r->pos == r->len) {
+        r->len = (int) fread(r->buf, 1, CSV_BUFSIZE, r->f);
+        r->pos = 0;
+        r->bytes += r->len;
+        if (r->len == 0)
+            return EOF;
+    }
+    return (unsigned char) r->buf[r->pos++];
+}
+
+static void csv_append(csv_reader *r, char c) {
+    if (r->cell_len == r->cell_cap) {
+        int4 nc = r->cell_cap == 0 ? 256 : r->cell_cap * 2;
+        char *ncell = (char *) realloc(r->cell, nc);
+        if (ncell == NULL) {
+            r->fail = true;
+            return;
+        }
+        r->cell = ncell;
+        /* ascii2hp() may write up to 4 characters past the end */
+        ncell = (char *) realloc(r->hpcell, nc + 5);
+        if (ncell == NULL) {
+            r->fail = true;
+            return;
+        }
+        r->hpcell = ncell;
+        r->cell_cap = nc;
+    }
+    r->cell[r->cell_len++] = c;
+}
+
+/* Reads the next cell into r->cell, with surrounding quotes removed and
+ * doubled quotes unescaped. Returns what ended the cell, or CSV_NONE if there
+ * are no more cells in the file.
+ */
+static int csv_next_cell(csv_reader *r) {
+    r->cell_len = 0;
+    r->quoted = false;
+    int c = csv_getc(r);
+    if (c == EOF)
+        return CSV_NONE;
+    if (c == '"') {
+        r->quoted = true;
+        while (true) {
+            c = csv_getc(r);
+            if (c == EOF)
+                return CSV_EOF;
+            if (c == '"') {
+                c = csv_getc(r);
+                if (c != '"')
+                    break;
+            }
+            csv_append(r, (char) c);
+        }
+        // Anything between the closing quote and the delimiter is ignored
+        while (c != EOF && c != r->delim && c != '\n' && c != '\r')
+            c = csv_getc(r);
+    } else {
+        while (c != EOF && c != r->delim && c != '\n' && c != '\r') {
+            csv_append(r, (char) c);
+            c = csv_getc(r);
+        }
+    }
+    if (c == r->delim)
+        return CSV_DELIM;
+    if (c == '\r') {
+        c = csv_getc(r);
+        if (c != '\n' && c != EOF)
+            r->pos--;
+        return CSV_EOL;
+    }
+    return c == '\n' ? CSV_EOL : CSV_EOF;
+}
+
+static bool csv_rewind(csv_reader *r) {
+    r->len = r->pos = 0;
+    r->bytes = 0;
+    return fseek(r->f, 0, SEEK_SET) == 0;
+}
+
+/* Opens a file for reading and detects its delimiter: tab-separated if the
+ * first line contains a tab, comma-separated otherwise. Reports any error
+ * itself, and returns NULL in that case.
+ */
+static csv_reader *csv_open(const char *file_name) {
+    csv_reader *r = (csv_reader *) malloc(sizeof(csv_reader));
+    if (r == NULL) {
+        display_error(ERR_INSUFFICIENT_MEMORY);
+        redisplay();
+        return NULL;
+    }
+    r->f = my_fopen(file_name, "rb");
+    if (r->f == NULL) {
+        char msg[1024];
+        int err = errno;
+        snprintf(msg, 1024, "Could not open \"%s\" for reading: %s (%d)", file_name, strerror(err), err);
+        shell_message(msg);
+        free(r);
+        return NULL;
+    }
+    r->len = r->pos = 0;
+    r->bytes = 0;
+    r->cell = NULL;
+    r->hpcell = NULL;
+    r->cell_len = r->cell_cap = 0;
+    r->fail = false;
+
+    r->delim = ',';
+    int c;
+    while ((c = csv_getc(r)) != EOF && c != '\n' && c != '\r')
+        if (c == '\t') {
+            r->delim = '\t';
+            break;
+        }
+    return r;
+}
+
+/* True if the cell just read makes up an entire line by itself, and is empty
+ * and unquoted. Such lines are ignored, like blank lines in Sigma+ from CSV.
+ */
+static bool csv_blank_line(csv_reader *r, int res, int col) {
+    return col == 0 && res != CSV_DELIM && r->cell_len == 0 && !r->quoted;
+}
+
+static void csv_close(csv_reader *r) {
+    fclose(r->f);
+    free(r->cell);
+    free(r->hpcell);
+    free(r);
+}
+
+/* Converts the current cell to a scalar: quoted cells are always strings;
+ * anything else is parsed like a pasted spreadsheet cell. Returns the hp
+ * text length for strings, or -1 for numbers.
+ */
+static int csv_parse_cell(csv_reader *r, phloat *re, phloat *im, bool *is_complex) {
+    *re = 0;
+    *im = 0;
+    *is_complex = false;
+    if (r->cell_len == 0)
+        return r->quoted ? 0 : -1;
+    int hplen = ascii2hp(r->hpcell, r->cell_len, r->cell, r->cell_len);
+    if (r->quoted)
+        return hplen;
+    int slen;
+    switch (parse_scalar(r->hpcell, hplen, true, re, im, &slen, csv_format)) {
+        case TYPE_REAL:
+            return -1;
+        case TYPE_COMPLEX:
+            *is_complex = true;
+            return -1;
+        default:
+            return slen;
+    }
+}
+
+bool core_import_csv(const char *name, const char *file_name, bool as_list) {
+    if (mode_interruptible != NULL)
+        stop_interruptible();
+    set_running(false);
+
+    char hpname[11];
+    int hplen;
+    if (!csv_lookup(name, hpname, &hplen)) {
+        display_error(ERR_INVALID_DATA);
+        redisplay();
+        return false;
+    }
+
+    csv_reader *r = csv_open(file_name);
+    if (r == NULL)
+        return false;
+
+    // First pass: find the dimensions
+    int4 rows = 0, cols = 0, col = 0;
+    const char *msg = NULL;
+    vartype *v = NULL;
+    int err = ERR_NONE;
+    if (!csv_rewind(r))
+        goto read_error;
+    while (true) {
+        int res = csv_next_cell(r);
+        if (res == CSV_NONE)
+            break;
+        if (csv_blank_line(r, res, col))
+            continue;
+        col++;
+        if (res == CSV_DELIM)
+            continue;
+        rows++;
+        if (col > cols)
+            cols = col;
+        col = 0;
+        if (res == CSV_EOF)
+            break;
+    }
+    if (ferror(r->f))
+        goto read_error;
+    if (r->fail) {
+        err = ERR_INSUFFICIENT_MEMORY;
+        goto done;
+    }
+    if (rows == 0) {
+        msg = "The file contains no data.";
+        goto done;
+    }
+
+    if (as_list) {
+        if ((double) rows * cols > 2147483647.0) {
+            err = ERR_INSUFFICIENT_MEMORY;
+            goto done;
+        }
+        v = new_list(rows * cols);
+    } else
+        v = new_realmatrix(rows, cols);
+    if (v == NULL) {
+        err = ERR_INSUFFICIENT_MEMORY;
+        goto done;
+    }
+
+    // Second pass: fill in the cells. Short rows are padded with zeros.
+    if (!csv_rewind(r))
+        goto read_error;
+    {
+        int4 row = 0;
+        col = 0;
+        while (row < rows) {
+            int res = csv_next_cell(r);
+            if (res == CSV_NONE)
+                break;
+            if (r->fail) {
+                err = ERR_INSUFFICIENT_MEMORY;
+                goto done;
+            }
+            if (csv_blank_line(r, res, col))
+                continue;
+            int4 n = row * cols + col;
+            phloat re, im;
+            bool is_complex;
+            int slen = csv_parse_cell(r, &re, &im, &is_complex);
+            if (as_list) {
+                vartype *elem;
+                if (slen != -1)
+                    elem = new_string(r->hpcell, slen);
+                else if (is_complex)
+                    elem = new_complex(re, im);
+                else
+                    elem = new_real(re);
+                if (elem == NULL) {
+                    err = ERR_INSUFFICIENT_MEMORY;
+                    goto done;
+                }
+                ((vartype_list *) v)->array->data[n] = elem;
+            } else if (v->type == TYPE_REALMATRIX) {
+                vartype_realmatrix *rm = (vartype_realmatrix *) v;
+                if (slen != -1) {
+                    if (!put_matrix_string(rm, n, r->hpcell, slen)) {
+                        err = ERR_INSUFFICIENT_MEMORY;
+                        goto done;
+                    }
+                } else if (is_complex) {
+                    // Like Paste, switch to complex, dropping any strings
+                    vartype *cv = new_complexmatrix(rows, cols);
+                    if (cv == NULL) {
+                        err = ERR_INSUFFICIENT_MEMORY;
+                        goto done;
+                    }
+                    phloat *src = rm->array->data;
+                    phloat *dst = ((vartype_complexmatrix *) cv)->array->data;
+                    char *is_string = rm->array->is_string;
+                    for (int4 i = 0; i < n; i++)
+                        if (is_string == NULL || is_string[i] == 0)
+                            dst[2 * i] = src[i];
+                    dst[2 * n] = re;
+                    dst[2 * n + 1] = im;
+                    free_vartype(v);
+                    v = cv;
+                } else
+                    rm->array->data[n] = re;
+            } else if (slen == -1) {
+                phloat *data = ((vartype_complexmatrix *) v)->array->data;
+                data[2 * n] = re;
+                data[2 * n + 1] = im;
+            }
+            if (res == CSV_DELIM) {
+                col++;
+            } else {
+                row++;
+                col = 0;
+                if (res == CSV_EOF)
+                    break;
+            }
+        }
+    }
+    if (ferror(r->f))
+        goto read_error;
+    if (as_list) {
+        // Padding cells in short rows
+        vartype_list *list = (vartype_list *) v;
+        for (int4 i = 0; i < list->size; i++)
+            if (list->array->data[i] == NULL) {
+                list->array->data[i] = new_real(0);
+                if (list->array->data[i] == NULL) {
+                    err = ERR_INSUFFICIENT_MEMORY;
+                    goto done;
+                }
+            }
+    } else
+        touch_matrix(v);
+
+    if (hplen == 0) {
+        err = recall_result(v);
+        if (err == ERR_NONE) {
+            mode_number_entry = false;
+            mode_varmenu = false;
+            flags.f.stack_lift_disable = 0;
+        }
+    } else
+        err = store_var(hpname, hplen, v);
+    if (err == ERR_NONE)
+        v = NULL;
+    else if (hplen == 0)
+        // recall_result() has already freed it
+        v = NULL;
+    goto done;
+
+    read_error:
+    {
+        char buf[1024];
+        snprintf(buf, 1024, "An error occurred while reading \"%s\".", file_name);
+        shell_message(buf);
+        msg = "";
+    }
+
+    done:
+    csv_close(r);
+    if (v != NULL)
+        free_vartype(v);
+    if (msg != NULL) {
+        if (*msg != 0)
+            shell_message(msg);
+        return false;
+    }
+    if (err != ERR_NONE)
+        display_error(err);
+    else {
+        flags.f.message = 0;
+        flags.f.two_line_message = 0;
+    }
+    redisplay();
+    return err == ERR_NONE;
+}
+
+// Data points per batch in core_sigma_csv(), and lines read per call to
+// csv_sigma_worker(), so the shell stays responsive
+#define CSV_SIGMA_BATCH 4096
+#ifdef BCD_MATH
+#define CSV_SIGMA_LINES_PER_CALL 4096
+#else
+#define CSV_SIGMA_LINES_PER_CALL 16384
+#endif
+
+struct csv_sigma_data_struct {
+    csv_reader *r;
+    char *file_name;
+    sigma_state st;
+    phloat *data;
+    int4 n;
+    int col;
+    bool good;
+    int8 points, skipped;
+    int8 size;
+    int percent;
+    uint4 start;
+    // The fit flags are only updated for good if all the data gets added
+    bool log_fit_invalid, exp_fit_invalid, pwr_fit_invalid;
+};
+
+static csv_sigma_data_struct *csv_sigma_data = NULL;
+
+static int csv_sigma_finish(int err, bool read_error) {
+    csv_sigma_data_struct *dat = csv_sigma_data;
+    csv_sigma_data = NULL;
+    uint4 elapsed = shell_milliseconds() - dat->start;
+    int8 bytes = dat->r->bytes;
+    int8 points = dat->points;
+    int8 skipped = dat->skipped;
+    csv_close(dat->r);
+    free(dat->data);
+    flags.f.message = 0;
+    flags.f.two_line_message = 0;
+
+    if (read_error || err != ERR_NONE) {
+        flags.f.log_fit_invalid = dat->log_fit_invalid;
+        flags.f.exp_fit_invalid = dat->exp_fit_invalid;
+        flags.f.pwr_fit_invalid = dat->pwr_fit_invalid;
+        if (read_error) {
+            char buf[1024];
+            snprintf(buf, 1024, "An error occurred while reading \"%s\".", dat->file_name);
+            shell_message(buf);
+        }
+        free(dat->file_name);
+        free(dat);
+        return err;
+    }
+
+    sigma_end(&dat->st);
+    free(dat->file_name);
+    free(dat);
+    redisplay();
+
+    char buf[1024];
+    double mb = bytes / 1048576.0;
+    double secs = elapsed / 1000.0;
+    int len = snprintf(buf, 1024, "Added %lld data point%s from %.1f MB in %.1f s",
+                       (long long) points, points == 1 ? "" : "s", mb, secs);
+    if (secs > 0)
+        len += snprintf(buf + len, 1024 - len, " (%.1f MB/s)", mb / secs);
+    if (skipped > 0)
+        snprintf(buf + len, 1024 - len, "; %lld line%s skipped.", (long long) skipped, skipped == 1 ? " was" : "s were");
+    else
+        snprintf(buf + len, 1024 - len, ".");
+    shell_message(buf);
+    return ERR_NONE;
+}
+
+static void csv_sigma_progress(csv_sigma_data_struct *dat) {
+    if (dat->size <= 0)
+        return;
+    int percent = (int) (dat->r->bytes * 100 / dat->size);
+    if (percent == dat->percent)
+        return;
+    dat->percent = percent;
+    char buf[22];
+    int len = snprintf(buf, 22, "\5+ from CSV: %d%%", percent);
+    clear_row(0);
+    draw_string(0, 0, buf, len);
+    flush_display();
+    flags.f.message = 1;
+    flags.f.two_line_message = 0;
+}
+
+static int csv_sigma_worker(bool interrupted) {
+    csv_sigma_data_struct *dat = csv_sigma_data;
+    if (interrupted)
+        return csv_sigma_finish(ERR_INTERRUPTED, false);
+
+    csv_reader *r = dat->r;
+    phloat *data = dat->data;
+    int4 lines = 0;
+    while (true) {
+        int res = csv_next_cell(r);
+        if (res == CSV_NONE)
+            break;
+        if (r->fail)
+            return csv_sigma_finish(ERR_INSUFFICIENT_MEMORY, false);
+        if (dat->col < 2) {
+            phloat re, im;
+            bool is_complex;
+            if (r->cell_len == 0
+                    || csv_parse_cell(r, &re, &im, &is_complex) != -1
+                    || is_complex)
+                dat->good = false;
+            else
+                data[2 * dat->n + dat->col] = re;
+        }
+        dat->col++;
+        if (res == CSV_DELIM)
+            continue;
+        if (dat->good) {
+            if (dat->col == 1)
+                data[2 * dat->n + 1] = 0;
+            if (++dat->n == CSV_SIGMA_BATCH) {
+                sigma_add_points(&dat->st, data, dat->n, 1);
+                dat->points += dat->n;
+                dat->n = 0;
+            }
+        } else if (!csv_blank_line(r, res, dat->col - 1))
+            dat->skipped++;
+        dat->col = 0;
+        dat->good = true;
+        if (res == CSV_EOF)
+            break;
+        if (++lines == CSV_SIGMA_LINES_PER_CALL) {
+            csv_sigma_progress(dat);
+            return ERR_INTERRUPTIBLE;
+        }
+    }
+    if (ferror(r->f))
+        return csv_sigma_finish(ERR_NONE, true);
+    if (dat->n > 0) {
+        sigma_add_points(&dat->st, data, dat->n, 1);
+        dat->points += dat->n;
+    }
+    return csv_sigma_finish(ERR_NONE, false);
+}
+
+bool core_sigma_csv(const char *file_name) {
+    if (mode_interruptible != NULL)
+        stop_interruptible();
+    set_running(false);
+
+    csv_sigma_data_struct *dat = (csv_sigma_data_struct *)
+                                    malloc(sizeof(csv_sigma_data_struct));
+    if (dat == NULL) {
+        display_error(ERR_INSUFFICIENT_MEMORY);
+        redisplay();
+        return false;
+    }
+    int err = sigma_begin(&dat->st);
+    if (err != ERR_NONE) {
+        free(dat);
+        display_error(err);
+        redisplay();
+        return false;
+    }
+    dat->data = (phloat *) malloc(2 * CSV_SIGMA_BATCH * sizeof(phloat));
+    dat->file_name = strdup(file_name);
+    if (dat->data == NULL || dat->file_name == NULL) {
+        free(dat->data);
+        free(dat->file_name);
+        free(dat);
+        display_error(ERR_INSUFFICIENT_MEMORY);
+        redisplay();
+        return false;
+    }
+    dat->r = csv_open(file_name);
+    if (dat->r == NULL) {
+        free(dat->data);
+        free(dat->file_name);
+        free(dat);
+        return false;
+    }
+    dat->size = fseek(dat->r->f, 0, SEEK_END) == 0 ? ftell(dat->r->f) : -1;
+    if (!csv_rewind(dat->r)) {
+        char buf[1024];
+        snprintf(buf, 1024, "An error occurred while reading \"%s\".", file_name);
+        shell_message(buf);
+        csv_close(dat->r);
+        free(dat->data);
+        free(dat->file_name);
+        free(dat);
+        return false;
+    }
+    dat->n = 0;
+    dat->col = 0;
+    dat->good = true;
+    dat->points = dat->skipped = 0;
+    dat->percent = -1;
+    dat->start = shell_milliseconds();
+    dat->log_fit_invalid = flags.f.log_fit_invalid;
+    dat->exp_fit_invalid = flags.f.exp_fit_invalid;
+    dat->pwr_fit_invalid = flags.f.pwr_fit_invalid;
+
+    csv_sigma_data = dat;
+    csv_sigma_progress(dat);
+    mode_interruptible = csv_sigma_worker;
+    mode_stoppable = false;
+    shell_annunciators(-1, -1, -1, 1, -1, -1);
+    return true;
+}
+
 #if defined(ANDROID) || defined(IPHONE)
 
 void core_get_char_pixels(const char *ch, char *pixels) {
@@ -56,6 +56,19 @@ void core_save_state(const char *state_file_name);
  */
 void core_cleanup();
 
+/* core_move_state_files()
+ *
+ * When core_settings.map_large_matrices is set, very large matrices are kept
+ * in separate files, named after the state file plus a random suffix, which
+ * the state file refers to. The shell calls this function whenever it
+ * renames, copies, or deletes a state file itself, so those files go with
+ * it: they are renamed to go with new_state_file_name, or copied, if 'copy'
+ * is true, or, if new_state_file_name is NULL, deleted. Returns false if any
+ * of them could not be renamed or copied.
+ */
+bool core_move_state_files(const char *state_file_name,
+                           const char *new_state_file_name, bool copy);
+
 /* core_repaint_display()
  *
  * This function asks the emulator core to repaint the display. The core will
@@ -310,6 +323,56 @@ char *core_copy();
  */
 void core_paste(const char *s);
 
+/* core_export_csv()
+ *
+ * Writes a matrix or list to the file named by file_name, one matrix row or
+ * list element per line, with cells separated by 'delim' (normally ',' or
+ * '\t'). The 'name' parameter is the name of the variable to export, in
+ * UTF-8; NULL means the X register. Strings are written in double quotes;
+ * numbers are written in full precision, using '.' as the decimal point.
+ * The file is written row by row, without building the whole text in
+ * memory. Returns false if the value could not be exported; the error is
+ * reported by the core.
+ * Used by the shell to implement the Export Matrix command.
+ */
+bool core_export_csv(const char *name, const char *file_name, char delim);
+
+/* core_import_csv()
+ *
+ * Reads a comma- or tab-separated file, as written by core_export_csv() or
+ * by a spreadsheet, and stores it in the variable 'name' (UTF-8), or, if
+ * 'name' is NULL, pushes it onto the stack. Tabs are used as the delimiter if
+ * the first line contains any; commas otherwise. The result is a real or
+ * complex matrix, with short rows padded with zeros, or, if as_list is true,
+ * a list with the cells in row-major order. Quoted cells are always read as
+ * strings. The file is read twice, once to find the dimensions and once to
+ * fill in the cells, through a fixed-size buffer. Returns false if the file
+ * could not be imported; the error is reported by the core.
+ * Used by the shell to implement the Import Matrix command.
+ */
+bool core_import_csv(const char *name, const char *file_name, bool as_list);
+
+/* core_sigma_csv()
+ *
+ * Reads a comma- or tab-separated file, like core_import_csv(), and adds each
+ * line to the summation registers, as if by Σ+, with the first cell as x and
+ * the second as y, or 0 if there is only one. Lines whose first two cells
+ * aren't real numbers, like headings, are skipped. The file is read through
+ * a fixed-size buffer, and the data points are added in batches, so files of
+ * any size can be used.
+ * The file is read a bit at a time, like an interruptible function such as
+ * SOLVE, with the progress shown in the display: if this function returns
+ * true, the shell should keep calling core_keydown() with key = 0, as it
+ * does when core_keydown() returns true, until that returns false. Pressing
+ * EXIT cancels. The registers and the fit flags are only updated if the
+ * whole file was read successfully. When done, the number of data points
+ * and the throughput are reported using shell_message(). Returns false if
+ * the file could not be opened, or the data could not be added; the error is
+ * reported by the core.
+ * Used by the shell to implement the Σ+ from CSV command.
+ */
+bool core_sigma_csv(const char *file_name);
+
 #if defined(ANDROID) || defined(IPHONE)
 
 /* core_get_char_pixels()
@@ -340,6 +403,8 @@ struct core_settings_struct {
     bool auto_repeat;
     bool allow_big_stack;
     bool localized_copy_paste;
+    int matrix_block_size; // Not user-configurable; saved with the core state
+    bool map_large_matrices;
 };
 
 extern core_settings_struct core_settings;
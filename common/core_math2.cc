@@ -18,7 +18,44 @@
 #include "core_globals.h"
 #include "core_math2.h"
 
-phloat math_random() {
+/* The RAN generator is a decimal LCG, state = state * 2851130928467 mod 10^15,
+ * with the state split across random_number_high (7 digits) and
+ * random_number_low (8 digits). The step and the conversion to a phloat are
+ * kept separate so that math_random_fill() can run the whole loop on local
+ * copies of the state.
+ */
+static inline void random_step(int8 &low, int8 &high) {
+    int8 temp = low * 30928467;
+    high = (low * 28511 + high * 30928467 + temp / 100000000) % 10000000;
+    low = temp % 100000000;
+}
+
+static inline phloat random_value(int8 low, int8 high) {
+    #ifdef BCD_MATH
+        // The result has at most 15 significant digits, so rather than adding
+        // two quotients, we assemble all the digits in one integer and do a
+        // single, exact, division.
+        if (high >= 1000000)
+            return Phloat(high * 100000 + low / 1000) / Phloat(1000000000000LL);
+        else if (high >= 100000)
+            return Phloat(high * 1000000 + low / 100) / Phloat(10000000000000LL);
+        else if (high >= 10000)
+            return Phloat(high * 10000000 + low / 10) / Phloat(100000000000000LL);
+        else
+            return Phloat(high * 100000000 + low) / Phloat(1000000000000000LL);
+    #else
+        if (high >= 1000000)
+            return low / 1000 / 1000000000000.0 + high / 10000000.0;
+        else if (high >= 100000)
+            return low / 100 / 10000000000000.0 + high / 10000000.0;
+        else if (high >= 10000)
+            return low / 10 / 100000000000000.0 + high / 10000000.0;
+        else
+            return low / 1000000000000000.0 + high / 10000000.0;
+    #endif
+}
+
+static void random_init() {
     if (random_number_low == 0 && random_number_high == 0) {
         random_number_high = 0;
         random_number_low = 2787;
@@ -27,45 +64,24 @@ phloat math_random() {
         // random_number_high = 9995003;
         // random_number_low = 33083533;
     }
-    int8 temp = random_number_low * 30928467;
-    random_number_high = (random_number_low * 28511 + random_number_high * 30928467 + temp / 100000000) % 10000000;
-    random_number_low = temp % 100000000;
-    if (random_number_high >= 1000000) {
-        temp = random_number_low / 1000;
-        #ifdef BCD_MATH
-            const Phloat n1(1000000000000LL);
-            const Phloat n2(10000000);
-            return Phloat(temp) / n1 + Phloat(random_number_high) / n2;
-        #else
-            return temp / 1000000000000.0 + random_number_high / 10000000.0;
-        #endif
-    } else if (random_number_high >= 100000) {
-        temp = random_number_low / 100;
-        #ifdef BCD_MATH
-            const Phloat n1(10000000000000LL);
-            const Phloat n2(10000000);
-            return Phloat(temp) / n1 + Phloat(random_number_high) / n2;
-        #else
-            return temp / 10000000000000.0 + random_number_high / 10000000.0;
-        #endif
-    } else if (random_number_high >= 10000) {
-        temp = random_number_low / 10;
-        #ifdef BCD_MATH
-            const Phloat n1(100000000000000LL);
-            const Phloat n2(10000000);
-            return Phloat(temp) / n1 + Phloat(random_number_high) / n2;
-        #else
-            return temp / 100000000000000.0 + random_number_high / 10000000.0;
-        #endif
-    } else {
-        #ifdef BCD_MATH
-            const Phloat n1(1000000000000000LL);
-            const Phloat n2(10000000);
-            return Phloat(random_number_low) / n1 + Phloat(random_number_high) / n2;
-        #else
-            return random_number_low / 1000000000000000.0 + random_number_high / 10000000.0;
-        #endif
+}
+
+phloat math_random() {
+    random_init();
+    random_step(random_number_low, random_number_high);
+    return random_value(random_number_low, random_number_high);
+}
+
+void math_random_fill(phloat *x, int4 n) {
+    random_init();
+    int8 low = random_number_low;
+    int8 high = random_number_high;
+    for (int4 i = 0; i < n; i++) {
+        random_step(low, high);
+        x[i] = random_value(low, high);
     }
+    random_number_low = low;
+    random_number_high = high;
 }
 
 int math_tan(phloat x, phloat *y, bool rad) {
@@ -78,7 +94,8 @@ int math_tan(phloat x, phloat *y, bool rad) {
             neg = true;
         }
         // [0 200[
-        x = fmod(x, 200);
+        if (x >= 200)
+            x = fmod(x, 200);
         if (x == 100)
             goto infinite;
         // TAN(x+100gon) = -TAN(100gon-x)
@@ -88,9 +105,9 @@ int math_tan(phloat x, phloat *y, bool rad) {
         }
         // to improve accuracy for x close to 100gon
         if (x > 89)
-            *y = 1 / tan((100 - x) / (200 / PI));
+            *y = 1 / tan((100 - x) / RAD_TO_GRAD_PHLOAT);
         else
-            *y = tan(x / (200 / PI));
+            *y = tan(x / RAD_TO_GRAD_PHLOAT);
         if (neg)
             *y = -(*y);
     } else {
@@ -100,7 +117,8 @@ int math_tan(phloat x, phloat *y, bool rad) {
             neg = true;
         }
         // [0 180[
-        x = fmod(x, 180);
+        if (x >= 180)
+            x = fmod(x, 180);
         if (x == 90)
             goto infinite;
         // TAN(x+90°) = -TAN(90°-x)
@@ -110,9 +128,9 @@ int math_tan(phloat x, phloat *y, bool rad) {
         }
         // to improve accuracy for x close to 90°
         if (x > 80)
-            *y = 1 / tan((90 - x) / (180 / PI));
+            *y = 1 / tan((90 - x) / RAD_TO_DEG_PHLOAT);
         else
-            *y = tan(x / (180 / PI));
+            *y = tan(x / RAD_TO_DEG_PHLOAT);
         if (neg)
             *y = -(*y);
     }
@@ -290,7 +308,7 @@ int math_ln(phloat xre, phloat xim, phloat *yre, phloat *yim) {
         } else {
             #ifdef BCD_MATH
             phloat m = scalbn(phloat(1), 38);
-            phloat b = -log(phloat(10)) * 38;
+            phloat b = -LN10_PHLOAT * 38;
             #else
             phloat m = 0x2000000000000000; // 2^61
             phloat b = -log(phloat(2)) * 61;
@@ -419,3 +437,57 @@ int math_inv(phloat xre, phloat xim, phloat *yre, phloat *yim) {
     *yim = rim;
     return ERR_NONE;
 }
+
+/* In the binary build, the array sums are split over several independent
+ * accumulators, which removes the loop-carried dependency on a single sum and
+ * lets the compiler vectorize the loop body. The decimal build sums in order,
+ * so its results are unchanged.
+ */
+#define SUM_LANES 4
+
+phloat math_sum(const phloat *x, int4 stride, int4 n) {
+#ifdef BCD_MATH
+    phloat_sum acc;
+    sum_init(&acc);
+    for (int4 i = 0; i < n; i++)
+        sum_add(&acc, x[i * stride]);
+    return sum_result(&acc);
+#else
+    phloat_sum acc[SUM_LANES];
+    int4 i, l;
+    for (l = 0; l < SUM_LANES; l++)
+        sum_init(&acc[l]);
+    for (i = 0; i + SUM_LANES <= n; i += SUM_LANES)
+        for (l = 0; l < SUM_LANES; l++)
+            sum_add(&acc[l], x[(i + l) * stride]);
+    for (; i < n; i++)
+        sum_add(&acc[0], x[i * stride]);
+    for (l = 1; l < SUM_LANES; l++)
+        sum_merge(&acc[0], &acc[l]);
+    return sum_result(&acc[0]);
+#endif
+}
+
+phloat math_dot(const phloat *x, int4 xstride,
+                const phloat *y, int4 ystride, int4 n) {
+#ifdef BCD_MATH
+    phloat_sum acc;
+    sum_init(&acc);
+    for (int4 i = 0; i < n; i++)
+        sum_add_product(&acc, x[i * xstride], y[i * ystride]);
+    return sum_result(&acc);
+#else
+    phloat_sum acc[SUM_LANES];
+    int4 i, l;
+    for (l = 0; l < SUM_LANES; l++)
+        sum_init(&acc[l]);
+    for (i = 0; i + SUM_LANES <= n; i += SUM_LANES)
+        for (l = 0; l < SUM_LANES; l++)
+            sum_add_product(&acc[l], x[(i + l) * xstride], y[(i + l) * ystride]);
+    for (; i < n; i++)
+        sum_add_product(&acc[0], x[i * xstride], y[i * ystride]);
+    for (l = 1; l < SUM_LANES; l++)
+        sum_merge(&acc[0], &acc[l]);
+    return sum_result(&acc[0]);
+#endif
+}
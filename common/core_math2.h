@@ -21,6 +21,7 @@
 #include "core_phloat.h"
 
 phloat math_random();
+void math_random_fill(phloat *x, int4 n);
 int math_tan(phloat x, phloat *y, bool rad);
 int math_asinh(phloat xre, phloat xim, phloat *yre, phloat *yim);
 int math_acosh(phloat xre, phloat xim, phloat *yre, phloat *yim);
@@ -29,4 +30,79 @@ int math_ln(phloat xre, phloat xim, phloat *yre, phloat *yim);
 int math_sqrt(phloat xre, phloat xim, phloat *yre, phloat *yim);
 int math_inv(phloat xre, phloat xim, phloat *yre, phloat *yim);
 
+
+/* Compensated summation, used by RSUM, FNRM, DOT, and the statistics
+ * accumulators. In the binary build, every addition is done with Knuth's
+ * TwoSum and every product with Dekker's TwoProduct, and the rounding errors
+ * are accumulated separately and added back in at the end; the result is
+ * about as accurate as if the sum had been computed in twice the working
+ * precision. In the decimal build, which already has 34 digits, these are
+ * plain running sums, in the same order as before.
+ */
+
+struct phloat_sum {
+    phloat s;
+#ifndef BCD_MATH
+    phloat c;
+#endif
+};
+
+inline void sum_init(phloat_sum *acc) {
+    acc->s = 0;
+#ifndef BCD_MATH
+    acc->c = 0;
+#endif
+}
+
+inline void sum_add(phloat_sum *acc, phloat x) {
+#ifdef BCD_MATH
+    acc->s += x;
+#else
+    phloat t = acc->s + x;
+    phloat z = t - acc->s;
+    acc->c += (acc->s - (t - z)) + (x - z);
+    acc->s = t;
+#endif
+}
+
+inline void sum_add_product(phloat_sum *acc, phloat x, phloat y) {
+#ifdef BCD_MATH
+    acc->s += x * y;
+#else
+    const phloat split = 134217729.0; // 2^27 + 1
+    phloat p = x * y;
+    phloat t = split * x;
+    phloat xh = t - (t - x);
+    phloat xl = x - xh;
+    t = split * y;
+    phloat yh = t - (t - y);
+    phloat yl = y - yh;
+    acc->c += ((xh * yh - p) + xh * yl + xl * yh) + xl * yl;
+    sum_add(acc, p);
+#endif
+}
+
+inline void sum_merge(phloat_sum *acc, const phloat_sum *other) {
+    sum_add(acc, other->s);
+#ifndef BCD_MATH
+    acc->c += other->c;
+#endif
+}
+
+inline phloat sum_result(const phloat_sum *acc) {
+#ifdef BCD_MATH
+    return acc->s;
+#else
+    // The correction is NaN if any intermediate result overflowed, or if
+    // a product was too large to be split; in those cases, it is useless.
+    if (p_isnan(acc->c) || p_isinf(acc->c) != 0)
+        return acc->s;
+    return acc->s + acc->c;
+#endif
+}
+
+phloat math_sum(const phloat *x, int4 stride, int4 n);
+phloat math_dot(const phloat *x, int4 xstride,
+                const phloat *y, int4 ystride, int4 n);
+
 #endif
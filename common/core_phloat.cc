@@ -62,6 +62,10 @@ void phloat_init() {
     NAN_PHLOAT = nan;
     bid128_nan(&NAN_1_PHLOAT.val, "1");
     bid128_nan(&NAN_2_PHLOAT.val, "2");
+    RAD_TO_DEG_PHLOAT = 180 / PI;
+    RAD_TO_GRAD_PHLOAT = 200 / PI;
+    LN10_PHLOAT = log(phloat(10));
+    SQRT_HALF_PHLOAT = sqrt(phloat(0.5));
 }
 
 int string2phloat(const char *buf, int buflen, phloat *d) {
@@ -816,6 +820,10 @@ bool operator==(int4 x, Phloat y) {
 }
 
 Phloat PI("3.141592653589793238462643383279503");
+Phloat RAD_TO_DEG_PHLOAT;
+Phloat RAD_TO_GRAD_PHLOAT;
+Phloat LN10_PHLOAT;
+Phloat SQRT_HALF_PHLOAT;
 
 
 #else // BCD_MATH
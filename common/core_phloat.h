@@ -62,6 +62,13 @@
 #define PI 3.1415926535897932384626433
 #define P 7
 
+// Conversion and argument-reduction constants; see the BCD_MATH section below
+// for why these are cached there.
+#define RAD_TO_DEG_PHLOAT (180 / PI)
+#define RAD_TO_GRAD_PHLOAT (200 / PI)
+#define LN10_PHLOAT 2.3025850929940456840179914546843642
+#define SQRT_HALF_PHLOAT 0.70710678118654752440084436210484903
+
 double decimal2double(void *data, bool pin_magnitude = false);
 
 
@@ -173,6 +180,15 @@ bool operator==(int4 x, Phloat y);
 
 extern Phloat PI;
 
+// In the decimal build, every use of an expression like 180 / PI or
+// log(phloat(10)) is a full BID128 division or logarithm, and these occur in
+// the inner loop of every trig function in DEG and GRAD modes. They are
+// computed once, in phloat_init(), instead.
+extern Phloat RAD_TO_DEG_PHLOAT;
+extern Phloat RAD_TO_GRAD_PHLOAT;
+extern Phloat LN10_PHLOAT;
+extern Phloat SQRT_HALF_PHLOAT;
+
 
 #endif // BCD_MATH
 
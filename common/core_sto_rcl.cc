@@ -26,6 +26,8 @@
 
 
 static int apply_sto_operation(char operation, vartype *oldval, bool trace_stk);
+static int sparse_map(const vartype_sparsematrix *sm, vartype **dst,
+                    mappable_r mr, mappable_rr mrr, phloat s, bool s_first);
 static int generic_sto_completion(int error, vartype *res);
 
 static bool preserve_ij;
@@ -43,17 +45,17 @@ static int apply_sto_operation(char operation, vartype *oldval, bool trace_stk)
     switch (operation) {
         case '/':
             preserve_ij = true;
-            return generic_div(stack[sp], oldval, generic_sto_completion);
+            return generic_div(stack[sp], oldval, generic_sto_completion, true);
         case '*':
             preserve_ij = false;
-            return generic_mul(stack[sp], oldval, generic_sto_completion);
+            return generic_mul(stack[sp], oldval, generic_sto_completion, true);
         case '-':
             preserve_ij = true;
-            error = generic_sub(stack[sp], oldval, &newval);
+            error = generic_sub(stack[sp], oldval, &newval, true);
             return generic_sto_completion(error, newval);
         case '+':
             preserve_ij = true;
-            error = generic_add(stack[sp], oldval, &newval);
+            error = generic_add(stack[sp], oldval, &newval, true);
             return generic_sto_completion(error, newval);
         default:
             return ERR_INTERNAL_ERROR;
@@ -62,7 +64,8 @@ static int apply_sto_operation(char operation, vartype *oldval, bool trace_stk)
 
 int assert_numeric(const vartype *v) {
     if (v->type == TYPE_REAL || v->type == TYPE_COMPLEX
-            || v->type == TYPE_REALMATRIX || v->type == TYPE_COMPLEXMATRIX)
+            || v->type == TYPE_REALMATRIX || v->type == TYPE_COMPLEXMATRIX
+            || v->type == TYPE_SPARSEMATRIX)
         return ERR_NONE;
     else if (v->type == TYPE_STRING)
         return ERR_ALPHA_DATA_IS_INVALID;
@@ -81,7 +84,7 @@ int generic_rcl(arg_struct *arg, vartype **dst) {
     }
     switch (arg->type) {
         case ARGTYPE_NUM: {
-            vartype *regs = recall_var("REGS", 4);
+            vartype *regs = recall_regs();
             if (regs == NULL)
                 return ERR_SIZE_ERROR;
             if (regs->type == TYPE_REALMATRIX) {
@@ -90,7 +93,7 @@ int generic_rcl(arg_struct *arg, vartype **dst) {
                 int4 index = arg->val.num;
                 if (index >= size)
                     return ERR_SIZE_ERROR;
-                if (rm->array->is_string[index] == 0) {
+                if (get_is_string(rm->array, index) == 0) {
                     *dst = new_real(rm->array->data[index]);
                 } else {
                     char *text;
@@ -208,7 +211,7 @@ int generic_sto(arg_struct *arg, char operation) {
 
     switch (arg->type) {
         case ARGTYPE_NUM: {
-            vartype *regs = recall_var("REGS", 4);
+            vartype *regs = recall_regs();
             if (regs == NULL)
                 return ERR_SIZE_ERROR;
             if (regs->type == TYPE_REALMATRIX) {
@@ -228,14 +231,14 @@ int generic_sto(arg_struct *arg, char operation) {
                     if (!disentangle((vartype *) rm))
                         return ERR_INSUFFICIENT_MEMORY;
                     if (operation == 0) {
-                        if (rm->array->is_string[num] == 2)
+                        if (get_is_string(rm->array, num) == 2)
                             free(*(void **) &rm->array->data[num]);
                         rm->array->data[num] = ((vartype_real *) stack[sp])->x;
-                        rm->array->is_string[num] = 0;
+                        set_is_string(rm->array, num, 0);
                     } else {
                         phloat x, n;
                         int inf;
-                        if (rm->array->is_string[num] != 0)
+                        if (get_is_string(rm->array, num) != 0)
                             return ERR_ALPHA_DATA_IS_INVALID;
                         x = ((vartype_real *) stack[sp])->x;
                         n = rm->array->data[num];
@@ -449,13 +452,16 @@ int generic_sto(arg_struct *arg, char operation) {
                     return ERR_NONEXISTENT;
                 if (operation == '*'
                         && (stack[sp]->type == TYPE_REALMATRIX
-                            || stack[sp]->type == TYPE_COMPLEXMATRIX)
+                            || stack[sp]->type == TYPE_COMPLEXMATRIX
+                            || stack[sp]->type == TYPE_SPARSEMATRIX)
                         && matedit_mode == 3
                         && matedit_level == vars[idx].level
                         && string_equals(arg->val.text,
                                 arg->length, matedit_name, matedit_length))
                     return ERR_RESTRICTED_OPERATION;
                 temp_arg = *arg;
+                if (!materialize(vars[idx].value))
+                    return ERR_INSUFFICIENT_MEMORY;
                 return apply_sto_operation(operation, vars[idx].value, false);
             }
         }
@@ -464,7 +470,8 @@ int generic_sto(arg_struct *arg, char operation) {
     }
 }
 
-int map_unary(const vartype *src, vartype **dst, mappable_r mr, mappable_c mc) {
+int map_unary(const vartype *src, vartype **dst, mappable_r mr, mappable_c mc,
+                                                            batch_r br) {
     int error;
     switch (src->type) {
         case TYPE_REAL: {
@@ -491,14 +498,16 @@ int map_unary(const vartype *src, vartype **dst, mappable_r mr, mappable_c mc) {
         case TYPE_REALMATRIX: {
             vartype_realmatrix *sm = (vartype_realmatrix *) src;
             vartype_realmatrix *dm;
+            if (contains_strings(sm))
+                return ERR_ALPHA_DATA_IS_INVALID;
             dm = (vartype_realmatrix *) new_realmatrix(sm->rows, sm->columns);
             if (dm == NULL)
                 return ERR_INSUFFICIENT_MEMORY;
-            if (contains_strings(sm)) {
-                free_vartype((vartype *) dm);
-                return ERR_ALPHA_DATA_IS_INVALID;
-            }
             int4 size = sm->rows * sm->columns;
+            if (br != NULL && br(sm->array->data, dm->array->data, size)) {
+                *dst = (vartype *) dm;
+                return ERR_NONE;
+            }
             for (int4 i = 0; i < size; i++) {
                 int error = mr(sm->array->data[i], &dm->array->data[i]);
                 if (error != ERR_NONE) {
@@ -529,13 +538,161 @@ int map_unary(const vartype *src, vartype **dst, mappable_r mr, mappable_c mc) {
             *dst = (vartype *) dm;
             return ERR_NONE;
         }
+        case TYPE_SPARSEMATRIX:
+            return sparse_map((const vartype_sparsematrix *) src, dst,
+                                                        mr, NULL, 0, false);
         default:
             return ERR_INTERNAL_ERROR;
     }
 }
 
+/* When the caller is going to discard src2, and nobody else shares its data,
+ * map_binary() writes the result into that data instead of allocating a new
+ * matrix. A failed operation must leave its operands untouched, so unless the
+ * caller can tell up front that no element will fail, the result is computed
+ * twice: once to find out whether any element fails, and once more to store
+ * it. Both passes go a block at a time through a small buffer, since
+ * the scalar functions still need the original elements of a block after a
+ * batch kernel has given up on it.
+ */
+#define MAP_BLOCK 64
+
+static int map_block(const vartype *src1, const vartype *src2,
+        int4 start, int4 n, phloat *buf,
+        mappable_rr mrr, mappable_rc mrc, mappable_cc mcc, batch_rr brr) {
+    int error;
+    if (src2->type == TYPE_REALMATRIX) {
+        const phloat *y = ((vartype_realmatrix *) src2)->array->data + start;
+        const phloat *x;
+        int xinc;
+        if (src1->type == TYPE_REAL) {
+            x = &((vartype_real *) src1)->x;
+            xinc = 0;
+        } else {
+            x = ((vartype_realmatrix *) src1)->array->data + start;
+            xinc = 1;
+        }
+        if (brr != NULL && brr(x, xinc, y, 1, buf, n))
+            return ERR_NONE;
+        for (int4 i = 0; i < n; i++) {
+            error = mrr(x[i * xinc], y[i], &buf[i]);
+            if (error != ERR_NONE)
+                return error;
+        }
+        return ERR_NONE;
+    }
+    const phloat *y = ((vartype_complexmatrix *) src2)->array->data + 2 * start;
+    for (int4 i = 0; i < n; i++) {
+        const phloat *yi = y + 2 * i;
+        phloat *zi = buf + 2 * i;
+        switch (src1->type) {
+            case TYPE_REAL:
+                error = mrc(((vartype_real *) src1)->x, yi[0], yi[1],
+                            &zi[0], &zi[1]);
+                break;
+            case TYPE_COMPLEX:
+                error = mcc(((vartype_complex *) src1)->re,
+                            ((vartype_complex *) src1)->im, yi[0], yi[1],
+                            &zi[0], &zi[1]);
+                break;
+            case TYPE_REALMATRIX:
+                error = mrc(((vartype_realmatrix *) src1)->array->data[start + i],
+                            yi[0], yi[1], &zi[0], &zi[1]);
+                break;
+            default: {
+                const phloat *xi = ((vartype_complexmatrix *) src1)->array->data
+                                                            + 2 * (start + i);
+                error = mcc(xi[0], xi[1], yi[0], yi[1], &zi[0], &zi[1]);
+                break;
+            }
+        }
+        if (error != ERR_NONE)
+            return error;
+    }
+    return ERR_NONE;
+}
+
+static bool can_map_in_place(const vartype *src1, const vartype *src2) {
+    int4 rows, columns;
+    if (src2->type == TYPE_REALMATRIX) {
+        vartype_realmatrix *rm = (vartype_realmatrix *) src2;
+        if (rm->array->refcount != 1 || rm->array->cow_base != NULL
+                || contains_strings(rm))
+            return false;
+        if (src1->type == TYPE_REAL)
+            return true;
+        if (src1->type != TYPE_REALMATRIX)
+            return false;
+        rows = rm->rows;
+        columns = rm->columns;
+    } else if (src2->type == TYPE_COMPLEXMATRIX) {
+        vartype_complexmatrix *cm = (vartype_complexmatrix *) src2;
+        if (cm->array->refcount != 1 || cm->array->cow_base != NULL)
+            return false;
+        if (src1->type == TYPE_REAL || src1->type == TYPE_COMPLEX)
+            return true;
+        if (src1->type == TYPE_COMPLEXMATRIX) {
+            vartype_complexmatrix *cm1 = (vartype_complexmatrix *) src1;
+            return cm1->rows == cm->rows && cm1->columns == cm->columns;
+        }
+        if (src1->type != TYPE_REALMATRIX)
+            return false;
+        rows = cm->rows;
+        columns = cm->columns;
+    } else
+        return false;
+    vartype_realmatrix *rm1 = (vartype_realmatrix *) src1;
+    return rm1->rows == rows && rm1->columns == columns
+            && !contains_strings(rm1);
+}
+
+static int map_binary_in_place(const vartype *src1, const vartype *src2,
+        vartype **dst,
+        mappable_rr mrr, mappable_rc mrc, mappable_cc mcc, batch_rr brr,
+        bool (*cannot_fail)(const vartype *src1)) {
+    phloat buf[MAP_BLOCK];
+    phloat *data;
+    int4 size;
+    int width;
+    if (src2->type == TYPE_REALMATRIX) {
+        vartype_realmatrix *rm = (vartype_realmatrix *) src2;
+        data = rm->array->data;
+        size = rm->rows * rm->columns;
+        width = 1;
+    } else {
+        vartype_complexmatrix *cm = (vartype_complexmatrix *) src2;
+        data = cm->array->data;
+        size = cm->rows * cm->columns;
+        width = 2;
+    }
+    int4 step = MAP_BLOCK / width;
+    if (cannot_fail == NULL || !cannot_fail(src1))
+        for (int4 i = 0; i < size; i += step) {
+            int4 n = size - i < step ? size - i : step;
+            int error = map_block(src1, src2, i, n, buf, mrr, mrc, mcc, brr);
+            if (error != ERR_NONE)
+                return error;
+        }
+    vartype *v = dup_vartype(src2);
+    if (v == NULL)
+        return ERR_INSUFFICIENT_MEMORY;
+    for (int4 i = 0; i < size; i += step) {
+        int4 n = size - i < step ? size - i : step;
+        map_block(src1, src2, i, n, buf, mrr, mrc, mcc, brr);
+        memcpy((void *) (data + i * width), (const void *) buf,
+                                            n * width * sizeof(phloat));
+    }
+    touch_matrix(v);
+    *dst = v;
+    return ERR_NONE;
+}
+
 int map_binary(const vartype *src1, const vartype *src2, vartype **dst,
-        mappable_rr mrr, mappable_rc mrc, mappable_cr mcr, mappable_cc mcc) {
+        mappable_rr mrr, mappable_rc mrc, mappable_cr mcr, mappable_cc mcc,
+        batch_rr brr, bool reuse_src2, bool (*cannot_fail)(const vartype *)) {
+    if (reuse_src2 && can_map_in_place(src1, src2))
+        return map_binary_in_place(src1, src2, dst, mrr, mrc, mcc, brr,
+                                                            cannot_fail);
     int error;
     switch (src1->type) {
         case TYPE_REAL:
@@ -567,15 +724,19 @@ int map_binary(const vartype *src1, const vartype *src2, vartype **dst,
                 case TYPE_REALMATRIX: {
                     vartype_realmatrix *sm = (vartype_realmatrix *) src2;
                     vartype_realmatrix *dm;
+                    if (contains_strings(sm))
+                        return ERR_ALPHA_DATA_IS_INVALID;
                     dm = (vartype_realmatrix *)
                                         new_realmatrix(sm->rows, sm->columns);
                     if (dm == NULL)
                         return ERR_INSUFFICIENT_MEMORY;
-                    if (contains_strings(sm)) {
-                        free_vartype((vartype *) dm);
-                        return ERR_ALPHA_DATA_IS_INVALID;
-                    }
                     int4 size = sm->rows * sm->columns;
+                    if (brr != NULL && brr(&((vartype_real *) src1)->x, 0,
+                                    sm->array->data, 1,
+                                    dm->array->data, size)) {
+                        *dst = (vartype *) dm;
+                        return ERR_NONE;
+                    }
                     for (int4 i = 0; i < size; i++) {
                         int error = mrr(((vartype_real *) src1)->x,
                                     sm->array->data[i],
@@ -645,14 +806,12 @@ int map_binary(const vartype *src1, const vartype *src2, vartype **dst,
                 case TYPE_REALMATRIX: {
                     vartype_realmatrix *sm = (vartype_realmatrix *) src2;
                     vartype_complexmatrix *dm;
+                    if (contains_strings(sm))
+                        return ERR_ALPHA_DATA_IS_INVALID;
                     dm = (vartype_complexmatrix *)
                                     new_complexmatrix(sm->rows, sm->columns);
                     if (dm == NULL)
                         return ERR_INSUFFICIENT_MEMORY;
-                    if (contains_strings(sm)) {
-                        free_vartype((vartype *) dm);
-                        return ERR_ALPHA_DATA_IS_INVALID;
-                    }
                     int4 size = sm->rows * sm->columns;
                     for (int4 i = 0; i < size; i++) {
                         int error = mcr(((vartype_complex *) src1)->re,
@@ -699,15 +858,19 @@ int map_binary(const vartype *src1, const vartype *src2, vartype **dst,
                 case TYPE_REAL: {
                     vartype_realmatrix *sm = (vartype_realmatrix *) src1;
                     vartype_realmatrix *dm;
+                    if (contains_strings(sm))
+                        return ERR_ALPHA_DATA_IS_INVALID;
                     dm = (vartype_realmatrix *)
                                         new_realmatrix(sm->rows, sm->columns);
                     if (dm == NULL)
                         return ERR_INSUFFICIENT_MEMORY;
-                    if (contains_strings(sm)) {
-                        free_vartype((vartype *) dm);
-                        return ERR_ALPHA_DATA_IS_INVALID;
-                    }
                     int4 size = sm->rows * sm->columns;
+                    if (brr != NULL && brr(sm->array->data, 1,
+                                    &((vartype_real *) src2)->x, 0,
+                                    dm->array->data, size)) {
+                        *dst = (vartype *) dm;
+                        return ERR_NONE;
+                    }
                     for (int4 i = 0; i < size; i++) {
                         int error = mrr(sm->array->data[i],
                                     ((vartype_real *) src2)->x,
@@ -723,14 +886,12 @@ int map_binary(const vartype *src1, const vartype *src2, vartype **dst,
                 case TYPE_COMPLEX: {
                     vartype_realmatrix *sm = (vartype_realmatrix *) src1;
                     vartype_complexmatrix *dm;
+                    if (contains_strings(sm))
+                        return ERR_ALPHA_DATA_IS_INVALID;
                     dm = (vartype_complexmatrix *)
                                     new_complexmatrix(sm->rows, sm->columns);
                     if (dm == NULL)
                         return ERR_INSUFFICIENT_MEMORY;
-                    if (contains_strings(sm)) {
-                        free_vartype((vartype *) dm);
-                        return ERR_ALPHA_DATA_IS_INVALID;
-                    }
                     int4 size = sm->rows * sm->columns;
                     for (int4 i = 0; i < size; i++) {
                         int error = mrc(sm->array->data[i],
@@ -752,15 +913,19 @@ int map_binary(const vartype *src1, const vartype *src2, vartype **dst,
                     vartype_realmatrix *dm;
                     if (sm1->rows != sm2->rows || sm1->columns != sm2->columns)
                         return ERR_DIMENSION_ERROR;
+                    if (contains_strings(sm1) || contains_strings(sm2))
+                        return ERR_ALPHA_DATA_IS_INVALID;
                     dm = (vartype_realmatrix *)
                                     new_realmatrix(sm1->rows, sm1->columns);
                     if (dm == NULL)
                         return ERR_INSUFFICIENT_MEMORY;
-                    if (contains_strings(sm1) || contains_strings(sm2)) {
-                        free_vartype((vartype *) dm);
-                        return ERR_ALPHA_DATA_IS_INVALID;
-                    }
                     int4 size = sm1->rows * sm1->columns;
+                    if (brr != NULL && brr(sm1->array->data, 1,
+                                    sm2->array->data, 1,
+                                    dm->array->data, size)) {
+                        *dst = (vartype *) dm;
+                        return ERR_NONE;
+                    }
                     for (int4 i = 0; i < size; i++) {
                         int error = mrr(sm1->array->data[i],
                                         sm2->array->data[i],
@@ -779,14 +944,12 @@ int map_binary(const vartype *src1, const vartype *src2, vartype **dst,
                     vartype_complexmatrix *dm;
                     if (sm1->rows != sm2->rows || sm1->columns != sm2->columns)
                         return ERR_DIMENSION_ERROR;
+                    if (contains_strings(sm1))
+                        return ERR_ALPHA_DATA_IS_INVALID;
                     dm = (vartype_complexmatrix *)
                                     new_complexmatrix(sm1->rows, sm1->columns);
                     if (dm == NULL)
                         return ERR_INSUFFICIENT_MEMORY;
-                    if (contains_strings(sm1)) {
-                        free_vartype((vartype *) dm);
-                        return ERR_ALPHA_DATA_IS_INVALID;
-                    }
                     int4 size = sm1->rows * sm1->columns;
                     for (int4 i = 0; i < size; i++) {
                         int error = mrc(sm1->array->data[i],
@@ -858,14 +1021,12 @@ int map_binary(const vartype *src1, const vartype *src2, vartype **dst,
                     vartype_complexmatrix *dm;
                     if (sm1->rows != sm2->rows || sm1->columns != sm2->columns)
                         return ERR_DIMENSION_ERROR;
+                    if (contains_strings(sm2))
+                        return ERR_ALPHA_DATA_IS_INVALID;
                     dm = (vartype_complexmatrix *)
                                     new_complexmatrix(sm1->rows, sm1->columns);
                     if (dm == NULL)
                         return ERR_INSUFFICIENT_MEMORY;
-                    if (contains_strings(sm2)) {
-                        free_vartype((vartype *) dm);
-                        return ERR_ALPHA_DATA_IS_INVALID;
-                    }
                     int4 size = sm1->rows * sm1->columns;
                     for (int4 i = 0; i < size; i++) {
                         int error = mcr(sm1->array->data[i * 2],
@@ -1286,32 +1447,296 @@ static int add_cc(phloat xre, phloat xim, phloat yre, phloat yim,
     return ERR_NONE;
 }
 
-int generic_div(const vartype *px, const vartype *py, int (*completion)(int, vartype *)) {
-    if ((px->type == TYPE_REALMATRIX || px->type == TYPE_COMPLEXMATRIX)
-            && (py->type == TYPE_REALMATRIX || py->type == TYPE_COMPLEXMATRIX)) {
+/* Batch versions of the real-real cases of the above. 'expr' computes r from
+ * x and y, and 'ok' is false for any element that the scalar function would
+ * either reject or clamp. The three loops are written out separately so that
+ * the compiler can vectorize each of them.
+ */
+#define BATCH_RR(name, expr, ok)                                            \
+static bool name(const phloat *xp, int xinc, const phloat *yp, int yinc,   \
+                                                    phloat *z, int4 n) {   \
+    bool all_ok = true;                                                     \
+    if (xinc == 0) {                                                        \
+        phloat x = *xp;                                                     \
+        for (int4 i = 0; i < n; i++) {                                      \
+            phloat y = yp[i];                                               \
+            phloat r = expr;                                                \
+            all_ok &= ok;                                                   \
+            z[i] = r;                                                       \
+        }                                                                   \
+    } else if (yinc == 0) {                                                 \
+        phloat y = *yp;                                                     \
+        for (int4 i = 0; i < n; i++) {                                      \
+            phloat x = xp[i];                                               \
+            phloat r = expr;                                                \
+            all_ok &= ok;                                                   \
+            z[i] = r;                                                       \
+        }                                                                   \
+    } else {                                                                \
+        for (int4 i = 0; i < n; i++) {                                      \
+            phloat x = xp[i];                                               \
+            phloat y = yp[i];                                               \
+            phloat r = expr;                                                \
+            all_ok &= ok;                                                   \
+            z[i] = r;                                                       \
+        }                                                                   \
+    }                                                                       \
+    return all_ok;                                                          \
+}
+
+BATCH_RR(batch_div_rr, y / x, x != 0 && p_isinf(r) == 0)
+BATCH_RR(batch_mul_rr, y * x, p_isinf(r) == 0)
+BATCH_RR(batch_sub_rr, y - x, p_isinf(r) == 0)
+BATCH_RR(batch_add_rr, y + x, p_isinf(r) == 0)
+
+/* With range errors ignored, overflows are clamped, so +, -, and * can't
+ * fail, and / only fails when dividing by zero.
+ */
+static bool arith_cannot_fail(const vartype *x) {
+    return flags.f.range_error_ignore;
+}
+
+static bool div_cannot_fail(const vartype *x) {
+    if (!flags.f.range_error_ignore)
+        return false;
+    switch (x->type) {
+        case TYPE_REAL:
+            return ((vartype_real *) x)->x != 0;
+        case TYPE_COMPLEX:
+            return ((vartype_complex *) x)->re != 0
+                    || ((vartype_complex *) x)->im != 0;
+        case TYPE_REALMATRIX: {
+            vartype_realmatrix *rm = (vartype_realmatrix *) x;
+            int4 size = rm->rows * rm->columns;
+            for (int4 i = 0; i < size; i++)
+                if (rm->array->data[i] == 0)
+                    return false;
+            return true;
+        }
+        case TYPE_COMPLEXMATRIX: {
+            vartype_complexmatrix *cm = (vartype_complexmatrix *) x;
+            int4 size = 2 * cm->rows * cm->columns;
+            for (int4 i = 0; i < size; i += 2)
+                if (cm->array->data[i] == 0 && cm->array->data[i + 1] == 0)
+                    return false;
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+/* Elementwise operations on sparse matrices. A function that maps zero to
+ * zero only has to be applied to the stored elements, and gives a sparse
+ * result; otherwise, the result is dense, with the function's value for zero
+ * everywhere except at the stored elements. Combinations this doesn't cover,
+ * like sparse and complex operands, are done by converting the sparse
+ * operand to a dense matrix first.
+ */
+
+static int sparse_elem(phloat x, phloat *z, mappable_r mr, mappable_rr mrr,
+                                                phloat s, bool s_first) {
+    if (mr != NULL)
+        return mr(x, z);
+    else if (s_first)
+        return mrr(s, x, z);
+    else
+        return mrr(x, s, z);
+}
+
+static int sparse_map(const vartype_sparsematrix *sm, vartype **dst,
+                    mappable_r mr, mappable_rr mrr, phloat s, bool s_first) {
+    const sparsematrix_data *sd = sm->array;
+    int4 rows = sm->rows;
+    int4 columns = sm->columns;
+    phloat z0;
+    int error = sparse_elem(0, &z0, mr, mrr, s, s_first);
+    bool full = sd->nnz == ((int8) rows) * columns;
+    if (error != ERR_NONE && !full)
+        return error;
+
+    if (error != ERR_NONE || z0 == 0) {
+        vartype_sparsematrix *dm = (vartype_sparsematrix *)
+                                new_sparsematrix(rows, columns, sd->nnz);
+        if (dm == NULL)
+            return ERR_INSUFFICIENT_MEMORY;
+        sparsematrix_data *dd = dm->array;
+        int4 nnz = 0;
+        for (int4 i = 0; i < rows; i++) {
+            for (int4 p = sd->rowptr[i]; p < sd->rowptr[i + 1]; p++) {
+                phloat z;
+                error = sparse_elem(sd->data[p], &z, mr, mrr, s, s_first);
+                if (error != ERR_NONE) {
+                    free_vartype((vartype *) dm);
+                    return error;
+                }
+                if (z != 0) {
+                    dd->colidx[nnz] = sd->colidx[p];
+                    dd->data[nnz++] = z;
+                }
+            }
+            dd->rowptr[i + 1] = nnz;
+        }
+        dd->nnz = nnz;
+        *dst = (vartype *) dm;
+        return ERR_NONE;
+    }
+
+    vartype_realmatrix *dm = (vartype_realmatrix *) new_realmatrix(rows, columns);
+    if (dm == NULL)
+        return ERR_INSUFFICIENT_MEMORY;
+    int4 size = rows * columns;
+    for (int4 n = 0; n < size; n++)
+        dm->array->data[n] = z0;
+    for (int4 i = 0; i < rows; i++) {
+        phloat *row = dm->array->data + i * columns;
+        for (int4 p = sd->rowptr[i]; p < sd->rowptr[i + 1]; p++) {
+            error = sparse_elem(sd->data[p], row + sd->colidx[p],
+                                                    mr, mrr, s, s_first);
+            if (error != ERR_NONE) {
+                free_vartype((vartype *) dm);
+                return error;
+            }
+        }
+    }
+    *dst = (vartype *) dm;
+    return ERR_NONE;
+}
+
+/* Sum or difference of two sparse matrices: a merge of the rows */
+static int sparse_merge(const vartype_sparsematrix *sx,
+                const vartype_sparsematrix *sy, vartype **dst, mappable_rr mrr) {
+    if (sx->rows != sy->rows || sx->columns != sy->columns)
+        return ERR_DIMENSION_ERROR;
+    const sparsematrix_data *xd = sx->array;
+    const sparsematrix_data *yd = sy->array;
+    int8 cap = ((int8) xd->nnz) + yd->nnz;
+    int8 size = ((int8) sx->rows) * sx->columns;
+    vartype_sparsematrix *dm = (vartype_sparsematrix *)
+            new_sparsematrix(sx->rows, sx->columns, (int4) (cap < size ? cap : size));
+    if (dm == NULL)
+        return ERR_INSUFFICIENT_MEMORY;
+    sparsematrix_data *dd = dm->array;
+    int4 nnz = 0;
+    for (int4 i = 0; i < sx->rows; i++) {
+        int4 px = xd->rowptr[i], xend = xd->rowptr[i + 1];
+        int4 py = yd->rowptr[i], yend = yd->rowptr[i + 1];
+        while (px < xend || py < yend) {
+            int4 jx = px < xend ? xd->colidx[px] : sx->columns;
+            int4 jy = py < yend ? yd->colidx[py] : sx->columns;
+            int4 j = jx < jy ? jx : jy;
+            phloat x = jx == j ? xd->data[px++] : 0;
+            phloat y = jy == j ? yd->data[py++] : 0;
+            phloat z;
+            int error = mrr(x, y, &z);
+            if (error != ERR_NONE) {
+                free_vartype((vartype *) dm);
+                return error;
+            }
+            if (z != 0) {
+                dd->colidx[nnz] = j;
+                dd->data[nnz++] = z;
+            }
+        }
+        dd->rowptr[i + 1] = nnz;
+    }
+    dd->nnz = nnz;
+    *dst = (vartype *) dm;
+    return ERR_NONE;
+}
+
+static int sparse_binary(const vartype *px, const vartype *py, vartype **dst,
+        mappable_rr mrr, mappable_rc mrc, mappable_cr mcr, mappable_cc mcc,
+        batch_rr brr) {
+    if (px->type == TYPE_SPARSEMATRIX && py->type == TYPE_SPARSEMATRIX)
+        return sparse_merge((const vartype_sparsematrix *) px,
+                            (const vartype_sparsematrix *) py, dst, mrr);
+    if (px->type == TYPE_SPARSEMATRIX && py->type == TYPE_REAL)
+        return sparse_map((const vartype_sparsematrix *) px, dst, NULL, mrr,
+                            ((vartype_real *) py)->x, false);
+    if (px->type == TYPE_REAL && py->type == TYPE_SPARSEMATRIX)
+        return sparse_map((const vartype_sparsematrix *) py, dst, NULL, mrr,
+                            ((vartype_real *) px)->x, true);
+    vartype *tx = NULL, *ty = NULL;
+    if (px->type == TYPE_SPARSEMATRIX) {
+        tx = sparse_to_dense((const vartype_sparsematrix *) px);
+        if (tx == NULL)
+            return ERR_INSUFFICIENT_MEMORY;
+        px = tx;
+    }
+    if (py->type == TYPE_SPARSEMATRIX) {
+        ty = sparse_to_dense((const vartype_sparsematrix *) py);
+        if (ty == NULL)
+            return ERR_INSUFFICIENT_MEMORY;
+        py = ty;
+    }
+    int error = map_binary(px, py, dst, mrr, mrc, mcr, mcc, brr);
+    free_vartype(tx);
+    free_vartype(ty);
+    return error;
+}
+
+static bool is_matrix(const vartype *v) {
+    return v->type == TYPE_REALMATRIX || v->type == TYPE_COMPLEXMATRIX
+            || v->type == TYPE_SPARSEMATRIX;
+}
+
+static bool is_sparse(const vartype *px, const vartype *py) {
+    return px->type == TYPE_SPARSEMATRIX || py->type == TYPE_SPARSEMATRIX;
+}
+
+int generic_div(const vartype *px, const vartype *py,
+                        int (*completion)(int, vartype *), bool reuse_y) {
+    if (is_matrix(px) && is_matrix(py)) {
         return linalg_div(py, px, completion);
     } else {
         vartype *dst;
-        int error = map_binary(px, py, &dst, div_rr, div_rc, div_cr, div_cc);
+        int error;
+        if (is_sparse(px, py))
+            error = sparse_binary(px, py, &dst, div_rr, div_rc, div_cr, div_cc,
+                                                            batch_div_rr);
+        else
+            error = map_binary(px, py, &dst, div_rr, div_rc, div_cr, div_cc,
+                                                    batch_div_rr, reuse_y,
+                                                    div_cannot_fail);
         return completion(error, dst);
     }
 }
 
-int generic_mul(const vartype *px, const vartype *py, int (*completion)(int, vartype *)) {
-    if ((px->type == TYPE_REALMATRIX || px->type == TYPE_COMPLEXMATRIX)
-            && (py->type == TYPE_REALMATRIX || py->type == TYPE_COMPLEXMATRIX)) {
+int generic_mul(const vartype *px, const vartype *py,
+                        int (*completion)(int, vartype *), bool reuse_y) {
+    if (is_matrix(px) && is_matrix(py)) {
         return linalg_mul(py, px, completion);
     } else {
         vartype *dst;
-        int error = map_binary(px, py, &dst, mul_rr, mul_rc, mul_cr, mul_cc);
+        int error;
+        if (is_sparse(px, py))
+            error = sparse_binary(px, py, &dst, mul_rr, mul_rc, mul_cr, mul_cc,
+                                                            batch_mul_rr);
+        else
+            error = map_binary(px, py, &dst, mul_rr, mul_rc, mul_cr, mul_cc,
+                                                    batch_mul_rr, reuse_y,
+                                                    arith_cannot_fail);
         return completion(error, dst);
     }
 }
 
-int generic_sub(const vartype *px, const vartype *py, vartype **dst) {
-    return map_binary(px, py, dst, sub_rr, sub_rc, sub_cr, sub_cc);
+int generic_sub(const vartype *px, const vartype *py, vartype **dst,
+                                                            bool reuse_y) {
+    if (is_sparse(px, py))
+        return sparse_binary(px, py, dst, sub_rr, sub_rc, sub_cr, sub_cc,
+                                                            batch_sub_rr);
+    return map_binary(px, py, dst, sub_rr, sub_rc, sub_cr, sub_cc,
+                                                    batch_sub_rr, reuse_y,
+                                                    arith_cannot_fail);
 }
 
-int generic_add(const vartype *px, const vartype *py, vartype **dst) {
-    return map_binary(px, py, dst, add_rr, add_rc, add_cr, add_cc);
+int generic_add(const vartype *px, const vartype *py, vartype **dst,
+                                                            bool reuse_y) {
+    if (is_sparse(px, py))
+        return sparse_binary(px, py, dst, add_rr, add_rc, add_cr, add_cc,
+                                                            batch_add_rr);
+    return map_binary(px, py, dst, add_rr, add_rc, add_cr, add_cc,
+                                                    batch_add_rr, reuse_y,
+                                                    arith_cannot_fail);
 }
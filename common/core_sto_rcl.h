@@ -45,29 +45,58 @@ typedef int (*mappable_cc)(phloat xre, phloat xim, phloat yre, phloat yim,
                                                 phloat *zre, phloat *zim);
 
 
+/*****************************************************************/
+/* Batch kernels, optionally used by map_unary and map_binary to */
+/* process the elements of real matrices in a single tight loop. */
+/* In map_binary, an increment of 0 means that operand is a      */
+/* scalar. A kernel returns false if any element needs special   */
+/* handling (an error or range clamping); the mapper then redoes */
+/* the whole matrix using the scalar function, so the results    */
+/* and errors are always exactly those of the scalar function.   */
+/*****************************************************************/
+
+typedef bool (*batch_r)(const phloat *x, phloat *z, int4 n);
+typedef bool (*batch_rr)(const phloat *x, int xinc, const phloat *y, int yinc,
+                                                phloat *z, int4 n);
+
+
 /****************************************************************/
 /* Generic arithmetic operators, for use in the implementations */
 /* of +, -, *, /, STO+, STO-, etc...                            */
+/* If reuse_y is true, the caller will discard y once the       */
+/* operation succeeds, so an elementwise result may be written  */
+/* into y's data, if y is the only user of that data.           */
 /****************************************************************/
 
 int assert_numeric(const vartype *v);
 int generic_div(const vartype *x, const vartype *y,
-                            int (*completion)(int, vartype *));
+                            int (*completion)(int, vartype *),
+                            bool reuse_y = false);
 int generic_mul(const vartype *x, const vartype *y,
-                            int (*completion)(int, vartype *));
-int generic_sub(const vartype *x, const vartype *y, vartype **res);
-int generic_add(const vartype *x, const vartype *y, vartype **res);
+                            int (*completion)(int, vartype *),
+                            bool reuse_y = false);
+int generic_sub(const vartype *x, const vartype *y, vartype **res,
+                            bool reuse_y = false);
+int generic_add(const vartype *x, const vartype *y, vartype **res,
+                            bool reuse_y = false);
 int generic_rcl(arg_struct *arg, vartype **dst);
 int generic_sto(arg_struct *arg, char operation);
 
 
 /**********************************************/
 /* Mappers to apply unary or binary operators */
-/* to arbitrary parameter types               */
+/* to arbitrary parameter types. reuse_src2   */
+/* works like reuse_y in the generic          */
+/* operators above. cannot_fail, if given,    */
+/* tells whether the operator is certain to   */
+/* succeed for every element with this src1.  */
 /**********************************************/
 
-int map_unary(const vartype *src, vartype **dst, mappable_r, mappable_c mc);
+int map_unary(const vartype *src, vartype **dst, mappable_r, mappable_c mc,
+            batch_r br = NULL);
 int map_binary(const vartype *src1, const vartype *src2, vartype **dst,
-            mappable_rr mrr, mappable_rc mrc, mappable_cr mcr, mappable_cc mcc);
+            mappable_rr mrr, mappable_rc mrc, mappable_cr mcr, mappable_cc mcc,
+            batch_rr brr = NULL, bool reuse_src2 = false,
+            bool (*cannot_fail)(const vartype *src1) = NULL);
 
 #endif
@@ -59,41 +59,41 @@ const command_spec cmd_array[] =
     { /* ENTER */       docmd_enter,       "ENT\305R",            0x00, 0x00, 0x00, 0x83,  5, ARG_NONE,   1, ALLT },
     { /* SWAP */        docmd_swap,        "X<>Y",                0x00, 0x00, 0x00, 0x71,  4, ARG_NONE,   2, ALLT },
     { /* RDN */         docmd_rdn,         "R\16",                0x00, 0x00, 0x00, 0x75,  2, ARG_NONE,   0, NA_T },
-    { /* CHS */         docmd_chs,         "+/-",                 0x00, 0x00, 0x00, 0x54,  3, ARG_NONE,   1, 0x0f },
-    { /* DIV */         docmd_div,         "\0",                  0x00, 0x00, 0x00, 0x43,  1, ARG_NONE,   2, 0x0f },
-    { /* MUL */         docmd_mul,         "\1",                  0x00, 0x00, 0x00, 0x42,  1, ARG_NONE,   2, 0x0f },
-    { /* SUB */         docmd_sub,         "-",                   0x00, 0x00, 0x00, 0x41,  1, ARG_NONE,   2, 0x0f },
-    { /* ADD */         docmd_add,         "+",                   0x00, 0x00, 0x00, 0x40,  1, ARG_NONE,   2, 0x0f },
+    { /* CHS */         docmd_chs,         "+/-",                 0x00, 0x00, 0x00, 0x54,  3, ARG_NONE,   1, 0x4f },
+    { /* DIV */         docmd_div,         "\0",                  0x00, 0x00, 0x00, 0x43,  1, ARG_NONE,   2, 0x4f },
+    { /* MUL */         docmd_mul,         "\1",                  0x00, 0x00, 0x00, 0x42,  1, ARG_NONE,   2, 0x4f },
+    { /* SUB */         docmd_sub,         "-",                   0x00, 0x00, 0x00, 0x41,  1, ARG_NONE,   2, 0x4f },
+    { /* ADD */         docmd_add,         "+",                   0x00, 0x00, 0x00, 0x40,  1, ARG_NONE,   2, 0x4f },
     { /* LASTX */       docmd_lastx,       "LASTX",               0x00, 0x00, 0x00, 0x76,  5, ARG_NONE,   0, NA_T },
     { /* SILENT_OFF */  NULL,              "",                    0x34, 0x00, 0x00, 0x00,  0, ARG_NONE,   0, NA_T },
     { /* SILENT_ON */   NULL,              "",                    0x34, 0x00, 0x00, 0x00,  0, ARG_NONE,   0, NA_T },
-    { /* SIN */         docmd_sin,         "SIN",                 0x00, 0x00, 0x00, 0x59,  3, ARG_NONE,   1, 0x0f },
-    { /* COS */         docmd_cos,         "COS",                 0x00, 0x00, 0x00, 0x5a,  3, ARG_NONE,   1, 0x0f },
-    { /* TAN */         docmd_tan,         "TAN",                 0x00, 0x00, 0x00, 0x5b,  3, ARG_NONE,   1, 0x0f },
-    { /* ASIN */        docmd_asin,        "ASIN",                0x00, 0x00, 0x00, 0x5c,  4, ARG_NONE,   1, 0x0f },
-    { /* ACOS */        docmd_acos,        "ACOS",                0x00, 0x00, 0x00, 0x5d,  4, ARG_NONE,   1, 0x0f },
-    { /* ATAN */        docmd_atan,        "ATAN",                0x00, 0x00, 0x00, 0x5e,  4, ARG_NONE,   1, 0x0f },
-    { /* LOG */         docmd_log,         "LOG",                 0x00, 0x00, 0x00, 0x56,  3, ARG_NONE,   1, 0x0f },
-    { /* 10_POW_X */    docmd_10_pow_x,    "10^X",                0x00, 0x00, 0x00, 0x57,  4, ARG_NONE,   1, 0x0f },
-    { /* LN */          docmd_ln,          "LN",                  0x00, 0x00, 0x00, 0x50,  2, ARG_NONE,   1, 0x0f },
-    { /* E_POW_X */     docmd_e_pow_x,     "E^X",                 0x00, 0x00, 0x00, 0x55,  3, ARG_NONE,   1, 0x0f },
-    { /* SQRT */        docmd_sqrt,        "SQRT",                0x00, 0x00, 0x00, 0x52,  4, ARG_NONE,   1, 0x0f },
-    { /* SQUARE */      docmd_square,      "X^2",                 0x00, 0x00, 0x00, 0x51,  3, ARG_NONE,   1, 0x0f },
-    { /* INV */         docmd_inv,         "1/X",                 0x00, 0x00, 0x00, 0x60,  3, ARG_NONE,   1, 0x0f },
+    { /* SIN */         docmd_sin,         "SIN",                 0x00, 0x00, 0x00, 0x59,  3, ARG_NONE,   1, 0x4f },
+    { /* COS */         docmd_cos,         "COS",                 0x00, 0x00, 0x00, 0x5a,  3, ARG_NONE,   1, 0x4f },
+    { /* TAN */         docmd_tan,         "TAN",                 0x00, 0x00, 0x00, 0x5b,  3, ARG_NONE,   1, 0x4f },
+    { /* ASIN */        docmd_asin,        "ASIN",                0x00, 0x00, 0x00, 0x5c,  4, ARG_NONE,   1, 0x4f },
+    { /* ACOS */        docmd_acos,        "ACOS",                0x00, 0x00, 0x00, 0x5d,  4, ARG_NONE,   1, 0x4f },
+    { /* ATAN */        docmd_atan,        "ATAN",                0x00, 0x00, 0x00, 0x5e,  4, ARG_NONE,   1, 0x4f },
+    { /* LOG */         docmd_log,         "LOG",                 0x00, 0x00, 0x00, 0x56,  3, ARG_NONE,   1, 0x4f },
+    { /* 10_POW_X */    docmd_10_pow_x,    "10^X",                0x00, 0x00, 0x00, 0x57,  4, ARG_NONE,   1, 0x4f },
+    { /* LN */          docmd_ln,          "LN",                  0x00, 0x00, 0x00, 0x50,  2, ARG_NONE,   1, 0x4f },
+    { /* E_POW_X */     docmd_e_pow_x,     "E^X",                 0x00, 0x00, 0x00, 0x55,  3, ARG_NONE,   1, 0x4f },
+    { /* SQRT */        docmd_sqrt,        "SQRT",                0x00, 0x00, 0x00, 0x52,  4, ARG_NONE,   1, 0x4f },
+    { /* SQUARE */      docmd_square,      "X^2",                 0x00, 0x00, 0x00, 0x51,  3, ARG_NONE,   1, 0x4f },
+    { /* INV */         docmd_inv,         "1/X",                 0x00, 0x00, 0x00, 0x60,  3, ARG_NONE,   1, 0x4f },
     { /* Y_POW_X */     docmd_y_pow_x,     "Y^X",                 0x00, 0x00, 0x00, 0x53,  3, ARG_NONE,   2, FUNC },
     { /* PERCENT */     docmd_percent,     "%",                   0x00, 0x00, 0x00, 0x4c,  1, ARG_NONE,   2, 0x01 },
     { /* PI */          docmd_pi,          "PI",                  0x00, 0x00, 0x00, 0x72,  2, ARG_NONE,   0, NA_T },
     { /* COMPLEX */     docmd_complex,     "C\317\315PL\305X",    0x00, 0x00, 0xa0, 0x72,  7, ARG_NONE,  -1, 0x00 },
     { /* STO */         docmd_sto,         "STO",                 0x20, 0x81, 0x00, 0x91,  3, ARG_VAR,    1, ALLT },
-    { /* STO_DIV */     docmd_sto_div,     "STO\0",               0x00, 0x85, 0x00, 0x95,  4, ARG_VAR,    1, 0x0f },
-    { /* STO_MUL */     docmd_sto_mul,     "STO\1",               0x00, 0x84, 0x00, 0x94,  4, ARG_VAR,    1, 0x0f },
-    { /* STO_SUB */     docmd_sto_sub,     "STO-",                0x00, 0x83, 0x00, 0x93,  4, ARG_VAR,    1, 0x0f },
-    { /* STO_ADD */     docmd_sto_add,     "STO+",                0x00, 0x82, 0x00, 0x92,  4, ARG_VAR,    1, 0x0f },
+    { /* STO_DIV */     docmd_sto_div,     "STO\0",               0x00, 0x85, 0x00, 0x95,  4, ARG_VAR,    1, 0x4f },
+    { /* STO_MUL */     docmd_sto_mul,     "STO\1",               0x00, 0x84, 0x00, 0x94,  4, ARG_VAR,    1, 0x4f },
+    { /* STO_SUB */     docmd_sto_sub,     "STO-",                0x00, 0x83, 0x00, 0x93,  4, ARG_VAR,    1, 0x4f },
+    { /* STO_ADD */     docmd_sto_add,     "STO+",                0x00, 0x82, 0x00, 0x92,  4, ARG_VAR,    1, 0x4f },
     { /* RCL */         docmd_rcl,         "RCL",                 0x20, 0x91, 0x00, 0x90,  3, ARG_VAR,    0, NA_T },
-    { /* RCL_DIV */     docmd_rcl_div,     "RCL\0",               0x00, 0x95, 0xf2, 0xd4,  4, ARG_VAR,    1, 0x0f },
-    { /* RCL_MUL */     docmd_rcl_mul,     "RCL\1",               0x00, 0x94, 0xf2, 0xd3,  4, ARG_VAR,    1, 0x0f },
-    { /* RCL_SUB */     docmd_rcl_sub,     "RCL-",                0x00, 0x93, 0xf2, 0xd2,  4, ARG_VAR,    1, 0x0f },
-    { /* RCL_ADD */     docmd_rcl_add,     "RCL+",                0x00, 0x92, 0xf2, 0xd1,  4, ARG_VAR,    1, 0x0f },
+    { /* RCL_DIV */     docmd_rcl_div,     "RCL\0",               0x00, 0x95, 0xf2, 0xd4,  4, ARG_VAR,    1, 0x4f },
+    { /* RCL_MUL */     docmd_rcl_mul,     "RCL\1",               0x00, 0x94, 0xf2, 0xd3,  4, ARG_VAR,    1, 0x4f },
+    { /* RCL_SUB */     docmd_rcl_sub,     "RCL-",                0x00, 0x93, 0xf2, 0xd2,  4, ARG_VAR,    1, 0x4f },
+    { /* RCL_ADD */     docmd_rcl_add,     "RCL+",                0x00, 0x92, 0xf2, 0xd1,  4, ARG_VAR,    1, 0x4f },
     { /* FIX */         docmd_fix,         "FIX",                 0x20, 0xd4, 0x00, 0x9c,  3, ARG_NUM11,  0, NA_T },
     { /* SCI */         docmd_sci,         "SCI",                 0x20, 0xd5, 0x00, 0x9d,  3, ARG_NUM11,  0, NA_T },
     { /* ENG */         docmd_eng,         "ENG",                 0x20, 0xd6, 0x00, 0x9e,  3, ARG_NUM11,  0, NA_T },
@@ -133,7 +133,7 @@ const command_spec cmd_array[] =
     { /* TO_POL */      docmd_to_pol,      "\17POL",              0x00, 0x00, 0x00, 0x4f,  4, ARG_NONE,  -1, 0x00 },
     { /* IP */          docmd_ip,          "IP",                  0x00, 0x00, 0x00, 0x68,  2, ARG_NONE,   1, 0x05 },
     { /* FP */          docmd_fp,          "FP",                  0x00, 0x00, 0x00, 0x69,  2, ARG_NONE,   1, 0x05 },
-    { /* RND */         docmd_rnd,         "RND",                 0x00, 0x00, 0x00, 0x6e,  3, ARG_NONE,   1, 0x0f },
+    { /* RND */         docmd_rnd,         "RND",                 0x00, 0x00, 0x00, 0x6e,  3, ARG_NONE,   1, 0x4f },
     { /* ABS */         docmd_abs,         "ABS",                 0x00, 0x00, 0x00, 0x61,  3, ARG_NONE,   1, 0x07 },
     { /* SIGN */        docmd_sign,        "SIGN",                0x00, 0x00, 0x00, 0x7a,  4, ARG_NONE,   1, 0x1f },
     { /* MOD */         docmd_mod,         "MOD",                 0x00, 0x00, 0x00, 0x4b,  3, ARG_NONE,   2, 0x01 },
@@ -199,8 +199,8 @@ const command_spec cmd_array[] =
     { /* MAN */         docmd_man,         "MAN",                 0x00, 0x00, 0xa7, 0x5b,  3, ARG_NONE,   0, NA_T },
     { /* NORM */        docmd_norm,        "NORM",                0x00, 0x00, 0xa7, 0x5c,  4, ARG_NONE,   0, NA_T },
     { /* TRACE */       docmd_trace,       "TRACE",               0x00, 0x00, 0xa7, 0x5d,  5, ARG_NONE,   0, NA_T },
-    { /* SIGMAADD */    docmd_sigmaadd,    "\5+",                 0x00, 0x00, 0x00, 0x47,  2, ARG_NONE,   1, 0x05 },
-    { /* SIGMASUB */    docmd_sigmasub,    "\5-",                 0x00, 0x00, 0x00, 0x48,  2, ARG_NONE,   1, 0x05 },
+    { /* SIGMAADD */    docmd_sigmaadd,    "\5+",                 0x00, 0x00, 0x00, 0x47,  2, ARG_NONE,   1, 0x25 },
+    { /* SIGMASUB */    docmd_sigmasub,    "\5-",                 0x00, 0x00, 0x00, 0x48,  2, ARG_NONE,   1, 0x25 },
     { /* GTO */         docmd_gto,         "GTO",                 0x20, 0xa6, 0x00, 0x00,  3, ARG_LBL,    0, NA_T },
     { /* END */         docmd_rtn,         "END",                 0x20, 0x00, 0x00, 0x00,  3, ARG_NONE,   0, NA_T },
     { /* NUMBER */      docmd_number,      "",                    0x24, 0x00, 0x00, 0x00,  0, ARG_NONE,   0, NA_T },
@@ -216,7 +216,7 @@ const command_spec cmd_array[] =
     { /* CPX_T */       docmd_cpx_t,       "CPX?",                0x00, 0x00, 0xa2, 0x67,  4, ARG_NONE,   1, ALLT },
     { /* STR_T */       docmd_str_t,       "STR?",                0x00, 0x00, 0xa2, 0x68,  4, ARG_NONE,   1, ALLT },
     { /* MAT_T */       docmd_mat_t,       "MAT?",                0x00, 0x00, 0xa2, 0x66,  4, ARG_NONE,   1, ALLT },
-    { /* DIM_T */       docmd_dim_t,       "DIM?",                0x00, 0x00, 0xa6, 0xe7,  4, ARG_NONE,   1, 0x0c },
+    { /* DIM_T */       docmd_dim_t,       "DIM?",                0x00, 0x00, 0xa6, 0xe7,  4, ARG_NONE,   1, 0x4c },
     { /* ASSIGNa */     NULL,              "AS\323\311GN",        0x40, 0x00, 0x00, 0x00,  6, ARG_NAMED,  0, NA_T },
     { /* ASSIGNb */     NULL,              "",                    0x44, 0x00, 0x00, 0x00,  0, ARG_CKEY,   0, NA_T },
     { /* ASGN01 */      docmd_asgn01,      "",                    0x24, 0x00, 0x00, 0x00,  0, ARG_OTHER,  0, NA_T },
@@ -262,7 +262,7 @@ const command_spec cmd_array[] =
     { /* SIGMAREG */    docmd_sigma_reg,   "\5REG",               0x00, 0xd3, 0x00, 0x99,  4, ARG_NUM99,  0, NA_T },
     { /* SIGMAREG_T */  docmd_sigma_reg_t, "\5R\305G?",           0x00, 0x00, 0xa6, 0x78,  5, ARG_NONE,   0, NA_T },
     { /* CLD */         docmd_cld,         "CLD",                 0x00, 0x00, 0x00, 0x7f,  3, ARG_NONE,   0, NA_T },
-    { /* ACOSH */       docmd_acosh,       "ACOSH",               0x00, 0x00, 0xa0, 0x66,  5, ARG_NONE,   1, 0x0f },
+    { /* ACOSH */       docmd_acosh,       "ACOSH",               0x00, 0x00, 0xa0, 0x66,  5, ARG_NONE,   1, 0x4f },
     { /* ALENG */       docmd_aleng,       "ALEN\307",            0x00, 0x00, 0xa6, 0x41,  5, ARG_NONE,   0, NA_T },
     { /* ALLSIGMA */    docmd_allsigma,    "ALL\5",               0x00, 0x00, 0xa0, 0xae,  4, ARG_NONE,   0, NA_T },
     { /* AND */         docmd_and,         "AND",                 0x00, 0x00, 0xa5, 0x88,  3, ARG_NONE,   2, 0x01 },
@@ -270,8 +270,8 @@ const command_spec cmd_array[] =
     { /* AON */         docmd_aon,         "AON",                 0x00, 0x00, 0x00, 0x8c,  3, ARG_NONE,   0, NA_T },
     { /* AROT */        docmd_arot,        "AROT",                0x00, 0x00, 0xa6, 0x46,  4, ARG_NONE,   1, 0x01 },
     { /* ASHF */        docmd_ashf,        "ASHF",                0x00, 0x00, 0x00, 0x88,  4, ARG_NONE,   0, NA_T },
-    { /* ASINH */       docmd_asinh,       "ASINH",               0x00, 0x00, 0xa0, 0x64,  5, ARG_NONE,   1, 0x0f },
-    { /* ATANH */       docmd_atanh,       "AT\301NH",            0x00, 0x00, 0xa0, 0x65,  5, ARG_NONE,   1, 0x0f },
+    { /* ASINH */       docmd_asinh,       "ASINH",               0x00, 0x00, 0xa0, 0x64,  5, ARG_NONE,   1, 0x4f },
+    { /* ATANH */       docmd_atanh,       "AT\301NH",            0x00, 0x00, 0xa0, 0x65,  5, ARG_NONE,   1, 0x4f },
     { /* ATOX */        docmd_atox,        "ATOX",                0x00, 0x00, 0xa6, 0x47,  4, ARG_NONE,   0, NA_T },
     { /* BASEADD */     docmd_baseadd,     "BASE+",               0x00, 0x00, 0xa0, 0xe6,  5, ARG_NONE,   2, 0x01 },
     { /* BASESUB */     docmd_basesub,     "BASE-",               0x00, 0x00, 0xa0, 0xe7,  5, ARG_NONE,   2, 0x01 },
@@ -283,7 +283,7 @@ const command_spec cmd_array[] =
     { /* BIT_T */       docmd_bit_t,       "BIT?",                0x00, 0x00, 0xa5, 0x8c,  4, ARG_NONE,   2, 0x01 },
     { /* BST */         NULL,              "BST",                 0x40, 0x00, 0x00, 0x00,  3, ARG_NONE,   0, NA_T },
     { /* CORR */        docmd_corr,        "CORR",                0x00, 0x00, 0xa0, 0xa7,  4, ARG_NONE,   0, NA_T },
-    { /* COSH */        docmd_cosh,        "COSH",                0x00, 0x00, 0xa0, 0x62,  4, ARG_NONE,   1, 0x0f },
+    { /* COSH */        docmd_cosh,        "COSH",                0x00, 0x00, 0xa0, 0x62,  4, ARG_NONE,   1, 0x4f },
     { /* CROSS */       docmd_cross,       "CROSS",               0x00, 0x00, 0xa6, 0xca,  5, ARG_NONE,   2, FUNC },
     { /* CUSTOM */      docmd_custom,      "CUST\317\315",        0x00, 0x00, 0xa2, 0x6f,  6, ARG_NONE,   0, NA_T },
     { /* DECM */        docmd_decm,        "DECM",                0x00, 0x00, 0xa0, 0xe3,  4, ARG_NONE,   0, NA_T },
@@ -333,14 +333,14 @@ const command_spec cmd_array[] =
     { /* RSUM */        docmd_rsum,        "RSUM",                0x00, 0x00, 0xa6, 0xd0,  4, ARG_NONE,   1, 0x0c },
     { /* SWAP_R */      docmd_swap_r,      "R<>R",                0x00, 0x00, 0xa6, 0xd1,  4, ARG_NONE,   2, FUNC },
     { /* SDEV */        docmd_sdev,        "SDEV",                0x00, 0x00, 0x00, 0x7d,  4, ARG_NONE,   0, NA_T },
-    { /* SINH */        docmd_sinh,        "SINH",                0x00, 0x00, 0xa0, 0x61,  4, ARG_NONE,   1, 0x0f },
+    { /* SINH */        docmd_sinh,        "SINH",                0x00, 0x00, 0xa0, 0x61,  4, ARG_NONE,   1, 0x4f },
     { /* SLOPE */       docmd_slope,       "SLOPE",               0x00, 0x00, 0xa0, 0xa4,  5, ARG_NONE,   0, NA_T },
     { /* SOLVE */       docmd_solve,       "SOLVE",               0x00, 0xb7, 0xf2, 0xeb,  5, ARG_RVAR,   1, FUNC },
     { /* STOEL */       docmd_stoel,       "STOEL",               0x00, 0x00, 0xa6, 0xd6,  5, ARG_NONE,   1, FUNC },
     { /* STOIJ */       docmd_stoij,       "STOIJ",               0x00, 0x00, 0xa6, 0xd8,  5, ARG_NONE,   2, FUNC },
     { /* SUM */         docmd_sum,         "SUM",                 0x00, 0x00, 0xa0, 0xa5,  3, ARG_NONE,   0, NA_T },
-    { /* TANH */        docmd_tanh,        "TANH",                0x00, 0x00, 0xa0, 0x63,  4, ARG_NONE,   1, 0x0f },
-    { /* TRANS */       docmd_trans,       "TRANS",               0x00, 0x00, 0xa6, 0xc9,  5, ARG_NONE,   1, 0x0c },
+    { /* TANH */        docmd_tanh,        "TANH",                0x00, 0x00, 0xa0, 0x63,  4, ARG_NONE,   1, 0x4f },
+    { /* TRANS */       docmd_trans,       "TRANS",               0x00, 0x00, 0xa6, 0xc9,  5, ARG_NONE,   1, 0x4c },
     { /* UVEC */        docmd_uvec,        "UVEC",                0x00, 0x00, 0xa6, 0xcd,  4, ARG_NONE,   1, 0x06 },
     { /* WMEAN */       docmd_wmean,       "WM\305\301N",         0x00, 0x00, 0xa0, 0xac,  5, ARG_NONE,   0, NA_T },
     { /* WRAP */        docmd_wrap,        "WRAP",                0x00, 0x00, 0xa6, 0xe2,  4, ARG_NONE,   0, NA_T },
@@ -556,6 +556,16 @@ const command_spec cmd_array[] =
     /* For Plus42 Compatibility */
     { /* WIDTH */       docmd_width,       "WIDTH",               0x00, 0x00, 0xa2, 0x72,  5, ARG_NONE,   0, NA_T },
     { /* HEIGHT */      docmd_height,      "HEIGHT",              0x00, 0x00, 0xa2, 0x73,  6, ARG_NONE,   0, NA_T },
+
+    /* Bulk Operations */
+    { /* RANFILL */     docmd_ranfill,     "RANF\311LL",          0x00, 0x00, 0xa7, 0xfc,  7, ARG_NONE,   1, 0x24 },
+    { /* SPARSE */      docmd_sparse,      "SPARSE",              0x00, 0x00, 0xa7, 0xfd,  6, ARG_NONE,   1, 0x45 },
+    { /* DENSE */       docmd_dense,       "DENSE",               0x00, 0x00, 0xa7, 0xfe,  5, ARG_NONE,   1, 0x40 },
+    { /* COND */        docmd_cond,        "COND",                0x00, 0x00, 0xa7, 0xff,  4, ARG_NONE,   1, 0x0c },
+    { /* SORT */        docmd_sort,        "SORT",                0x00, 0x00, 0xa7, 0xcb,  4, ARG_NONE,   1, 0x34 },
+    { /* ISORT */       docmd_isort,       "ISORT",               0x00, 0x00, 0xa7, 0xcc,  5, ARG_NONE,   1, 0x34 },
+    { /* SORTR */       docmd_sortr,       "SORTR",               0x00, 0x00, 0xa7, 0xcd,  5, ARG_NONE,   2, 0x05 },
+    { /* SORTC */       docmd_sortc,       "SORTC",               0x00, 0x00, 0xa7, 0xce,  5, ARG_NONE,   2, 0x05 },
 };
 
 /*
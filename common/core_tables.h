@@ -523,7 +523,16 @@
 #define CMD_WIDTH       473
 #define CMD_HEIGHT      474
 
-#define CMD_SENTINEL    475
+#define CMD_RANFILL     475
+#define CMD_SPARSE      476
+#define CMD_DENSE       477
+#define CMD_COND        478
+#define CMD_SORT        479
+#define CMD_ISORT       480
+#define CMD_SORTR       481
+#define CMD_SORTC       482
+
+#define CMD_SENTINEL    483
 
 
 /* command_spec.argtype */
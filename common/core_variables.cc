@@ -17,10 +17,20 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <stdio.h>
+#ifndef WINDOWS
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <errno.h>
+#endif
 
 #include "core_globals.h"
 #include "core_helpers.h"
 #include "core_display.h"
+#include "core_main.h"
 #include "core_variables.h"
 
 
@@ -35,6 +45,16 @@ static int realpool_size = 0;
 static int complexpool_size = 0;
 static int stringpool_size = 0;
 
+// Matrix data arrays carry a generation number, which gets a new value when
+// the array is created and whenever its contents may be about to change, so
+// that (array, generation) identifies one particular set of contents. This is
+// what the LU decomposition cache in core_linalg1.cc is keyed on.
+// disentangle() and dimension_array_ref() take care of this for the code that
+// uses them; anything that modifies a matrix in place without calling either
+// must call touch_matrix() itself.
+
+static uint8 matrix_generation = 0;
+
 vartype *new_real(phloat value) {
     vartype_real *r;
     if (realpool_size > 0) {
@@ -100,7 +120,7 @@ vartype *new_realmatrix(int4 rows, int4 columns) {
                                         malloc(sizeof(vartype_realmatrix));
     if (rm == NULL)
         return NULL;
-    int4 i, sz;
+    int4 sz;
     rm->type = TYPE_REALMATRIX;
     rm->rows = rows;
     rm->columns = columns;
@@ -110,23 +130,25 @@ vartype *new_realmatrix(int4 rows, int4 columns) {
         free(rm);
         return NULL;
     }
-    rm->array->data = (phloat *) malloc(sz * sizeof(phloat));
+    /* All-zero bits are a valid zero both as a double and as a BID128, so
+     * calloc() can do the initialization. For large matrices, it gets fresh
+     * zero pages from the OS, so creating one doesn't require a pass over
+     * the whole array, and only the pages that are actually written to end
+     * up using memory. The same goes for a newly mapped file, which is
+     * what matrix_data_alloc() uses for very large matrices.
+     */
+    rm->array->data = matrix_data_alloc(sz, &rm->array->map);
     if (rm->array->data == NULL) {
         free(rm->array);
         free(rm);
         return NULL;
     }
-    rm->array->is_string = (char *) malloc(sz);
-    if (rm->array->is_string == NULL) {
-        free(rm->array->data);
-        free(rm->array);
-        free(rm);
-        return NULL;
-    }
-    for (i = 0; i < sz; i++)
-        rm->array->data[i] = 0;
-    memset(rm->array->is_string, 0, sz);
+    rm->array->is_string = NULL;
+    rm->array->nstrings = 0;
+    rm->array->cow_base = NULL;
+    rm->array->cow_chunks = NULL;
     rm->array->refcount = 1;
+    rm->array->generation = ++matrix_generation;
     return (vartype *) rm;
 }
 
@@ -139,7 +161,7 @@ vartype *new_complexmatrix(int4 rows, int4 columns) {
                                         malloc(sizeof(vartype_complexmatrix));
     if (cm == NULL)
         return NULL;
-    int4 i, sz;
+    int4 sz;
     cm->type = TYPE_COMPLEXMATRIX;
     cm->rows = rows;
     cm->columns = columns;
@@ -149,15 +171,17 @@ vartype *new_complexmatrix(int4 rows, int4 columns) {
         free(cm);
         return NULL;
     }
-    cm->array->data = (phloat *) malloc(sz * sizeof(phloat));
+    /* See new_realmatrix() */
+    cm->array->data = (phloat *) calloc(sz, sizeof(phloat));
     if (cm->array->data == NULL) {
         free(cm->array);
         free(cm);
         return NULL;
     }
-    for (i = 0; i < sz; i++)
-        cm->array->data[i] = 0;
+    cm->array->cow_base = NULL;
+    cm->array->cow_chunks = NULL;
     cm->array->refcount = 1;
+    cm->array->generation = ++matrix_generation;
     return (vartype *) cm;
 }
 
@@ -183,6 +207,49 @@ vartype *new_list(int4 size) {
     return (vartype *) list;
 }
 
+vartype *new_sparsematrix(int4 rows, int4 columns, int4 capacity) {
+    double d_bytes = ((double) rows + 1) * sizeof(int4);
+    if (((double) (int4) d_bytes) != d_bytes)
+        return NULL;
+    d_bytes = ((double) capacity) * sizeof(phloat);
+    if (((double) (int4) d_bytes) != d_bytes)
+        return NULL;
+    if (capacity < 1)
+        capacity = 1;
+
+    vartype_sparsematrix *sm = (vartype_sparsematrix *)
+                                        malloc(sizeof(vartype_sparsematrix));
+    if (sm == NULL)
+        return NULL;
+    sm->type = TYPE_SPARSEMATRIX;
+    sm->rows = rows;
+    sm->columns = columns;
+    sm->array = (sparsematrix_data *) malloc(sizeof(sparsematrix_data));
+    if (sm->array == NULL) {
+        free(sm);
+        return NULL;
+    }
+    sm->array->rowptr = (int4 *) malloc((rows + 1) * sizeof(int4));
+    sm->array->colidx = (int4 *) malloc(capacity * sizeof(int4));
+    sm->array->data = (phloat *) malloc(capacity * sizeof(phloat));
+    if (sm->array->rowptr == NULL || sm->array->colidx == NULL
+            || sm->array->data == NULL) {
+        free(sm->array->rowptr);
+        free(sm->array->colidx);
+        free(sm->array->data);
+        free(sm->array);
+        free(sm);
+        return NULL;
+    }
+    memset(sm->array->rowptr, 0, (rows + 1) * sizeof(int4));
+    sm->array->nnz = 0;
+    sm->array->capacity = capacity;
+    sm->array->refcount = 1;
+    return (vartype *) sm;
+}
+
+static void cow_free(phloat **chunks, int4 len);
+
 void free_vartype(vartype *v) {
     if (v == NULL)
         return;
@@ -213,10 +280,22 @@ void free_vartype(vartype *v) {
         }
         case TYPE_REALMATRIX: {
             vartype_realmatrix *rm = (vartype_realmatrix *) v;
+            if (rm->array->cow_base != NULL) {
+                /* Chunked: drop the chunks, and then the reference to
+                 * the array they were copied from */
+                realmatrix_data *b = rm->array->cow_base;
+                if (--(rm->array->refcount) != 0) {
+                    free(rm);
+                    break;
+                }
+                cow_free(rm->array->cow_chunks, rm->rows * rm->columns);
+                free(rm->array);
+                rm->array = b;
+            }
             if (--(rm->array->refcount) == 0) {
                 int4 sz = rm->rows * rm->columns;
                 free_long_strings(rm->array->is_string, rm->array->data, sz);
-                free(rm->array->data);
+                matrix_data_free(rm->array->data, rm->array->map);
                 free(rm->array->is_string);
                 free(rm->array);
             }
@@ -225,6 +304,16 @@ void free_vartype(vartype *v) {
         }
         case TYPE_COMPLEXMATRIX: {
             vartype_complexmatrix *cm = (vartype_complexmatrix *) v;
+            if (cm->array->cow_base != NULL) {
+                complexmatrix_data *b = cm->array->cow_base;
+                if (--(cm->array->refcount) != 0) {
+                    free(cm);
+                    break;
+                }
+                cow_free(cm->array->cow_chunks, cm->rows * cm->columns * 2);
+                free(cm->array);
+                cm->array = b;
+            }
             if (--(cm->array->refcount) == 0) {
                 free(cm->array->data);
                 free(cm->array);
@@ -243,6 +332,17 @@ void free_vartype(vartype *v) {
             free(list);
             break;
         }
+        case TYPE_SPARSEMATRIX: {
+            vartype_sparsematrix *sm = (vartype_sparsematrix *) v;
+            if (--(sm->array->refcount) == 0) {
+                free(sm->array->rowptr);
+                free(sm->array->colidx);
+                free(sm->array->data);
+                free(sm->array);
+            }
+            free(sm);
+            break;
+        }
     }
 }
 
@@ -256,6 +356,8 @@ void clean_vartype_pools() {
 }
 
 void free_long_strings(char *is_string, phloat *data, int4 n) {
+    if (is_string == NULL)
+        return;
     for (int4 i = 0; i < n; i++)
         if (is_string[i] == 2)
             free(*(void **) &data[i]);
@@ -280,13 +382,15 @@ void get_matrix_string(const vartype_realmatrix *rm, int i, const char **text, i
 bool put_matrix_string(vartype_realmatrix *rm, int i, const char *text, int4 length) {
     char *ptext;
     int4 plength;
-    if (rm->array->is_string[i] != 0) {
+    if (get_is_string(rm->array, i) != 0) {
         get_matrix_string(rm, i, &ptext, &plength);
         if (plength == length) {
             memcpy(ptext, text, length);
             return true;
         }
     }
+    if (!alloc_is_string(rm->array, rm->rows * rm->columns))
+        return false;
     if (length > SSLENM) {
         int4 *p = (int4 *) malloc(length + 4);
         if (p == NULL)
@@ -296,19 +400,815 @@ bool put_matrix_string(vartype_realmatrix *rm, int i, const char *text, int4 len
         if (rm->array->is_string[i] == 2)
             free(*(void **) &rm->array->data[i]);
         *(int4 **) &rm->array->data[i] = p;
-        rm->array->is_string[i] = 2;
+        set_is_string(rm->array, i, 2);
     } else {
         void *oldptr = rm->array->is_string[i] == 2 ? *(void **) &rm->array->data[i] : NULL;
         char *t = (char *) &rm->array->data[i];
         t[0] = length;
         memmove(t + 1, text, length);
-        rm->array->is_string[i] = 1;
+        set_is_string(rm->array, i, 1);
         if (oldptr != NULL)
             free(oldptr);
     }
     return true;
 }
 
+/* Chunked copy-on-write; see the comment above COW_CHUNK in
+ * core_variables.h. These work on arrays of 'len' phloats, so they are
+ * shared by real and complex matrices.
+ */
+#define COW_MIN_CHUNKS 4
+
+static int4 cow_nchunks(int4 len) {
+    return (len + COW_CHUNK - 1) / COW_CHUNK;
+}
+
+static void cow_free(phloat **chunks, int4 len) {
+    int4 nc = cow_nchunks(len);
+    for (int4 c = 0; c < nc; c++)
+        free(chunks[c]);
+    free(chunks);
+}
+
+static bool cow_own(phloat **chunks, const phloat *base, int4 len, int4 k) {
+    int4 c = k / COW_CHUNK;
+    if (chunks[c] != NULL)
+        return true;
+    int4 off = c * COW_CHUNK;
+    int4 n = len - off < COW_CHUNK ? len - off : COW_CHUNK;
+    phloat *p = (phloat *) malloc(COW_CHUNK * sizeof(phloat));
+    if (p == NULL)
+        return false;
+    memcpy((void *) p, (const void *) (base + off), n * sizeof(phloat));
+    chunks[c] = p;
+    return true;
+}
+
+/* Builds the flat array for a chunked matrix. If 'steal' is set, nobody
+ * else uses the base any more, and its array is reused; otherwise, a new
+ * one is allocated, and NULL is returned if that fails. The chunks are
+ * freed unless NULL is returned. For real matrices, 'map' receives the
+ * mapping of a new array; see matrix_data_alloc().
+ */
+static phloat *cow_flatten(phloat **chunks, phloat *base, bool steal, int4 len, matrix_map **map) {
+    phloat *data = base;
+    if (!steal) {
+        if (map != NULL)
+            data = matrix_data_alloc(len, map);
+        else
+            data = (phloat *) malloc(len * sizeof(phloat));
+        if (data == NULL)
+            return NULL;
+    }
+    int4 nc = cow_nchunks(len);
+    for (int4 c = 0; c < nc; c++) {
+        int4 off = c * COW_CHUNK;
+        int4 n = len - off < COW_CHUNK ? len - off : COW_CHUNK;
+        if (chunks[c] != NULL)
+            memcpy((void *) (data + off), (const void *) chunks[c], n * sizeof(phloat));
+        else if (!steal)
+            memcpy((void *) (data + off), (const void *) (base + off), n * sizeof(phloat));
+    }
+    cow_free(chunks, len);
+    return data;
+}
+
+/* Like disentangle(), but only guarantees that element n can be written,
+ * through matrix_element(). Large numeric matrices that are shared get a
+ * chunked copy, so that only the chunk containing element n is copied,
+ * instead of the whole array. Only for matrices stored in variables; see
+ * the comment above COW_CHUNK.
+ */
+bool disentangle_element(vartype *v, int4 n) {
+    switch (v->type) {
+        case TYPE_REALMATRIX: {
+            vartype_realmatrix *rm = (vartype_realmatrix *) v;
+            int4 len = rm->rows * rm->columns;
+            realmatrix_data *a = rm->array;
+            if (a->cow_base == NULL) {
+                if (a->refcount == 1 || a->nstrings != 0
+                        || cow_nchunks(len) < COW_MIN_CHUNKS)
+                    return disentangle(v);
+                realmatrix_data *md = (realmatrix_data *)
+                                        malloc(sizeof(realmatrix_data));
+                if (md == NULL)
+                    return false;
+                md->cow_chunks = (phloat **) calloc(cow_nchunks(len), sizeof(phloat *));
+                if (md->cow_chunks == NULL) {
+                    free(md);
+                    return false;
+                }
+                /* The new array takes over this matrix's reference to
+                 * the shared one */
+                md->cow_base = a;
+                md->data = NULL;
+                md->is_string = NULL;
+                md->nstrings = 0;
+                md->map = NULL;
+                md->refcount = 1;
+                rm->array = a = md;
+            } else if (a->refcount > 1)
+                return disentangle(v);
+            if (!cow_own(a->cow_chunks, a->cow_base->data, len, n))
+                return false;
+            a->generation = ++matrix_generation;
+            return true;
+        }
+        case TYPE_COMPLEXMATRIX: {
+            vartype_complexmatrix *cm = (vartype_complexmatrix *) v;
+            int4 len = cm->rows * cm->columns * 2;
+            complexmatrix_data *a = cm->array;
+            if (a->cow_base == NULL) {
+                if (a->refcount == 1 || cow_nchunks(len) < COW_MIN_CHUNKS)
+                    return disentangle(v);
+                complexmatrix_data *md = (complexmatrix_data *)
+                                        malloc(sizeof(complexmatrix_data));
+                if (md == NULL)
+                    return false;
+                md->cow_chunks = (phloat **) calloc(cow_nchunks(len), sizeof(phloat *));
+                if (md->cow_chunks == NULL) {
+                    free(md);
+                    return false;
+                }
+                md->cow_base = a;
+                md->data = NULL;
+                md->refcount = 1;
+                cm->array = a = md;
+            } else if (a->refcount > 1)
+                return disentangle(v);
+            /* COW_CHUNK is even, so both halves of a complex element are
+             * always in the same chunk */
+            if (!cow_own(a->cow_chunks, a->cow_base->data, len, 2 * n))
+                return false;
+            a->generation = ++matrix_generation;
+            return true;
+        }
+        default:
+            return disentangle(v);
+    }
+}
+
+/* Returns the address of element n of a real matrix, or of the real part
+ * of element n of a complex matrix, whether or not the matrix is chunked.
+ */
+phloat *matrix_element(const vartype *v, int4 n) {
+    if (v->type == TYPE_REALMATRIX) {
+        realmatrix_data *a = ((vartype_realmatrix *) v)->array;
+        if (a->cow_base == NULL)
+            return a->data + n;
+        phloat *c = a->cow_chunks[n / COW_CHUNK];
+        return c != NULL ? c + n % COW_CHUNK : a->cow_base->data + n;
+    } else {
+        complexmatrix_data *a = ((vartype_complexmatrix *) v)->array;
+        int4 k = 2 * n;
+        if (a->cow_base == NULL)
+            return a->data + k;
+        phloat *c = a->cow_chunks[k / COW_CHUNK];
+        return c != NULL ? c + k % COW_CHUNK : a->cow_base->data + k;
+    }
+}
+
+/* Turns a chunked matrix back into one with a flat 'data' array. Returns
+ * false if there isn't enough memory for that; does nothing for other
+ * matrices.
+ */
+bool materialize(vartype *v) {
+    if (v->type == TYPE_REALMATRIX) {
+        vartype_realmatrix *rm = (vartype_realmatrix *) v;
+        realmatrix_data *a = rm->array;
+        if (a->cow_base == NULL)
+            return true;
+        realmatrix_data *b = a->cow_base;
+        bool steal = b->refcount == 1;
+        matrix_map *map = NULL;
+        phloat *data = cow_flatten(a->cow_chunks, b->data, steal,
+                                   rm->rows * rm->columns, &map);
+        if (data == NULL)
+            return false;
+        if (steal) {
+            /* The base had no strings when it was chunked, and it has
+             * been read-only since */
+            map = b->map;
+            free(b->is_string);
+            free(b);
+        } else
+            b->refcount--;
+        a->map = map;
+        a->data = data;
+        a->cow_base = NULL;
+        a->cow_chunks = NULL;
+        return true;
+    } else if (v->type == TYPE_COMPLEXMATRIX) {
+        vartype_complexmatrix *cm = (vartype_complexmatrix *) v;
+        complexmatrix_data *a = cm->array;
+        if (a->cow_base == NULL)
+            return true;
+        complexmatrix_data *b = a->cow_base;
+        bool steal = b->refcount == 1;
+        phloat *data = cow_flatten(a->cow_chunks, b->data, steal,
+                                   cm->rows * cm->columns * 2, NULL);
+        if (data == NULL)
+            return false;
+        if (steal)
+            free(b);
+        else
+            b->refcount--;
+        a->data = data;
+        a->cow_base = NULL;
+        a->cow_chunks = NULL;
+        return true;
+    } else
+        return true;
+}
+
+/* Memory-mapped matrix storage; see the comment above MATRIX_MAP_MIN in
+ * core_variables.h. A backing file is named after the state file it belongs
+ * to, plus a random suffix. It is referenced by that state file once the state
+ * has been saved, so when a matrix that was in the last saved state is freed,
+ * its file is only deleted after the next successful save; otherwise, a crash
+ * in between would leave a state file that refers to a missing file. The
+ * shell renames, copies, and deletes the files along with their state file,
+ * using matrix_map_move_files(). Matrices in files that still belong to a
+ * different state file are read into new arrays when the state is loaded,
+ * rather than mapped, so two states never share a file.
+ * A file that has been saved by reference is never written again: its matrix
+ * is mapped privately from then on, so changes stay in memory, and the file
+ * keeps matching the saved state even if the program crashes halfway through
+ * an operation. If the matrix's generation has changed by the time the state
+ * is saved again, its contents go into a new file, which replaces the old one
+ * once that save has succeeded.
+ */
+
+struct matrix_map {
+    char *path;
+    char *new_path;
+    void *base;
+    size_t size;
+    bool in_state;
+    bool saved;
+    bool priv;
+    uint8 generation;
+    uint8 save_generation;
+    matrix_map *next;
+};
+
+static char *map_prefix = NULL;
+static bool map_by_reference = false;
+static matrix_map *maps = NULL;
+static char **map_dropped = NULL;
+static int map_dropped_count = 0;
+static int map_dropped_capacity = 0;
+
+#ifndef WINDOWS
+
+static matrix_map *map_register(char *path, void *base, size_t size, bool in_state) {
+    matrix_map *m = (matrix_map *) malloc(sizeof(matrix_map));
+    if (m == NULL)
+        return NULL;
+    m->path = path;
+    m->new_path = NULL;
+    m->base = base;
+    m->size = size;
+    m->in_state = in_state;
+    m->saved = false;
+    m->priv = in_state;
+    m->generation = 0;
+    m->next = maps;
+    maps = m;
+    return m;
+}
+
+static void map_drop(char *path) {
+    if (map_dropped_count == map_dropped_capacity) {
+        int nc = map_dropped_capacity + 10;
+        char **nd = (char **) realloc(map_dropped, nc * sizeof(char *));
+        if (nd == NULL) {
+            // Can't defer it; leave the file behind rather than
+            // breaking the saved state
+            free(path);
+            return;
+        }
+        map_dropped = nd;
+        map_dropped_capacity = nc;
+    }
+    map_dropped[map_dropped_count++] = path;
+}
+
+static char *map_new_path(int *fd) {
+    size_t len = strlen(map_prefix) + 8;
+    char *path = (char *) malloc(len);
+    if (path == NULL)
+        return NULL;
+    snprintf(path, len, "%s.XXXXXX", map_prefix);
+    *fd = mkstemp(path);
+    if (*fd == -1) {
+        free(path);
+        return NULL;
+    }
+    return path;
+}
+
+/* Writes the current contents of a privately mapped matrix to a new file. */
+static char *map_write_copy(matrix_map *m) {
+    int fd;
+    char *path = map_new_path(&fd);
+    if (path == NULL)
+        return NULL;
+    const char *p = (const char *) m->base;
+    size_t left = m->size;
+    while (left > 0) {
+        ssize_t n = write(fd, p, left);
+        if (n <= 0)
+            break;
+        p += n;
+        left -= n;
+    }
+    if (left > 0 || fsync(fd) != 0) {
+        close(fd);
+        unlink(path);
+        free(path);
+        return NULL;
+    }
+    close(fd);
+    return path;
+}
+
+/* Replaces a matrix's mapping, in place, with a private mapping of its file,
+ * which must have the same contents. Any pages that were changed in memory
+ * are released, since the file now has the same data.
+ */
+static bool map_make_private(matrix_map *m) {
+    int fd = open(m->path, O_RDONLY);
+    if (fd == -1)
+        return false;
+    void *p = mmap(m->base, m->size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_FIXED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        return false;
+    m->priv = true;
+    return true;
+}
+
+#endif
+
+phloat *matrix_data_alloc(int4 n, matrix_map **map) {
+    *map = NULL;
+#ifndef WINDOWS
+    if (core_settings.map_large_matrices && map_prefix != NULL
+            && n >= MATRIX_MAP_MIN) {
+        int fd;
+        char *path = map_new_path(&fd);
+        if (path != NULL) {
+            size_t size = (size_t) n * sizeof(phloat);
+            void *p = MAP_FAILED;
+            // ftruncate() fills the file with zeroes, without
+            // allocating disk space for them
+            if (ftruncate(fd, size) == 0)
+                p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            close(fd);
+            if (p != MAP_FAILED) {
+                *map = map_register(path, p, size, false);
+                if (*map != NULL)
+                    return (phloat *) p;
+                munmap(p, size);
+            }
+            unlink(path);
+            free(path);
+        }
+    }
+#endif
+    return (phloat *) calloc(n, sizeof(phloat));
+}
+
+void matrix_data_free(phloat *data, matrix_map *map) {
+    if (map == NULL) {
+        free(data);
+        return;
+    }
+#ifndef WINDOWS
+    munmap(map->base, map->size);
+    matrix_map **p = &maps;
+    while (*p != map)
+        p = &(*p)->next;
+    *p = map->next;
+    if (map->in_state)
+        map_drop(map->path);
+    else {
+        unlink(map->path);
+        free(map->path);
+    }
+    if (map->new_path != NULL) {
+        unlink(map->new_path);
+        free(map->new_path);
+    }
+    free(map);
+#endif
+}
+
+phloat *grow_data(phloat *data, int4 oldsize, int4 newsize) {
+    phloat *new_data;
+    if (newsize / 2 >= oldsize) {
+        new_data = (phloat *) calloc(newsize, sizeof(phloat));
+        if (new_data == NULL)
+            return NULL;
+        memcpy((void *) new_data, (const void *) data, oldsize * sizeof(phloat));
+        free((void *) data);
+    } else {
+        new_data = (phloat *) realloc((void *) data, newsize * sizeof(phloat));
+        if (new_data == NULL)
+            return NULL;
+        memset((void *) (new_data + oldsize), 0, (newsize - oldsize) * sizeof(phloat));
+    }
+    return new_data;
+}
+
+/* Resizes a real matrix's data array, zero-filling any new elements. Arrays
+ * that grow past MATRIX_MAP_MIN move to a mapped file, if mapping is enabled;
+ * mapped arrays stay mapped, and privately mapped ones move to a new file, so
+ * the saved state's file keeps its size. Returns NULL if growing fails,
+ * leaving the old array intact; shrinking always succeeds, possibly returning
+ * the old array.
+ */
+phloat *matrix_data_resize(phloat *data, matrix_map **map, int4 oldn, int4 newn) {
+    if (*map == NULL) {
+        if (newn <= oldn) {
+            phloat *new_data = (phloat *) realloc((void *) data, newn * sizeof(phloat));
+            return new_data == NULL ? data : new_data;
+        }
+        if (newn < MATRIX_MAP_MIN)
+            return grow_data(data, oldn, newn);
+        phloat *new_data = matrix_data_alloc(newn, map);
+        if (new_data == NULL)
+            return NULL;
+        memcpy((void *) new_data, (const void *) data, oldn * sizeof(phloat));
+        free((void *) data);
+        return new_data;
+    }
+#ifdef WINDOWS
+    return NULL;
+#else
+    matrix_map *m = *map;
+    bool grow = newn > oldn;
+    if (m->priv || m->in_state) {
+        matrix_map *new_map;
+        phloat *new_data = matrix_data_alloc(newn, &new_map);
+        if (new_data == NULL)
+            return grow ? NULL : data;
+        memcpy((void *) new_data, (const void *) data,
+               (grow ? oldn : newn) * sizeof(phloat));
+        matrix_data_free(data, m);
+        *map = new_map;
+        return new_data;
+    }
+    int fd = open(m->path, O_RDWR);
+    if (fd == -1)
+        return grow ? NULL : data;
+    size_t size = (size_t) newn * sizeof(phloat);
+    if (grow && ftruncate(fd, size) != 0) {
+        close(fd);
+        return NULL;
+    }
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        if (grow)
+            ftruncate(fd, m->size);
+        close(fd);
+        return grow ? NULL : data;
+    }
+    munmap(m->base, m->size);
+    if (!grow)
+        ftruncate(fd, size);
+    close(fd);
+    m->base = p;
+    m->size = size;
+    return (phloat *) p;
+#endif
+}
+
+/* Called when a state file is loaded or created, with its name, which is
+ * used as the prefix for the names of any backing files.
+ */
+void matrix_map_init(const char *state_file_name) {
+    free(map_prefix);
+    map_prefix = state_file_name == NULL ? NULL : strdup(state_file_name);
+}
+
+/* Forgets about freed matrices without deleting their files, since the last
+ * saved state may still refer to them.
+ */
+void matrix_map_cleanup() {
+    for (int i = 0; i < map_dropped_count; i++)
+        free(map_dropped[i]);
+    free(map_dropped);
+    map_dropped = NULL;
+    map_dropped_count = map_dropped_capacity = 0;
+    free(map_prefix);
+    map_prefix = NULL;
+}
+
+/* Mapped matrices are only saved by reference in the state file they belong
+ * to; saving under any other name, to duplicate or export the state, writes
+ * them out in full, so the copy stands on its own.
+ */
+void matrix_map_begin_save(const char *state_file_name) {
+    map_by_reference = map_prefix != NULL && strcmp(state_file_name, map_prefix) == 0;
+    for (matrix_map *m = maps; m != NULL; m = m->next)
+        m->saved = false;
+}
+
+void matrix_map_end_save(bool success) {
+    if (!map_by_reference)
+        return;
+#ifndef WINDOWS
+    for (matrix_map *m = maps; m != NULL; m = m->next) {
+        if (!success) {
+            if (m->new_path != NULL) {
+                unlink(m->new_path);
+                free(m->new_path);
+                m->new_path = NULL;
+            }
+            continue;
+        }
+        bool remap = false;
+        if (m->new_path != NULL) {
+            // The state that referred to the old file is gone now
+            if (m->in_state)
+                map_drop(m->path);
+            else {
+                unlink(m->path);
+                free(m->path);
+            }
+            m->path = m->new_path;
+            m->new_path = NULL;
+            remap = true;
+        }
+        m->in_state = m->saved;
+        if (m->saved) {
+            m->generation = m->save_generation;
+            // This only releases the pages changed in memory; if it
+            // fails, the old private mapping still holds the same data
+            if (remap)
+                map_make_private(m);
+        }
+    }
+    if (!success)
+        return;
+    for (int i = 0; i < map_dropped_count; i++) {
+        unlink(map_dropped[i]);
+        free(map_dropped[i]);
+    }
+#endif
+    map_dropped_count = 0;
+}
+
+/* Returns the name of the backing file, if the matrix, with n elements, is to
+ * be saved by reference, or NULL if it is to be written out in full. The
+ * latter includes arrays whose mapping is larger than the matrix, which can
+ * happen when shrinking one fails to unmap the tail. A shared mapping is
+ * flushed to its file and made private first; a private one is written to a
+ * new file if its contents have changed since the file was written, as
+ * indicated by the array's generation.
+ */
+const char *matrix_map_save(matrix_map *map, int4 n, uint8 generation) {
+#ifdef WINDOWS
+    return NULL;
+#else
+    if (map == NULL || !map_by_reference || map->size != (size_t) n * sizeof(phloat))
+        return NULL;
+    if (!map->priv) {
+        // The file is about to belong to the saved state, so from now on,
+        // changes must stay in memory; if the mapping can't be made private,
+        // the matrix is written out in full instead
+        if (msync(map->base, map->size, MS_SYNC) != 0 || !map_make_private(map))
+            return NULL;
+        map->generation = generation;
+    } else if (generation != map->generation && map->new_path == NULL) {
+        map->new_path = map_write_copy(map);
+        if (map->new_path == NULL)
+            return NULL;
+    }
+    map->saved = true;
+    map->save_generation = generation;
+    return map->new_path != NULL ? map->new_path : map->path;
+#endif
+}
+
+/* Records that a matrix that was just mapped by matrix_map_load() has the
+ * given generation, so it won't be written to a new file unless it changes.
+ */
+void matrix_map_loaded(matrix_map *map, uint8 generation) {
+    if (map != NULL)
+        map->generation = generation;
+}
+
+#ifndef WINDOWS
+
+/* True if 'name' is 'prefix' followed by a suffix like mkstemp() makes. */
+static bool map_file_suffix(const char *name, const char *prefix, size_t plen) {
+    if (strncmp(name, prefix, plen) != 0 || name[plen] != '.'
+            || strlen(name + plen) != 7)
+        return false;
+    for (size_t i = plen + 1; i < plen + 7; i++) {
+        char c = name[i];
+        if (!(c >= '0' && c <= '9' || c >= 'A' && c <= 'Z' || c >= 'a' && c <= 'z'))
+            return false;
+    }
+    return true;
+}
+
+static bool map_copy_file(const char *from, const char *to) {
+    int in = open(from, O_RDONLY);
+    if (in == -1)
+        return false;
+    int out = open(to, O_WRONLY | O_CREAT | O_EXCL, 0600);
+    if (out == -1) {
+        close(in);
+        return false;
+    }
+    char buf[65536];
+    ssize_t n;
+    bool ok = true;
+    while (ok && (n = read(in, buf, sizeof(buf))) > 0) {
+        char *p = buf;
+        while (n > 0) {
+            ssize_t w = write(out, p, n);
+            if (w <= 0) {
+                ok = false;
+                break;
+            }
+            p += w;
+            n -= w;
+        }
+    }
+    if (n < 0 || close(out) != 0)
+        ok = false;
+    close(in);
+    if (!ok)
+        unlink(to);
+    return ok;
+}
+
+static void map_rename_path(char **path, const char *new_prefix) {
+    size_t plen = strlen(map_prefix);
+    if (!map_file_suffix(*path, map_prefix, plen))
+        return;
+    size_t len = strlen(new_prefix) + 8;
+    char *p = (char *) malloc(len);
+    if (p == NULL)
+        return;
+    snprintf(p, len, "%s%s", new_prefix, *path + plen);
+    free(*path);
+    *path = p;
+}
+
+#endif
+
+/* Renames, copies, or, if new_state_file_name is NULL, deletes the backing
+ * files that belong to a state file. Renamed and copied files keep their
+ * suffixes, which is how matrix_map_load() finds them under the new name.
+ * When the current state is renamed, its mapped matrices follow it.
+ */
+bool matrix_map_move_files(const char *state_file_name, const char *new_state_file_name, bool copy) {
+#ifdef WINDOWS
+    return true;
+#else
+    const char *slash = strrchr(state_file_name, '/');
+    const char *base = slash == NULL ? state_file_name : slash + 1;
+    size_t blen = strlen(base);
+    char *dir = slash == NULL ? strdup(".") : strndup(state_file_name, slash - state_file_name + 1);
+    if (dir == NULL)
+        return false;
+    DIR *d = opendir(dir);
+    if (d == NULL) {
+        free(dir);
+        return true;
+    }
+    // Collect the names first, since renaming while reading the directory
+    // could make readdir() return files twice
+    char **names = NULL;
+    int count = 0, capacity = 0;
+    bool ok = true;
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL) {
+        if (!map_file_suffix(e->d_name, base, blen))
+            continue;
+        if (count == capacity) {
+            capacity += 10;
+            char **nn = (char **) realloc(names, capacity * sizeof(char *));
+            if (nn == NULL) {
+                ok = false;
+                break;
+            }
+            names = nn;
+        }
+        names[count] = (char *) malloc(strlen(dir) + strlen(e->d_name) + 2);
+        if (names[count] == NULL) {
+            ok = false;
+            break;
+        }
+        sprintf(names[count++], "%s%s%s", dir, slash == NULL ? "/" : "", e->d_name);
+    }
+    closedir(d);
+    free(dir);
+
+    for (int i = 0; i < count; i++) {
+        if (ok && new_state_file_name == NULL)
+            unlink(names[i]);
+        else if (ok) {
+            size_t len = strlen(new_state_file_name) + 8;
+            char *to = (char *) malloc(len);
+            if (to == NULL) {
+                ok = false;
+            } else {
+                snprintf(to, len, "%s%s", new_state_file_name, names[i] + strlen(names[i]) - 7);
+                if (copy)
+                    ok = map_copy_file(names[i], to);
+                else
+                    ok = rename(names[i], to) == 0;
+                free(to);
+            }
+        }
+        free(names[i]);
+    }
+    free(names);
+
+    if (!copy && new_state_file_name != NULL && map_prefix != NULL
+            && strcmp(state_file_name, map_prefix) == 0) {
+        // The current state was renamed; keep track of its files
+        char *np = strdup(new_state_file_name);
+        if (np == NULL)
+            return false;
+        for (matrix_map *m = maps; m != NULL; m = m->next)
+            map_rename_path(&m->path, np);
+        for (int i = 0; i < map_dropped_count; i++)
+            map_rename_path(&map_dropped[i], np);
+        free(map_prefix);
+        map_prefix = np;
+    }
+    return ok;
+#endif
+}
+
+/* Maps a backing file, privately, while loading state. The pages are only
+ * read when the matrix is used. A file that is named after a different state
+ * file is looked for under this state file's name, with the same suffix,
+ * since the state may have been renamed or copied along with its files; if
+ * it isn't there, and the state it is named after no longer exists, it is
+ * renamed to belong to this state. Returns NULL if the file belongs to
+ * another existing state, or can't be mapped; the caller should then read its
+ * contents instead. A file whose size doesn't match the matrix isn't mapped,
+ * and isn't changed, either.
+ */
+phloat *matrix_map_load(const char *path, int4 n, matrix_map **map) {
+    *map = NULL;
+#ifdef WINDOWS
+    return NULL;
+#else
+    if (map_prefix == NULL)
+        return NULL;
+    size_t len = strlen(path);
+    if (len < 8 || path[len - 7] != '.')
+        return NULL;
+    size_t plen = strlen(map_prefix);
+    char *p = (char *) malloc(plen + 8);
+    if (p == NULL)
+        return NULL;
+    snprintf(p, plen + 8, "%s%s", map_prefix, path + len - 7);
+    if (strcmp(p, path) != 0 && access(p, F_OK) != 0) {
+        char *owner = strndup(path, len - 7);
+        bool orphan = owner != NULL && access(owner, F_OK) != 0 && errno == ENOENT;
+        free(owner);
+        if (!orphan || rename(path, p) != 0) {
+            free(p);
+            return NULL;
+        }
+    }
+    int fd = open(p, O_RDONLY);
+    if (fd == -1) {
+        free(p);
+        return NULL;
+    }
+    size_t size = (size_t) n * sizeof(phloat);
+    struct stat st;
+    void *base = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t) st.st_size == size)
+        base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        free(p);
+        return NULL;
+    }
+    *map = map_register(p, base, size, true);
+    if (*map == NULL) {
+        munmap(base, size);
+        free(p);
+        return NULL;
+    }
+    return (phloat *) base;
+#endif
+}
+
 vartype *dup_vartype(const vartype *v) {
     if (v == NULL)
         return NULL;
@@ -323,6 +1223,8 @@ vartype *dup_vartype(const vartype *v) {
         }
         case TYPE_REALMATRIX: {
             vartype_realmatrix *rm = (vartype_realmatrix *) v;
+            if (!materialize((vartype *) v))
+                return NULL;
             vartype_realmatrix *rm2 = (vartype_realmatrix *)
                                         malloc(sizeof(vartype_realmatrix));
             if (rm2 == NULL)
@@ -333,6 +1235,8 @@ vartype *dup_vartype(const vartype *v) {
         }
         case TYPE_COMPLEXMATRIX: {
             vartype_complexmatrix *cm = (vartype_complexmatrix *) v;
+            if (!materialize((vartype *) v))
+                return NULL;
             vartype_complexmatrix *cm2 = (vartype_complexmatrix *)
                                         malloc(sizeof(vartype_complexmatrix));
             if (cm2 == NULL)
@@ -354,6 +1258,16 @@ vartype *dup_vartype(const vartype *v) {
             list->array->refcount++;
             return (vartype *) list2;
         }
+        case TYPE_SPARSEMATRIX: {
+            vartype_sparsematrix *sm = (vartype_sparsematrix *) v;
+            vartype_sparsematrix *sm2 = (vartype_sparsematrix *)
+                                        malloc(sizeof(vartype_sparsematrix));
+            if (sm2 == NULL)
+                return NULL;
+            *sm2 = *sm;
+            sm->array->refcount++;
+            return (vartype *) sm2;
+        }
         default:
             return NULL;
     }
@@ -363,20 +1277,33 @@ bool disentangle(vartype *v) {
     switch (v->type) {
         case TYPE_REALMATRIX: {
             vartype_realmatrix *rm = (vartype_realmatrix *) v;
-            if (rm->array->refcount == 1)
+            if (!materialize(v))
+                return false;
+            if (rm->array->refcount == 1) {
+                rm->array->generation = ++matrix_generation;
                 return true;
-            else {
+            } else {
                 realmatrix_data *md = (realmatrix_data *)
                                         malloc(sizeof(realmatrix_data));
                 if (md == NULL)
                     return false;
                 int4 sz = rm->rows * rm->columns;
                 int4 i;
-                md->data = (phloat *) malloc(sz * sizeof(phloat));
+                md->map = NULL;
+                if (rm->array->is_string == NULL)
+                    md->data = matrix_data_alloc(sz, &md->map);
+                else
+                    md->data = (phloat *) malloc(sz * sizeof(phloat));
                 if (md->data == NULL) {
                     free(md);
                     return false;
                 }
+                md->nstrings = rm->array->nstrings;
+                if (rm->array->is_string == NULL) {
+                    md->is_string = NULL;
+                    memcpy((void *) md->data, (const void *) rm->array->data, sz * sizeof(phloat));
+                    goto done;
+                }
                 md->is_string = (char *) malloc(sz);
                 if (md->is_string == NULL) {
                     free(md->data);
@@ -402,7 +1329,11 @@ bool disentangle(vartype *v) {
                         md->data[i] = rm->array->data[i];
                     }
                 }
+                done:
                 md->refcount = 1;
+                md->generation = ++matrix_generation;
+                md->cow_base = NULL;
+                md->cow_chunks = NULL;
                 rm->array->refcount--;
                 rm->array = md;
                 return true;
@@ -410,9 +1341,12 @@ bool disentangle(vartype *v) {
         }
         case TYPE_COMPLEXMATRIX: {
             vartype_complexmatrix *cm = (vartype_complexmatrix *) v;
-            if (cm->array->refcount == 1)
+            if (!materialize(v))
+                return false;
+            if (cm->array->refcount == 1) {
+                cm->array->generation = ++matrix_generation;
                 return true;
-            else {
+            } else {
                 complexmatrix_data *md = (complexmatrix_data *)
                                             malloc(sizeof(complexmatrix_data));
                 if (md == NULL)
@@ -427,6 +1361,9 @@ bool disentangle(vartype *v) {
                 for (i = 0; i < sz; i++)
                     md->data[i] = cm->array->data[i];
                 md->refcount = 1;
+                md->generation = ++matrix_generation;
+                md->cow_base = NULL;
+                md->cow_chunks = NULL;
                 cm->array->refcount--;
                 cm->array = md;
                 return true;
@@ -465,6 +1402,28 @@ bool disentangle(vartype *v) {
                 return true;
             }
         }
+        case TYPE_SPARSEMATRIX: {
+            vartype_sparsematrix *sm = (vartype_sparsematrix *) v;
+            if (sm->array->refcount == 1)
+                return true;
+            else {
+                int4 nnz = sm->array->nnz;
+                vartype_sparsematrix *copy = (vartype_sparsematrix *)
+                                new_sparsematrix(sm->rows, sm->columns, nnz);
+                if (copy == NULL)
+                    return false;
+                sparsematrix_data *sd = copy->array;
+                free(copy);
+                memcpy(sd->rowptr, sm->array->rowptr, (sm->rows + 1) * sizeof(int4));
+                memcpy(sd->colidx, sm->array->colidx, nnz * sizeof(int4));
+                for (int4 i = 0; i < nnz; i++)
+                    sd->data[i] = sm->array->data[i];
+                sd->nnz = nnz;
+                sm->array->refcount--;
+                sm->array = sd;
+                return true;
+            }
+        }
         case TYPE_REAL:
         case TYPE_COMPLEX:
         case TYPE_STRING:
@@ -473,6 +1432,13 @@ bool disentangle(vartype *v) {
     }
 }
 
+void touch_matrix(vartype *v) {
+    if (v->type == TYPE_REALMATRIX)
+        ((vartype_realmatrix *) v)->array->generation = ++matrix_generation;
+    else if (v->type == TYPE_COMPLEXMATRIX)
+        ((vartype_complexmatrix *) v)->array->generation = ++matrix_generation;
+}
+
 int lookup_var(const char *name, int namelength) {
     int i, j;
     for (i = vars_count - 1; i >= 0; i--) {
@@ -493,8 +1459,31 @@ vartype *recall_var(const char *name, int namelength) {
     int varindex = lookup_var(name, namelength);
     if (varindex == -1)
         return NULL;
-    else
-        return vars[varindex].value;
+    return vars[varindex].value;
+}
+
+/* Index of the REGS variable, as of the last lookup. There is never more than
+ * one visible variable with any given name, so if the entry at this index is
+ * still a visible REGS, it is the one lookup_var() would find, and any change
+ * to the variable table that moves, hides, or removes it is caught by simply
+ * checking the entry again.
+ */
+static int regs_index = -1;
+
+vartype *recall_regs() {
+    int i = regs_index;
+    if (i < 0 || i >= vars_count
+            || (vars[i].flags & (VAR_HIDDEN | VAR_PRIVATE)) != 0
+            || !string_equals(vars[i].name, vars[i].length, "REGS", 4)) {
+        i = lookup_var("REGS", 4);
+        if (i == -1)
+            return NULL;
+        regs_index = i;
+    }
+    vartype *v = vars[i].value;
+    if (!materialize(v))
+        return NULL;
+    return v;
 }
 
 bool ensure_var_space(int n) {
@@ -552,6 +1541,7 @@ int store_var(const char *name, int namelength, vartype *value, bool local) {
                 string_equals(name, namelength, matedit_name, matedit_length)) {
             if (value->type == TYPE_REALMATRIX
                     || value->type == TYPE_COMPLEXMATRIX
+                    || value->type == TYPE_SPARSEMATRIX
                     || value->type == TYPE_LIST) {
                 matedit_i = matedit_j = 0;
             } else {
@@ -642,6 +1632,7 @@ bool vars_exist(int section) {
                     break;
             case TYPE_REALMATRIX:
             case TYPE_COMPLEXMATRIX:
+            case TYPE_SPARSEMATRIX:
                 if (section == CATSECT_MAT || section == CATSECT_MAT_LIST)
                     return true;
                 else
@@ -657,11 +1648,40 @@ bool vars_exist(int section) {
 }
 
 bool contains_strings(const vartype_realmatrix *rm) {
-    int4 size = rm->rows * rm->columns;
-    for (int4 i = 0; i < size; i++)
-        if (rm->array->is_string[i] != 0)
-            return true;
-    return false;
+    return rm->array->nstrings != 0;
+}
+
+/* Makes sure the matrix has an is_string array, so string flags can be
+ * set. Returns false if it had to be allocated and there is no memory.
+ */
+bool alloc_is_string(realmatrix_data *a, int4 size) {
+    if (a->is_string != NULL)
+        return true;
+    a->is_string = (char *) calloc(size, 1);
+    return a->is_string != NULL;
+}
+
+/* Sets one string flag and keeps the string count up to date. Setting a
+ * nonzero flag requires the is_string array to exist (see alloc_is_string);
+ * clearing a flag in a matrix without one is a no-op.
+ */
+void set_is_string(realmatrix_data *a, int4 i, char s) {
+    if (a->is_string == NULL)
+        return;
+    char old = a->is_string[i];
+    a->is_string[i] = s;
+    a->nstrings += (s != 0) - (old != 0);
+}
+
+/* Frees all long strings in the matrix, and the is_string array itself,
+ * turning all string elements into garbage numbers. The caller is expected
+ * to overwrite them.
+ */
+void clear_is_string(realmatrix_data *a, int4 size) {
+    free_long_strings(a->is_string, a->data, size);
+    free(a->is_string);
+    a->is_string = NULL;
+    a->nstrings = 0;
 }
 
 /* This is only used by core_linalg1, and does not deal with strings,
@@ -678,8 +1698,7 @@ int matrix_copy(vartype *dst, const vartype *src) {
             if (contains_strings(s))
                 return ERR_ALPHA_DATA_IS_INVALID;
             int4 size = s->rows * s->columns;
-            free_long_strings(d->array->is_string, d->array->data, size);
-            memset(d->array->is_string, 0, size);
+            clear_is_string(d->array, size);
             memcpy((void *) d->array->data, (const void *) s->array->data, size * sizeof(phloat));
             return ERR_NONE;
         } else if (dst->type == TYPE_COMPLEXMATRIX) {
@@ -709,6 +1728,164 @@ int matrix_copy(vartype *dst, const vartype *src) {
         return ERR_INVALID_TYPE;
 }
 
+/* Makes room for at least 'capacity' entries in a sparse matrix. Growing
+ * is done geometrically, so that filling a matrix one element at a time
+ * doesn't reallocate for every element.
+ */
+bool sparse_reserve(vartype_sparsematrix *sm, int4 capacity) {
+    sparsematrix_data *sd = sm->array;
+    if (capacity <= sd->capacity)
+        return true;
+    int4 newcap = sd->capacity * 2;
+    if (newcap < capacity || newcap < sd->capacity)
+        newcap = capacity;
+    double d_bytes = ((double) newcap) * sizeof(phloat);
+    if (((double) (int4) d_bytes) != d_bytes)
+        return false;
+    int4 *newidx = (int4 *) realloc(sd->colidx, newcap * sizeof(int4));
+    if (newidx == NULL)
+        return false;
+    sd->colidx = newidx;
+    phloat *newdata = (phloat *) realloc((void *) sd->data, newcap * sizeof(phloat));
+    if (newdata == NULL)
+        return false;
+    sd->data = newdata;
+    sd->capacity = newcap;
+    return true;
+}
+
+/* Returns the position of element (i, j) in colidx and data, or, if it is
+ * not stored, -1 - the position where it would have to be inserted.
+ */
+static int4 sparse_find(const vartype_sparsematrix *sm, int4 i, int4 j) {
+    const int4 *colidx = sm->array->colidx;
+    int4 lo = sm->array->rowptr[i];
+    int4 hi = sm->array->rowptr[i + 1];
+    while (lo < hi) {
+        int4 mid = (lo + hi) / 2;
+        if (colidx[mid] < j)
+            lo = mid + 1;
+        else if (colidx[mid] > j)
+            hi = mid;
+        else
+            return mid;
+    }
+    return -1 - lo;
+}
+
+phloat sparse_get(const vartype_sparsematrix *sm, int4 i, int4 j) {
+    int4 p = sparse_find(sm, i, j);
+    return p >= 0 ? sm->array->data[p] : 0;
+}
+
+/* Stores x at (i, j), inserting or removing the entry as needed to keep
+ * only nonzero elements stored. The caller must have disentangled the
+ * matrix. Returns false if there was no memory to grow the matrix.
+ */
+bool sparse_put(vartype_sparsematrix *sm, int4 i, int4 j, phloat x) {
+    sparsematrix_data *sd = sm->array;
+    int4 p = sparse_find(sm, i, j);
+    int4 r;
+    if (p >= 0) {
+        if (x != 0) {
+            sd->data[p] = x;
+            return true;
+        }
+        memmove(sd->colidx + p, sd->colidx + p + 1, (sd->nnz - p - 1) * sizeof(int4));
+        memmove((void *) (sd->data + p), (void *) (sd->data + p + 1), (sd->nnz - p - 1) * sizeof(phloat));
+        sd->nnz--;
+        for (r = i + 1; r <= sm->rows; r++)
+            sd->rowptr[r]--;
+        return true;
+    }
+    if (x == 0)
+        return true;
+    if (!sparse_reserve(sm, sd->nnz + 1))
+        return false;
+    p = -1 - p;
+    memmove(sd->colidx + p + 1, sd->colidx + p, (sd->nnz - p) * sizeof(int4));
+    memmove((void *) (sd->data + p + 1), (void *) (sd->data + p), (sd->nnz - p) * sizeof(phloat));
+    sd->colidx[p] = j;
+    sd->data[p] = x;
+    sd->nnz++;
+    for (r = i + 1; r <= sm->rows; r++)
+        sd->rowptr[r]++;
+    return true;
+}
+
+vartype *sparse_to_dense(const vartype_sparsematrix *sm) {
+    vartype_realmatrix *rm = (vartype_realmatrix *)
+                                    new_realmatrix(sm->rows, sm->columns);
+    if (rm == NULL)
+        return NULL;
+    const int4 *rowptr = sm->array->rowptr;
+    for (int4 i = 0; i < sm->rows; i++) {
+        phloat *row = rm->array->data + i * sm->columns;
+        for (int4 p = rowptr[i]; p < rowptr[i + 1]; p++)
+            row[sm->array->colidx[p]] = sm->array->data[p];
+    }
+    return (vartype *) rm;
+}
+
+vartype *sparse_transpose(const vartype_sparsematrix *sm) {
+    const sparsematrix_data *sd = sm->array;
+    vartype_sparsematrix *tm = (vartype_sparsematrix *)
+                    new_sparsematrix(sm->columns, sm->rows, sd->nnz);
+    if (tm == NULL)
+        return NULL;
+    sparsematrix_data *td = tm->array;
+    /* Count the entries in each column, turn the counts into starting
+     * positions, and then scatter the rows in order, which leaves the
+     * entries within each new row sorted.
+     */
+    int4 *next = td->rowptr;
+    for (int4 p = 0; p < sd->nnz; p++)
+        next[sd->colidx[p] + 1]++;
+    for (int4 j = 0; j < sm->columns; j++)
+        next[j + 1] += next[j];
+    for (int4 i = 0; i < sm->rows; i++)
+        for (int4 p = sd->rowptr[i]; p < sd->rowptr[i + 1]; p++) {
+            int4 q = next[sd->colidx[p]]++;
+            td->colidx[q] = i;
+            td->data[q] = sd->data[p];
+        }
+    // Scattering advanced each starting position to the start of the
+    // next column; shift them back.
+    for (int4 j = sm->columns; j > 0; j--)
+        next[j] = next[j - 1];
+    next[0] = 0;
+    td->nnz = sd->nnz;
+    return (vartype *) tm;
+}
+
+int dense_to_sparse(const vartype_realmatrix *rm, vartype **res) {
+    if (contains_strings(rm))
+        return ERR_ALPHA_DATA_IS_INVALID;
+    int4 size = rm->rows * rm->columns;
+    int4 nnz = 0;
+    for (int4 n = 0; n < size; n++)
+        if (rm->array->data[n] != 0)
+            nnz++;
+    vartype_sparsematrix *sm = (vartype_sparsematrix *)
+                        new_sparsematrix(rm->rows, rm->columns, nnz);
+    if (sm == NULL)
+        return ERR_INSUFFICIENT_MEMORY;
+    sparsematrix_data *sd = sm->array;
+    int4 n = 0;
+    for (int4 i = 0; i < rm->rows; i++) {
+        for (int4 j = 0; j < rm->columns; j++, n++) {
+            phloat x = rm->array->data[n];
+            if (x != 0) {
+                sd->colidx[sd->nnz] = j;
+                sd->data[sd->nnz++] = x;
+            }
+        }
+        sd->rowptr[i + 1] = sd->nnz;
+    }
+    *res = (vartype *) sm;
+    return ERR_NONE;
+}
+
 static int lookup_private_var(const char *name, int namelength) {
     int level = get_rtn_level();
     int i, j;
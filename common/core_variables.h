@@ -31,6 +31,7 @@
 #define TYPE_COMPLEXMATRIX 4
 #define TYPE_STRING 5
 #define TYPE_LIST 6
+#define TYPE_SPARSEMATRIX 7
 
 struct vartype {
     int type;
@@ -49,12 +50,55 @@ struct vartype_complex {
 };
 
 
+/* When a large shared matrix is modified one element at a time (STOEL),
+ * the private copy doesn't get its own flat array right away. Instead, it
+ * keeps a reference to the shared array (cow_base) and a table of chunks of
+ * COW_CHUNK phloats; a NULL chunk still reads from cow_base, and a chunk is
+ * only copied when an element in it is written. 'data' is NULL in this
+ * state, so everything except disentangle_element() and matrix_element()
+ * must call materialize() first, which turns it back into a flat array.
+ * This is done by dup_vartype(), disentangle(), dimension_array_ref() and
+ * matedit_get(); code that reads the data of a matrix it got from
+ * recall_var() calls it itself, and reports ERR_INSUFFICIENT_MEMORY if it
+ * fails. Only numeric matrices stored in variables are ever in this state,
+ * and they are never shared.
+ */
+#define COW_CHUNK 1024
+
+/* When core_settings.map_large_matrices is set, the 'data' array of a real
+ * matrix with at least MATRIX_MAP_MIN elements is allocated in a memory-mapped
+ * file next to the state file, instead of on the heap; 'map' is then non-NULL,
+ * and the array must be allocated, resized, and freed with matrix_data_alloc(),
+ * matrix_data_resize(), and matrix_data_free(). Everything else just uses the
+ * 'data' pointer as usual. When the state is saved, such matrices are written
+ * as a reference to their file, instead of element by element, provided they
+ * contain no strings. After that, the file belongs to the saved state, and
+ * the matrix is mapped privately until the next save.
+ */
+#define MATRIX_MAP_MIN (1 << 20)
+struct matrix_map;
+
+/* is_string holds one flag per element: 0 for a number, 1 for a short
+ * string stored in the element itself, 2 for a long string whose pointer
+ * is stored in the element. It is only allocated once the first string is
+ * stored; purely numeric matrices leave it NULL. nstrings is the number of
+ * nonzero flags.
+ */
 struct realmatrix_data {
     int refcount;
     phloat *data;
     char *is_string;
+    int4 nstrings;
+    uint8 generation;
+    realmatrix_data *cow_base;
+    phloat **cow_chunks;
+    matrix_map *map;
 };
 
+inline char get_is_string(const realmatrix_data *a, int4 i) {
+    return a->is_string == NULL ? 0 : a->is_string[i];
+}
+
 struct vartype_realmatrix {
     int type;
     int4 rows;
@@ -66,6 +110,9 @@ struct vartype_realmatrix {
 struct complexmatrix_data {
     int refcount;
     phloat *data;
+    uint8 generation;
+    complexmatrix_data *cow_base;
+    phloat **cow_chunks;
 };
 
 struct vartype_complexmatrix {
@@ -111,12 +158,35 @@ struct vartype_list {
 };
 
 
+/* Sparse real matrices are stored in compressed sparse row form: the
+ * entries of row i are at positions rowptr[i] through rowptr[i + 1] - 1
+ * of colidx and data, sorted by column. Only nonzero elements are stored,
+ * and sparse matrices cannot contain strings.
+ */
+struct sparsematrix_data {
+    int refcount;
+    int4 nnz;
+    int4 capacity;
+    int4 *rowptr;
+    int4 *colidx;
+    phloat *data;
+};
+
+struct vartype_sparsematrix {
+    int type;
+    int4 rows;
+    int4 columns;
+    sparsematrix_data *array;
+};
+
+
 vartype *new_real(phloat value);
 vartype *new_complex(phloat re, phloat im);
 vartype *new_string(const char *s, int slen);
 vartype *new_realmatrix(int4 rows, int4 columns);
 vartype *new_complexmatrix(int4 rows, int4 columns);
 vartype *new_list(int4 size);
+vartype *new_sparsematrix(int4 rows, int4 columns, int4 capacity);
 void free_vartype(vartype *v);
 void clean_vartype_pools();
 void free_long_strings(char *is_string, phloat *data, int4 n);
@@ -125,15 +195,41 @@ void get_matrix_string(const vartype_realmatrix *rm, int4 i, const char **text,
 bool put_matrix_string(vartype_realmatrix *rm, int4 i, const char *text, int4 length);
 vartype *dup_vartype(const vartype *v);
 bool disentangle(vartype *v);
+bool disentangle_element(vartype *v, int4 n);
+phloat *matrix_element(const vartype *v, int4 n);
+bool materialize(vartype *v);
+void touch_matrix(vartype *v);
 int lookup_var(const char *name, int namelength);
 vartype *recall_var(const char *name, int namelength);
+vartype *recall_regs();
 bool ensure_var_space(int n);
 int store_var(const char *name, int namelength, vartype *value, bool local = false);
 bool purge_var(const char *name, int namelength, bool global = true, bool local = true);
 void purge_all_vars();
 bool vars_exist(int section);
 bool contains_strings(const vartype_realmatrix *rm);
+bool alloc_is_string(realmatrix_data *a, int4 size);
+void set_is_string(realmatrix_data *a, int4 i, char s);
+void clear_is_string(realmatrix_data *a, int4 size);
 int matrix_copy(vartype *dst, const vartype *src);
+bool sparse_reserve(vartype_sparsematrix *sm, int4 capacity);
+phloat sparse_get(const vartype_sparsematrix *sm, int4 i, int4 j);
+bool sparse_put(vartype_sparsematrix *sm, int4 i, int4 j, phloat x);
+vartype *sparse_to_dense(const vartype_sparsematrix *sm);
+vartype *sparse_transpose(const vartype_sparsematrix *sm);
+int dense_to_sparse(const vartype_realmatrix *rm, vartype **res);
+phloat *matrix_data_alloc(int4 n, matrix_map **map);
+phloat *matrix_data_resize(phloat *data, matrix_map **map, int4 oldn, int4 newn);
+void matrix_data_free(phloat *data, matrix_map *map);
+phloat *grow_data(phloat *data, int4 oldsize, int4 newsize);
+void matrix_map_init(const char *state_file_name);
+void matrix_map_cleanup();
+void matrix_map_begin_save(const char *state_file_name);
+void matrix_map_end_save(bool success);
+const char *matrix_map_save(matrix_map *map, int4 n, uint8 generation);
+void matrix_map_loaded(matrix_map *map, uint8 generation);
+phloat *matrix_map_load(const char *path, int4 n, matrix_map **map);
+bool matrix_map_move_files(const char *state_file_name, const char *new_state_file_name, bool copy);
 vartype *recall_private_var(const char *name, int namelength);
 vartype *recall_and_purge_private_var(const char *name, int namelength);
 int store_private_var(const char *name, int namelength, vartype *value);
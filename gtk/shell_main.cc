@@ -172,6 +172,9 @@ static void exportProgramCB();
 static GtkWidget *make_file_select_dialog(
         const char *title, const char *pattern, bool save, GtkWidget *owner);
 static void importProgramCB();
+static void exportMatrixCB();
+static void importMatrixCB();
+static void sigmaFromCsvCB();
 static void paperAdvanceCB();
 static void copyPrintAsTextCB();
 static void copyPrintAsImageCB();
@@ -263,6 +266,21 @@ static const char *mainWindowXml =
                         "<property name='label'>Export Programs...</property>"
                       "</object>"
                     "</child>"
+                    "<child>"
+                      "<object class='GtkMenuItem' id='import_matrix_item'>"
+                        "<property name='label'>Import Matrix...</property>"
+                      "</object>"
+                    "</child>"
+                    "<child>"
+                      "<object class='GtkMenuItem' id='export_matrix_item'>"
+                        "<property name='label'>Export Matrix...</property>"
+                      "</object>"
+                    "</child>"
+                    "<child>"
+                      "<object class='GtkMenuItem' id='sigma_csv_item'>"
+                        "<property name='label'>\316\243+ from CSV File...</property>"
+                      "</object>"
+                    "</child>"
                     "<child>"
                       "<object class='GtkSeparatorMenuItem' id='sep_3'>"
                       "</object>"
@@ -700,6 +718,12 @@ static void activate(GtkApplication *theApp, gpointer userData) {
     g_signal_connect(G_OBJECT(item), "activate", G_CALLBACK(importProgramCB), NULL);
     item = GTK_MENU_ITEM(gtk_builder_get_object(builder, "export_programs_item"));
     g_signal_connect(G_OBJECT(item), "activate", G_CALLBACK(exportProgramCB), NULL);
+    item = GTK_MENU_ITEM(gtk_builder_get_object(builder, "import_matrix_item"));
+    g_signal_connect(G_OBJECT(item), "activate", G_CALLBACK(importMatrixCB), NULL);
+    item = GTK_MENU_ITEM(gtk_builder_get_object(builder, "export_matrix_item"));
+    g_signal_connect(G_OBJECT(item), "activate", G_CALLBACK(exportMatrixCB), NULL);
+    item = GTK_MENU_ITEM(gtk_builder_get_object(builder, "sigma_csv_item"));
+    g_signal_connect(G_OBJECT(item), "activate", G_CALLBACK(sigmaFromCsvCB), NULL);
     item = GTK_MENU_ITEM(gtk_builder_get_object(builder, "preferences_item"));
     g_signal_connect(G_OBJECT(item), "activate", G_CALLBACK(preferencesCB), NULL);
     item = GTK_MENU_ITEM(gtk_builder_get_object(builder, "quit_item"));
@@ -1127,7 +1151,12 @@ static void init_shell_state(int4 version) {
             state.mainWindowHeight = 0;
             // fall through
         case 11:
-            /* current version (SHELL_VERSION = 11),
+            // fall through
+        case 12:
+            core_settings.map_large_matrices = false;
+            // fall through
+        case 13:
+            /* current version (SHELL_VERSION = 13),
              * so nothing to do here since everything
              * was initialized from the state file.
              */
@@ -1175,6 +1204,8 @@ static int read_shell_state(int4 *ver) {
         core_settings.allow_big_stack = state.allow_big_stack;
     if (state_version >= 10)
         core_settings.localized_copy_paste = state.localized_copy_paste;
+    if (state_version >= 13)
+        core_settings.map_large_matrices = state.map_large_matrices;
 
     init_shell_state(state_version);
     *ver = version;
@@ -1200,6 +1231,7 @@ static int write_shell_state() {
     state.auto_repeat = core_settings.auto_repeat;
     state.allow_big_stack = core_settings.allow_big_stack;
     state.localized_copy_paste = core_settings.localized_copy_paste;
+    state.map_large_matrices = core_settings.map_large_matrices;
     if (fwrite(&state, 1, sizeof(state_type), statefile) != sizeof(int4))
         return 0;
 
@@ -1549,6 +1581,12 @@ static bool copy_state(const char *orig_name, const char *copy_name) {
             goto duplication_failed;
         fclose(fin);
         fclose(fout);
+        // The copy gets its own copies of any memory-mapped matrices
+        if (!core_move_state_files(orig_name, copy_name, true)) {
+            core_move_state_files(copy_name, NULL, false);
+            remove(copy_name);
+            return false;
+        }
         return true;
     } else {
         duplication_failed:
@@ -1643,7 +1681,8 @@ static void states_menu_rename() {
     snprintf(oldpath, FILENAMELEN, "%s/%s.f42", free42dirname, state_names[selectedStateIndex]);
     char newpath[FILENAMELEN];
     snprintf(newpath, FILENAMELEN, "%s/%s.f42", free42dirname, newname);
-    rename(oldpath, newpath);
+    if (rename(oldpath, newpath) == 0)
+        core_move_state_files(oldpath, newpath, false);
     if (strcmp(state_names[selectedStateIndex], state.coreName) == 0)
         strncpy(state.coreName, newname, FILENAMELEN);
     gtk_dialog_response(GTK_DIALOG(dlg), 4);
@@ -1670,6 +1709,7 @@ static void states_menu_delete() {
     char statePath[FILENAMELEN];
     snprintf(statePath, FILENAMELEN, "%s/%s.f42", free42dirname, stateName);
     remove(statePath);
+    core_move_state_files(statePath, NULL, false);
     gtk_dialog_response(GTK_DIALOG(dlg), 4);
 }
 
@@ -2204,6 +2244,145 @@ static void importProgramCB() {
     redisplay();
 }
 
+#define MATRIX_FILE_PATTERN \
+        "CSV Files (*.csv)\0*.[Cc][Ss][Vv]\0" \
+        "TSV Files (*.tsv)\0*.[Tt][Ss][Vv]\0" \
+        "All Files (*.*)\0*\0"
+
+/* Adds a variable name field, and optionally an "as list" check box, below
+ * the file chooser of the Import and Export Matrix dialogs. An empty name
+ * means the X register.
+ */
+static void add_matrix_options(GtkWidget *dialog, GtkWidget **name, GtkWidget **as_list) {
+    GtkWidget *box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+    GtkWidget *label = gtk_label_new("Variable (empty for X):");
+    gtk_box_pack_start(GTK_BOX(box), label, FALSE, FALSE, 0);
+    *name = gtk_entry_new();
+    gtk_entry_set_max_length(GTK_ENTRY(*name), 7);
+    gtk_entry_set_width_chars(GTK_ENTRY(*name), 8);
+    gtk_box_pack_start(GTK_BOX(box), *name, FALSE, FALSE, 0);
+    if (as_list != NULL) {
+        *as_list = gtk_check_button_new_with_label("Import as list");
+        gtk_box_pack_start(GTK_BOX(box), *as_list, FALSE, FALSE, 10);
+    }
+    gtk_widget_show_all(box);
+    gtk_file_chooser_set_extra_widget(GTK_FILE_CHOOSER(dialog), box);
+}
+
+/* The matrix or list in X, or in the named variable, is written to the
+ * chosen file. Tab-separated if the TSV filter is selected or the name ends
+ * in .tsv or .txt; otherwise comma-separated.
+ */
+static void exportMatrixCB() {
+    static GtkWidget *dialog = NULL;
+    static GtkWidget *name;
+
+    if (dialog == NULL) {
+        dialog = make_file_select_dialog("Export Matrix",
+                MATRIX_FILE_PATTERN, true, mainwindow);
+        add_matrix_options(dialog, &name, NULL);
+    }
+
+    char *filename = NULL;
+    gtk_window_set_role(GTK_WINDOW(dialog), "Free42 Dialog");
+    if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT)
+        filename = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(dialog));
+    gtk_widget_hide(GTK_WIDGET(dialog));
+    if (filename == NULL)
+        return;
+
+    char export_file_name[FILENAMELEN];
+    strncpy(export_file_name, filename, FILENAMELEN);
+    export_file_name[FILENAMELEN - 1] = 0;
+    g_free(filename);
+    const char *filter = gtk_file_filter_get_name(
+                    gtk_file_chooser_get_filter(GTK_FILE_CHOOSER(dialog)));
+    if (strncmp(filter, "CSV", 3) == 0)
+        appendSuffix(export_file_name, ".csv");
+    else if (strncmp(filter, "TSV", 3) == 0)
+        appendSuffix(export_file_name, ".tsv");
+
+    if (file_exists(export_file_name)) {
+        GtkWidget *msg = gtk_message_dialog_new(GTK_WINDOW(mainwindow),
+                                                GTK_DIALOG_MODAL,
+                                                GTK_MESSAGE_QUESTION,
+                                                GTK_BUTTONS_YES_NO,
+                                                "Replace existing \"%s\"?",
+                                                export_file_name);
+        gtk_window_set_title(GTK_WINDOW(msg), "Replace?");
+        gtk_window_set_role(GTK_WINDOW(msg), "Free42 Dialog");
+        bool cancelled = gtk_dialog_run(GTK_DIALOG(msg)) != GTK_RESPONSE_YES;
+        gtk_widget_destroy(msg);
+        if (cancelled)
+            return;
+    }
+
+    int len = strlen(export_file_name);
+    bool tabs = len >= 4 && (strcasecmp(export_file_name + len - 4, ".tsv") == 0
+                          || strcasecmp(export_file_name + len - 4, ".txt") == 0);
+    const char *varname = gtk_entry_get_text(GTK_ENTRY(name));
+    core_export_csv(varname[0] == 0 ? NULL : varname, export_file_name, tabs ? '\t' : ',');
+}
+
+/* The chosen file is imported as a matrix, or as a list if that option is
+ * checked, and stored in the named variable, or pushed onto the stack.
+ */
+static void importMatrixCB() {
+    static GtkWidget *dialog = NULL;
+    static GtkWidget *name, *as_list;
+
+    if (dialog == NULL) {
+        dialog = make_file_select_dialog("Import Matrix",
+                MATRIX_FILE_PATTERN, false, mainwindow);
+        add_matrix_options(dialog, &name, &as_list);
+    }
+
+    gtk_window_set_role(GTK_WINDOW(dialog), "Free42 Dialog");
+    bool cancelled = gtk_dialog_run(GTK_DIALOG(dialog)) != GTK_RESPONSE_ACCEPT;
+    gtk_widget_hide(dialog);
+    if (cancelled)
+        return;
+
+    char *filename = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(dialog));
+    if (filename == NULL)
+        return;
+
+    char filenamebuf[FILENAMELEN];
+    strncpy(filenamebuf, filename, FILENAMELEN);
+    filenamebuf[FILENAMELEN - 1] = 0;
+    g_free(filename);
+
+    const char *varname = gtk_entry_get_text(GTK_ENTRY(name));
+    core_import_csv(varname[0] == 0 ? NULL : varname, filenamebuf,
+            gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(as_list)));
+}
+
+static void sigmaFromCsvCB() {
+    static GtkWidget *dialog = NULL;
+
+    if (dialog == NULL)
+        dialog = make_file_select_dialog("\316\243+ from CSV File",
+                MATRIX_FILE_PATTERN, false, mainwindow);
+
+    gtk_window_set_role(GTK_WINDOW(dialog), "Free42 Dialog");
+    bool cancelled = gtk_dialog_run(GTK_DIALOG(dialog)) != GTK_RESPONSE_ACCEPT;
+    gtk_widget_hide(dialog);
+    if (cancelled)
+        return;
+
+    char *filename = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(dialog));
+    if (filename == NULL)
+        return;
+
+    char filenamebuf[FILENAMELEN];
+    strncpy(filenamebuf, filename, FILENAMELEN);
+    filenamebuf[FILENAMELEN - 1] = 0;
+    g_free(filename);
+
+    if (core_sigma_csv(filenamebuf))
+        enable_reminder();
+}
+
 static void paperAdvanceCB() {
     static const char *bits = "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0";
     shell_print("", 0, bits, 18, 0, 0, 143, 9);
@@ -2391,6 +2570,7 @@ static void preferencesCB() {
     static GtkWidget *autorepeat;
     static GtkWidget *allowbigstack;
     static GtkWidget *localizedcopypaste;
+    static GtkWidget *maplargematrices;
     static GtkWidget *repaintwholedisplay;
     static GtkWidget *printtotext;
     static GtkWidget *textpath;
@@ -2422,25 +2602,27 @@ static void preferencesCB() {
         gtk_grid_attach(GTK_GRID(grid), allowbigstack, 0, 3, 4, 1);
         localizedcopypaste = gtk_check_button_new_with_label("Localized Copy & Paste");
         gtk_grid_attach(GTK_GRID(grid), localizedcopypaste, 0, 4, 4, 1);
+        maplargematrices = gtk_check_button_new_with_label("Keep very large matrices in memory-mapped files");
+        gtk_grid_attach(GTK_GRID(grid), maplargematrices, 0, 5, 4, 1);
         repaintwholedisplay = gtk_check_button_new_with_label("Always repaint entire display");
-        gtk_grid_attach(GTK_GRID(grid), repaintwholedisplay, 0, 5, 4, 1);
+        gtk_grid_attach(GTK_GRID(grid), repaintwholedisplay, 0, 6, 4, 1);
         printtotext = gtk_check_button_new_with_label("Print to text file:");
-        gtk_grid_attach(GTK_GRID(grid), printtotext, 0, 6, 1, 1);
+        gtk_grid_attach(GTK_GRID(grid), printtotext, 0, 7, 1, 1);
         textpath = gtk_entry_new();
-        gtk_grid_attach(GTK_GRID(grid), textpath, 1, 6, 2, 1);
+        gtk_grid_attach(GTK_GRID(grid), textpath, 1, 7, 2, 1);
         GtkWidget *browse1 = gtk_button_new_with_label("Browse...");
-        gtk_grid_attach(GTK_GRID(grid), browse1, 3, 6, 1, 1);
+        gtk_grid_attach(GTK_GRID(grid), browse1, 3, 7, 1, 1);
         printtogif = gtk_check_button_new_with_label("Print to GIF file:");
-        gtk_grid_attach(GTK_GRID(grid), printtogif, 0, 7, 1, 1);
+        gtk_grid_attach(GTK_GRID(grid), printtogif, 0, 8, 1, 1);
         gifpath = gtk_entry_new();
-        gtk_grid_attach(GTK_GRID(grid), gifpath, 1, 7, 2, 1);
+        gtk_grid_attach(GTK_GRID(grid), gifpath, 1, 8, 2, 1);
         GtkWidget *browse2 = gtk_button_new_with_label("Browse...");
-        gtk_grid_attach(GTK_GRID(grid), browse2, 3, 7, 1, 1);
+        gtk_grid_attach(GTK_GRID(grid), browse2, 3, 8, 1, 1);
         GtkWidget *label = gtk_label_new("Maximum GIF height (pixels):");
-        gtk_grid_attach(GTK_GRID(grid), label, 1, 8, 1, 1);
+        gtk_grid_attach(GTK_GRID(grid), label, 1, 9, 1, 1);
         gifheight = gtk_entry_new();
         gtk_entry_set_max_length(GTK_ENTRY(gifheight), 5);
-        gtk_grid_attach(GTK_GRID(grid), gifheight, 2, 8, 1, 1);
+        gtk_grid_attach(GTK_GRID(grid), gifheight, 2, 9, 1, 1);
 
         g_signal_connect(G_OBJECT(browse1), "clicked", G_CALLBACK(browse_file),
                 (gpointer) new browse_file_info("Select Text File Name",
@@ -2459,6 +2641,7 @@ static void preferencesCB() {
     gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(autorepeat), core_settings.auto_repeat);
     gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(allowbigstack), core_settings.allow_big_stack);
     gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(localizedcopypaste), core_settings.localized_copy_paste);
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(maplargematrices), core_settings.map_large_matrices);
     gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(printtotext), state.printerToTxtFile);
     gtk_entry_set_text(GTK_ENTRY(textpath), state.printerTxtFileName);
     gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(printtogif), state.printerToGifFile);
@@ -2478,6 +2661,7 @@ static void preferencesCB() {
         if (oldBigStack != core_settings.allow_big_stack)
             core_update_allow_big_stack();
         core_settings.localized_copy_paste = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(localizedcopypaste));
+        core_settings.map_large_matrices = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(maplargematrices));
 
         state.printerToTxtFile = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(printtotext));
         char *old = strclone(state.printerTxtFileName);
@@ -26,7 +26,7 @@ extern GtkWidget *calc_widget;
 extern GtkWidget *mainwindow;
 extern bool allow_paint;
 
-#define SHELL_VERSION 11
+#define SHELL_VERSION 13
 
 struct state_type {
     int extras;
@@ -48,6 +48,8 @@ struct state_type {
     bool allow_big_stack;
     bool localized_copy_paste;
     int mainWindowWidth, mainWindowHeight;
+    int matrix_block_size; // No longer used; the core saves it now
+    bool map_large_matrices;
 };
 
 extern state_type state;